@@ -135,12 +135,12 @@ public:
     /*
      * Get and clear the error register by reading it
      */
-    String getErrors();
+    const char* getErrors();
 
     /**
      * Get diagnostic
      */
-    String getDiagnostic();
+    const char* getDiagnostic();
 
     /*
      * Set the zero position
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Picks the acceleration of an axis from the load margin measured over each move.
+ *
+ * During a move the StallGuard reading (SG_RESULT, lower is closer to a stall) is sampled.
+ * SG_RESULT also depends on the speed and on the motor current, so the readings while cruising
+ * form a slowly learnt no-load baseline per band of SPEED_BINS up to fullSpeed, tagged with the
+ * current scale (CS_ACTUAL) it was read at. A reading while accelerating is only compared with
+ * the baseline of its own speed band at the same current scale, the lowest ratio is the load
+ * margin of the move. A heavy part pulls the margin down, a light one leaves it high. Readings
+ * without a matching baseline are left out, CoolStep and a current boost while accelerating
+ * would leave every one of them out.
+ *
+ * An axis with an encoder can instead hand in its margin directly with sampleMargin().
+ *
+ * After each move the acceleration is
+ * - lowered by `decrease` at once when the margin is under targetMargin - deadBand, or when the
+ *   move was flagged unsafe (e.g. the AS5048A saw the axis fall behind the step count)
+ * - raised by `increase` once movesToIncrease moves in a row had a margin over
+ *   targetMargin + deadBand
+ * - held otherwise
+ *
+ * and always kept within [minAcceleration, maxAcceleration]. Backing off is immediate and
+ * speeding up is slow, so one noisy move can't push the axis into a stall.
+ */
+class AdaptiveAcceleration
+{
+public:
+    struct Config
+    {
+        float minAcceleration   = 1000.0f;   ///< steps / second², the worst case part
+        float maxAcceleration   = 10000.0f;  ///< steps / second², never exceeded
+        float targetMargin      = 0.4f;      ///< Load margin aimed for, 0 stalled to 1 no load
+        float deadBand          = 0.1f;      ///< Margin either side of the target that holds
+        float increase          = 1.2f;      ///< Acceleration multiplier when there is margin
+        float decrease          = 0.7f;      ///< Acceleration multiplier when there is not
+        uint8_t movesToIncrease = 3;         ///< Moves in a row with margin before speeding up
+        uint8_t minSamples      = 3;         ///< Compared samples needed to judge a move
+        float fullSpeed         = 10000.0f;  ///< steps / second, top of the baseline speed bands
+
+        constexpr Config() {}
+        constexpr Config(
+            float minAcceleration_,
+            float maxAcceleration_,
+            float targetMargin_,
+            float deadBand_,
+            float increase_,
+            float decrease_,
+            uint8_t movesToIncrease_,
+            uint8_t minSamples_,
+            float fullSpeed_)
+            : minAcceleration(minAcceleration_),
+              maxAcceleration(maxAcceleration_),
+              targetMargin(targetMargin_),
+              deadBand(deadBand_),
+              increase(increase_),
+              decrease(decrease_),
+              movesToIncrease(movesToIncrease_),
+              minSamples(minSamples_),
+              fullSpeed(fullSpeed_)
+        {
+        }
+    };
+
+    static constexpr uint8_t SPEED_BINS = 4;
+
+    enum Decision : uint8_t
+    {
+        NO_DATA = 0,  ///< Too few samples, nothing changed
+        HELD,
+        INCREASED,
+        DECREASED,
+    };
+
+    explicit AdaptiveAcceleration(const Config& cfg = Config()) : cfg_(cfg)
+    {
+        reset(cfg.minAcceleration);
+    }
+
+    /** @brief Starts over from `acceleration` with no baseline, e.g. after a new part */
+    void reset(float acceleration)
+    {
+        acceleration_ = clamp(acceleration);
+        for (auto& baseline : baselines_)
+        {
+            baseline = Baseline();
+        }
+        margin_    = 1.0f;
+        goodMoves_ = 0;
+        beginMove();
+    }
+
+    /** @brief Clears the statistics of the move about to start */
+    void beginMove()
+    {
+        minMargin_ = 1.0f;
+        samples_   = 0;
+        unsafe_    = false;
+    }
+
+    /**
+     * @brief Adds one StallGuard reading taken during the move. Readings while slowing down are
+     * left out, braking loads the motor too and would drag the baseline down.
+     *
+     * @param stallGuard SG_RESULT, only meaningful while the driver is in SpreadCycle
+     * @param speed steps / second when the reading was taken
+     * @param currentScale CS_ACTUAL the reading was taken at
+     * @param accelerating the axis was speeding up when the reading was taken, cruising otherwise
+     */
+    void sample(float stallGuard, float speed, uint8_t currentScale, bool accelerating)
+    {
+        Baseline& baseline = baselines_[bin(speed)];
+        if (!accelerating)
+        {
+            // Cruising is as close to no load as a move gets, a new current scale starts over
+            if (baseline.stallGuard <= 0.0f || baseline.currentScale != currentScale)
+            {
+                baseline.stallGuard   = stallGuard;
+                baseline.currentScale = currentScale;
+                return;
+            }
+            baseline.stallGuard += BASELINE_ALPHA * (stallGuard - baseline.stallGuard);
+            return;
+        }
+        if (baseline.stallGuard > 0.0f && baseline.currentScale == currentScale)
+        {
+            sampleMargin(stallGuard / baseline.stallGuard);
+        }
+    }
+
+    /** @brief Adds a load margin measured some other way, 0 stalled to 1 no load */
+    void sampleMargin(float margin)
+    {
+        minMargin_ = margin < minMargin_ ? margin : minMargin_;
+        samples_++;
+    }
+
+    /** @brief Marks the move as unsafe whatever StallGuard says, the next one is slower */
+    void flagUnsafe() { unsafe_ = true; }
+
+    /**
+     * @brief Judges the finished move and updates acceleration().
+     */
+    Decision endMove()
+    {
+        Decision decision = NO_DATA;
+        if (unsafe_)
+        {
+            margin_  = 0.0f;
+            decision = DECREASED;
+        }
+        else if (samples_ >= cfg_.minSamples)
+        {
+            margin_  = minMargin_;
+            decision = HELD;
+            if (margin_ < cfg_.targetMargin - cfg_.deadBand)
+            {
+                decision = DECREASED;
+            }
+            else if (margin_ > cfg_.targetMargin + cfg_.deadBand &&
+                     ++goodMoves_ >= cfg_.movesToIncrease)
+            {
+                decision = INCREASED;
+            }
+        }
+
+        if (decision == DECREASED || decision == INCREASED)
+        {
+            const float next =
+                clamp(acceleration_ * (decision == DECREASED ? cfg_.decrease : cfg_.increase));
+            // Already at the limit
+            decision      = next == acceleration_ ? HELD : decision;
+            acceleration_ = next;
+            goodMoves_    = 0;
+        }
+        else if (decision == HELD && margin_ <= cfg_.targetMargin + cfg_.deadBand)
+        {
+            goodMoves_ = 0;
+        }
+        beginMove();
+        return decision;
+    }
+
+    float acceleration() const { return acceleration_; }
+
+    /** @brief Load margin of the last judged move, 0 stalled to 1 no load */
+    float margin() const { return margin_; }
+
+    const Config& config() const { return cfg_; }
+
+private:
+    static constexpr float BASELINE_ALPHA = 0.05f;
+
+    struct Baseline
+    {
+        float stallGuard     = 0.0f;  ///< 0 until a cruising reading was seen in the band
+        uint8_t currentScale = 0;
+    };
+
+    float clamp(float acceleration) const
+    {
+        return acceleration < cfg_.minAcceleration
+                   ? cfg_.minAcceleration
+                   : (acceleration > cfg_.maxAcceleration ? cfg_.maxAcceleration : acceleration);
+    }
+
+    uint8_t bin(float speed) const
+    {
+        const float band = (speed < 0.0f ? -speed : speed) * SPEED_BINS / cfg_.fullSpeed;
+        return band < SPEED_BINS - 1 ? static_cast<uint8_t>(band) : SPEED_BINS - 1;
+    }
+
+    Config cfg_;
+    float acceleration_;
+    Baseline baselines_[SPEED_BINS];
+    float margin_;
+    float minMargin_;
+    uint16_t samples_;
+    uint8_t goodMoves_;
+    bool unsafe_;
+};
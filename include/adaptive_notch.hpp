@@ -0,0 +1,191 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "butterworth.hpp"
+#include "discrete_filter.hpp"
+#include "hot_path.hpp"
+
+/**
+ * @brief Tracks the dominant resonance of a signal online and notches it out.
+ *
+ * Two second order notches share the constrained pole-zero form
+ *
+ * \f$ H(z) = \frac{1 + a z^{-1} + z^{-2}}{1 + \rho a z^{-1} + \rho^2 z^{-2}}, \quad
+ * a = -2\cos(\omega_0 T_s) \f$
+ *
+ * The estimator notch adapts `a` with a normalised gradient step that minimises its own output
+ * power, which drives its zeros onto the strongest sinusoid in the search band. The applied notch
+ * is a DiscreteFilter<3> that is moved towards the estimate a little every sample, so its
+ * coefficients never jump, and is cross faded in only once the estimator has locked (it removes
+ * lockRatio times more power than it lets through). With no resonance present the signal passes
+ * untouched. The estimator only sees the signal high passed at fMin / 2, otherwise the motion
+ * profile itself would pull it to the bottom of the band.
+ *
+ * The resonance of the jaw shifts with the inertia of the clamped part, which is why a fixed
+ * filter::butterworth BANDSTOP is not enough here.
+ */
+class AdaptiveNotch
+{
+public:
+    struct Config
+    {
+        float fMin        = 5.0f;    ///< Lowest frequency searched, Hz
+        float fMax        = 200.0f;  ///< Highest frequency searched, Hz, below 0.5 / Ts
+        float Ts          = 1e-3f;   ///< Sample time, s
+        float poleRadius  = 0.95f;   ///< Estimator rho, closer to 1 is narrower and slower
+        float notchRadius = 0.9f;    ///< Applied notch rho, sets the width of the notch
+        float stepSize    = 0.005f;  ///< Normalised gradient step of the estimator
+        float smoothing   = 0.01f;   ///< Fraction of the distance to the estimate moved per sample
+        float lockRatio   = 4.0f;    ///< Input / residual power ratio needed to engage the notch
+
+        constexpr Config() {}
+        constexpr Config(
+            float fMin_,
+            float fMax_,
+            float Ts_,
+            float poleRadius_,
+            float notchRadius_,
+            float stepSize_,
+            float smoothing_,
+            float lockRatio_)
+            : fMin(fMin_),
+              fMax(fMax_),
+              Ts(Ts_),
+              poleRadius(poleRadius_),
+              notchRadius(notchRadius_),
+              stepSize(stepSize_),
+              smoothing(smoothing_),
+              lockRatio(lockRatio_)
+        {
+        }
+    };
+
+    explicit AdaptiveNotch(const Config& cfg = Config())
+        : cfg_(cfg),
+          highpass_(filter::butterworth<1, filter::HIGHPASS>(0.5f * TAU * cfg.fMin, cfg.Ts)),
+          notch_(
+              std::array<float, 3>{{1.0f, 0.0f, 0.0f}},
+              std::array<float, 3>{{1.0f, 0.0f, 0.0f}})
+    {
+        aMin_ = -2.0f * std::cos(TAU * cfg_.fMin * cfg_.Ts);
+        aMax_ = -2.0f * std::cos(TAU * cfg_.fMax * cfg_.Ts);
+        // 10 % / 5 % in from the ends of the band
+        aLockMin_ = -2.0f * std::cos(TAU * 1.1f * cfg_.fMin * cfg_.Ts);
+        aLockMax_ = -2.0f * std::cos(TAU * 0.95f * cfg_.fMax * cfg_.Ts);
+        reset();
+    }
+
+    /**
+     * @brief Runs one sample through the estimator and the applied notch.
+     *
+     * @param x input sample
+     * @return the input with the tracked resonance removed (unchanged while not locked)
+     */
+    HOT_PATH float filterData(float x)
+    {
+        // Estimator, all-pole part then the zeros
+        const float xh  = highpass_.filterData(x);
+        const float rho = cfg_.poleRadius;
+        const float s   = xh - rho * a_ * s1_ - rho * rho * s2_;
+        const float e   = s + a_ * s1_ + s2_;
+
+        gradientPower_ += POWER_ALPHA * (s1_ * s1_ - gradientPower_);
+        a_ -= cfg_.stepSize * e * s1_ / (gradientPower_ + 1e-9f);
+        a_ = a_ < aMin_ ? aMin_ : (a_ > aMax_ ? aMax_ : a_);
+
+        s2_ = s1_;
+        s1_ = s;
+
+        inputPower_ += POWER_ALPHA * (xh * xh - inputPower_);
+        residualPower_ += POWER_ALPHA * (e * e - residualPower_);
+
+        // Applied notch follows the estimate and fades in and out with the lock
+        aApplied_ += cfg_.smoothing * (a_ - aApplied_);
+        setNotch(aApplied_);
+        const float target = locked() ? 1.0f : 0.0f;
+        depth_ += cfg_.smoothing * (target - depth_);
+
+        const float notched = notch_.filterData(x);
+        return x + depth_ * (notched - x);
+    }
+
+    /** @brief Frequency the estimator currently sits on, Hz */
+    float trackedFrequency() const { return frequencyOf(a_); }
+
+    /** @brief Frequency of the notch applied to the signal, Hz */
+    float notchFrequency() const { return frequencyOf(aApplied_); }
+
+    /**
+     * @brief True when a resonance stands out enough for the notch to be engaged. An estimate
+     * pinned to either end of the band is something outside of it (a decaying transient), not a
+     * resonance.
+     */
+    bool locked() const
+    {
+        return inputPower_ > cfg_.lockRatio * residualPower_ && inputPower_ > 0 &&
+               a_ > aLockMin_ && a_ < aLockMax_;
+    }
+
+    /** @brief How much of the notch is blended in, 0 bypassed to 1 fully engaged */
+    float depth() const { return depth_; }
+
+    /** @brief Power removed by the estimator, dB */
+    float attenuation() const
+    {
+        return residualPower_ > 0 ? 10.0f * std::log10(inputPower_ / residualPower_) : 0.0f;
+    }
+
+    const Config& config() const { return cfg_; }
+
+    /** @brief Clears the signal state and restarts the search from the middle of the band */
+    void reset()
+    {
+        a_             = -2.0f * std::cos(TAU * std::sqrt(cfg_.fMin * cfg_.fMax) * cfg_.Ts);
+        aApplied_      = a_;
+        s1_            = 0.0f;
+        s2_            = 0.0f;
+        gradientPower_ = 0.0f;
+        inputPower_    = 0.0f;
+        residualPower_ = 0.0f;
+        depth_         = 0.0f;
+        setNotch(aApplied_);
+        notch_.reset();
+        highpass_.reset();
+    }
+
+private:
+    static constexpr float TAU         = 6.28318530718f;
+    static constexpr float POWER_ALPHA = 0.005f;  // ~200 sample power averages
+
+    float frequencyOf(float a) const { return std::acos(-0.5f * a) / (TAU * cfg_.Ts); }
+
+    /** @brief Sets the applied notch to a = -2 cos(w0 Ts) with unity gain at DC */
+    void setNotch(float a)
+    {
+        const float rho  = cfg_.notchRadius;
+        const float gain = (1.0f + rho * a + rho * rho) / (2.0f + a);
+        notch_.setCoefficients(
+            std::array<float, 3>{{1.0f, rho * a, rho * rho}},
+            std::array<float, 3>{{gain, gain * a, gain}});
+    }
+
+    Config cfg_;
+    DiscreteFilter<2> highpass_;
+    DiscreteFilter<3> notch_;
+
+    float aMin_;
+    float aMax_;
+    float aLockMin_;
+    float aLockMax_;
+    float a_;
+    float aApplied_;
+    float s1_;
+    float s2_;
+    float gradientPower_;
+    float inputPower_;
+    float residualPower_;
+    float depth_;
+};
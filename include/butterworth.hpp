@@ -5,7 +5,6 @@
 
 #include <array>
 #include <cmath>
-#include <complex>
 #include <cstdint>
 
 #include "discrete_filter.hpp"
@@ -78,6 +77,58 @@
  */
 namespace filter {
 
+/**
+ * Precision of the design math. The ESP32-S3 FPU is single precision only, designing in float keeps
+ * the soft-float double routines and the double libm trig out of the image. Define
+ * FILTER_DESIGN_DOUBLE for high order or very narrow filters that need the extra precision.
+ */
+#ifdef FILTER_DESIGN_DOUBLE
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
+/**
+ * Minimal complex number with only what the design math needs, used instead of std::complex so
+ * <complex> and its iostream/locale baggage stay out of the firmware.
+ */
+struct Complex
+{
+    real_t re;
+    real_t im;
+
+    constexpr Complex(real_t re_ = 0, real_t im_ = 0) : re(re_), im(im_) {}
+
+    constexpr real_t real() const { return re; }
+    constexpr real_t imag() const { return im; }
+
+    Complex &operator+=(const Complex &o)
+    {
+        re += o.re;
+        im += o.im;
+        return *this;
+    }
+    Complex &operator-=(const Complex &o)
+    {
+        re -= o.re;
+        im -= o.im;
+        return *this;
+    }
+};
+
+inline Complex operator+(const Complex &a, const Complex &b) { return {a.re + b.re, a.im + b.im}; }
+inline Complex operator-(const Complex &a, const Complex &b) { return {a.re - b.re, a.im - b.im}; }
+inline Complex operator-(const Complex &a) { return {-a.re, -a.im}; }
+inline Complex operator*(const Complex &a, const Complex &b)
+{
+    return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+}
+inline Complex operator/(const Complex &a, const Complex &b)
+{
+    const real_t d = b.re * b.re + b.im * b.im;
+    return {(a.re * b.re + a.im * b.im) / d, (a.im * b.re - a.re * b.im) / d};
+}
+
 enum FilterType : uint8_t
 {
     LOWPASS  = 0b00,
@@ -94,10 +145,9 @@ enum FilterType : uint8_t
  * @param [in] Ts the sample time
  * @return a complex number corresponding to the Z domain location
  */
-std::complex<double> inline s2z(std::complex<double> s, double Ts)
+Complex inline s2z(Complex s, real_t Ts)
 {
-    return (static_cast<std::complex<double>>(1.0) + (Ts / 2) * s) /
-           (static_cast<std::complex<double>>(1.0) - (Ts / 2) * s);
+    return (Complex(1.0) + (Ts / 2) * s) / (Complex(1.0) - (Ts / 2) * s);
 }
 
 /**
@@ -109,19 +159,18 @@ std::complex<double> inline s2z(std::complex<double> s, double Ts)
  *
  * @return a vector of coefficients for the polynomial with the 0th index being the
  * constant term and the last index being the leading coefficient
- * @note the coefficients are returned as doubles, the imaginary part of the
+ * @note the coefficients are returned as real_t, the imaginary part of the
  * complex number is ignored
  */
 template <uint8_t ORDER>
-std::array<double, ORDER + 1> expandPolynomial(std::array<std::complex<double>, ORDER> zeros)
+std::array<real_t, ORDER + 1> expandPolynomial(std::array<Complex, ORDER> zeros)
 {
-    std::array<std::complex<double>, ORDER + 1> coefficients{
-        std::complex<double>(1.0, 0.0)};  // Start with 1
+    std::array<Complex, ORDER + 1> coefficients{Complex(1.0, 0.0)};  // Start with 1
 
     for (size_t i = 0; i < ORDER; i++)
     {
         // Multiply current polynomial by (x - zero)
-        std::array<std::complex<double>, ORDER + 1> newCoefficients{std::complex<double>(0.0, 0.0)};
+        std::array<Complex, ORDER + 1> newCoefficients{Complex(0.0, 0.0)};
         for (size_t j = 0; j < i + 1; j++)
         {
             newCoefficients[j] -=
@@ -130,9 +179,9 @@ std::array<double, ORDER + 1> expandPolynomial(std::array<std::complex<double>,
         }
         coefficients.swap(newCoefficients);
     }
-    std::array<double, ORDER + 1> stripped_coefficients{};
+    std::array<real_t, ORDER + 1> stripped_coefficients{};
     // Extract the real part of each coefficient, the imaginary appears to be an
-    // artifact of double
+    // artifact of floating point
     for (size_t i = 0; i < ORDER + 1; i++)
     {
         stripped_coefficients[i] = coefficients[i].real();
@@ -152,30 +201,30 @@ std::array<double, ORDER + 1> expandPolynomial(std::array<std::complex<double>,
  */
 
 template <uint8_t ORDER>
-std::complex<double> evaluateFrequencyResponse(
-    const std::array<double, ORDER + 1> &b,
-    const std::array<double, ORDER + 1> &a,
-    double w,
-    double Ts)
+Complex evaluateFrequencyResponse(
+    const std::array<real_t, ORDER + 1> &b,
+    const std::array<real_t, ORDER + 1> &a,
+    real_t w,
+    real_t Ts)
 {
-    std::complex<double> j(0, 1);  // imaginary unit i = sqrt(-1)
-    std::complex<double> numerator(0, 0);
-    std::complex<double> denominator(0, 0);
+    Complex j(0, 1);  // imaginary unit i = sqrt(-1)
+    Complex numerator(0, 0);
+    Complex denominator(0, 0);
 
-    double omega = w * Ts;  // omega is in terms of rad/sample
+    real_t omega = w * Ts;  // omega is in terms of rad/sample
 
     // Evaluate numerator: b0 + b1 * e^{-jω} + b2 * e^{-j2ω} + ...
     for (size_t k = 0; k < b.size(); ++k)
     {
-        numerator += b[k] * (std::cos(omega * static_cast<double>(k)) -
-                             j * std::sin(omega * static_cast<double>(k)));
+        numerator += b[k] * (std::cos(omega * static_cast<real_t>(k)) -
+                             j * std::sin(omega * static_cast<real_t>(k)));
     }
 
     // Evaluate denominator: a0 + a1 * e^{-jω} + a2 * e^{-j2ω} + ...
     for (size_t k = 0; k < a.size(); ++k)
     {
-        denominator += a[k] * (std::cos(omega * static_cast<double>(k)) -
-                               j * std::sin(omega * static_cast<double>(k)));
+        denominator += a[k] * (std::cos(omega * static_cast<real_t>(k)) -
+                               j * std::sin(omega * static_cast<real_t>(k)));
     }
 
     return numerator / denominator;
@@ -185,7 +234,7 @@ std::complex<double> evaluateFrequencyResponse(
  * @param [in] z the complex number to calculate the magnitude of
  * @return the magnitude of the complex number
  */
-double inline complexAbs(std::complex<double> z)
+real_t inline complexAbs(Complex z)
 {
     return std::sqrt(z.real() * z.real() + z.imag() * z.imag());
 }
@@ -196,10 +245,10 @@ double inline complexAbs(std::complex<double> z)
  * @return the square root of the complex number
  */
 
-std::complex<double> inline complexSqrt(std::complex<double> z)
+Complex inline complexSqrt(Complex z)
 {
-    double r     = std::sqrt(complexAbs(z));
-    double theta = static_cast<double>(std::atan2(z.imag(), z.real())) * static_cast<double>(0.5f);
+    real_t r     = std::sqrt(complexAbs(z));
+    real_t theta = static_cast<real_t>(std::atan2(z.imag(), z.real())) * static_cast<real_t>(0.5f);
     return {r * std::cos(theta), r * std::sin(theta)};
 }
 
@@ -217,7 +266,7 @@ constexpr uint16_t getNumCoefficients(uint8_t ORDER, FilterType type)
  * @param[in] wh   upper edge ωh (only used for band filters).
  */
 template <uint8_t ORDER, FilterType Type = LOWPASS, typename T = float>
-Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double Ts, double wh = 0.0)
+Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(real_t wc, real_t Ts, real_t wh = 0)
 {
     const uint16_t COEFFICIENTS = getNumCoefficients(ORDER, Type);
 
@@ -227,23 +276,24 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
     const int n = ORDER;
 
     // For band filters we treat wc as ωl
-    double wl  = wc;
-    double whp = wh;
-    std::array<std::complex<double>, 2 * ORDER> bandpass_stop_poles;
+    real_t wl  = wc;
+    real_t whp = wh;
+    std::array<Complex, 2 * ORDER> bandpass_stop_poles;
 
     // pre-warp all edges for bilinear transform
-    wl  = static_cast<double>(2.0) / Ts * std::tan(wl * (Ts / static_cast<double>(2.0)));
-    whp = static_cast<double>(2.0) / Ts * std::tan(whp * (Ts / static_cast<double>(2.0)));
+    wl  = static_cast<real_t>(2.0) / Ts * std::tan(wl * (Ts / static_cast<real_t>(2.0)));
+    whp = static_cast<real_t>(2.0) / Ts * std::tan(whp * (Ts / static_cast<real_t>(2.0)));
 
     // generate N prototype poles on unit circle
-    std::array<std::complex<double>, COEFFICIENTS - 1> poles;
+    std::array<Complex, COEFFICIENTS - 1> poles;
     for (int k = 0; k < n; ++k)
     {
-        double theta = M_PI * (2.0 * k + 1) / (2.0 * n) + M_PI / 2.0;
-        poles[k]     = std::complex<double>(std::cos(theta), std::sin(theta));
+        const real_t pi = static_cast<real_t>(M_PI);
+        real_t theta    = pi * (2 * k + 1) / (2 * n) + pi / 2;
+        poles[k]     = Complex(std::cos(theta), std::sin(theta));
     }
 
-    std::array<std::complex<double>, COEFFICIENTS - 1> zPoles;
+    std::array<Complex, COEFFICIENTS - 1> zPoles;
 
     // apply the appropriate s-domaisn transform to each pole
     switch (Type)
@@ -277,21 +327,21 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
              *      Ω₀ = √(Ω_low * Ω_high)      // Center frequency (rad/sec)
              *      B  = Ω_high - Ω_low         // Bandwidth (rad/sec)
              */
-            double B    = whp - wl;
-            double W0sq = whp * wl;
+            real_t B    = whp - wl;
+            real_t W0sq = whp * wl;
 
             for (int j = 0; j < ORDER; ++j)
             {
-                std::complex<double> p = poles[j];
+                Complex p = poles[j];
 
-                std::complex<double> discriminant =
-                    (p * B) * (p * B) - static_cast<std::complex<double>>(4.0) * W0sq;
-                std::complex<double> root = complexSqrt(discriminant);
+                Complex discriminant =
+                    (p * B) * (p * B) - Complex(4.0) * W0sq;
+                Complex root = complexSqrt(discriminant);
 
                 bandpass_stop_poles[2 * j] =
-                    (p * B + root) * static_cast<std::complex<double>>(0.5);
+                    (p * B + root) * Complex(0.5);
                 bandpass_stop_poles[2 * j + 1] =
-                    (p * B - root) * static_cast<std::complex<double>>(0.5);
+                    (p * B - root) * Complex(0.5);
             }
 
             // now map each analog pole into the z-plane
@@ -308,20 +358,20 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
              *      Ω₀ = √(Ω_low * Ω_high)      // Center frequency (rad/sec)
              *      B  = Ω_high - Ω_low         // Bandwidth (rad/sec)
              */
-            double B    = whp - wl;
-            double W0sq = whp * wl;
+            real_t B    = whp - wl;
+            real_t W0sq = whp * wl;
             for (int j = 0; j < n; ++j)
             {
-                std::complex<double> p = poles[j];
+                Complex p = poles[j];
 
-                std::complex<double> discriminant =
-                    B * B - (static_cast<std::complex<double>>(4.0) * -p * W0sq);
-                std::complex<double> root = complexSqrt(discriminant);
+                Complex discriminant =
+                    B * B - (Complex(4.0) * -p * W0sq);
+                Complex root = complexSqrt(discriminant);
 
                 bandpass_stop_poles[2 * j] =
-                    (B + root) / (static_cast<std::complex<double>>(2.0) * p);
+                    (B + root) / (Complex(2.0) * p);
                 bandpass_stop_poles[2 * j + 1] =
-                    (B - root) / (static_cast<std::complex<double>>(2.0) * p);
+                    (B - root) / (Complex(2.0) * p);
             }
 
             // now map each analog pole into the z-plane
@@ -331,23 +381,23 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
         }
     }
 
-    std::array<std::complex<double>, COEFFICIENTS - 1> zZeros;
+    std::array<Complex, COEFFICIENTS - 1> zZeros;
 
     switch (Type)
     {
         case LOWPASS:
             // zeros: for Butterworth lowpass all z-zeros at z = –1
-            zZeros.fill(std::complex<double>(-1, 0));
+            zZeros.fill(Complex(-1, 0));
             break;
         case HIGHPASS:
             // zeros: for butterworth highpass all z-zeros are at z = 1
-            zZeros.fill(std::complex<double>(1, 0));
+            zZeros.fill(Complex(1, 0));
             break;
         case BANDPASS:
             // zeros: for butterworth bandpass all z-zeros are at z = ±1
             for (int i = 0; i < COEFFICIENTS - 1; ++i)
             {
-                zZeros[i] = (i % 2 == 0) ? std::complex<double>(1, 0) : std::complex<double>(-1, 0);
+                zZeros[i] = (i % 2 == 0) ? Complex(1, 0) : Complex(-1, 0);
             }
             break;
         case BANDSTOP:
@@ -358,13 +408,13 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
              */
 
             /* the notch (center) frequency in radians/sample */
-            double omega0 = std::sqrt(wl * whp) * Ts;
+            real_t omega0 = std::sqrt(wl * whp) * Ts;
 
-            double realPart = std::cos(omega0);
-            double imagPart = std::sin(omega0);
+            real_t realPart = std::cos(omega0);
+            real_t imagPart = std::sin(omega0);
 
-            std::complex<double> zeroPlus(realPart, imagPart);    // e^(+jω0)
-            std::complex<double> zeroMinus(realPart, -imagPart);  // e^(-jω0)
+            Complex zeroPlus(realPart, imagPart);    // e^(+jω0)
+            Complex zeroMinus(realPart, -imagPart);  // e^(-jω0)
 
             for (int i = 0; i < COEFFICIENTS - 1; i += 2)
             {
@@ -387,7 +437,7 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
             // Eval at DC
             auto freqResp = evaluateFrequencyResponse<COEFFICIENTS - 1>(b, a, 0, Ts);
             auto mag      = complexAbs(freqResp);
-            double scale  = 1 / mag;
+            real_t scale  = 1 / mag;
             for (auto &coef : b) coef *= scale;
             break;
         }
@@ -397,10 +447,10 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
             auto freqResp = evaluateFrequencyResponse<COEFFICIENTS - 1>(
                 b,
                 a,
-                static_cast<double>(M_PI) / Ts,
+                static_cast<real_t>(M_PI) / Ts,
                 Ts);
             auto mag     = complexAbs(freqResp);
-            double scale = 1 / mag;
+            real_t scale = 1 / mag;
             for (auto &coef : b) coef *= scale;
             break;
         }
@@ -410,7 +460,7 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
             auto freqResp =
                 evaluateFrequencyResponse<COEFFICIENTS - 1>(b, a, std::sqrt(wl * whp), Ts);
             auto mag     = complexAbs(freqResp);
-            double scale = 1 / mag;
+            real_t scale = 1 / mag;
             for (auto &coef : b) coef *= scale;
             break;
         }
@@ -419,7 +469,7 @@ Coefficients<getNumCoefficients(ORDER, Type), T> butterworth(double wc, double T
             // Eval at dc gain
             auto freqResp = evaluateFrequencyResponse<COEFFICIENTS - 1>(b, a, 0, Ts);
             auto mag      = complexAbs(freqResp);
-            double scale  = 1 / mag;
+            real_t scale  = 1 / mag;
             for (auto &coef : b) coef *= scale;
             break;
         }
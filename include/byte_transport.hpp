@@ -0,0 +1,133 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "frame_pool.hpp"
+
+#ifdef TRANSPORT_TCP
+#include <WiFi.h>
+#endif
+
+/**
+ * @brief The link SerialReceiverTransmitter talks over, a byte stream both ways.
+ *
+ * The framing, the batch queue and the receive pool stay in SerialReceiverTransmitter, a backend
+ * only moves bytes. Nothing blocks: reads take what has arrived, writes what fits.
+ */
+class ByteTransport
+{
+public:
+    virtual ~ByteTransport() {}
+
+    /**
+     * @param baudrate ignored by links without one
+     * @param rxBufferSize bytes the link must hold before they are read, a whole frame
+     * @return EXIT_SUCCESS or EXIT_FAILURE
+     */
+    virtual int begin(uint32_t baudrate, size_t rxBufferSize) = 0;
+    /** @brief Once per parse(), true when a new peer connected and a partial frame is void */
+    virtual bool poll() { return false; }
+    /**
+     * @brief Once per parse(), moves what has arrived into `assembler`, bodies straight into the
+     * pool. A backend that receives from a driver task of its own feeds it from there instead.
+     */
+    virtual void receive(frames::Assembler& assembler, int64_t now)
+    {
+        frames::drain(*this, assembler, now);
+    }
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    /** @brief Reads up to `size` bytes that have arrived, returns how many */
+    virtual size_t read(uint8_t* buffer, size_t size) = 0;
+    virtual int availableForWrite() = 0;
+    /** @brief Writes up to `size` bytes, what doesn't fit is dropped, returns how many */
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+};
+
+/** @brief The Nano ESP32's USB CDC port, `Serial` */
+class UsbCdcTransport : public ByteTransport
+{
+public:
+    int begin(uint32_t baudrate, size_t rxBufferSize) override;
+    int available() override { return Serial.available(); }
+    int read() override { return Serial.read(); }
+    size_t read(uint8_t* buffer, size_t size) override;
+    int availableForWrite() override { return Serial.availableForWrite(); }
+    size_t write(const uint8_t* data, size_t size) override { return Serial.write(data, size); }
+};
+
+#ifdef TRANSPORT_UART
+/**
+ * @brief A hardware UART, for the RS-485 link to the cell PLC.
+ *
+ * The IDF UART driver moves the bytes between the FIFOs and its ring buffers from its interrupt,
+ * the CPU never waits on the line. With a driver enable pin the UART runs in RS-485 half duplex
+ * mode, it raises DE for every transmission and drops it after the last stop bit in hardware.
+ *
+ * Frames are received off loop(): the core's UART event task wakes when the line has been idle
+ * for RX_TIMEOUT_SYMBOLS characters, the end of a frame, and moves everything the driver holds
+ * into the assembler. parse() only takes whole frames out of the pool.
+ */
+class UartTransport : public ByteTransport
+{
+public:
+    /** @param dePin RS-485 driver enable, -1 for a point to point link */
+    UartTransport(HardwareSerial& uart, int8_t rxPin, int8_t txPin, int8_t dePin = -1)
+        : uart_(uart), rxPin_(rxPin), txPin_(txPin), dePin_(dePin)
+    {
+    }
+
+    int begin(uint32_t baudrate, size_t rxBufferSize) override;
+    void receive(frames::Assembler& assembler, int64_t now) override;
+    int available() override { return uart_.available(); }
+    int read() override { return uart_.read(); }
+    size_t read(uint8_t* buffer, size_t size) override;
+    int availableForWrite() override { return uart_.availableForWrite(); }
+    size_t write(const uint8_t* data, size_t size) override;
+
+private:
+    static constexpr uint8_t RX_TIMEOUT_SYMBOLS = 2;
+
+    HardwareSerial& uart_;
+    int8_t rxPin_;
+    int8_t txPin_;
+    int8_t dePin_;
+    frames::Assembler* assembler_ = nullptr;  // fed from the UART event task once set
+};
+#endif
+
+#ifdef TRANSPORT_TCP
+/**
+ * @brief A TCP socket over the ESP32's Wi-Fi, one host at a time.
+ *
+ * The board joins `ssid` as a station and listens on `port`. A new connection replaces the last,
+ * a host that lost its link can come back without waiting for the old socket to time out. Nagle
+ * is off, every answer goes out at once.
+ */
+class TcpTransport : public ByteTransport
+{
+public:
+    TcpTransport(const char* ssid, const char* password, uint16_t port)
+        : ssid_(ssid), password_(password), server_(port)
+    {
+    }
+
+    int begin(uint32_t baudrate, size_t rxBufferSize) override;
+    bool poll() override;
+    int available() override { return client_ ? client_.available() : 0; }
+    int read() override { return client_ ? client_.read() : -1; }
+    size_t read(uint8_t* buffer, size_t size) override;
+    int availableForWrite() override;
+    size_t write(const uint8_t* data, size_t size) override;
+
+private:
+    // lwIP takes this much per write without waiting for the window, TCP_SND_BUF is 5744
+    static constexpr int WRITE_CHUNK = 1436;
+
+    const char* ssid_;
+    const char* password_;
+    WiFiServer server_;
+    WiFiClient client_;
+};
+#endif
@@ -1,17 +1,43 @@
 #pragma once
 
-#include <vector>
+#include <array>
 
 #include "AS5048A.hpp"
 #include "PCF8575.h"
 #include "RotaryEncoder.h"
 #include "SimpleKalmanFilter.hpp"
 #include "TMCStepper.h"
+#include "cleaner_system_constants.hpp"
 #include "controllers.hpp"
 #include "discrete_filter.hpp"
+#include "frequency_response.hpp"
+#include "input_shaper.hpp"
+#include "lead_screw_compensation.hpp"
+#include "persistent_config.hpp"
 #include "pin_defs.hpp"
+#include "program.hpp"
+#include "program_planner.hpp"
+#include "program_store.hpp"
 #include "serial_receiver_transmitter.hpp"
 #include "stepper_motor.hpp"
+#include "telemetry.hpp"
+
+#ifdef ADAPTIVE_ACCELERATION
+#include "adaptive_acceleration.hpp"
+#endif
+
+#ifdef ADAPTIVE_NOTCH
+#include "adaptive_notch.hpp"
+#endif
+
+#ifdef STEP_VERIFICATION
+#include "step_counter.hpp"
+#include "step_reconciler.hpp"
+#endif
+
+#ifdef VIBRATION_MONITOR
+#include "vibration_monitor.hpp"
+#endif
 
 class Cleaner
 {
@@ -23,11 +49,36 @@ public:
     int shutdown();
     void home(SerialReceiverTransmitter::CommandMessage command);
     void processCommand(SerialReceiverTransmitter::CommandMessage command);
+    void runBatch();
     void run();
     void initializeManualMode();
     void initializeAutoMode(SerialReceiverTransmitter& receiver);
 
     void stop();
+    bool isMotionIdle();
+
+    int setShaper(uint8_t axis, const shaping::Params& params);
+    void reportShapers();
+
+    int setCompensation(const compensation::Settings& settings);
+    void reportCompensation();
+    int saveConfig();
+
+    int checkProgram(const char* name);
+    int startProgram(const char* name);
+    void reportProgram();
+    bool isProgramRunning() const { return programRunner_.isRunning(); }
+
+    void reportDrivers();
+
+    int startIdentification(uint8_t axis, const identification::Config& cfg);
+    void stopIdentification();
+    bool isIdentifying() const { return identRunning_; }
+
+    int startTelemetry();
+    void stopTelemetry();
+    int setTelemetryChannel(uint8_t channel, const telemetry::Channel& settings);
+    void reportTelemetry();
 
     void PCFMessageRec();
     void updatePCF8575();
@@ -105,7 +156,7 @@ public:
         }
     };
 
-    bool updatePCF8575_flag = false;
+    volatile bool updatePCF8575_flag = false;  // set from the PCF8575 INT ISR
     void updateModeAuto();
 
     State updateDesStateManual();
@@ -122,10 +173,85 @@ public:
 
     AS5048A& getEncoder() { return encoder_; }
 
+#ifdef STEP_VERIFICATION
+    /** @brief Last hardware vs software step comparison for motors[axis] */
+    StepReconciler::Report getStepReport(uint8_t axis) const
+    {
+        return stepReconcilers_[axis].lastReport();
+    }
+#endif
+
+#ifdef ADAPTIVE_NOTCH
+    /** @brief Resonance tracker on the jaw rotation velocity */
+    const AdaptiveNotch& getJawNotch() const { return jawNotch_; }
+
+    /** @brief Jaw rotation velocity from the AS5048A, notched and low passed, rad/s */
+    float getJawRotationVelocity() const { return jaw_rotation_velocity_; }
+#endif
+
+#ifdef VIBRATION_MONITOR
+    /** @brief Spectrum of the jaw rotation velocity, analysed in the background */
+    VibrationMonitor& getVibrationMonitor() { return vibration_; }
+#endif
+
 private:
     void runControl();
+    void updateJawEncoder();
+
+    /** @brief RotaryEncoder pin reader, context is the PCF8575 the encoder is wired to */
+    static int readIOExtender(void* ioExtender, int pin)
+    {
+        return static_cast<PCF8575*>(ioExtender)->readNoUpdate(pin);
+    }
+#ifdef STEP_VERIFICATION
+    void verifySteps();
+#endif
+#ifdef ADAPTIVE_NOTCH
+    void updateJawVelocity();
+    void reportResonance();
+#endif
+#ifdef VIBRATION_MONITOR
+    void sampleVibration();
+    void reportVibrationEvents();
+#endif
+    void reportVibration();
+    void updateCurrents();
+    void checkDriverHealth();
+#ifdef ADAPTIVE_ACCELERATION
+    void adaptAccelerations();
+#endif
+    void applyShapers();
+    void resetShapers();
+    void applyCompensation();
+    void setMaxSpeeds(float jawPos, float jawRotation, float clamp);
+    void setAccelerations(float jawPos, float jawRotation, float clamp);
+    void processProgramCommands(const SerialReceiverTransmitter::CommandMessage& command);
+    void runProgram();
+    void stopProgram();
+    program::Kinematics currentKinematics();
+    void restoreProgramKinematics();
+    void recordIdentification(float perturbation);
+    void streamIdentification();
+    void recordTelemetry(const State& error);
+    void streamTelemetry();
 
     static constexpr uint32_t DEBOUNCE_TIME_MS = 10;
+    // 255 ticks of reference history, ZVD/EI down to ~4 Hz and ZV down to ~2 Hz
+    static constexpr uint16_t SHAPER_HISTORY = 256;
+    // 256 ticks of slack for the serial stream, ~4 kB
+    static constexpr uint16_t IDENT_BUFFER_SAMPLES = 256;
+    // Position, error and speed of every axis, see TelemetryChannels
+    static constexpr uint8_t TELEMETRY_CHANNELS = 9;
+    // Packets are written whole, small enough for the transmit buffer to take one at a time,
+    // 8 of them queued are ~80 ms of slack for the link
+    static constexpr size_t TELEMETRY_PACKET_SIZE = 128;
+    static constexpr size_t TELEMETRY_QUEUED      = 8;
+    // A linked program and what it calls, 16 bytes an op, 8 kB
+    static constexpr uint16_t PROGRAM_OPS = 512;
+    // Moves of a program planned before it starts, 20 bytes a move, 5 kB
+    static constexpr uint16_t PLAN_SEGMENTS = 256;
+    // Part of its max speed the clamp PID may command
+    static constexpr float CLAMP_SPEED_FRACTION = 0.25f;
     struct ToggleButtonState
     {
         const char* name;
@@ -175,10 +301,10 @@ private:
         button.debouncedStateLast = button.debouncedState;
     }
 
-    std::vector<ToggleButtonState> ENCODER_BUTTONS = {
+    std::array<ToggleButtonState, 3> ENCODER_BUTTONS = {{
         {"Jaw Rotation", ENCODER_JAW_ROTATION_SPEED_HIGH},
         {"Jaw Position", ENCODER_JAW_POSITION_SPEED_HIGH},
-        {"Clamp", ENCODER_CLAMP_SPEED_HIGH}};
+        {"Clamp", ENCODER_CLAMP_SPEED_HIGH}}};
 
     State state_;
     State des_state_;
@@ -189,7 +315,6 @@ private:
     constexpr static float ENCODER_JAW_POSITION_SENSITIVITY = 1.0f;
     constexpr static float ENCODER_CLAMP_SENSITIVITY        = 0.1f;
 
-    constexpr static const float RUN_RATE_HZ  = 1000.0f;
     constexpr static const float HOMING_SPEED = 100.0f;  // Speed for homing in mm/s
 
     float last_enc_jaw_rot_;
@@ -204,10 +329,18 @@ private:
     bool breakSwitchedOn = false;
 
     bool command_in_progress_ = false;
+    // receiver message count of the last one shot command handled (M425, M500, M593, M911,
+    // M950, M951, M952, M953 and the program commands)
+    uint32_t lastHandledMessage_ = 0;
+    // A command of a BATCH message was taken and is acked once it completes
+    bool batchCommandOpen_ = false;
 
     PCF8575 IOExtender_;  // Must be defined before the rotary encoders
 
     AS5048A encoder_;
+    // Read once per control tick by updateJawEncoder(), rad and rad/s
+    float jawAngle_    = 0;
+    float jawVelocity_ = 0;
 
     RotaryEncoder encoder_jaw_rotation_;
     RotaryEncoder encoder_jaw_pos_;
@@ -219,6 +352,83 @@ private:
 
     // handy array of all motors
     StepperMotor* motors[3];
+    // Thermal flags at the last checkDriverHealth(), only changes are reported
+    bool driverPreWarning_[3]      = {false, false, false};
+    bool driverOverTemperature_[3] = {false, false, false};
+
+#ifdef FAST_STEP_OUTPUT
+    // Shared STEP/DIR register backend, flushed once per pass of run()
+    FastStepOutput stepOutput_;
+#endif
+
+#ifdef STEP_VERIFICATION
+    // Pulse counters watching the STEP/DIR pins of each motor, same order as motors[]
+    StepCounter stepCounters_[3];
+    StepReconciler stepReconcilers_[3];
+#endif
+
+#ifdef ADAPTIVE_NOTCH
+    // Measured jaw rotation velocity, velocity -> notch -> jawEncoderLowpassFilter
+    AdaptiveNotch jawNotch_;
+    float jaw_rotation_velocity_ = 0;
+#endif
+
+#ifdef ADAPTIVE_ACCELERATION
+    // Acceleration of the jaw axes (motors[0], motors[1]) from the load margin of each move
+    AdaptiveAcceleration accelAdapters_[2];
+    bool adaptMoving_[2]     = {false, false};
+    float adaptClampTarget_  = 0;  // a new clamp target means a new part, start over
+    float adaptEncoderStart_ = 0;  // AS5048A and step count of the jaw rotation at move start
+    float adaptStepsStart_   = 0;
+#endif
+
+#ifdef VIBRATION_MONITOR
+    // Raw jaw rotation velocity -> spectrum, analysed by a task on the other core
+    VibrationMonitor vibration_;
+#endif
+
+    // Input shapers on the position references, same order as motors[]. New parameters wait in
+    // shaperParams_ until the machine is idle so a move is never reshaped half way.
+    shaping::InputShaper<SHAPER_HISTORY> shapers_[3];
+    shaping::Params shaperParams_[3];
+    bool shaperPending_ = false;
+    // While any axis is shaped the jaw rotation and position move the shaped trajectories_ with
+    // followUnits() instead of AccelStepper's own trapezoid, which would not be shaped
+    shaping::Trajectory trajectories_[2];
+    bool shaped_ = false;
+
+    // Calibration kept in flash, loaded by begin() and written by M500
+    PersistentConfig config_;
+    // Pitch error and backlash of the jaw position lead screw, changes wait for idle like shapers
+    compensation::LeadScrewCompensator jawPosCompensator_;
+    bool compensationPending_ = false;
+
+    // Stored programs, the running one is linked into programImage_ and never read from flash
+    ProgramStore programStore_;
+    program::Image<PROGRAM_OPS> programImage_;
+    program::Runner<> programRunner_;
+    char programName_[program::NAME_LENGTH] = {};
+    uint32_t programDwellEnd_               = 0;  // millis() a program G4 ends at
+    // Checked and planned by checkProgram() before the run, the moves replay programPlan_
+    program::Plan<PLAN_SEGMENTS> programPlan_;
+    program::Kinematics programKinematics_;  // M80/M17 of the program, restored when it ends
+    uint32_t programMoves_ = 0;
+
+    // Frequency response identification, the jaw rotation is perturbed while identRunning_
+    identification::Perturbation identPerturbation_;
+    identification::SampleRing<IDENT_BUFFER_SAMPLES> identSamples_;
+    bool identRunning_ = false;
+    float identOffset_ = 0;  // integrated perturbation of the jaw rotation position
+
+    // Compact telemetry, sampled in the control tick while telemetryOn_ and streamed until the
+    // queue is empty after a stop. telemetryChannels_ are taken by the encoder at every start.
+    telemetry::Encoder<TELEMETRY_CHANNELS, TELEMETRY_PACKET_SIZE, TELEMETRY_QUEUED> telemetry_;
+    telemetry::Channel telemetryChannels_[TELEMETRY_CHANNELS];
+    bool telemetryOn_         = false;
+    bool telemetryStreaming_  = false;
+    uint8_t telemetryHeader_  = 0;  // header lines still to print, TLM_START and a TLM_CH each
+    uint32_t telemetryBusyUs_ = 0;  // spent in the encoder since the start, and the longest tick
+    uint32_t telemetryMaxUs_  = 0;
 
     // Filters and Controllers
     DiscreteFilter<3> clampLowpassFilter;
@@ -237,7 +447,7 @@ private:
     unsigned long last_read_time = 0;
 };
 
-Cleaner::State abs(Cleaner::State state)
+inline Cleaner::State abs(Cleaner::State state)
 {
     state.jaw_rotation = std::abs(state.jaw_rotation);
     state.jaw_pos      = std::abs(state.jaw_pos);
@@ -1,6 +1,16 @@
 #pragma once
+#include "adaptive_acceleration.hpp"
+#include "adaptive_notch.hpp"
+#include "input_shaper.hpp"
 #include "pin_defs.hpp"
+#include "program_planner.hpp"
+#include "spectrum_monitor.hpp"
+#include "step_reconciler.hpp"
 #include "stepper_motor.hpp"
+#include "telemetry.hpp"
+
+// Rate of Cleaner::runControl(), every filter and controller of the tick is discretised with it
+constexpr float RUN_RATE_HZ = 1000.0f;
 
 constexpr StepperMotor::StaticConfig jawRotationCfg{
     /* pins */ {JAW_ROTATION_CS_PIN, JAW_ROTATION_STEP_PIN, JAW_ROTATION_DIR_PIN, 255},
@@ -17,11 +27,68 @@ constexpr StepperMotor::StaticConfig clampCfg{
     StepperMotor::TMC5160_PRO_RSENSE,
     "Clamp Motor"};
 
+/* Chopper Presets, StealthChop below the fraction of max speed and SpreadCycle above it */
+constexpr StepperMotor::ChopperParams JawRotationChopper{
+    /* stealthChopFraction  */ 0.3f,
+    /* highVelocityFraction */ 0.0f};
+// Long fast moves, hand over to SpreadCycle early and fullstep near the top speed so it can go
+// faster before stalling
+constexpr StepperMotor::ChopperParams JawPositionChopper{
+    /* stealthChopFraction  */ 0.15f,
+    /* highVelocityFraction */ 0.8f};
+constexpr StepperMotor::ChopperParams ClampChopper{
+    /* stealthChopFraction  */ 0.3f,
+    /* highVelocityFraction */ 0.0f};
+
+/* Current Presets, M911 reports the StallGuard and current scale to tune CoolStep against */
+constexpr StepperMotor::CurrentParams JawRotationCurrent{
+    /* holdFraction   */ 0.5f,
+    /* idleDelay_ms   */ 500,
+    /* accelBoost     */ 1.2f,
+    /* coolStepMin    */ 5,
+    /* coolStepMax    */ 2,
+    /* stallThreshold */ 0};
+// Adaptive acceleration compares its StallGuard readings at one current, so it runs the position
+// without the boost and without CoolStep
+#ifdef ADAPTIVE_ACCELERATION
+constexpr StepperMotor::CurrentParams JawPositionCurrent{
+    /* holdFraction   */ 0.3f,  // the lead screw holds the jaw by itself
+    /* idleDelay_ms   */ 500,
+    /* accelBoost     */ 1.0f,
+    /* coolStepMin    */ 0,
+    /* coolStepMax    */ 2,
+    /* stallThreshold */ 0};
+#else
+constexpr StepperMotor::CurrentParams JawPositionCurrent{
+    /* holdFraction   */ 0.3f,  // the lead screw holds the jaw by itself
+    /* idleDelay_ms   */ 500,
+    /* accelBoost     */ 1.3f,
+    /* coolStepMin    */ 5,
+    /* coolStepMax    */ 2,
+    /* stallThreshold */ 0};
+#endif
+// The clamp current is the clamping force, it is never lowered
+constexpr StepperMotor::CurrentParams ClampCurrent{
+    /* holdFraction   */ 1.0f,
+    /* idleDelay_ms   */ 500,
+    /* accelBoost     */ 1.0f,
+    /* coolStepMin    */ 0,
+    /* coolStepMax    */ 2,
+    /* stallThreshold */ 0};
+
 /* Electrical Presets */
 // As of right now, clamp and jawRotation need to have the same microstepping
-constexpr StepperMotor::ElectricalParams JawRotationElectrical{2000, 32};
-constexpr StepperMotor::ElectricalParams JawPositionElectrical{1200, 32};
-constexpr StepperMotor::ElectricalParams clampElectrical{1500, 32};
+constexpr StepperMotor::ElectricalParams JawRotationElectrical{
+    2000,
+    32,
+    JawRotationChopper,
+    JawRotationCurrent};
+constexpr StepperMotor::ElectricalParams JawPositionElectrical{
+    1200,
+    32,
+    JawPositionChopper,
+    JawPositionCurrent};
+constexpr StepperMotor::ElectricalParams clampElectrical{1500, 32, ClampChopper, ClampCurrent};
 
 /* Physical Presets */
 constexpr StepperMotor::PhysicalParams JawRotationPhysical{
@@ -40,4 +107,99 @@ constexpr StepperMotor::MotionParams JawPositionMotion{
     8000 * JawPositionElectrical.microsteps};
 constexpr StepperMotor::MotionParams ClampMotion{
     1200 * clampElectrical.microsteps,
-    2500 * clampElectrical.microsteps};
\ No newline at end of file
+    2500 * clampElectrical.microsteps};
+
+/* Stored Program Limits, every move of a program is checked against them before it starts (M24,
+ * M31). Y, A, C in mm, rad and rad, set them to the machine */
+constexpr program::Limits ProgramLimits{
+    /* min         */ {0.0f, -100.0f, -1.0f},
+    /* max         */ {300.0f, 100.0f, 10.0f},
+    /* clampOpenAt */ 2.0f};  // C2.5 and up release the part, C-.1 holds it
+
+/* Input Shaper Presets, M593 changes them live. NONE on every axis adds no delay */
+constexpr shaping::Params JawRotationShaper{shaping::NONE, 10.0f, 0.05f};
+constexpr shaping::Params JawPositionShaper{shaping::NONE, 10.0f, 0.05f};
+constexpr shaping::Params ClampShaper{shaping::NONE, 10.0f, 0.05f};
+
+/* Driver Current Management */
+constexpr float CURRENT_UPDATE_PERIOD_S = 0.01f;  // acceleration boost on / off
+constexpr float DRIVER_HEALTH_PERIOD_S  = 1.0f;   // over temperature flags polled
+
+/* Adaptive Acceleration (only used with -D ADAPTIVE_ACCELERATION), the motion presets are the
+ * worst case part and the floor, light parts may go up to 3x. The rotation margin is the AS5048A
+ * lag against the tolerance, the position margin is StallGuard against its cruising baseline */
+constexpr float ADAPT_TRACKING_TOLERANCE = 0.02f;  // rad the AS5048A may fall behind the steps
+constexpr AdaptiveAcceleration::Config JawRotationAdaptive{
+    /* minAcceleration */ JawRotationMotion.acceleration,
+    /* maxAcceleration */ 3 * JawRotationMotion.acceleration,
+    /* targetMargin    */ 0.4f,
+    /* deadBand        */ 0.1f,
+    /* increase        */ 1.2f,
+    /* decrease        */ 0.7f,
+    /* movesToIncrease */ 3,
+    /* minSamples      */ 3,
+    /* fullSpeed       */ JawRotationMotion.maxSpeed};
+constexpr AdaptiveAcceleration::Config JawPositionAdaptive{
+    /* minAcceleration */ JawPositionMotion.acceleration,
+    /* maxAcceleration */ 3 * JawPositionMotion.acceleration,
+    /* targetMargin    */ 0.4f,
+    /* deadBand        */ 0.1f,
+    /* increase        */ 1.2f,
+    /* decrease        */ 0.7f,
+    /* movesToIncrease */ 3,
+    /* minSamples      */ 3,
+    /* fullSpeed       */ JawPositionMotion.maxSpeed};
+
+/* Step Verification (only used with -D STEP_VERIFICATION) */
+constexpr float STEP_VERIFY_PERIOD_S = 0.1f;  // must see < modulus / 2 steps per period
+constexpr StepReconciler::Config StepVerificationCfg{
+    /* modulus        */ 30000,
+    /* driftTolerance */ 4,
+    /* autoCorrect    */ false};
+
+/* Jaw Resonance Notch (only used with -D ADAPTIVE_NOTCH) */
+constexpr float NOTCH_REPORT_PERIOD_S = 1.0f;
+constexpr AdaptiveNotch::Config JawNotchCfg{
+    /* fMin        */ 5.0f,
+    /* fMax        */ 200.0f,
+    /* Ts          */ 1.0f / RUN_RATE_HZ,
+    /* poleRadius  */ 0.95f,
+    /* notchRadius */ 0.9f,
+    /* stepSize    */ 0.005f,
+    /* smoothing   */ 0.01f,
+    /* lockRatio   */ 4.0f};
+
+/* Vibration Monitor (only used with -D VIBRATION_MONITOR) */
+constexpr float VIBRATION_EVENT_POLL_S = 0.1f;
+constexpr spectrum::Config VibrationCfg{
+    /* fMin      */ 5.0f,
+    /* fMax      */ 200.0f,
+    /* Ts        */ 1.0f / RUN_RATE_HZ,
+    /* fullScale */ 5.0f};  // rad/s, the AS5048A resolves ~0.4 rad/s per tick at 1 kHz
+// RMS rad/s per band (~5-50, 55-100, 105-150, 155-200 Hz), 0 disables. The lowest band carries
+// the motion profile itself so it is left off, tune the rest from M952 readings.
+constexpr float VibrationThresholds[4] = {0.0f, 0.2f, 0.2f, 0.2f};
+
+/* Frequency Response Identification (M950) */
+constexpr float IDENT_STREAM_PERIOD_S = 0.005f;  // drain the sample ring at least every 5 ticks
+
+/* Telemetry (M953) */
+constexpr float TELEMETRY_STREAM_PERIOD_S   = 0.002f;
+constexpr uint8_t TELEMETRY_PACKET_TICKS    = 10;    // a packet at least every 10 ms
+constexpr uint32_t TELEMETRY_KEYFRAME_TICKS = 1000;  // a host that lost a packet waits 1 s at most
+// Position, error and speed of every axis, axes in the order of motors[]. Positions and errors
+// every tick, speeds as the min, max and mean of 10 ticks. M953 C<n> changes them.
+constexpr const char* TelemetryChannelNames[9] = {
+    "jaw_rotation.position", "jaw_pos.position", "clamp.position",
+    "jaw_rotation.error",    "jaw_pos.error",    "clamp.error",
+    "jaw_rotation.speed",    "jaw_pos.speed",    "clamp.speed"};
+constexpr telemetry::Channel TelemetryChannels[9] = {
+    /* rad   */ {1e-4f, 1, telemetry::LAST},
+    /* mm    */ {1e-3f, 1, telemetry::LAST},
+    /* mm    */ {1e-3f, 1, telemetry::LAST},
+    /* rad   */ {1e-4f, 1, telemetry::LAST},
+    /* mm    */ {1e-3f, 1, telemetry::LAST},
+    /* mm    */ {1e-3f, 1, telemetry::LAST},
+    /* rad/s */ {1e-3f, 10, telemetry::MIN | telemetry::MAX | telemetry::MEAN},
+    /* mm/s  */ {1e-2f, 10, telemetry::MIN | telemetry::MAX | telemetry::MEAN},
+    /* mm/s  */ {1e-2f, 10, telemetry::MIN | telemetry::MAX | telemetry::MEAN}};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Many G/M lines in one frame, each with a 16-bit sequence number, run in order and acked
+ * by number.
+ *
+ * A BATCH frame body is
+ *
+ *     1 byte     flags, bit 0 RESTART: drop anything queued and start the sequence over at 0
+ *     records    2 byte seq, little endian, then the line, null terminated, back to back
+ *
+ * Sequence numbers start at 0 and go up by one per command, wrapping. A record the device already
+ * has is dropped silently, so the host may resend everything past the last ack after a glitch. A
+ * record past the next expected one is refused, it stays the host's to resend. Lines that can't be
+ * run still take their number, they are reported and then skipped, so the cumulative ack goes past
+ * them.
+ */
+namespace batch
+{
+enum Flags : uint8_t
+{
+    RESTART = 1 << 0,
+};
+
+enum Result : uint8_t
+{
+    ACCEPTED = 0,
+    DUPLICATE,  ///< already queued or run, dropped
+    GAP,        ///< past the next expected seq, dropped
+    FULL,       ///< no room, dropped
+    TOO_LONG,   ///< queued empty, it is skipped when its turn comes
+    MALFORMED,  ///< not a G or M code, queued empty like TOO_LONG
+};
+
+/** @brief Walks the records of one BATCH frame body */
+class Reader
+{
+public:
+    Reader(const char* body, size_t length)
+        : cursor_(length > 0 ? body + 1 : body),
+          end_(body + length),
+          flags_(length > 0 ? static_cast<uint8_t>(body[0]) : 0)
+    {
+    }
+
+    bool restart() const { return flags_ & RESTART; }
+
+    /**
+     * @brief Next record of the frame.
+     *
+     * @return false once the body is used up or the rest of it is not a whole record, see
+     * truncated()
+     */
+    bool next(uint16_t& seq, const char*& line, size_t& length)
+    {
+        if (end_ - cursor_ < 3)
+        {
+            truncated_ = cursor_ != end_;
+            return false;
+        }
+        const void* terminator = memchr(cursor_ + 2, '\0', end_ - cursor_ - 2);
+        if (terminator == nullptr)
+        {
+            truncated_ = true;
+            return false;
+        }
+        seq     = static_cast<uint8_t>(cursor_[0]) | static_cast<uint8_t>(cursor_[1]) << 8;
+        line    = cursor_ + 2;
+        length  = static_cast<const char*>(terminator) - line;
+        cursor_ = static_cast<const char*>(terminator) + 1;
+        return true;
+    }
+
+    /** @brief The frame ended in the middle of a record */
+    bool truncated() const { return truncated_; }
+
+private:
+    const char* cursor_;
+    const char* end_;
+    uint8_t flags_;
+    bool truncated_ = false;
+};
+
+/**
+ * @brief Commands of the BATCH frames waiting for their turn, in sequence order.
+ *
+ * Lines are kept where they were received, not copied. Each carries the `owner` it was pushed with,
+ * the frame buffer holding it, and the line must stay put until it leaves the queue, see
+ * frontOwner().
+ *
+ * @tparam CAPACITY commands queued at most, the host keeps no more than this many unacked
+ * @tparam LINE_LENGTH longest line taken, including the terminator
+ */
+template <uint8_t CAPACITY, uint8_t LINE_LENGTH>
+class Queue
+{
+public:
+    /**
+     * @brief Drops everything queued, `next` is the first seq of the new sequence. The owners of
+     * what was queued are the caller's to release first.
+     */
+    void restart(uint16_t next = 0)
+    {
+        head_     = 0;
+        count_    = 0;
+        expected_ = next;
+    }
+
+    /**
+     * @brief Queues the command `seq` if it is the next one expected. Only an ACCEPTED line is
+     * kept, the owner holds on to its buffer for it.
+     */
+    Result push(uint16_t seq, const char* line, size_t length, uint32_t owner = 0)
+    {
+        if (seq != expected_)
+        {
+            // Wrapping difference, behind is a resend of something already taken
+            return static_cast<int16_t>(seq - expected_) < 0 ? DUPLICATE : GAP;
+        }
+        if (count_ >= CAPACITY)
+        {
+            return FULL;
+        }
+        Result result = ACCEPTED;
+        if (length >= LINE_LENGTH)
+        {
+            result = TOO_LONG;
+        }
+        else if (length < 2 || (line[0] != 'G' && line[0] != 'M'))
+        {
+            result = MALFORMED;
+        }
+
+        const uint8_t tail = (head_ + count_) % CAPACITY;
+        lines_[tail]       = result == ACCEPTED ? line : "";
+        owners_[tail]      = owner;
+        seqs_[tail]        = seq;
+        count_++;
+        expected_ = seq + 1;
+        return result;
+    }
+
+    bool empty() const { return count_ == 0; }
+    uint8_t size() const { return count_; }
+
+    /** @brief Oldest queued command, empty if it was refused on arrival. Only when !empty() */
+    const char* front(uint16_t& seq) const
+    {
+        seq = seqs_[head_];
+        return lines_[head_];
+    }
+
+    /**
+     * @brief Owner of the oldest queued command, false if it was refused and holds nothing. The
+     * buffer is the caller's to release once the command is popped.
+     */
+    bool frontOwner(uint32_t& owner) const
+    {
+        owner = owners_[head_];
+        return lines_[head_][0] != '\0';
+    }
+
+    void pop()
+    {
+        if (count_ > 0)
+        {
+            head_ = (head_ + 1) % CAPACITY;
+            count_--;
+        }
+    }
+
+    /** @brief Seq the next record has to carry */
+    uint16_t expected() const { return expected_; }
+
+private:
+    const char* lines_[CAPACITY];
+    uint32_t owners_[CAPACITY];
+    uint16_t seqs_[CAPACITY];
+    uint8_t head_      = 0;
+    uint8_t count_     = 0;
+    uint16_t expected_ = 0;
+};
+}  // namespace batch
@@ -2,6 +2,8 @@
 #include "discrete_filter.hpp"
 namespace controller
 {
+// Tustin designs derived by hand, further ones come out of filter::discretize() in
+// discretization.hpp in one line
 Coefficients<3, float> PIDControllerCoefficients(float kp, float ki, float kd, float ts);
 Coefficients<2, float> PhaseLagLeadCoefficients(float k, float z, float p, float ts);
 }
@@ -3,6 +3,8 @@
 #include <array>
 #include <cstdint>
 
+#include "hot_path.hpp"
+
 /**
  * @struct Coefficients
  * @brief Represents the coefficients used in a discrete filter.
@@ -70,7 +72,7 @@ public:
      * a_{k}y(n-k)\right]. \qquad{(2)} \f$
      *
      */
-    T filterData(float dat)
+    HOT_PATH T filterData(float dat)
     {
         for (int i = SIZE - 1; i > 0; i--)
         {
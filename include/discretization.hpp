@@ -0,0 +1,776 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+
+#include "butterworth.hpp"
+#include "discrete_filter.hpp"
+
+/**
+ * @brief Continuous to discrete design, an s-domain compensator or filter in one line.
+ *
+ * A transfer function is given in s as numerator and denominator, tf(), or as zeros, poles and
+ * gain, zpk(), and mapped to the z-domain by one of
+ *
+ * - TUSTIN:  s = k (z - 1) / (z + 1) with k = 2 / Ts, or k = w / tan(w Ts / 2) to match the
+ *            response exactly at w (prewarp). Takes improper designs like the PID, the missing
+ *            zeros or poles land on z = -1
+ * - ZOH:     exact for a staircase input, the model of a plant behind a sample and hold
+ * - MATCHED: poles and zeros by z = e^(s Ts), zeros at infinity to z = -1, the gain matched at DC,
+ *            or at w when H has a pole or zero at the origin
+ *
+ * ZOH and MATCHED need a proper H, no more zeros than poles. The result is again a ZeroPoleGain,
+ * with Ts set, which toCoefficients() expands into the direct form of a DiscreteFilter and toSos()
+ * into second order sections. The direct form in float loses precision quickly past order 2, run
+ * the sections in series instead.
+ *
+ * @code
+ *    // Lag-lead k (s + z) / (s + p)
+ *    auto lead = toCoefficients(discretize(tf<1>({k, k * z}, {1, p}), Ts));
+ *    // PID (kd s^2 + kp s + ki) / s
+ *    auto pid = toCoefficients(discretize(tf<2>({kd, kp, ki}, {0, 1, 0}), Ts));
+ *    // Lightly damped plant, checked before it goes into an observer
+ *    auto plant = discretize(zpk<2>({}, {Complex(-a, w), Complex(-a, -w)}, g), Ts, ZOH);
+ *    bool ok    = isStable(plant);
+ * @endcode
+ *
+ * Roots of a polynomial come from a Durand-Kerner iteration in real_t. Define FILTER_DESIGN_DOUBLE
+ * for orders above about 4 or for poles much slower than the sample rate under ZOH.
+ */
+namespace filter
+{
+enum Method : uint8_t
+{
+    TUSTIN = 0,
+    ZOH,
+    MATCHED,
+};
+
+/**
+ * H = gain (x - zeros[0]) ... (x - zeros[zeroCount - 1]) / (x - poles[0]) ... with x = s in the
+ * s-domain, Ts == 0, or x = z. Complex roots come in conjugate pairs. N is the order, the larger
+ * of the two counts. An invalid design, a bad argument, has a NaN gain.
+ */
+template <uint8_t N>
+struct ZeroPoleGain
+{
+    std::array<Complex, N> zeros;
+    std::array<Complex, N> poles;
+    uint8_t zeroCount = 0;
+    uint8_t poleCount = 0;
+    real_t gain       = 1;
+    real_t Ts         = 0;  ///< Sample time, 0 in the s-domain
+
+    bool valid() const { return std::isfinite(gain); }
+};
+
+inline Complex complexExp(Complex s)
+{
+    const real_t r = std::exp(s.re);
+    return {r * std::cos(s.im), r * std::sin(s.im)};
+}
+
+/**
+ * Multiplies out (x - roots[0]) ... (x - roots[count - 1]) into c[0] x^count + ... + c[count],
+ * highest power first, which is also the z^-1 order of Coefficients.
+ */
+template <uint8_t N>
+void expandRoots(const Complex* roots, uint8_t count, real_t* c)
+{
+    Complex product[N + 1];
+    product[0] = Complex(1);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        product[i + 1] = Complex(0);
+        for (uint8_t j = i + 1; j > 0; j--)
+        {
+            product[j] -= product[j - 1] * roots[i];
+        }
+    }
+    for (uint8_t i = 0; i <= count; i++)
+    {
+        c[i] = product[i].re;
+    }
+}
+
+/**
+ * Makes conjugate pairs exact and nearly real roots real, so the sections built from them pair
+ * up and expand to real coefficients.
+ */
+template <uint8_t N>
+void cleanConjugates(Complex* roots, uint8_t count)
+{
+    const real_t tolerance = std::sqrt(std::numeric_limits<real_t>::epsilon());
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (std::fabs(roots[i].im) <= tolerance * std::fmax(real_t(1), complexAbs(roots[i])))
+        {
+            roots[i].im = 0;
+        }
+    }
+    bool paired[N] = {};
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (paired[i] || roots[i].im <= 0)
+        {
+            continue;
+        }
+        const Complex conjugate(roots[i].re, -roots[i].im);
+        int16_t partner = -1;
+        real_t distance = 0;
+        for (uint8_t j = 0; j < count; j++)
+        {
+            const real_t d = complexAbs(roots[j] - conjugate);
+            if (!paired[j] && roots[j].im < 0 && (partner < 0 || d < distance))
+            {
+                partner  = j;
+                distance = d;
+            }
+        }
+        if (partner < 0)
+        {
+            roots[i].im = 0;
+            continue;
+        }
+        const Complex mean((roots[i].re + roots[partner].re) / 2,
+                           (roots[i].im - roots[partner].im) / 2);
+        roots[i]        = mean;
+        roots[partner]  = Complex(mean.re, -mean.im);
+        paired[i]       = true;
+        paired[partner] = true;
+    }
+}
+
+/**
+ * Roots of c[0] x^n + c[1] x^(n - 1) + ... + c[n] by Durand-Kerner. Leading zeros lower the
+ * degree, a numerator shorter than its denominator is written with them.
+ * @return the number of roots written, the degree
+ */
+template <uint8_t N>
+uint8_t polynomialRoots(const real_t* c, uint8_t n, Complex* roots)
+{
+    uint8_t first = 0;
+    while (first < n && c[first] == 0)
+    {
+        first++;
+    }
+    const uint8_t degree = n - first;
+    const real_t* p      = c + first;
+    if (degree == 0)
+    {
+        return 0;
+    }
+
+    // Start on a circle the size of the largest root, off the real axis so conjugates separate
+    real_t radius = 0;
+    for (uint8_t k = 1; k <= degree; k++)
+    {
+        radius = std::fmax(radius, std::pow(std::fabs(p[k] / p[0]), real_t(1) / k));
+    }
+    if (radius == 0)
+    {
+        for (uint8_t i = 0; i < degree; i++) roots[i] = Complex(0);
+        return degree;
+    }
+    const real_t pi = static_cast<real_t>(M_PI);
+    for (uint8_t i = 0; i < degree; i++)
+    {
+        const real_t angle = 2 * pi * i / degree + real_t(0.4);
+        roots[i]           = Complex(radius * std::cos(angle), radius * std::sin(angle));
+    }
+
+    const real_t tolerance = 8 * std::numeric_limits<real_t>::epsilon() * radius;
+    for (uint16_t iteration = 0; iteration < 500; iteration++)
+    {
+        real_t change = 0;
+        for (uint8_t i = 0; i < degree; i++)
+        {
+            Complex value(1);
+            Complex product(1);
+            for (uint8_t k = 1; k <= degree; k++)
+            {
+                value = value * roots[i] + Complex(p[k] / p[0]);
+            }
+            for (uint8_t j = 0; j < degree; j++)
+            {
+                if (j != i) product = product * (roots[i] - roots[j]);
+            }
+            if (product.re == 0 && product.im == 0)
+            {
+                product = Complex(tolerance);  // two estimates met, push them apart
+            }
+            const Complex delta = value / product;
+            roots[i] -= delta;
+            change = std::fmax(change, complexAbs(delta));
+        }
+        if (change <= tolerance)
+        {
+            break;
+        }
+    }
+    cleanConjugates<N>(roots, degree);
+    return degree;
+}
+
+/**
+ * @param [in] zeros, poles in the s-domain, at most N of each
+ * @param [in] gain multiplies the product form, not the DC gain
+ */
+template <uint8_t N>
+ZeroPoleGain<N> zpk(
+    std::initializer_list<Complex> zeros,
+    std::initializer_list<Complex> poles,
+    real_t gain)
+{
+    ZeroPoleGain<N> H;
+    if (zeros.size() > N || poles.size() > N)
+    {
+        H.gain = std::numeric_limits<real_t>::quiet_NaN();
+        return H;
+    }
+    for (const Complex& zero : zeros) H.zeros[H.zeroCount++] = zero;
+    for (const Complex& pole : poles) H.poles[H.poleCount++] = pole;
+    H.gain = gain;
+    return H;
+}
+
+/**
+ * @param [in] num, den in s, highest power first, leading zeros where one is shorter
+ */
+template <uint8_t N>
+ZeroPoleGain<N> tf(const std::array<real_t, N + 1>& num, const std::array<real_t, N + 1>& den)
+{
+    ZeroPoleGain<N> H;
+    H.zeroCount = polynomialRoots<N>(num.data(), N, H.zeros.data());
+    H.poleCount = polynomialRoots<N>(den.data(), N, H.poles.data());
+    // Leading coefficients, an all zero denominator leaves the NaN of 0 / 0
+    const real_t b = num[N - H.zeroCount];
+    const real_t a = den[N - H.poleCount];
+    H.gain         = a != 0 ? b / a : std::numeric_limits<real_t>::quiet_NaN();
+    return H;
+}
+
+/**
+ * @brief Response at w rad/s, H(jw) in the s-domain, H(e^(jw Ts)) in the z-domain.
+ */
+template <uint8_t N>
+Complex frequencyResponse(const ZeroPoleGain<N>& H, real_t w)
+{
+    const Complex x = H.Ts > 0 ? Complex(std::cos(w * H.Ts), std::sin(w * H.Ts)) : Complex(0, w);
+    Complex response(H.gain);
+    for (uint8_t i = 0; i < H.zeroCount; i++) response = response * (x - H.zeros[i]);
+    for (uint8_t i = 0; i < H.poleCount; i++) response = response / (x - H.poles[i]);
+    return response;
+}
+
+/**
+ * e^(M), M is n x n row major, n <= SIZE, by Taylor series after scaling M below 1/2 and squaring
+ * back.
+ */
+template <uint8_t SIZE>
+void matrixExponential(const real_t* M, uint8_t n, real_t* E)
+{
+    real_t norm = 0;
+    for (uint8_t r = 0; r < n; r++)
+    {
+        real_t row = 0;
+        for (uint8_t c = 0; c < n; c++) row += std::fabs(M[r * n + c]);
+        norm = std::fmax(norm, row);
+    }
+    uint8_t squarings = 0;
+    real_t scale      = 1;
+    while (norm * scale > real_t(0.5) && squarings < 60)
+    {
+        scale /= 2;
+        squarings++;
+    }
+
+    real_t term[SIZE * SIZE];
+    real_t next[SIZE * SIZE];
+    for (uint16_t i = 0; i < n * n; i++)
+    {
+        term[i] = (i % (n + 1) == 0) ? 1 : 0;
+        E[i]    = term[i];
+    }
+    // 12 terms leave 0.5^13 / 13! of error, below float and double precision alike
+    for (uint8_t k = 1; k <= 12; k++)
+    {
+        for (uint8_t r = 0; r < n; r++)
+        {
+            for (uint8_t c = 0; c < n; c++)
+            {
+                real_t sum = 0;
+                for (uint8_t j = 0; j < n; j++) sum += term[r * n + j] * M[j * n + c];
+                next[r * n + c] = sum * scale / k;
+            }
+        }
+        for (uint16_t i = 0; i < n * n; i++)
+        {
+            term[i] = next[i];
+            E[i] += term[i];
+        }
+    }
+    for (uint8_t s = 0; s < squarings; s++)
+    {
+        for (uint8_t r = 0; r < n; r++)
+        {
+            for (uint8_t c = 0; c < n; c++)
+            {
+                real_t sum = 0;
+                for (uint8_t j = 0; j < n; j++) sum += E[r * n + j] * E[j * n + c];
+                next[r * n + c] = sum;
+            }
+        }
+        for (uint16_t i = 0; i < n * n; i++) E[i] = next[i];
+    }
+}
+
+/**
+ * ZOH through the controllable canonical form: [Phi Gamma; 0 1] = e^([A B; 0 0] Ts) and the poles
+ * are e^(p Ts). The numerator is the denominator times the impulse response h[0] = D,
+ * h[k] = C Phi^(k-1) Gamma, up to z^-P, which keeps its small coefficients free of cancellation.
+ */
+template <uint8_t N>
+ZeroPoleGain<N> zeroOrderHold(const ZeroPoleGain<N>& H, real_t Ts)
+{
+    ZeroPoleGain<N> D;
+    D.Ts            = Ts;
+    D.gain          = H.gain;
+    const uint8_t P = H.poleCount;
+    const uint8_t Q = P + 1;
+    if (P == 0)
+    {
+        return D;
+    }
+
+    // s^P + a[1] s^(P-1) + ... + a[P] and the numerator b[0] s^P + ... + b[P]
+    real_t a[N + 1];
+    real_t b[N + 1] = {};
+    real_t zeros[N + 1];
+    expandRoots<N>(H.poles.data(), P, a);
+    expandRoots<N>(H.zeros.data(), H.zeroCount, zeros);
+    for (uint8_t i = 0; i <= H.zeroCount; i++) b[P - H.zeroCount + i] = H.gain * zeros[i];
+
+    real_t M[(N + 1) * (N + 1)] = {};
+    real_t E[(N + 1) * (N + 1)];
+    for (uint8_t i = 0; i + 1 < P; i++) M[i * Q + i + 1] = Ts;
+    for (uint8_t j = 0; j < P; j++) M[(P - 1) * Q + j] = -a[P - j] * Ts;
+    M[(P - 1) * Q + P] = Ts;
+    matrixExponential<N + 1>(M, Q, E);
+
+    // x = Phi^(k-1) Gamma, C[c] = b[P - c] - b[0] a[P - c] is the strictly proper part
+    real_t h[N + 1];
+    real_t x[N];
+    real_t next[N];
+    h[0] = b[0];
+    for (uint8_t r = 0; r < P; r++) x[r] = E[r * Q + P];
+    for (uint8_t k = 1; k <= P; k++)
+    {
+        h[k] = 0;
+        for (uint8_t c = 0; c < P; c++) h[k] += (b[P - c] - b[0] * a[P - c]) * x[c];
+        for (uint8_t r = 0; r < P; r++)
+        {
+            next[r] = 0;
+            for (uint8_t c = 0; c < P; c++) next[r] += E[r * Q + c] * x[c];
+        }
+        for (uint8_t r = 0; r < P; r++) x[r] = next[r];
+    }
+
+    D.poleCount = P;
+    for (uint8_t i = 0; i < P; i++) D.poles[i] = complexExp(H.poles[i] * Complex(Ts));
+    real_t den[N + 1];
+    real_t num[N + 1];
+    expandRoots<N>(D.poles.data(), P, den);
+    for (uint8_t k = 0; k <= P; k++)
+    {
+        num[k] = 0;
+        for (uint8_t i = 0; i <= k; i++) num[k] += den[i] * h[k - i];
+    }
+
+    D.zeroCount = polynomialRoots<N>(num, P, D.zeros.data());
+    D.gain      = num[P - D.zeroCount];
+    return D;
+}
+
+/**
+ * @brief Maps an s-domain design to the z-domain.
+ * @param [in] H in the s-domain
+ * @param [in] Ts sample time, s
+ * @param [in] method TUSTIN, ZOH or MATCHED
+ * @param [in] w TUSTIN: prewarp frequency in rad/s, below pi / Ts, 0 for none. MATCHED: where the
+ *               gain is matched when H has a pole or zero at the origin, 0 for a tenth of Nyquist
+ * @return the design in the z-domain, a NaN gain for an invalid argument
+ */
+template <uint8_t N>
+ZeroPoleGain<N> discretize(
+    const ZeroPoleGain<N>& H,
+    real_t Ts,
+    Method method = TUSTIN,
+    real_t w      = 0)
+{
+    ZeroPoleGain<N> D;
+    D.Ts            = Ts;
+    D.gain          = std::numeric_limits<real_t>::quiet_NaN();
+    const real_t pi = static_cast<real_t>(M_PI);
+    if (!H.valid() || H.Ts != 0 || !(Ts > 0) || w < 0 ||
+        (method != TUSTIN && H.zeroCount > H.poleCount))
+    {
+        return D;
+    }
+
+    switch (method)
+    {
+        case TUSTIN:
+        {
+            if (w * Ts >= pi)
+            {
+                return D;
+            }
+            // (s - r) = (k - r) (z - s2z(r)) / (z + 1), s2z maps with 2 / k in place of Ts
+            const real_t k = w > 0 ? w / std::tan(w * Ts / 2) : 2 / Ts;
+            Complex gain(H.gain);
+            for (uint8_t i = 0; i < H.zeroCount; i++)
+            {
+                D.zeros[D.zeroCount++] = s2z(H.zeros[i], 2 / k);
+                gain                   = gain * (Complex(k) - H.zeros[i]);
+            }
+            for (uint8_t i = 0; i < H.poleCount; i++)
+            {
+                D.poles[D.poleCount++] = s2z(H.poles[i], 2 / k);
+                gain                   = gain / (Complex(k) - H.poles[i]);
+            }
+            while (D.zeroCount < D.poleCount) D.zeros[D.zeroCount++] = Complex(-1);
+            while (D.poleCount < D.zeroCount) D.poles[D.poleCount++] = Complex(-1);
+            D.gain = gain.re;
+            return D;
+        }
+        case ZOH:
+            return zeroOrderHold(H, Ts);
+        case MATCHED:
+        {
+            bool origin = false;
+            for (uint8_t i = 0; i < H.zeroCount; i++)
+            {
+                D.zeros[D.zeroCount++] = complexExp(H.zeros[i] * Complex(Ts));
+                origin |= complexAbs(H.zeros[i]) * Ts < real_t(1e-6);
+            }
+            for (uint8_t i = 0; i < H.poleCount; i++)
+            {
+                D.poles[D.poleCount++] = complexExp(H.poles[i] * Complex(Ts));
+                origin |= complexAbs(H.poles[i]) * Ts < real_t(1e-6);
+            }
+            while (D.zeroCount < D.poleCount) D.zeros[D.zeroCount++] = Complex(-1);
+
+            const real_t match  = !origin ? 0 : w > 0 ? w : real_t(0.1) * pi / Ts;
+            D.gain              = 1;
+            const Complex ratio = frequencyResponse(H, match) / frequencyResponse(D, match);
+            D.gain              = ratio.re < 0 ? -complexAbs(ratio) : complexAbs(ratio);
+            return D;
+        }
+    }
+    return D;
+}
+
+/**
+ * @brief Direct form of a z-domain design, a[0] = 1, ready for DiscreteFilter<N + 1>.
+ */
+template <typename T = float, uint8_t N>
+Coefficients<N + 1, T> toCoefficients(const ZeroPoleGain<N>& D)
+{
+    real_t a[N + 1];
+    real_t b[N + 1];
+    expandRoots<N>(D.poles.data(), D.poleCount, a);
+    expandRoots<N>(D.zeros.data(), D.zeroCount, b);
+
+    // Fewer zeros than poles is a delay, z^(zeros - poles) in front of the z^-1 polynomials
+    const uint8_t delay = D.poleCount > D.zeroCount ? D.poleCount - D.zeroCount : 0;
+    Coefficients<N + 1, T> coefficients;
+    coefficients.naturalResponseCoefficients.fill(0);
+    coefficients.forcedResponseCoefficients.fill(0);
+    for (uint8_t i = 0; i <= D.poleCount; i++)
+    {
+        coefficients.naturalResponseCoefficients[i] = static_cast<T>(a[i]);
+    }
+    for (uint8_t i = 0; i <= D.zeroCount; i++)
+    {
+        coefficients.forcedResponseCoefficients[i + delay] = static_cast<T>(D.gain * b[i]);
+    }
+    return coefficients;
+}
+
+/**
+ * @brief Second order sections of a z-domain design, to run in series through DiscreteFilter<3>.
+ *
+ * Conjugate poles share a section, real poles pair up by radius. The sections are ordered with the
+ * poles nearest the unit circle last and each takes the zeros nearest its poles, conjugate pairs
+ * first. The gain goes into the first section, unused sections pass through.
+ */
+template <typename T = float, uint8_t N>
+std::array<Coefficients<3, T>, (N + 1) / 2> toSos(const ZeroPoleGain<N>& D)
+{
+    const uint8_t SECTIONS = (N + 1) / 2;
+
+    // Exact conjugates, so a pair is found by comparison
+    Complex poles[N];
+    Complex zeros[N];
+    for (uint8_t i = 0; i < D.poleCount; i++) poles[i] = D.poles[i];
+    for (uint8_t i = 0; i < D.zeroCount; i++) zeros[i] = D.zeros[i];
+    cleanConjugates<N>(poles, D.poleCount);
+    cleanConjugates<N>(zeros, D.zeroCount);
+
+    // Conjugate poles share a section, the real ones pair up largest first
+    Complex sectionPoles[SECTIONS][2];
+    uint8_t poleCount[SECTIONS] = {};
+    uint8_t groups              = 0;
+    bool used[N]                = {};
+    for (uint8_t i = 0; i < D.poleCount; i++)
+    {
+        for (uint8_t j = 0; j < D.poleCount && poles[i].im > 0; j++)
+        {
+            if (!used[j] && poles[j].re == poles[i].re && poles[j].im == -poles[i].im)
+            {
+                used[i] = used[j]       = true;
+                sectionPoles[groups][0] = poles[i];
+                sectionPoles[groups][1] = poles[j];
+                poleCount[groups++]     = 2;
+                break;
+            }
+        }
+    }
+    for (;;)
+    {
+        int16_t largest = -1;
+        for (uint8_t i = 0; i < D.poleCount; i++)
+        {
+            if (!used[i] && (largest < 0 || complexAbs(poles[i]) > complexAbs(poles[largest])))
+            {
+                largest = i;
+            }
+        }
+        if (largest < 0)
+        {
+            break;
+        }
+        used[largest]                             = true;
+        sectionPoles[groups][poleCount[groups]++] = poles[largest];
+        if (poleCount[groups] == 2)
+        {
+            groups++;
+        }
+    }
+    if (groups < SECTIONS && poleCount[groups] == 1)
+    {
+        groups++;
+    }
+
+    // Ordered by radius, the poles nearest the unit circle last
+    uint8_t order[SECTIONS];
+    real_t radius[SECTIONS];
+    for (uint8_t g = 0; g < groups; g++)
+    {
+        radius[g] = complexAbs(sectionPoles[g][0]);
+        if (poleCount[g] == 2)
+        {
+            radius[g] = std::fmax(radius[g], complexAbs(sectionPoles[g][1]));
+        }
+        order[g] = g;
+        for (uint8_t h = g; h > 0 && radius[order[h - 1]] > radius[order[h]]; h--)
+        {
+            const uint8_t swap = order[h];
+            order[h]           = order[h - 1];
+            order[h - 1]       = swap;
+        }
+    }
+
+    // The sections nearest the unit circle choose their zeros first, conjugate pairs before real
+    Complex sectionZeros[SECTIONS][2];
+    uint8_t zeroCount[SECTIONS] = {};
+    bool taken[N]               = {};
+    for (int16_t g = groups - 1; g >= 0; g--)
+    {
+        const uint8_t group = order[g];
+        const Complex pole  = sectionPoles[group][0];
+        int16_t nearest     = -1;
+        for (uint8_t i = 0; i < D.zeroCount && poleCount[group] == 2; i++)
+        {
+            if (!taken[i] && zeros[i].im > 0 &&
+                (nearest < 0 ||
+                 complexAbs(zeros[i] - pole) < complexAbs(zeros[nearest] - pole)))
+            {
+                nearest = i;
+            }
+        }
+        for (uint8_t j = 0; j < D.zeroCount && nearest >= 0; j++)
+        {
+            if (!taken[j] && zeros[j].re == zeros[nearest].re &&
+                zeros[j].im == -zeros[nearest].im)
+            {
+                taken[nearest] = taken[j] = true;
+                sectionZeros[group][0]    = zeros[nearest];
+                sectionZeros[group][1]    = zeros[j];
+                zeroCount[group]          = 2;
+                break;
+            }
+        }
+        while (zeroCount[group] < poleCount[group])
+        {
+            nearest = -1;
+            for (uint8_t i = 0; i < D.zeroCount; i++)
+            {
+                if (!taken[i] && zeros[i].im == 0 &&
+                    (nearest < 0 ||
+                     complexAbs(zeros[i] - pole) < complexAbs(zeros[nearest] - pole)))
+                {
+                    nearest = i;
+                }
+            }
+            if (nearest < 0)
+            {
+                break;
+            }
+            taken[nearest]                          = true;
+            sectionZeros[group][zeroCount[group]++] = zeros[nearest];
+        }
+    }
+
+    std::array<Coefficients<3, T>, (N + 1) / 2> sections;
+    for (uint8_t s = 0; s < SECTIONS; s++)
+    {
+        const real_t gain = s == 0 ? D.gain : 1;
+        sections[s].naturalResponseCoefficients = {1, 0, 0};
+        sections[s].forcedResponseCoefficients  = {static_cast<T>(gain), 0, 0};
+        if (s >= groups)
+        {
+            continue;
+        }
+        // Fewer zeros than poles is a delay inside the section, as in toCoefficients()
+        const uint8_t group = order[s];
+        const uint8_t delay = poleCount[group] - zeroCount[group];
+        real_t a[3];
+        real_t b[3];
+        expandRoots<2>(sectionPoles[group], poleCount[group], a);
+        expandRoots<2>(sectionZeros[group], zeroCount[group], b);
+        sections[s].forcedResponseCoefficients[0] = 0;
+        for (uint8_t i = 0; i <= poleCount[group]; i++)
+        {
+            sections[s].naturalResponseCoefficients[i] = static_cast<T>(a[i]);
+        }
+        for (uint8_t i = 0; i <= zeroCount[group]; i++)
+        {
+            sections[s].forcedResponseCoefficients[i + delay] = static_cast<T>(gain * b[i]);
+        }
+    }
+    return sections;
+}
+
+/**
+ * @brief Response of direct form coefficients at w rad/s.
+ */
+template <uint8_t SIZE, typename T>
+Complex frequencyResponse(const Coefficients<SIZE, T>& coefficients, real_t w, real_t Ts)
+{
+    std::array<real_t, SIZE> b;
+    std::array<real_t, SIZE> a;
+    for (uint8_t i = 0; i < SIZE; i++)
+    {
+        b[i] = coefficients.forcedResponseCoefficients[i];
+        a[i] = coefficients.naturalResponseCoefficients[i];
+    }
+    return evaluateFrequencyResponse<SIZE - 1>(b, a, w, Ts);
+}
+
+/**
+ * @brief Response of sections in series at w rad/s.
+ */
+template <size_t SECTIONS, typename T>
+Complex frequencyResponse(
+    const std::array<Coefficients<3, T>, SECTIONS>& sections,
+    real_t w,
+    real_t Ts)
+{
+    Complex response(1);
+    for (const Coefficients<3, T>& section : sections)
+    {
+        response = response * frequencyResponse(section, w, Ts);
+    }
+    return response;
+}
+
+/**
+ * @brief All poles in the left half plane, or inside the circle of `radius` in the z-domain.
+ */
+template <uint8_t N>
+bool isStable(const ZeroPoleGain<N>& H, real_t radius = 1)
+{
+    if (!H.valid())
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < H.poleCount; i++)
+    {
+        if (H.Ts > 0 ? !(complexAbs(H.poles[i]) < radius) : !(H.poles[i].re < 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief All roots of a inside the circle of `radius`, by the Schur-Cohn step down, without
+ * finding them. A radius below 1 asks for a stability margin, every mode decaying at least as
+ * fast as radius^n.
+ */
+template <uint8_t SIZE, typename T>
+bool isStable(const Coefficients<SIZE, T>& coefficients, real_t radius = 1)
+{
+    // a(radius z) has its roots inside the unit circle when a has them inside radius
+    real_t a[SIZE];
+    real_t scale = 1;
+    for (uint8_t k = 0; k < SIZE; k++)
+    {
+        a[k] = coefficients.naturalResponseCoefficients[k] * scale;
+        scale /= radius;
+    }
+    uint8_t n = SIZE - 1;
+    while (n > 0 && a[n] == 0)
+    {
+        n--;  // poles at the origin
+    }
+    if (a[0] == 0 || !std::isfinite(a[0]))
+    {
+        return false;
+    }
+    for (uint8_t k = 1; k <= n; k++) a[k] /= a[0];
+
+    for (; n > 0; n--)
+    {
+        // Reflection coefficient, the order drops by one while every |k| < 1
+        const real_t k = a[n];
+        if (!(std::fabs(k) < 1))
+        {
+            return false;
+        }
+        real_t lower[SIZE];
+        for (uint8_t i = 1; i < n; i++) lower[i] = (a[i] - k * a[n - i]) / (1 - k * k);
+        for (uint8_t i = 1; i < n; i++) a[i] = lower[i];
+    }
+    return true;
+}
+
+template <size_t SECTIONS, typename T>
+bool isStable(const std::array<Coefficients<3, T>, SECTIONS>& sections, real_t radius = 1)
+{
+    for (const Coefficients<3, T>& section : sections)
+    {
+        if (!isStable(section, radius))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}  // namespace filter
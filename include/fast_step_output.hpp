@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <soc/gpio_struct.h>
+
+#include "step_output_batch.hpp"
+
+/**
+ * @brief Direct access to the ESP32-S3 GPIO write-1-to-set / write-1-to-clear registers.
+ *
+ * Writing a mask only touches the pins in it, so no read-modify-write and no locking is needed.
+ * The pins must already be configured as outputs (AccelStepper does that in its constructor).
+ */
+class Esp32GpioRegisters
+{
+public:
+    /** Minimum STEP high time, the TMC5160 needs ~100 ns, leave some margin */
+    static constexpr uint32_t STEP_PULSE_NS = 250;
+    /** DIR to STEP setup time, the TMC5160 needs 20 ns, leave some margin */
+    static constexpr uint32_t DIR_SETUP_NS = 100;
+
+    Esp32GpioRegisters()
+        : pulseCycles_(getCpuFrequencyMhz() * STEP_PULSE_NS / 1000),
+          setupCycles_(getCpuFrequencyMhz() * DIR_SETUP_NS / 1000)
+    {
+    }
+
+    inline void IRAM_ATTR set(const GpioMask& mask)
+    {
+        if (mask.bank0)
+        {
+            GPIO.out_w1ts = mask.bank0;
+        }
+        if (mask.bank1)
+        {
+            GPIO.out1_w1ts.val = mask.bank1;
+        }
+    }
+
+    inline void IRAM_ATTR clear(const GpioMask& mask)
+    {
+        if (mask.bank0)
+        {
+            GPIO.out_w1tc = mask.bank0;
+        }
+        if (mask.bank1)
+        {
+            GPIO.out1_w1tc.val = mask.bank1;
+        }
+    }
+
+    inline void IRAM_ATTR holdPulse() { holdCycles(pulseCycles_); }
+
+    inline void IRAM_ATTR holdDirSetup() { holdCycles(setupCycles_); }
+
+private:
+    inline void IRAM_ATTR holdCycles(uint32_t cycles)
+    {
+        const uint32_t start = ESP.getCycleCount();
+        while (ESP.getCycleCount() - start < cycles)
+        {
+        }
+    }
+
+    uint32_t pulseCycles_;
+    uint32_t setupCycles_;
+};
+
+using FastStepOutput = StepOutputBatch<Esp32GpioRegisters>;
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Host frames received straight into a pool of buffers the parser works on in place.
+ *
+ * A frame on the link is
+ *
+ *     0xA5       sentinel
+ *     1 byte     type, SerialReceiverTransmitter::MessageType
+ *     4 bytes    body length, little endian
+ *     body
+ *
+ * The Assembler takes the bytes in whatever pieces they arrive and writes each body into a block
+ * of the Pool, the parser takes whole frames out of the pool and hands them on by Handle instead
+ * of copying them. A block is reused once every holder has released it.
+ *
+ * The pool is one ring of bytes, blocks are carved off it back to back in arrival order, so a
+ * frame costs its own size rather than the largest a frame can be. Blocks may be released in any
+ * order, the space is reused oldest first, a block still held keeps every later one too.
+ *
+ * One producer, one consumer: the Assembler and Pool::reserve()/commit() may run in a driver task
+ * while take()/retain()/release() run in loop(). Nothing here touches hardware, it is tested on the
+ * host.
+ */
+namespace frames
+{
+static constexpr uint8_t SENTINEL   = 0xA5;
+static constexpr size_t HEADER_SIZE = 5;     // after the sentinel, type and length
+static constexpr uint8_t SKIP       = 0xFF;  // block type of the unused end of the ring
+
+/** @brief Position of a block in the pool, what the holders of a frame keep */
+typedef uint32_t Handle;
+
+struct Frame
+{
+    Handle handle   = 0;
+    uint8_t type    = 0;
+    uint32_t length = 0;
+    char* body      = nullptr;  // `length` bytes and a terminator, may be modified in place
+    int64_t startUs = 0;        // when the sentinel arrived, in the producer's clock
+};
+
+class Pool
+{
+public:
+    /**
+     * @param storage 8 byte aligned, `size` bytes
+     * @param size a power of two
+     */
+    Pool(uint8_t* storage, uint32_t size) : storage_(storage), size_(size) {}
+
+    /* ------------------------------- producer ------------------------------- */
+
+    /**
+     * @brief Reserves a block for a body of `length` bytes, nullptr if it doesn't fit with
+     * `keepFree` bytes to spare. A new reserve() before commit() replaces it.
+     */
+    char* reserve(uint32_t length, uint32_t keepFree = 0)
+    {
+        const uint32_t span = align(sizeof(Block) + length + 1);
+        uint32_t at         = head_.load(std::memory_order_relaxed);
+        const uint32_t room = size_ - (at & (size_ - 1));
+        const uint32_t wrap = span > room ? room : 0;  // a block never runs past the end
+
+        const uint32_t used = at - tail_.load(std::memory_order_acquire);
+        if (span > size_ || used + wrap + span + keepFree > size_)
+        {
+            return nullptr;
+        }
+        if (wrap >= sizeof(Block))
+        {
+            Block* skip      = block(at);
+            skip->span       = wrap;
+            skip->type       = SKIP;
+            skip->references = 0;
+        }
+        at += wrap;
+        reserved_     = at;
+        reservedSpan_ = span;
+        return reinterpret_cast<char*>(block(at) + 1);
+    }
+
+    /** @brief Hands the reserved block to the consumer */
+    void commit(uint8_t type, uint32_t length, int64_t startUs)
+    {
+        Block* frame      = block(reserved_);
+        frame->span       = reservedSpan_;
+        frame->length     = length;
+        frame->type       = type;
+        frame->references = 0;
+        frame->startUs    = startUs;
+        head_.store(reserved_ + reservedSpan_, std::memory_order_release);
+    }
+
+    /* ------------------------------- consumer ------------------------------- */
+
+    /** @brief Oldest frame not yet taken, the caller holds it until release() */
+    bool take(Frame& frame)
+    {
+        const uint32_t head = head_.load(std::memory_order_acquire);
+        while (read_ != head)
+        {
+            Block* next = block(read_);
+            if (next == nullptr || next->type == SKIP)
+            {
+                read_ += spanAt(read_);
+                continue;
+            }
+            next->references = 1;
+            frame.handle     = read_;
+            frame.type       = next->type;
+            frame.length     = next->length;
+            frame.body       = reinterpret_cast<char*>(next + 1);
+            frame.startUs    = next->startUs;
+            read_ += next->span;
+            return true;
+        }
+        return false;
+    }
+
+    /** @brief One more holder of a taken frame */
+    void retain(Handle handle) { block(handle)->references++; }
+
+    /** @brief One holder less, the block is free for reuse after the last */
+    void release(Handle handle)
+    {
+        Block* frame = block(handle);
+        if (frame->references > 0 && --frame->references == 0)
+        {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            while (tail != read_ && (block(tail) == nullptr || block(tail)->references == 0))
+            {
+                tail += spanAt(tail);
+            }
+            tail_.store(tail, std::memory_order_release);
+        }
+    }
+
+    /** @brief Bytes not held or waiting, as the producer sees them */
+    uint32_t free() const
+    {
+        return size_ - (head_.load(std::memory_order_acquire) -
+                        tail_.load(std::memory_order_acquire));
+    }
+
+    uint32_t size() const { return size_; }
+
+private:
+    struct Block
+    {
+        int64_t startUs;
+        uint32_t span;  // bytes to the next block, a multiple of 8
+        uint32_t length;
+        uint8_t type;
+        uint8_t references;  // consumer side only
+    };
+
+    static uint32_t align(uint32_t bytes) { return (bytes + 7) & ~7u; }
+
+    /** @brief The block at `at`, nullptr where the ring's end has no room for one */
+    Block* block(uint32_t at) const
+    {
+        const uint32_t offset = at & (size_ - 1);
+        return size_ - offset < sizeof(Block) ? nullptr
+                                              : reinterpret_cast<Block*>(storage_ + offset);
+    }
+
+    uint32_t spanAt(uint32_t at) const
+    {
+        const Block* here = block(at);
+        return here != nullptr ? here->span : size_ - (at & (size_ - 1));
+    }
+
+    uint8_t* storage_;
+    uint32_t size_;
+
+    std::atomic<uint32_t> head_{0};  // end of the committed blocks, written by the producer
+    std::atomic<uint32_t> tail_{0};  // start of the oldest held block, written by the consumer
+    uint32_t reserved_     = 0;      // producer
+    uint32_t reservedSpan_ = 0;
+    uint32_t read_         = 0;  // consumer, next block to take
+};
+
+/**
+ * @brief Finds the frames in a byte stream and writes their bodies into the pool.
+ *
+ * Bytes before a sentinel are skipped, a length over `maxLength` can't be one of ours and starts
+ * the search over. A frame that doesn't fit in the pool is skipped and counted in dropped(). Frames
+ * of the `bulk` type have to leave `reserve` bytes free, so a flood of them can't keep a STOP or a
+ * PING out.
+ */
+class Assembler
+{
+public:
+    Assembler(Pool& pool, uint32_t maxLength, uint8_t bulk, uint32_t reserve)
+        : pool_(pool), maxLength_(maxLength), bulk_(bulk), reserve_(reserve)
+    {
+    }
+
+    /** @brief Takes `size` bytes of the stream, `now` stamps a frame whose sentinel is in them */
+    void feed(const uint8_t* data, size_t size, int64_t now)
+    {
+        while (size > 0)
+        {
+            size_t used = size;
+            switch (state_)
+            {
+                case HUNT:
+                {
+                    const void* sentinel = memchr(data, SENTINEL, size);
+                    if (sentinel == nullptr)
+                    {
+                        return;
+                    }
+                    used     = static_cast<const uint8_t*>(sentinel) - data + 1;
+                    startUs_ = now;
+                    got_     = 0;
+                    state_   = HEADER;
+                    break;
+                }
+                case HEADER:
+                    used = HEADER_SIZE - got_ < size ? HEADER_SIZE - got_ : size;
+                    memcpy(header_ + got_, data, used);
+                    got_ += used;
+                    if (got_ == HEADER_SIZE)
+                    {
+                        startBody();
+                    }
+                    break;
+                case BODY:
+                    used = length_ - got_ < size ? length_ - got_ : size;
+                    memcpy(body_ + got_, data, used);
+                    advance(used);
+                    break;
+                case DISCARD:
+                    used = length_ - got_ < size ? length_ - got_ : size;
+                    got_ += used;
+                    if (got_ == length_)
+                    {
+                        state_ = HUNT;
+                    }
+                    break;
+            }
+            data += used;
+            size -= used;
+        }
+    }
+
+    /**
+     * @brief Where the rest of the body goes, so a transport can read it there itself. nullptr
+     * between bodies, the bytes go through feed() then.
+     */
+    uint8_t* window(size_t& room)
+    {
+        if (state_ != BODY)
+        {
+            return nullptr;
+        }
+        room = length_ - got_;
+        return reinterpret_cast<uint8_t*>(body_) + got_;
+    }
+
+    /** @brief `size` bytes were written at window() */
+    void advance(size_t size)
+    {
+        got_ += size;
+        if (got_ == length_)
+        {
+            body_[length_] = '\0';
+            pool_.commit(type_, length_, startUs_);
+            state_ = HUNT;
+        }
+    }
+
+    /** @brief Drops a partial frame, the next one starts at a sentinel */
+    void reset() { state_ = HUNT; }
+
+    /** @brief Frames skipped for want of room, all types and the bulk type alone */
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint32_t droppedBulk() const { return droppedBulk_.load(std::memory_order_relaxed); }
+
+private:
+    enum State : uint8_t
+    {
+        HUNT,
+        HEADER,
+        BODY,
+        DISCARD
+    };
+
+    void startBody()
+    {
+        type_   = header_[0];
+        length_ = static_cast<uint32_t>(header_[1]) | static_cast<uint32_t>(header_[2]) << 8 |
+                  static_cast<uint32_t>(header_[3]) << 16 | static_cast<uint32_t>(header_[4]) << 24;
+        got_ = 0;
+        if (length_ > maxLength_)
+        {
+            state_ = HUNT;
+            return;
+        }
+        body_ = pool_.reserve(length_, type_ == bulk_ ? reserve_ : 0);
+        if (body_ == nullptr)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            if (type_ == bulk_)
+            {
+                droppedBulk_.fetch_add(1, std::memory_order_relaxed);
+            }
+            state_ = length_ > 0 ? DISCARD : HUNT;
+            return;
+        }
+        state_ = BODY;
+        if (length_ == 0)
+        {
+            advance(0);
+        }
+    }
+
+    Pool& pool_;
+    const uint32_t maxLength_;
+    const uint8_t bulk_;
+    const uint32_t reserve_;
+
+    State state_ = HUNT;
+    uint8_t header_[HEADER_SIZE];
+    uint8_t type_    = 0;
+    uint32_t length_ = 0;
+    uint32_t got_    = 0;  // of the header or the body
+    char* body_      = nullptr;
+    int64_t startUs_ = 0;
+
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<uint32_t> droppedBulk_{0};
+};
+
+/**
+ * @brief Moves what `source` has received into `assembler`, bodies are read straight into their
+ * blocks. `source` has available() and read(uint8_t*, size_t) like a ByteTransport.
+ */
+template <typename Source>
+void drain(Source& source, Assembler& assembler, int64_t now)
+{
+    uint8_t between[HEADER_SIZE + 1];  // sentinel and header, read a frame's worth at most
+    int ready = source.available();
+    while (ready > 0)
+    {
+        size_t room;
+        uint8_t* into = assembler.window(room);
+        if (into == nullptr)
+        {
+            into = between;
+            room = sizeof(between);
+        }
+        const size_t got = source.read(into, room < static_cast<size_t>(ready) ? room : ready);
+        if (got == 0)
+        {
+            return;
+        }
+        if (into == between)
+        {
+            assembler.feed(between, got, now);
+        }
+        else
+        {
+            assembler.advance(got);
+        }
+        ready -= static_cast<int>(got);
+    }
+}
+}  // namespace frames
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "hot_path.hpp"
+
+/**
+ * @brief Excitation and recording for measuring the frequency response of an axis.
+ *
+ * The control tick adds Perturbation::next() to the velocity command of the axis under test and
+ * pushes what it commanded and what the AS5048A measured into a SampleRing. The foreground drains
+ * the ring over serial and serverside/bode_identification.py turns the record into gain, phase
+ * and coherence. Nothing in here touches hardware so it can be tested on the host.
+ */
+namespace identification
+{
+enum Mode : uint8_t
+{
+    CHIRP = 0,     ///< Exponential sweep from fStart to fEnd over the whole duration
+    STEPPED_SINE,  ///< `steps` log spaced tones, each held for duration / steps
+};
+
+struct Config
+{
+    Mode mode       = CHIRP;
+    float amplitude = 0.0f;    ///< Peak velocity perturbation in axis units/s
+    float fStart    = 1.0f;    ///< First frequency in Hz
+    float fEnd      = 100.0f;  ///< Last frequency in Hz, must stay below the Nyquist limit
+    float duration  = 10.0f;   ///< Length of the whole run in seconds
+    uint16_t steps  = 20;      ///< Number of tones for STEPPED_SINE
+    float Ts        = 1e-3f;   ///< Sample time of the tick calling next()
+};
+
+/** @brief One record of the identification, streamed as a line to the host */
+struct Sample
+{
+    uint32_t index;   ///< Tick number since the start of the run
+    float frequency;  ///< Instantaneous excitation frequency in Hz
+    float command;    ///< Velocity perturbation that was commanded
+    float response;   ///< Velocity measured by the encoder
+};
+
+/**
+ * @brief Generates the chirp or stepped-sine perturbation one sample at a time.
+ *
+ * The phase is accumulated rather than computed from t so it stays continuous across the
+ * frequency steps, a phase jump would be a velocity step and excite everything at once.
+ */
+class Perturbation
+{
+public:
+    Perturbation() {}
+
+    /**
+     * @brief Validates the configuration and arms the generator.
+     *
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if the frequencies are not within (0, 0.4 / Ts),
+     * the duration is too short for a single period of fStart or one tick per tone, or the
+     * amplitude is not positive.
+     */
+    int start(const Config& cfg)
+    {
+        const float fMax = 0.4f / cfg.Ts;
+        if (cfg.Ts <= 0.0f || cfg.amplitude <= 0.0f || cfg.fStart <= 0.0f || cfg.fEnd <= 0.0f ||
+            cfg.fStart > fMax || cfg.fEnd > fMax || cfg.duration * cfg.fStart < 1.0f ||
+            (cfg.mode == STEPPED_SINE && (cfg.steps == 0 || cfg.duration / cfg.Ts < cfg.steps)))
+        {
+            active_ = false;
+            return EXIT_FAILURE;
+        }
+
+        cfg_          = cfg;
+        totalSamples_ = static_cast<uint32_t>(cfg.duration / cfg.Ts + 0.5f);
+        sample_       = 0;
+        phase_        = 0.0f;
+        frequency_    = cfg.fStart;
+        active_       = true;
+
+        if (cfg.mode == CHIRP)
+        {
+            // f[n + 1] = f[n] * ratio reaches fEnd on the last sample
+            ratio_ = std::pow(cfg.fEnd / cfg.fStart, 1.0f / static_cast<float>(totalSamples_ - 1));
+        }
+        else
+        {
+            samplesPerStep_ = totalSamples_ / cfg.steps;
+            ratio_          = cfg.steps > 1 ? std::pow(cfg.fEnd / cfg.fStart,
+                                                   1.0f / static_cast<float>(cfg.steps - 1))
+                                            : 1.0f;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    /** @brief Aborts the run, next() returns 0 from now on */
+    void stop() { active_ = false; }
+
+    bool active() const { return active_; }
+
+    /** @brief Frequency of the sample returned by the last call to next() */
+    float frequency() const { return frequency_; }
+
+    uint32_t sampleIndex() const { return sample_; }
+    uint32_t totalSamples() const { return totalSamples_; }
+    const Config& config() const { return cfg_; }
+
+    /**
+     * @brief Advances one sample, call once per control tick.
+     *
+     * @return the velocity perturbation for this tick, 0 once the run is finished
+     */
+    float HOT_PATH next()
+    {
+        if (!active_)
+        {
+            return 0.0f;
+        }
+        if (sample_ >= totalSamples_)
+        {
+            active_ = false;
+            return 0.0f;
+        }
+
+        if (cfg_.mode == CHIRP && sample_ > 0)
+        {
+            frequency_ *= ratio_;
+        }
+        else if (cfg_.mode == STEPPED_SINE && sample_ > 0 && sample_ % samplesPerStep_ == 0 &&
+                 sample_ / samplesPerStep_ < cfg_.steps)
+        {
+            frequency_ *= ratio_;
+        }
+
+        const float value = cfg_.amplitude * std::sin(phase_);
+
+        phase_ += TAU * frequency_ * cfg_.Ts;
+        if (phase_ >= TAU)
+        {
+            phase_ -= TAU;
+        }
+
+        sample_++;
+        return value;
+    }
+
+private:
+    static constexpr float TAU = 6.28318530718f;
+
+    Config cfg_;
+    uint32_t totalSamples_   = 0;
+    uint32_t samplesPerStep_ = 1;
+    uint32_t sample_         = 0;
+    float phase_             = 0.0f;
+    float frequency_         = 0.0f;
+    float ratio_             = 1.0f;
+    bool active_             = false;
+};
+
+/**
+ * @brief Fixed size FIFO between the control tick (push) and the serial stream (pop).
+ *
+ * Both ends run in loop() so no locking is needed. When the host cannot keep up the newest
+ * samples are dropped and counted, the host sees the gaps in Sample::index.
+ */
+template <uint16_t N>
+class SampleRing
+{
+public:
+    bool push(const Sample& sample)
+    {
+        if (count_ == N)
+        {
+            dropped_++;
+            return false;
+        }
+        buffer_[(head_ + count_) % N] = sample;
+        count_++;
+        return true;
+    }
+
+    bool pop(Sample& sample)
+    {
+        if (count_ == 0)
+        {
+            return false;
+        }
+        sample = buffer_[head_];
+        head_  = (head_ + 1) % N;
+        count_--;
+        return true;
+    }
+
+    void clear()
+    {
+        head_    = 0;
+        count_   = 0;
+        dropped_ = 0;
+    }
+
+    uint16_t size() const { return count_; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    Sample buffer_[N];
+    uint16_t head_    = 0;
+    uint16_t count_   = 0;
+    uint32_t dropped_ = 0;
+};
+}  // namespace identification
@@ -0,0 +1,24 @@
+#pragma once
+
+/**
+ * @brief Places a function in the curated hot-path section in IRAM.
+ *
+ * Code executed from flash goes through the cache and can stall on a miss, used on the step
+ * generation, ISRs and the control tick so their timing doesn't depend on what else ran. The
+ * sections are named `.iram1.hot.<n>`, the default ESP-IDF linker script already maps `.iram1.*`
+ * into IRAM and the `hot` tag lets scripts/linker_map.py report them as a group.
+ *
+ * Define HOT_PATH_IN_FLASH to leave everything in flash (e.g. to compare timing or when IRAM runs
+ * out). Expands to nothing on the host.
+ *
+ * @note IRAM alone doesn't keep code running during a flash write, the caches are disabled and the
+ * other core is paused. Only write flash while Cleaner::isMotionIdle() holds.
+ */
+#define HOT_PATH_STRINGIFY_(x) #x
+#define HOT_PATH_STRINGIFY(x)  HOT_PATH_STRINGIFY_(x)
+
+#if defined(ESP32) && !defined(HOT_PATH_IN_FLASH)
+#define HOT_PATH __attribute__((section(".iram1.hot." HOT_PATH_STRINGIFY(__COUNTER__))))
+#else
+#define HOT_PATH
+#endif
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "hot_path.hpp"
+
+/**
+ * @brief Input shaping of the per tick position reference.
+ *
+ * A shaper convolves the reference with a few impulses spaced over one damped period of the
+ * resonance, the vibration excited by each impulse cancels the others. The classic designs are
+ *
+ * - ZV:  2 impulses over Td / 2, shortest, sensitive to frequency error
+ * - ZVD: 3 impulses over Td, tolerates roughly +-20 % frequency error
+ * - EI:  3 impulses over Td, allows `tolerance` residual vibration at the design frequency to
+ *        tolerate roughly +-30 % frequency error
+ *
+ * with Td = 1 / (f sqrt(1 - zeta^2)). The EI amplitudes are the undamped ones with the same
+ * damping correction as ZVD, which is accurate for the light damping (zeta < 0.2) of a
+ * cantilevered part.
+ *
+ * The cost is latency, the shaped reference finishes `duration()` after the unshaped one. Several
+ * axes stay synchronised by giving each shaper an extra pure delay so all of them end up with the
+ * same total delay.
+ *
+ * A step in the target is shaped as a Trajectory, the trapezoid the axis will actually move, so
+ * the deceleration into the target is shaped as well as the start.
+ */
+namespace shaping
+{
+enum Type : uint8_t
+{
+    NONE = 0,  ///< Pure delay, used to keep unshaped axes in step with shaped ones
+    ZV,
+    ZVD,
+    EI,
+};
+
+struct Params
+{
+    Type type       = NONE;
+    float frequency = 10.0f;  ///< Resonance frequency, Hz
+    float damping   = 0.05f;  ///< Damping ratio of the resonance
+    float tolerance = 0.05f;  ///< EI only, residual vibration allowed at the design frequency
+
+    constexpr Params() {}
+    constexpr Params(Type type_, float frequency_, float damping_, float tolerance_ = 0.05f)
+        : type(type_),
+          frequency(frequency_),
+          damping(damping_),
+          tolerance(tolerance_)
+    {
+    }
+};
+
+inline const char* typeName(Type type)
+{
+    switch (type)
+    {
+        case ZV:
+            return "ZV";
+        case ZVD:
+            return "ZVD";
+        case EI:
+            return "EI";
+        default:
+            return "NONE";
+    }
+}
+
+struct Impulses
+{
+    static constexpr uint8_t MAX = 3;
+
+    uint8_t count = 1;
+    float amplitude[MAX] = {1.0f, 0.0f, 0.0f};
+    float time[MAX]      = {0.0f, 0.0f, 0.0f};  ///< Seconds after the first impulse
+};
+
+/**
+ * @brief Closed form impulse sequence of a shaper, amplitudes sum to 1.
+ *
+ * @return the impulses, a single unit impulse for NONE or an invalid frequency/damping
+ */
+inline Impulses design(const Params& params)
+{
+    Impulses impulses;
+    if (params.type == NONE || params.frequency <= 0.0f || params.damping < 0.0f ||
+        params.damping >= 1.0f)
+    {
+        return impulses;
+    }
+
+    const float zeta = params.damping;
+    const float root = std::sqrt(1.0f - zeta * zeta);
+    const float Td   = 1.0f / (params.frequency * root);
+    const float K    = std::exp(-zeta * 3.14159265359f / root);
+
+    switch (params.type)
+    {
+        case ZV:
+            impulses.count        = 2;
+            impulses.amplitude[0] = 1.0f;
+            impulses.amplitude[1] = K;
+            break;
+        case ZVD:
+            impulses.count        = 3;
+            impulses.amplitude[0] = 1.0f;
+            impulses.amplitude[1] = 2.0f * K;
+            impulses.amplitude[2] = K * K;
+            break;
+        case EI:
+            impulses.count        = 3;
+            impulses.amplitude[0] = (1.0f + params.tolerance) / 4.0f;
+            impulses.amplitude[1] = (1.0f - params.tolerance) / 2.0f * K;
+            impulses.amplitude[2] = (1.0f + params.tolerance) / 4.0f * K * K;
+            break;
+        default:
+            break;
+    }
+
+    float sum = 0.0f;
+    for (uint8_t i = 0; i < impulses.count; i++)
+    {
+        impulses.time[i] = 0.5f * Td * i;
+        sum += impulses.amplitude[i];
+    }
+    for (uint8_t i = 0; i < impulses.count; i++)
+    {
+        impulses.amplitude[i] /= sum;
+    }
+    return impulses;
+}
+
+/**
+ * @brief Applies a shaper to a reference sampled every Ts.
+ *
+ * @tparam HISTORY samples of reference kept, bounds shaper duration + extra delay to
+ * (HISTORY - 1) * Ts
+ */
+template <uint16_t HISTORY>
+class InputShaper
+{
+public:
+    InputShaper() { reset(0.0f); }
+
+    /**
+     * @brief Sets up the shaper. Any reference already in the history is kept, so only
+     * reconfigure while the reference is not changing or the output jumps.
+     *
+     * @param params shaper type and the resonance it targets
+     * @param Ts sample time of shape()
+     * @param extraDelay seconds of pure delay added in front of the shaper, for synchronisation
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if the shaper and delay do not fit in HISTORY, in
+     * which case the previous configuration is kept
+     */
+    int configure(const Params& params, float Ts, float extraDelay = 0.0f)
+    {
+        Impulses impulses = design(params);
+        uint16_t delays[Impulses::MAX];
+        for (uint8_t i = 0; i < impulses.count; i++)
+        {
+            const float ticks = (impulses.time[i] + extraDelay) / Ts + 0.5f;
+            if (ticks < 0.0f || ticks > HISTORY - 1)
+            {
+                return EXIT_FAILURE;
+            }
+            delays[i] = static_cast<uint16_t>(ticks);
+        }
+
+        params_   = params;
+        impulses_ = impulses;
+        Ts_       = Ts;
+        for (uint8_t i = 0; i < impulses.count; i++)
+        {
+            delay_[i] = delays[i];
+        }
+        return EXIT_SUCCESS;
+    }
+
+    /**
+     * @brief Pushes the newest reference sample and returns the shaped one.
+     */
+    HOT_PATH float shape(float reference)
+    {
+        head_           = head_ + 1 == HISTORY ? 0 : head_ + 1;
+        history_[head_] = reference;
+
+        float shaped = 0.0f;
+        for (uint8_t i = 0; i < impulses_.count; i++)
+        {
+            uint16_t index = head_ >= delay_[i] ? head_ - delay_[i] : head_ + HISTORY - delay_[i];
+            shaped += impulses_.amplitude[i] * history_[index];
+        }
+        return shaped;
+    }
+
+    /** @brief Fills the history with `value`, the output is `value` until the reference moves */
+    void reset(float value)
+    {
+        for (auto& sample : history_)
+        {
+            sample = value;
+        }
+        head_ = 0;
+    }
+
+    /** @brief Time from the reference changing to the shaped reference settling, s */
+    float duration() const { return delay_[impulses_.count - 1] * Ts_; }
+
+    /** @brief Amplitude weighted mean delay of the shaped reference, s */
+    float meanDelay() const
+    {
+        float delay = 0.0f;
+        for (uint8_t i = 0; i < impulses_.count; i++)
+        {
+            delay += impulses_.amplitude[i] * delay_[i] * Ts_;
+        }
+        return delay;
+    }
+
+    /** @brief Length of the shaper itself without the extra synchronisation delay, s */
+    float shaperDuration() const { return impulses_.time[impulses_.count - 1]; }
+
+    const Params& params() const { return params_; }
+
+private:
+    Params params_;
+    Impulses impulses_;
+    uint16_t delay_[Impulses::MAX] = {0, 0, 0};
+    float Ts_                      = 1e-3f;
+    float history_[HISTORY];
+    uint16_t head_ = 0;
+};
+
+/**
+ * @brief Time-optimal trapezoid towards a target that may change at any tick, sampled every Ts.
+ *
+ * The velocity follows the braking curve of the sampled profile, v² / 2a + v Ts / 2 = d, limited
+ * to the max speed and to a change of a Ts per tick. The tick that would pass the target lands on
+ * it instead.
+ */
+class Trajectory
+{
+public:
+    Trajectory() { reset(0.0f); }
+
+    /** @brief Stands still at `position` */
+    void reset(float position)
+    {
+        position_ = position;
+        velocity_ = 0.0f;
+    }
+
+    /**
+     * @brief Advances one tick towards `target`.
+     *
+     * @param target where the axis should stop, units
+     * @param maxSpeed units / s
+     * @param acceleration units / s², 0 or less jumps to the target
+     * @param Ts sample time, s
+     * @return the position at the end of the tick
+     */
+    HOT_PATH float next(float target, float maxSpeed, float acceleration, float Ts)
+    {
+        const float distance = target - position_;
+        if (!(acceleration > 0.0f && maxSpeed > 0.0f))
+        {
+            reset(target);
+            return position_;
+        }
+
+        const float dv      = acceleration * Ts;
+        const float braking =
+            0.5f * (std::sqrt(dv * dv + 8.0f * acceleration * std::fabs(distance)) - dv);
+        float velocity      = std::fmin(braking, maxSpeed);
+        velocity            = distance < 0.0f ? -velocity : velocity;
+        velocity            = std::fmax(velocity_ - dv, std::fmin(velocity_ + dv, velocity));
+
+        if (velocity * distance >= 0.0f && std::fabs(distance) <= std::fabs(velocity) * Ts)
+        {
+            reset(target);
+            return position_;
+        }
+        velocity_ = velocity;
+        position_ += velocity * Ts;
+        return position_;
+    }
+
+    float position() const { return position_; }
+    float velocity() const { return velocity_; }
+
+private:
+    float position_;
+    float velocity_;
+};
+}  // namespace shaping
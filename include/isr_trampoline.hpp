@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR  // host builds have no IRAM
+#endif
+
+/**
+ * @brief Compile-time generated `void()` interrupt stub that forwards to a member function.
+ *
+ * attachInterrupt() only takes a plain function pointer. Every (Class, Member, Slot) combination
+ * instantiates its own static stub and its own static instance pointer, so there is no runtime
+ * table, nothing is allocated and there is no limit on how many can exist. Use a different Slot
+ * when more than one object of the same class needs the same member as an ISR.
+ *
+ * The stub is placed in IRAM so it can run while the flash cache is disabled, the member it calls
+ * should be marked IRAM_ATTR as well.
+ *
+ * @code
+ *    attachInterrupt(pin, bindIsr<Cleaner, &Cleaner::PCFMessageRec>(this), CHANGE);
+ * @endcode
+ *
+ * @tparam Class class owning the handler
+ * @tparam Member handler, must be `void Class::member()`
+ * @tparam Slot distinguishes several instances of the same class/member pair
+ */
+template <typename Class, void (Class::*Member)(), uint8_t Slot = 0>
+class IsrTrampoline
+{
+public:
+    typedef void (*Isr)();
+
+    /** @brief Points the stub at an instance and returns the stub to hand to attachInterrupt() */
+    static Isr bind(Class* instance)
+    {
+        instance_ = instance;
+        return &isr;
+    }
+
+    /** @brief Detaches the instance, the stub becomes a no-op */
+    static void unbind() { instance_ = nullptr; }
+
+    static Class* instance() { return instance_; }
+
+    /** @brief The interrupt stub itself */
+    static void IRAM_ATTR isr()
+    {
+        Class* instance = instance_;
+        if (instance != nullptr)
+        {
+            (instance->*Member)();
+        }
+    }
+
+private:
+    static Class* volatile instance_;
+};
+
+template <typename Class, void (Class::*Member)(), uint8_t Slot>
+Class* volatile IsrTrampoline<Class, Member, Slot>::instance_ = nullptr;
+
+/**
+ * @brief Shorthand for IsrTrampoline<Class, Member, Slot>::bind(instance)
+ */
+template <typename Class, void (Class::*Member)(), uint8_t Slot = 0>
+inline typename IsrTrampoline<Class, Member, Slot>::Isr bindIsr(Class* instance)
+{
+    return IsrTrampoline<Class, Member, Slot>::bind(instance);
+}
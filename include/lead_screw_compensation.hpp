@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "hot_path.hpp"
+
+namespace compensation
+{
+static constexpr uint8_t PITCH_POINTS = 16;
+
+/**
+ * @brief Measured errors of one lead screw axis. Plain data, stored as is in the persistent
+ * config. Any change to the layout needs PersistentConfig::VERSION bumped, the stored calibration
+ * is then discarded and has to be measured again.
+ */
+struct Settings
+{
+    float start      = 0.0f;  ///< mm, position of errors[0]
+    float spacing    = 0.0f;  ///< mm between two points of the table, 0 disables the table
+    uint8_t points   = 0;     ///< entries of errors[] in use
+    float backlash   = 0.0f;  ///< mm of lost motion on a direction reversal, 0 disables it
+    float takeupRate = 5.0f;  ///< mm/s the backlash is taken up at, 0 takes it up in one tick
+    float errors[PITCH_POINTS] = {};  ///< mm, travel measured minus commanded at each point
+};
+
+/**
+ * @brief Corrects the commanded position of a lead screw axis for its pitch error and backlash.
+ *
+ * The pitch error is a table of measured errors at evenly spaced positions, linearly interpolated
+ * in between and held flat past either end. The position is moved against the error so the
+ * carriage lands where it was commanded.
+ *
+ * Backlash is tracked from the direction of the reference. Moving towards + needs the screw
+ * `backlash` further along than moving towards -, the difference is ramped in at takeupRate so
+ * the reversal doesn't show up as a jump in the step stream. A reversal only counts once the
+ * reference is REVERSAL_HYSTERESIS back from where it turned, jitter at a standstill doesn't take
+ * the lash up and down.
+ *
+ * Everything per tick is O(1): one index, one lerp and one clamped ramp.
+ */
+class LeadScrewCompensator
+{
+public:
+    static constexpr float REVERSAL_HYSTERESIS = 0.002f;  // mm
+
+    LeadScrewCompensator() = default;
+
+    /**
+     * @brief Sets the table and backlash. The backlash already taken up is kept.
+     *
+     * @param settings measured errors of the axis
+     * @param Ts control period in seconds, the takeup rate is converted to mm per tick
+     * @return EXIT_SUCCESS, or EXIT_FAILURE leaving the previous settings if any field is out of
+     * range
+     */
+    int configure(const Settings& settings, float Ts)
+    {
+        if (settings.points > PITCH_POINTS || !(settings.spacing >= 0.0f) ||
+            !(settings.backlash >= 0.0f) || !(settings.takeupRate >= 0.0f) || !(Ts > 0.0f) ||
+            !std::isfinite(settings.start))
+        {
+            return EXIT_FAILURE;
+        }
+        for (uint8_t i = 0; i < settings.points; i++)
+        {
+            if (!std::isfinite(settings.errors[i]))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        settings_    = settings;
+        invSpacing_  = settings.spacing > 0.0f ? 1.0f / settings.spacing : 0.0f;
+        takeupStep_  = settings.takeupRate > 0.0f ? settings.takeupRate * Ts : settings.backlash;
+        tableActive_ = settings.points >= 2 && invSpacing_ > 0.0f;
+        return EXIT_SUCCESS;
+    }
+
+    /**
+     * @brief Starts over at `reference` with the lash taken up towards -, as it is after homing
+     * towards the negative end.
+     */
+    void reset(float reference)
+    {
+        turn_       = reference;
+        positive_   = false;
+        takenUp_    = 0.0f;
+        correction_ = -pitchError(reference);
+    }
+
+    /** @brief Position to command the motor to for `reference`, called once per control tick */
+    HOT_PATH float apply(float reference)
+    {
+        // Follow the reference while it keeps going, flip once it came back past the hysteresis
+        if (positive_ ? reference > turn_ : reference < turn_)
+        {
+            turn_ = reference;
+        }
+        else if (std::fabs(reference - turn_) > REVERSAL_HYSTERESIS)
+        {
+            positive_ = !positive_;
+            turn_     = reference;
+        }
+
+        const float target = positive_ ? settings_.backlash : 0.0f;
+        const float delta  = target - takenUp_;
+        takenUp_ += delta > takeupStep_ ? takeupStep_
+                                        : (delta < -takeupStep_ ? -takeupStep_ : delta);
+
+        correction_ = takenUp_ - pitchError(reference);
+        return reference + correction_;
+    }
+
+    /** @brief Interpolated pitch error at `position`, mm */
+    HOT_PATH float pitchError(float position) const
+    {
+        if (!tableActive_)
+        {
+            return 0.0f;
+        }
+        const float x = (position - settings_.start) * invSpacing_;
+        if (x <= 0.0f)
+        {
+            return settings_.errors[0];
+        }
+        const uint8_t last = settings_.points - 1;
+        if (x >= last)
+        {
+            return settings_.errors[last];
+        }
+        const uint8_t i    = static_cast<uint8_t>(x);
+        const float weight = x - i;
+        return settings_.errors[i] + weight * (settings_.errors[i + 1] - settings_.errors[i]);
+    }
+
+    /** @brief Offset added by the last apply(), mm */
+    float correction() const { return correction_; }
+
+    /** @brief Part of the backlash currently taken up, 0 to backlash */
+    float takenUp() const { return takenUp_; }
+
+    const Settings& settings() const { return settings_; }
+
+private:
+    Settings settings_;
+    float invSpacing_  = 0.0f;
+    float takeupStep_  = 0.0f;  // mm per tick
+    bool tableActive_  = false;
+
+    float turn_       = 0.0f;  // furthest point of the reference in the current direction
+    bool positive_    = false;
+    float takenUp_    = 0.0f;
+    float correction_ = 0.0f;
+};
+}  // namespace compensation
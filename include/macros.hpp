@@ -23,16 +23,17 @@
         }                                                                                  \
     } while (0)
 
-#define DO_EVERY(seconds, block)                      \
-    do                                                \
-    {                                                 \
-        static unsigned long _lastRunTime = 0;        \
-        unsigned long _now                = millis(); \
-        if (_now - _lastRunTime >= (seconds * 1e3))   \
-        {                                             \
-            _lastRunTime = _now;                      \
-            block;                                    \
-        }                                             \
+// The period is rounded to whole ms, 1e-3f is a hair over 1 ms and would only run every 2 ms
+#define DO_EVERY(seconds, block)                                                      \
+    do                                                                                \
+    {                                                                                 \
+        static unsigned long _lastRunTime = 0;                                        \
+        unsigned long _now                = millis();                                 \
+        if (_now - _lastRunTime >= static_cast<unsigned long>((seconds) * 1e3 + 0.5)) \
+        {                                                                             \
+            _lastRunTime = _now;                                                      \
+            block;                                                                    \
+        }                                                                             \
     } while (0)
 
 template<class Callable>
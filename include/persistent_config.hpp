@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "lead_screw_compensation.hpp"
+
+/**
+ * @brief Machine calibration kept across power cycles in the NVS partition (ESP32 Preferences).
+ *
+ * Everything lives in one blob behind a version word, a blob written by firmware with another
+ * layout is ignored rather than misread. Bump VERSION whenever Data changes.
+ *
+ * @warning Writing NVS pauses both cores while the flash is erased, only call save() while
+ * Cleaner::isMotionIdle() holds.
+ */
+class PersistentConfig
+{
+public:
+    struct Data
+    {
+        compensation::Settings jawPosition;  ///< lead screw of the jaw position (Y) axis
+    };
+
+    PersistentConfig() = default;
+
+    /**
+     * @brief Reads the stored calibration into data().
+     *
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if nothing valid is stored, data() keeps the defaults
+     */
+    int load();
+
+    /**
+     * @brief Writes data() to flash.
+     *
+     * @return EXIT_SUCCESS or EXIT_FAILURE if the NVS write failed
+     */
+    int save();
+
+    Data& data() { return data_; }
+
+private:
+    static constexpr uint32_t VERSION      = 1;
+    static constexpr const char* NAMESPACE = "cleaner";
+    static constexpr const char* KEY       = "config";
+
+    struct Blob
+    {
+        uint32_t version;
+        Data data;
+    };
+
+    Data data_;
+};
@@ -55,4 +55,24 @@ constexpr static uint8_t CLAMP_POT_PIN                 = A1;   // Pin for curren
 constexpr static uint8_t ROLL_BRAKE_BUT_PIN            = 12;   // Pin for the roller brake input
 constexpr static uint8_t ROLL_BRAKE_REAL_PIN           = A3;   // Pin for actual brake
 constexpr static uint8_t MODE_PIN                      = 11;   // Pin for mode control
-constexpr static uint8_t ESTOP_PIN                     = 255;  // Pin for emergency stop
\ No newline at end of file
+constexpr static uint8_t ESTOP_PIN                     = 255;  // Pin for emergency stop
+
+/* -------------------------------------------------------------------------- */
+/*                         RS-485 LINK (TRANSPORT_UART)                       */
+/* -------------------------------------------------------------------------- */
+constexpr static uint8_t RS485_RX_PIN = A0;  // Pin for the transceiver's RO
+constexpr static uint8_t RS485_TX_PIN = A2;  // Pin for the transceiver's DI
+constexpr static uint8_t RS485_DE_PIN = A6;  // Pin for the transceiver's DE and /RE
+
+/**
+ * @brief Converts an Arduino pin number into the raw GPIO number used by the IDF drivers and the
+ * GPIO registers. The Nano ESP32 remaps D0..D13/A0..A7 by default, the IDF knows nothing of that.
+ */
+inline uint8_t gpioNumber(uint8_t pin)
+{
+#ifdef BOARD_HAS_PIN_REMAP
+    return digitalPinToGPIONumber(pin);
+#else
+    return pin;
+#endif
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief Stored G-code programs in their compact binary form, and the linker and interpreter
+ * that run them on the device.
+ *
+ * A program is compiled line by line at upload time (see ProgramStore::compile) into 16 byte Ops,
+ * so nothing is parsed while it runs. Besides the motion commands it may contain
+ *
+ *     M808 L<n>      start of a block repeated n times, L0 repeats until stopped
+ *     M808           end of the innermost block
+ *     M98 P<name>    runs another stored program, then carries on
+ *
+ * Before a run the program and everything it calls is linked into one Image in RAM, the run
+ * itself never touches flash.
+ */
+namespace program
+{
+static constexpr uint8_t NAME_LENGTH = 12;  // including the terminator
+
+enum OpCode : uint8_t
+{
+    END = 0,           ///< end of the linked image
+    MOVE,              ///< G0/G1, values are y, a, c, flags bit 0 the brake
+    DWELL,             ///< G4, values[0] is milliseconds
+    HOME,              ///< G28, flags bit 0 y, bit 1 a, bit 2 c
+    SET_SPEED,         ///< M80, values are y, a, c, 0 keeps the axis
+    SET_ACCELERATION,  ///< M17, values are y, a, c, 0 keeps the axis
+    LOOP_START,        ///< arg is the repeat count, 0 forever
+    LOOP_END,
+    CALL,              ///< name is the program, arg its offset once linked
+    RETURN,            ///< end of a called program in the linked image
+};
+
+enum AxisFlags : uint8_t
+{
+    AXIS_Y = 1 << 0,
+    AXIS_A = 1 << 1,
+    AXIS_C = 1 << 2,
+};
+
+struct Op
+{
+    OpCode code;
+    uint8_t flags;
+    uint16_t arg;
+    union
+    {
+        float values[3];  ///< y, a, c
+        char name[NAME_LENGTH];
+    };
+};
+static_assert(sizeof(Op) == 16, "programs are stored as 16 byte ops");
+
+/** @brief Reads the ops of a stored program, see ProgramStore::loader */
+typedef int (*Loader)(void* context, const char* name, Op* ops, uint16_t capacity,
+                      uint16_t& count);
+
+/**
+ * @brief One program and every program it calls, laid out back to back with the calls resolved.
+ *
+ * @tparam CAPACITY ops of RAM set aside for the image
+ * @tparam PROGRAMS most distinct programs one image may pull in
+ */
+template <uint16_t CAPACITY, uint8_t PROGRAMS = 8>
+class Image
+{
+public:
+    /**
+     * @brief Loads `main` and, transitively, every program it calls.
+     *
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if a program is missing or it all doesn't fit, the
+     * image is left empty
+     */
+    int link(const char* main, Loader load, void* context)
+    {
+        size_     = 0;
+        programs_ = 0;
+        if (append(main, END, load, context) != EXIT_SUCCESS)
+        {
+            return fail();
+        }
+
+        // Every program appended here is scanned by the same loop
+        for (uint16_t i = 0; i < size_; i++)
+        {
+            Op& op = ops_[i];
+            if (op.code != CALL)
+            {
+                continue;
+            }
+            int16_t target = find(op.name);
+            if (target < 0)
+            {
+                target = static_cast<int16_t>(size_);
+                if (append(op.name, RETURN, load, context) != EXIT_SUCCESS)
+                {
+                    return fail();
+                }
+            }
+            op.arg = static_cast<uint16_t>(target);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    const Op* ops() const { return ops_; }
+    uint16_t size() const { return size_; }
+
+private:
+    int append(const char* name, OpCode terminator, Loader load, void* context)
+    {
+        if (programs_ >= PROGRAMS || size_ >= CAPACITY)
+        {
+            return EXIT_FAILURE;
+        }
+        uint16_t count = 0;
+        // One op is kept for the terminator
+        if (load(context, name, &ops_[size_], CAPACITY - size_ - 1, count) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        strncpy(names_[programs_], name, NAME_LENGTH - 1);
+        names_[programs_][NAME_LENGTH - 1] = '\0';
+        offsets_[programs_++]              = size_;
+
+        size_ += count;
+        ops_[size_]      = Op();
+        ops_[size_].code = terminator;
+        size_++;
+        return EXIT_SUCCESS;
+    }
+
+    int16_t find(const char* name) const
+    {
+        for (uint8_t i = 0; i < programs_; i++)
+        {
+            if (strncmp(names_[i], name, NAME_LENGTH) == 0)
+            {
+                return static_cast<int16_t>(offsets_[i]);
+            }
+        }
+        return -1;
+    }
+
+    int fail()
+    {
+        size_     = 0;
+        programs_ = 0;
+        return EXIT_FAILURE;
+    }
+
+    Op ops_[CAPACITY];
+    uint16_t size_ = 0;
+
+    char names_[PROGRAMS][NAME_LENGTH];
+    uint16_t offsets_[PROGRAMS];
+    uint8_t programs_ = 0;
+};
+
+/**
+ * @brief Walks a linked image, resolving loops and calls, and hands out one motion op at a time.
+ *
+ * @tparam DEPTH nested loops plus calls a program may have open at once
+ */
+template <uint8_t DEPTH = 8>
+class Runner
+{
+public:
+    enum Error : uint8_t
+    {
+        NONE = 0,
+        TOO_DEEP,    ///< more loops and calls open than DEPTH
+        UNBALANCED,  ///< M808 end or return without its start
+        RUNAWAY,     ///< CONTROL_LIMIT loop and call ops in a row, an empty endless loop
+    };
+
+    void start(const Op* ops, uint16_t size)
+    {
+        ops_      = ops;
+        size_     = size;
+        pc_       = 0;
+        depth_    = 0;
+        executed_ = 0;
+        error_    = NONE;
+        running_  = size > 0;
+    }
+
+    void stop() { running_ = false; }
+
+    /**
+     * @brief Next op to execute, loops and calls are taken care of here.
+     *
+     * @return a MOVE, DWELL, HOME, SET_SPEED or SET_ACCELERATION op, or nullptr once the program
+     * ended, was stopped or failed (see error())
+     */
+    const Op* next()
+    {
+        for (uint16_t control = 0; running_ && control < CONTROL_LIMIT; control++)
+        {
+            if (pc_ >= size_)
+            {
+                return finish(UNBALANCED);
+            }
+            const Op& op = ops_[pc_++];
+            switch (op.code)
+            {
+                case END:
+                    return finish(depth_ == 0 ? NONE : UNBALANCED);
+                case LOOP_START:
+                    if (!push(pc_, op.arg, false))
+                    {
+                        return finish(TOO_DEEP);
+                    }
+                    break;
+                case LOOP_END:
+                {
+                    if (depth_ == 0 || stack_[depth_ - 1].call)
+                    {
+                        return finish(UNBALANCED);
+                    }
+                    Frame& loop = stack_[depth_ - 1];
+                    // A count of 0 never runs out
+                    if (loop.remaining == 0 || --loop.remaining > 0)
+                    {
+                        pc_ = loop.pc;
+                    }
+                    else
+                    {
+                        depth_--;
+                    }
+                    break;
+                }
+                case CALL:
+                    if (!push(pc_, 0, true))
+                    {
+                        return finish(TOO_DEEP);
+                    }
+                    pc_ = op.arg;
+                    break;
+                case RETURN:
+                    if (depth_ == 0 || !stack_[depth_ - 1].call)
+                    {
+                        return finish(UNBALANCED);
+                    }
+                    pc_ = stack_[--depth_].pc;
+                    break;
+                default:
+                    executed_++;
+                    return &op;
+            }
+        }
+        return running_ ? finish(RUNAWAY) : nullptr;
+    }
+
+    bool isRunning() const { return running_; }
+    Error error() const { return error_; }
+    /** @brief Offset of the next op in the image */
+    uint16_t pc() const { return pc_; }
+    /** @brief Motion ops handed out since start() */
+    uint32_t executed() const { return executed_; }
+
+private:
+    static constexpr uint16_t CONTROL_LIMIT = 256;
+
+    struct Frame
+    {
+        uint16_t pc;         // loop body start, or where a call returns to
+        uint16_t remaining;  // passes left of a loop, 0 forever
+        bool call;
+    };
+
+    bool push(uint16_t pc, uint16_t remaining, bool call)
+    {
+        if (depth_ >= DEPTH)
+        {
+            return false;
+        }
+        stack_[depth_++] = {pc, remaining, call};
+        return true;
+    }
+
+    const Op* finish(Error error)
+    {
+        error_   = error;
+        running_ = false;
+        return nullptr;
+    }
+
+    const Op* ops_     = nullptr;
+    uint16_t size_     = 0;
+    uint16_t pc_       = 0;
+    uint8_t depth_     = 0;
+    uint32_t executed_ = 0;
+    Error error_       = NONE;
+    bool running_      = false;
+
+    Frame stack_[DEPTH];
+};
+}  // namespace program
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "program.hpp"
+
+namespace program
+{
+enum Axis : uint8_t
+{
+    Y = 0,  ///< jaw position, Op values[0]
+    A,      ///< jaw rotation, Op values[1]
+    C,      ///< clamp, Op values[2]
+    AXES,
+};
+
+/** @brief Motion limits of the axes, in AccelStepper steps like M80 and M17 */
+struct Kinematics
+{
+    float stepDistance[AXES] = {1.0f, 1.0f, 1.0f};  ///< units per step
+    float maxSpeed[AXES]     = {};                  ///< steps / second, the clamp's its PID limit
+    float acceleration[AXES] = {};                  ///< steps / second², unused for the clamp
+};
+
+/** @brief Soft limits and interlocks every move of a program is checked against, in units */
+struct Limits
+{
+    float min[AXES];
+    float max[AXES];
+    float clampOpenAt;  ///< clamp position at and above which the part is released
+};
+
+/**
+ * @brief One planned move of the position commanded axes (Y and A). Both get the time-optimal
+ * trapezoid of the slower one, scaled, so they start and arrive together.
+ */
+struct Segment
+{
+    float speed[2];         ///< steps / second for Y and A
+    float acceleration[2];  ///< steps / second² for Y and A
+    float duration;         ///< seconds, including the clamp if it is slower
+};
+
+enum Problem : uint8_t
+{
+    NO_PROBLEM = 0,
+    PROGRAM_INVALID,  ///< unbalanced M808, calls nested too deep or an empty endless loop
+    OUT_OF_LIMITS,    ///< a target outside Limits::min/max
+    CLAMPED_TRAVEL,   ///< Y moves while the clamp holds the part
+    BRAKED_TRAVEL,    ///< Y moves with the roll brake engaged
+    BAD_KINEMATICS,   ///< M80/M17 of 0 or less on an axis that then has to move
+};
+
+struct Report
+{
+    Problem problem = NO_PROBLEM;
+    uint8_t axis    = 0;      ///< Axis the problem is on
+    uint16_t pc     = 0;      ///< op of the image the problem is at
+    uint32_t moves  = 0;      ///< moves checked
+    float duration  = 0.0f;   ///< seconds, moves and dwells, of one run or what was simulated
+    bool endless    = false;  ///< an M808 L0 keeps it going, only SIMULATED_MOVES were checked
+};
+
+/**
+ * @brief Time-optimal move of Y and A from `from` to `to` with both axes finishing together.
+ *
+ * Each axis' own fastest trapezoid (triangle when it can't reach its max speed) is computed, the
+ * longest one sets the duration and the other axis' speed and acceleration are scaled by 1/s and
+ * 1/s² so the same profile shape stretches to it. The clamp follows through its PID, it only
+ * counts towards the duration.
+ */
+inline Segment planMove(const float (&from)[AXES], const float (&to)[AXES], const Kinematics& k)
+{
+    Segment segment;
+    float times[2];
+    float duration = 0.0f;
+    for (uint8_t axis = Y; axis <= A; axis++)
+    {
+        const float distance = std::fabs(to[axis] - from[axis]) / k.stepDistance[axis];
+        const float vmax     = k.maxSpeed[axis];
+        const float amax     = k.acceleration[axis];
+        if (distance == 0.0f)
+        {
+            times[axis] = 0.0f;
+            continue;
+        }
+        // Reaches vmax if accelerating to it and braking from it takes less than the distance
+        times[axis] = distance * amax >= vmax * vmax ? distance / vmax + vmax / amax
+                                                     : 2.0f * std::sqrt(distance / amax);
+        duration    = times[axis] > duration ? times[axis] : duration;
+    }
+    for (uint8_t axis = Y; axis <= A; axis++)
+    {
+        const float s = times[axis] > 0.0f ? duration / times[axis] : 1.0f;
+        segment.speed[axis]        = k.maxSpeed[axis] / s;
+        segment.acceleration[axis] = k.acceleration[axis] / (s * s);
+    }
+    const float clampSteps = std::fabs(to[C] - from[C]) / k.stepDistance[C];
+    const float clamp      = clampSteps > 0.0f ? clampSteps / k.maxSpeed[C] : 0.0f;
+    segment.duration       = clamp > duration ? clamp : duration;
+    return segment;
+}
+
+/**
+ * @brief Checks a linked program move by move before it runs and plans every move up front.
+ *
+ * The program is simulated with the same Runner that executes it, so loops and calls unroll
+ * exactly as they will. Every target is checked against the soft limits and the interlocks, the
+ * M80/M17 it sets along the way are followed. The first SEGMENTS moves are kept, the run replays
+ * them without any planning. Moves past that are planned with the same planMove() as they come,
+ * they were checked all the same.
+ *
+ * @tparam SEGMENTS moves planned ahead
+ */
+template <uint16_t SEGMENTS>
+class Plan
+{
+public:
+    // An endless program is simulated this far, past its first passes every pass is the same. The
+    // check runs inside loop(), ~1 µs per move on the ESP32-S3 keeps the stall around 10 ms
+    static constexpr uint32_t SIMULATED_MOVES = 10000;
+
+    /**
+     * @param ops linked program
+     * @param start position every axis starts from, Y, A, C
+     * @param brake roll brake engaged at the start
+     * @param kinematics M80/M17 in effect at the start
+     * @param limits soft limits and interlocks
+     * @return the first problem found, or NO_PROBLEM with the number of moves and the duration.
+     * The plan is only usable if there is no problem.
+     */
+    Report build(const Op* ops, uint16_t size, const float (&start)[AXES], bool brake,
+                 Kinematics kinematics, const Limits& limits)
+    {
+        Report report;
+        size_ = 0;
+
+        float position[AXES] = {start[Y], start[A], start[C]};
+        Runner<> runner;
+        runner.start(ops, size);
+        while (const Op* op = runner.next())
+        {
+            report.pc = runner.pc() - 1;
+            switch (op->code)
+            {
+                case MOVE:
+                {
+                    const float target[AXES] = {op->values[0], op->values[1], op->values[2]};
+                    brake                    = op->flags & 1;
+                    if (check(position, target, brake, kinematics, limits, report) != NO_PROBLEM)
+                    {
+                        return report;
+                    }
+                    const Segment segment = planMove(position, target, kinematics);
+                    if (size_ < SEGMENTS)
+                    {
+                        segments_[size_++] = segment;
+                    }
+                    report.duration += segment.duration;
+                    for (uint8_t axis = 0; axis < AXES; axis++)
+                    {
+                        position[axis] = target[axis];
+                    }
+                    if (++report.moves >= SIMULATED_MOVES)
+                    {
+                        report.endless = true;
+                        return report;
+                    }
+                    break;
+                }
+                case DWELL:
+                    report.duration += op->values[0] * 1e-3f;
+                    break;
+                case HOME:
+                    for (uint8_t axis = 0; axis < AXES; axis++)
+                    {
+                        // Op flags are y, a, c like the axes
+                        position[axis] = op->flags & (1 << axis) ? 0.0f : position[axis];
+                    }
+                    break;
+                case SET_SPEED:
+                case SET_ACCELERATION:
+                    for (uint8_t axis = 0; axis < AXES; axis++)
+                    {
+                        float& value = op->code == SET_SPEED ? kinematics.maxSpeed[axis]
+                                                             : kinematics.acceleration[axis];
+                        // 0 keeps the axis, like M80 and M17 from the host
+                        value = op->values[axis] != 0 ? op->values[axis] : value;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (runner.error() != Runner<>::NONE)
+        {
+            report.problem = PROGRAM_INVALID;
+        }
+        return report;
+    }
+
+    /** @brief Planned segment of the `move`th move (from 0), nullptr past the planned ones */
+    const Segment* segment(uint32_t move) const
+    {
+        return move < size_ ? &segments_[move] : nullptr;
+    }
+
+    uint16_t size() const { return size_; }
+
+private:
+    static Problem check(const float (&from)[AXES], const float (&to)[AXES], bool brake,
+                         const Kinematics& k, const Limits& limits, Report& report)
+    {
+        for (uint8_t axis = 0; axis < AXES; axis++)
+        {
+            report.axis = axis;
+            if (!(to[axis] >= limits.min[axis] && to[axis] <= limits.max[axis]))
+            {
+                return report.problem = OUT_OF_LIMITS;
+            }
+            const bool moves = to[axis] != from[axis];
+            if (moves && (!(k.maxSpeed[axis] > 0.0f) ||
+                          (axis != C && !(k.acceleration[axis] > 0.0f))))
+            {
+                return report.problem = BAD_KINEMATICS;
+            }
+        }
+
+        report.axis = Y;
+        if (to[Y] != from[Y])
+        {
+            // The clamp moves during the travel too, it has to be open at both ends
+            if (from[C] < limits.clampOpenAt || to[C] < limits.clampOpenAt)
+            {
+                return report.problem = CLAMPED_TRAVEL;
+            }
+            if (brake)
+            {
+                return report.problem = BRAKED_TRAVEL;
+            }
+        }
+        return NO_PROBLEM;
+    }
+
+    Segment segments_[SEGMENTS];
+    uint16_t size_ = 0;
+};
+}  // namespace program
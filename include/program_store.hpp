@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "program.hpp"
+
+/**
+ * @brief Named programs in the LittleFS partition, compiled to program::Op at upload time.
+ *
+ * An upload is written to a temporary file and only replaces the stored program once it ended
+ * cleanly, a failed upload leaves the previous version in place. Uploading writes flash, only do
+ * it while Cleaner::isMotionIdle() holds. Reading happens when a run is linked, also at idle.
+ */
+class ProgramStore
+{
+public:
+    enum Compiled : uint8_t
+    {
+        OP = 0,   ///< `op` holds the compiled line
+        BLANK,    ///< empty or only a comment
+        INVALID,  ///< not allowed in a program
+    };
+
+    static constexpr uint8_t LINE_LENGTH = 96;
+
+    /** @brief Prints one line, e.g. SerialReceiverTransmitter::SafePrint */
+    typedef void (*Printer)(const char* line);
+
+    ProgramStore() = default;
+
+    /**
+     * @brief Mounts the file system, formatting it if it was never used.
+     *
+     * @return EXIT_SUCCESS or EXIT_FAILURE if there is no usable partition
+     */
+    int begin();
+    bool isMounted() const { return mounted_; }
+
+    int beginUpload(const char* name);
+    /**
+     * @brief Compiles and appends one line of the program being uploaded.
+     *
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if the line is invalid, the upload is then doomed and
+     * endUpload() discards it
+     */
+    int addLine(const char* line);
+    /**
+     * @brief Finishes the upload and replaces the stored program.
+     *
+     * @param count ops written
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if a line failed or the loops don't close
+     */
+    int endUpload(uint16_t& count);
+    bool isUploading() const { return uploading_; }
+
+    int remove(const char* name);
+    /** @brief Prints every stored program with its size in ops */
+    void list(Printer print);
+
+    int load(const char* name, program::Op* ops, uint16_t capacity, uint16_t& count);
+    /** @brief program::Loader for program::Image::link, `self` is the ProgramStore */
+    static int loader(void* self, const char* name, program::Op* ops, uint16_t capacity,
+                      uint16_t& count);
+
+    /** @brief Text line to its op, see program.hpp for the commands a program may contain */
+    static Compiled compile(const char* line, program::Op& op);
+    static bool validName(const char* name);
+
+private:
+    static constexpr const char* DIRECTORY = "/programs";
+    static constexpr uint8_t PATH_LENGTH   = 32;
+
+    static void path(const char* name, const char* extension, char (&out)[PATH_LENGTH]);
+
+    File upload_;
+    char uploadName_[program::NAME_LENGTH] = {};
+    uint16_t uploadOps_                    = 0;
+    int16_t uploadDepth_                   = 0;  // open M808 blocks
+    bool uploadFailed_                     = false;
+    bool uploading_                        = false;
+    bool mounted_                          = false;
+};
@@ -4,24 +4,29 @@
 #include <cstring>
 #include <Arduino.h>
 
+#include "byte_transport.hpp"
+#include "command_batch.hpp"
+#include "frame_pool.hpp"
+#include "program.hpp"
+
 class SerialReceiverTransmitter
 {
 public:
-    static constexpr int HEADER_SIZE = 5;
-    static constexpr int BUFFER_SIZE = 1024;
-
-    enum State
-    {
-        WAITING_FOR_HEADER = 0,
-        READING_HEADER,
-        READING_BODY
-    };
+    static constexpr int BUFFER_SIZE = 1024;  // longest frame body
+    // Commands of BATCH frames queued at most, the host keeps no more than this many unacked
+    static constexpr uint8_t BATCH_COMMANDS    = 48;
+    static constexpr uint8_t BATCH_LINE_LENGTH = 64;
+    // Received frames, parsed in place and held by the batch queue, see frame_pool.hpp
+    static constexpr uint32_t RX_POOL_SIZE = 4096;
+    static constexpr uint32_t RX_RESERVE   = 512;  // BATCH frames leave this much to the others
 
     enum MessageType
     {
         NONE = 0,
         COMMAND,
-        STOP
+        STOP,
+        BATCH,  // many sequence numbered commands, see command_batch.hpp
+        PING    // answered on the spot with timestamps, see SerialReceiverTransmitter::answerPing
     };
 
     struct gCommand
@@ -42,6 +47,62 @@ public:
         float val     = 0.0f;  // value for non-axis commands
     };
 
+    // M950, frequency response identification of one axis, see Cleaner::startIdentification
+    struct identCommand
+    {
+        bool received   = false;
+        char axis       = '\0';    // A, the jaw rotation, the letter carries the amplitude
+        float amplitude = 0.0f;    // peak velocity perturbation in axis units/s
+        float fStart    = 1.0f;    // F, first frequency Hz
+        float fEnd      = 100.0f;  // H, last frequency Hz
+        float duration  = 10.0f;   // T, length of the run in seconds
+        int mode        = 0;       // S, 0 chirp 1 stepped sine
+        int steps       = 20;      // N, number of tones for the stepped sine
+    };
+
+    // M953, the compact telemetry stream, see Cleaner::startTelemetry
+    struct telemetryCommand
+    {
+        bool received = false;
+        int state     = -1;     // S, 1 starts the stream 0 stops it, -1 only reports
+        int channel   = -1;     // C, channel D, F and Q are set on, see TelemetryChannelNames
+        int divider   = 0;      // D, ticks per window, 0 keeps the current
+        int stats     = -1;     // F, telemetry::Stat flags, 1 min 2 max 4 mean 8 last, -1 keeps
+        float scale   = -1.0f;  // Q, units per count, -1 keeps the current
+    };
+
+    // M593, input shaper of one or more axes, see Cleaner::setShaper
+    struct shaperCommand
+    {
+        bool received   = false;
+        bool y          = false;  // axes the shaper applies to, given as bare letters
+        bool a          = false;
+        bool c          = false;
+        int type        = -1;     // S, 0 none 1 ZV 2 ZVD 3 EI, -1 keeps the current type
+        float frequency = -1.0f;  // F, Hz, 0 takes the measured resonance, -1 keeps the current
+        float damping   = -1.0f;  // D, damping ratio, -1 keeps the current
+    };
+
+    // M425, lead screw compensation of the jaw position, see Cleaner::setCompensation
+    struct compensationCommand
+    {
+        bool received    = false;
+        float backlash   = -1.0f;  // Y, mm, -1 keeps the current
+        float takeupRate = -1.0f;  // F, mm/s the backlash is taken up at, -1 keeps the current
+        float start      = NAN;    // S, mm, position of the first pitch point, NAN keeps it
+        float spacing    = -1.0f;  // P, mm between pitch points, -1 keeps the current
+        int index        = -1;     // I, pitch point E is written to
+        float error      = 0.0f;   // E, mm, travel measured minus commanded at point I
+        int points       = -1;     // N, pitch points in use, -1 keeps the current
+    };
+
+    // M20/M24/M25/M27/M28/M29/M30/M31, the stored programs, see Cleaner::processProgramCommands
+    struct programCommand
+    {
+        bool received                   = false;
+        char name[program::NAME_LENGTH] = {};  // first parameter, the program name
+    };
+
     class CommandMessage
     {
     public:
@@ -52,17 +113,39 @@ public:
         mCommand M80;      // M80 is the set max speed command
         mCommand M17;      // M17 is the set acceleration command
         mCommand M906;    // M906 is the set current command
+        compensationCommand M425;  // M425 sets the lead screw compensation
+        mCommand M500;             // M500 saves the calibration to flash
+        mCommand M20;              // M20 lists the stored programs
+        programCommand M24;        // M24 runs a stored program
+        mCommand M25;              // M25 stops the running program
+        mCommand M27;              // M27 reports the running program
+        programCommand M28;        // M28 starts uploading a program, up to M29
+        mCommand M29;              // M29 ends the upload
+        programCommand M30;        // M30 deletes a stored program
+        programCommand M31;        // M31 checks and plans a stored program without running it
+        shaperCommand M593;  // M593 sets the input shaper
+        mCommand M911;      // M911 reports the driver temperature flags and load
+        identCommand M950;  // M950 starts a frequency response identification
+        mCommand M951;      // M951 aborts the identification
+        mCommand M952;      // M952 reports the vibration spectrum
+        telemetryCommand M953;  // M953 starts, stops, configures or reports the telemetry stream
         
 
         CommandMessage();
         CommandMessage(gCommand G0, gCommand G4, gCommand G28, gCommand G90, mCommand M80, mCommand M17, mCommand M906);
-        CommandMessage(char buffer[]);
+        CommandMessage(const char buffer[]);
 
     private:
 
         template <typename commandType>
         void ProcessCommand(char* param, commandType *commandName);
         void ProcessHomeCommand(char *param, gCommand *command);
+        void ProcessIdentificationCommand(char *param, identCommand *command);
+        void ProcessShaperCommand(char *param, shaperCommand *command);
+        void ProcessTelemetryCommand(char *param, telemetryCommand *command);
+        void ProcessCompensationCommand(char *param, compensationCommand *command);
+        void ProcessProgramCommand(char *param, programCommand *command);
+        static void reportUnhandled(const char* command, char parameter);
 
     };
 
@@ -74,28 +157,60 @@ public:
         Stop(char buffer[]);
     };
 
+    /** @brief Talks over the USB CDC port */
     SerialReceiverTransmitter();
-    
+    /** @brief Talks over `transport` instead, see byte_transport.hpp. There is one link, the last
+     * one given is the one SafePrint() writes to */
+    explicit SerialReceiverTransmitter(ByteTransport& transport);
+
     void parse();
     void reset();
-    void begin(uint32_t baudrate);
-
-    template <typename T>
-    void static SafePrint(T message);
+    int begin(uint32_t baudrate);
 
     void static SafePrint(const char* message);
-    void static SafePrint(String message);
+    void static SafePrint(long value);
+    /** @brief Writes `length` bytes of binary, cut short like a message, see availableForWrite() */
+    void static SafePrint(const uint8_t* data, size_t length);
+    /** @brief Bytes SafePrint() can write right now without cutting the message short */
+    static int availableForWrite() { return transport_->availableForWrite(); }
 
     CommandMessage lastReceivedCommandMessage() const;
     Stop lastReceivedStopMessage() const;
     MessageType lastReceivedMessageId() const;
+    /**
+     * @brief Number of messages parsed, and batch commands taken, since start up. Tells a new
+     * message from a repeat.
+     */
+    uint32_t messagesReceived() const { return messagesReceived_; }
+    /** @brief Text of the last command message as received, e.g. a line of a program upload */
+    const char* lastReceivedText() const { return lastText_; }
+
+    bool nextBatchCommand();
+    void completeBatchCommand();
 
 private:
-    State state_;
-    MessageType currMsgId_;
+    void receiveBatch(const frames::Frame& frame);
+    void answerPing(const frames::Frame& frame);
+    void hold(bool held, frames::Handle handle, const char* text);
+    void dropBatch();
+    void reportDropped();
+
+    static ByteTransport* transport_;
+
     MessageType lastReceivedMsgId_;
-    uint32_t currMsgLen_;
-    char currMsgData_[BUFFER_SIZE];  // buffer size defined by constant
     CommandMessage lastReceivedCommandMessage_;
     Stop lastReceivedStopMessage_;
+    uint32_t messagesReceived_;
+
+    alignas(8) uint8_t rxStorage_[RX_POOL_SIZE];
+    frames::Pool pool_;
+    frames::Assembler assembler_;
+    frames::Handle current_ = 0;      // frame of the last command message, while holding_
+    bool holding_           = false;
+    const char* lastText_   = "";
+    uint32_t droppedSeen_   = 0;  // BATCH frames dropped, as last reported
+
+    batch::Queue<BATCH_COMMANDS, BATCH_LINE_LENGTH> batch_;
+    uint16_t batchOpen_ = 0;   // seq of the command taken by nextBatchCommand()
+    int32_t batchAcked_ = -1;  // seq of the last ack, -1 before the first
 };
\ No newline at end of file
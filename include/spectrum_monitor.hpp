@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "hot_path.hpp"
+
+/**
+ * @brief Vibration spectrum of a velocity signal, computed window by window with a fixed point
+ * Goertzel bank.
+ *
+ * Samples are quantised to Q15 against a full scale velocity and collected into one of two
+ * statically allocated windows. Once a window is full it is handed to analyse(), which runs every
+ * bin over it with Q14 coefficients and 64 bit accumulation, so the per sample work is integer
+ * only and its cost is a fixed BINS * WINDOW multiply-adds. The bins are spread evenly between
+ * fMin and fMax and grouped into BANDS consecutive bands, e.g. low bands for a loose clamp and
+ * high bands for chatter or bearing noise.
+ *
+ * Goertzel instead of an FFT because only a few dozen frequencies are of interest and each bin is
+ * independent, so the work can be split or bounded per bin.
+ */
+namespace spectrum
+{
+struct Config
+{
+    float fMin      = 5.0f;    ///< First bin, Hz
+    float fMax      = 200.0f;  ///< Last bin, Hz, below 0.5 / Ts
+    float Ts        = 1e-3f;   ///< Sample time, s
+    float fullScale = 20.0f;   ///< Velocity mapped to the Q15 limit, larger values saturate
+
+    constexpr Config() {}
+    constexpr Config(float fMin_, float fMax_, float Ts_, float fullScale_)
+        : fMin(fMin_),
+          fMax(fMax_),
+          Ts(Ts_),
+          fullScale(fullScale_)
+    {
+    }
+};
+
+template <uint8_t BANDS>
+struct Summary
+{
+    uint32_t windows       = 0;     ///< Windows analysed since reset
+    float rms              = 0.0f;  ///< RMS of the window with its mean removed, velocity units
+    float peakFrequency    = 0.0f;  ///< Strongest bin, interpolated between neighbours, Hz
+    float peakAmplitude    = 0.0f;  ///< Amplitude of the strongest bin, velocity units
+    float bandRms[BANDS]   = {};    ///< RMS of the bins of each band, velocity units
+    float bandStart[BANDS] = {};    ///< First bin frequency of each band, Hz
+    uint32_t overMask      = 0;     ///< Bands currently over their threshold
+};
+
+/**
+ * @brief Two windows of Q15 samples, one is filled while the other is analysed.
+ */
+template <uint16_t WINDOW>
+class WindowBuffer
+{
+public:
+    /** @brief Maps a velocity onto Q15, saturating at +-fullScale */
+    static int16_t quantize(float value, float fullScale)
+    {
+        float scaled = value / fullScale * 32767.0f;
+        scaled       = scaled > 32767.0f ? 32767.0f : (scaled < -32767.0f ? -32767.0f : scaled);
+        return static_cast<int16_t>(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    }
+
+    /**
+     * @brief Appends a sample to the window being filled.
+     *
+     * @return the window that just filled up, or nullptr. The previous full window is overwritten
+     * from here on, so it must be analysed before the next one fills.
+     */
+    HOT_PATH const int16_t* push(int16_t sample)
+    {
+        buffer_[filling_][count_++] = sample;
+        if (count_ < WINDOW)
+        {
+            return nullptr;
+        }
+        const int16_t* full = buffer_[filling_];
+        filling_            = filling_ ^ 1;
+        count_              = 0;
+        return full;
+    }
+
+    void reset()
+    {
+        filling_ = 0;
+        count_   = 0;
+    }
+
+private:
+    int16_t buffer_[2][WINDOW];
+    uint8_t filling_ = 0;
+    uint16_t count_  = 0;
+};
+
+template <uint16_t WINDOW, uint8_t BINS, uint8_t BANDS>
+class SpectrumMonitor
+{
+    static_assert(BINS >= 3 && BINS % BANDS == 0, "bins must split evenly into the bands");
+    static_assert(BANDS <= 32, "overMask holds one bit per band");
+
+public:
+    /** @brief Multiply-adds of one analyse() call, the whole CPU cost of a window */
+    static constexpr uint32_t OPERATIONS = static_cast<uint32_t>(WINDOW) * (BINS + 1);
+
+    explicit SpectrumMonitor(const Config& cfg = Config()) { configure(cfg); }
+
+    /**
+     * @brief Sets the bins and the Hann window, clears the thresholds and the summary.
+     *
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if the band is empty or above Nyquist, in which case
+     * the previous configuration is kept
+     */
+    int configure(const Config& cfg)
+    {
+        if (cfg.fMin <= 0.0f || cfg.fMax <= cfg.fMin || cfg.fMax >= 0.5f / cfg.Ts ||
+            cfg.fullScale <= 0.0f)
+        {
+            return EXIT_FAILURE;
+        }
+        cfg_ = cfg;
+
+        const float step = (cfg.fMax - cfg.fMin) / (BINS - 1);
+        for (uint8_t k = 0; k < BINS; k++)
+        {
+            frequency_[k]   = cfg.fMin + step * k;
+            coefficient_[k] = coefficientOf(frequency_[k]);
+        }
+        for (uint16_t n = 0; n < WINDOW; n++)
+        {
+            window_[n] = static_cast<int16_t>(
+                std::lround(32767.0f * 0.5f * (1.0f - std::cos(TAU * n / (WINDOW - 1)))));
+        }
+        for (uint8_t b = 0; b < BANDS; b++)
+        {
+            threshold_[b] = 0.0f;
+        }
+        reset();
+        return EXIT_SUCCESS;
+    }
+
+    /**
+     * @brief Sets the RMS a band may reach before it raises an event, 0 disables the band. The band
+     * clears again below HYSTERESIS times the threshold.
+     */
+    int setThreshold(uint8_t band, float rms)
+    {
+        if (band >= BANDS || rms < 0.0f)
+        {
+            return EXIT_FAILURE;
+        }
+        threshold_[band] = rms;
+        return EXIT_SUCCESS;
+    }
+
+    /**
+     * @brief Analyses one full window and updates the summary.
+     *
+     * @param window WINDOW samples quantised with WindowBuffer::quantize against cfg.fullScale
+     * @return bit mask of the bands that went over their threshold with this window
+     */
+    uint32_t analyse(const int16_t* window)
+    {
+        // Mean removed first, a slow drift would otherwise leak into the low bins
+        int32_t sum = 0;
+        for (uint16_t n = 0; n < WINDOW; n++)
+        {
+            sum += window[n];
+        }
+        const int32_t mean = sum / static_cast<int32_t>(WINDOW);
+
+        int64_t energy = 0;
+        for (uint16_t n = 0; n < WINDOW; n++)
+        {
+            const int32_t centred = window[n] - mean;
+            energy += static_cast<int64_t>(centred) * centred;
+            // Q15 x Q15 -> Q15, one bit wider than a sample once the mean is removed
+            windowed_[n] = (centred * window_[n]) >> 15;
+        }
+
+        const float toUnits = cfg_.fullScale / 32767.0f;
+        float amplitude[BINS];
+        uint8_t peak = 0;
+        for (uint8_t k = 0; k < BINS; k++)
+        {
+            amplitude[k] = goertzel(coefficient_[k]) * toUnits;
+            if (amplitude[k] > amplitude[peak])
+            {
+                peak = k;
+            }
+        }
+
+        // The peak rarely sits on a bin, one more pass at the interpolated frequency gives its
+        // amplitude without the scalloping loss of the window
+        summary_.windows++;
+        summary_.rms           = std::sqrt(static_cast<float>(energy) / WINDOW) * toUnits;
+        summary_.peakFrequency = frequency_[peak] + interpolate(amplitude, peak) *
+                                                        (frequency_[1] - frequency_[0]);
+        summary_.peakAmplitude = goertzel(coefficientOf(summary_.peakFrequency)) * toUnits;
+
+        const uint8_t perBand = BINS / BANDS;
+        uint32_t rising       = 0;
+        for (uint8_t b = 0; b < BANDS; b++)
+        {
+            // A sine of amplitude A carries A^2 / 2
+            float power = 0.0f;
+            for (uint8_t k = b * perBand; k < (b + 1) * perBand; k++)
+            {
+                power += 0.5f * amplitude[k] * amplitude[k];
+            }
+            summary_.bandRms[b]   = std::sqrt(power);
+            summary_.bandStart[b] = frequency_[b * perBand];
+
+            const uint32_t bit = 1UL << b;
+            if (threshold_[b] <= 0.0f)
+            {
+                summary_.overMask &= ~bit;
+            }
+            else if (!(summary_.overMask & bit) && summary_.bandRms[b] > threshold_[b])
+            {
+                summary_.overMask |= bit;
+                rising |= bit;
+            }
+            else if ((summary_.overMask & bit) &&
+                     summary_.bandRms[b] < HYSTERESIS * threshold_[b])
+            {
+                summary_.overMask &= ~bit;
+            }
+        }
+        return rising;
+    }
+
+    const Summary<BANDS>& summary() const { return summary_; }
+    const Config& config() const { return cfg_; }
+
+    /** @brief Centre frequency of bin k, Hz */
+    float binFrequency(uint8_t k) const { return frequency_[k]; }
+
+    /** @brief Clears the summary, the thresholds are kept */
+    void reset() { summary_ = Summary<BANDS>(); }
+
+    static constexpr float HYSTERESIS = 0.8f;
+
+private:
+    static constexpr float TAU = 6.28318530718f;
+    static constexpr uint8_t Q = 14;  // coefficients are 2 cos(w) in Q14
+
+    int32_t coefficientOf(float frequency) const
+    {
+        return static_cast<int32_t>(
+            std::lround(2.0f * std::cos(TAU * frequency * cfg_.Ts) * (1 << Q)));
+    }
+
+    /**
+     * @brief Amplitude of one bin over windowed_, Q15 units. The Hann window halves a sine, hence
+     * 4 / WINDOW instead of 2 / WINDOW.
+     */
+    float goertzel(int32_t coefficient) const
+    {
+        int64_t s1 = 0;
+        int64_t s2 = 0;
+        for (uint16_t n = 0; n < WINDOW; n++)
+        {
+            const int64_t s = windowed_[n] + ((coefficient * s1) >> Q) - s2;
+            s2              = s1;
+            s1              = s;
+        }
+        const float f1    = static_cast<float>(s1);
+        const float f2    = static_cast<float>(s2);
+        const float c     = static_cast<float>(coefficient) / (1 << Q);
+        const float power = f1 * f1 + f2 * f2 - c * f1 * f2;
+        return power > 0.0f ? 4.0f * std::sqrt(power) / WINDOW : 0.0f;
+    }
+
+    /** @brief Offset of the true peak from bin k in bins, parabola through k - 1, k, k + 1 */
+    static float interpolate(const float* amplitude, uint8_t k)
+    {
+        if (k == 0 || k == BINS - 1)
+        {
+            return 0.0f;
+        }
+        const float left   = amplitude[k - 1];
+        const float centre = amplitude[k];
+        const float right  = amplitude[k + 1];
+        const float denom  = left - 2.0f * centre + right;
+        return denom < 0.0f ? 0.5f * (left - right) / denom : 0.0f;
+    }
+
+    Config cfg_;
+    float frequency_[BINS];
+    int32_t coefficient_[BINS];
+    int16_t window_[WINDOW];
+    int32_t windowed_[WINDOW];
+    float threshold_[BANDS];
+    Summary<BANDS> summary_;
+};
+}  // namespace spectrum
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "step_reconciler.hpp"
+
+/**
+ * @brief Counts the step pulses actually emitted on a STEP/DIR pair using one ESP32 pulse counter
+ * (PCNT) unit.
+ *
+ * The STEP pin drives the count input and the DIR pin the control input, a low DIR reverses the
+ * count so the counter tracks signed position the same way AccelStepper's DRIVER mode does. The
+ * pins stay outputs, the PCNT only taps their input path through the GPIO matrix.
+ */
+class StepCounter
+{
+public:
+    StepCounter() = default;
+
+    /**
+     * @brief Claims a PCNT unit and routes the STEP/DIR pins into it.
+     *
+     * @param unit PCNT unit index (0-3 on the ESP32-S3)
+     * @param stepPin Arduino pin number of the STEP output
+     * @param dirPin Arduino pin number of the DIR output
+     * @param modulus counter limit, must match StepReconciler::Config::modulus
+     * @return EXIT_SUCCESS or EXIT_FAILURE if the unit could not be configured
+     */
+    int begin(uint8_t unit, uint8_t stepPin, uint8_t dirPin, int16_t modulus);
+
+    /** @brief Returns the raw counter value, in (-modulus, modulus) */
+    int16_t read() const;
+
+    bool isActive() const { return active_; }
+
+private:
+    uint8_t unit_ = 0;
+    bool active_  = false;
+};
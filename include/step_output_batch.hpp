@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hot_path.hpp"
+
+/**
+ * @brief A set of GPIOs expressed as bit masks for the two ESP32-S3 output banks.
+ *
+ * Bank 0 covers GPIO0-31, bank 1 covers GPIO32-48. Precomputing these once per pin lets a step be
+ * emitted with a plain register write instead of a digitalWrite() lookup.
+ */
+struct GpioMask
+{
+    uint32_t bank0 = 0;
+    uint32_t bank1 = 0;
+
+    constexpr GpioMask() {}
+    constexpr GpioMask(uint32_t bank0_, uint32_t bank1_) : bank0(bank0_), bank1(bank1_) {}
+
+    /** @brief Mask for a single raw GPIO number, 255 (unused pin) gives an empty mask */
+    static constexpr GpioMask fromGpio(uint8_t gpio)
+    {
+        return gpio == 255 ? GpioMask()
+               : gpio < 32 ? GpioMask(1UL << gpio, 0)
+                           : GpioMask(0, 1UL << (gpio - 32));
+    }
+
+    bool empty() const { return bank0 == 0 && bank1 == 0; }
+    bool overlaps(const GpioMask& other) const
+    {
+        return (bank0 & other.bank0) != 0 || (bank1 & other.bank1) != 0;
+    }
+
+    /** @brief The pins of this mask that are not in other */
+    GpioMask without(const GpioMask& other) const
+    {
+        return GpioMask(bank0 & ~other.bank0, bank1 & ~other.bank1);
+    }
+
+    GpioMask& operator|=(const GpioMask& other)
+    {
+        bank0 |= other.bank0;
+        bank1 |= other.bank1;
+        return *this;
+    }
+};
+
+/**
+ * @brief Collects the step pulses of every axis that steps during one pass of the run loop and
+ * emits them together with the GPIO set/clear registers.
+ *
+ * Order of a flush:
+ *   1. DIR pins whose level changes are set/cleared (one write per bank)
+ *   2. if any did, the driver's DIR to STEP setup time is waited out
+ *   3. every pending STEP pin is raised with one write per bank
+ *   4. the pulse is held for the driver's minimum high time
+ *   5. every STEP pin is lowered with one write per bank
+ *
+ * Outside of a batch each queued step is flushed straight away, so code that runs a single motor
+ * (homing, stop()) still works unchanged.
+ *
+ * @tparam Registers provides set(GpioMask), clear(GpioMask), holdDirSetup() and holdPulse(). The
+ * firmware uses the real GPIO registers, the host tests a fake register file.
+ */
+template <typename Registers>
+class StepOutputBatch
+{
+public:
+    /**
+     * @brief Queues one step of an axis.
+     *
+     * @param step mask of the axis' STEP pin
+     * @param dir mask of the axis' DIR pin
+     * @param forward true to drive DIR high (AccelStepper's DIRECTION_CW)
+     */
+    HOT_PATH void queue(const GpioMask& step, const GpioMask& dir, bool forward)
+    {
+        // The same axis can't be pulsed twice in one write, emit what we have first
+        if (pendingStep_.overlaps(step))
+        {
+            flush();
+        }
+
+        pendingStep_ |= step;
+        if (forward)
+        {
+            pendingDirHigh_ |= dir;
+        }
+        else
+        {
+            pendingDirLow_ |= dir;
+        }
+
+        if (!batching_)
+        {
+            flush();
+        }
+    }
+
+    /** @brief Emits every queued step */
+    HOT_PATH void flush()
+    {
+        if (pendingStep_.empty())
+        {
+            return;
+        }
+
+        // Only a DIR pin that changes level needs the setup time before the edge
+        const GpioMask raise = pendingDirHigh_.without(dirHigh_);
+        const GpioMask lower = pendingDirLow_.without(dirLow_);
+        if (!raise.empty())
+        {
+            regs_.set(raise);
+        }
+        if (!lower.empty())
+        {
+            regs_.clear(lower);
+        }
+        if (!raise.empty() || !lower.empty())
+        {
+            dirHigh_ = dirHigh_.without(lower);
+            dirHigh_ |= raise;
+            dirLow_ = dirLow_.without(raise);
+            dirLow_ |= lower;
+            regs_.holdDirSetup();
+        }
+
+        regs_.set(pendingStep_);
+        regs_.holdPulse();
+        regs_.clear(pendingStep_);
+
+        pendingStep_    = GpioMask();
+        pendingDirHigh_ = GpioMask();
+        pendingDirLow_  = GpioMask();
+    }
+
+    /** @brief Starts collecting steps instead of emitting them one at a time */
+    void beginBatch() { batching_ = true; }
+
+    /** @brief Emits the collected steps and returns to immediate mode */
+    void endBatch()
+    {
+        batching_ = false;
+        flush();
+    }
+
+    Registers& registers() { return regs_; }
+
+private:
+    Registers regs_;
+    GpioMask pendingStep_;
+    GpioMask pendingDirHigh_;
+    GpioMask pendingDirLow_;
+    GpioMask dirHigh_;  ///< DIR pins last driven high, neither mask holds a pin not driven yet
+    GpioMask dirLow_;   ///< DIR pins last driven low
+    bool batching_ = false;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Reconciles hardware-counted step pulses against the software step count.
+ *
+ * AccelStepper's currentPosition() is only what the firmware *thinks* it stepped. The pulse
+ * counter peripheral watches the STEP/DIR pins themselves, so comparing the two tells us if
+ * pulses were dropped (too short for the driver, a stalled foreground loop, ...).
+ *
+ * The hardware counter is narrow and wraps, it is read as a value in (-modulus, modulus) that
+ * returns to zero every time it reaches either limit. As long as it is sampled at least once
+ * every modulus / 2 steps the delta between two readings is unambiguous.
+ *
+ * This class holds no hardware state so it can be tested on the host.
+ */
+class StepReconciler
+{
+public:
+    enum Status : uint8_t
+    {
+        OK = 0,           ///< Hardware and software agree within tolerance
+        DRIFT_FLAGGED,    ///< Drift exceeded tolerance, left for the caller to handle
+        DRIFT_CORRECTED,  ///< Drift exceeded tolerance and a correction is pending
+    };
+
+    struct Config
+    {
+        int16_t modulus        = 30000;  ///< Counter limit, the counter resets at +/- modulus
+        int32_t driftTolerance = 4;      ///< Steps of disagreement allowed before flagging
+        bool autoCorrect       = false;  ///< If true report DRIFT_CORRECTED instead of flagging
+
+        constexpr Config() {}
+        constexpr Config(int16_t modulus_, int32_t driftTolerance_, bool autoCorrect_)
+            : modulus(modulus_),
+              driftTolerance(driftTolerance_),
+              autoCorrect(autoCorrect_)
+        {
+        }
+    };
+
+    struct Report
+    {
+        int32_t hardwareSteps = 0;     ///< Position reconstructed from the pulse counter
+        int32_t softwareSteps = 0;     ///< Position reported by the step generator
+        int32_t drift         = 0;     ///< softwareSteps - hardwareSteps
+        float stepRate        = 0.0f;  ///< Achieved step rate since the last sample, steps/s
+        Status status         = OK;
+        bool changed          = false;  ///< status differs from the previous report
+    };
+
+    StepReconciler() {}
+    explicit StepReconciler(const Config& cfg) : cfg_(cfg) {}
+
+    /**
+     * @brief Re-aligns the hardware position with the software one, use whenever the software
+     * position is set directly (reset, homing) rather than stepped to.
+     *
+     * @param softwarePosition the new software position in steps
+     * @param counterReading the raw counter value at the time of the reset
+     * @param nowMicros current time in microseconds
+     */
+    void resync(int32_t softwarePosition, int16_t counterReading, uint32_t nowMicros)
+    {
+        hardwarePosition_   = softwarePosition;
+        lastCounter_        = counterReading;
+        lastMicros_         = nowMicros;
+        last_               = Report();
+        last_.hardwareSteps = softwarePosition;
+        last_.softwareSteps = softwarePosition;
+    }
+
+    /**
+     * @brief Accumulates a new counter reading and compares it against the software position.
+     *
+     * @param counterReading raw counter value
+     * @param softwarePosition position from the step generator in steps
+     * @param nowMicros current time in microseconds
+     * @return Report describing the state of the axis
+     */
+    Report reconcile(int16_t counterReading, int32_t softwarePosition, uint32_t nowMicros)
+    {
+        int32_t delta = wrapDelta(counterReading, lastCounter_);
+        hardwarePosition_ += delta;
+        lastCounter_ = counterReading;
+
+        uint32_t elapsed = nowMicros - lastMicros_;
+        lastMicros_      = nowMicros;
+
+        Report report;
+        report.hardwareSteps = hardwarePosition_;
+        report.softwareSteps = softwarePosition;
+        report.drift         = softwarePosition - hardwarePosition_;
+        report.stepRate      = elapsed > 0 ? delta * 1e6f / static_cast<float>(elapsed) : 0.0f;
+
+        int32_t magnitude = report.drift < 0 ? -report.drift : report.drift;
+        if (magnitude > cfg_.driftTolerance)
+        {
+            report.status = cfg_.autoCorrect ? DRIFT_CORRECTED : DRIFT_FLAGGED;
+        }
+        report.changed = report.status != last_.status;
+
+        last_ = report;
+        return report;
+    }
+
+    /**
+     * @brief Accepts the hardware position as truth after the caller has applied a correction
+     * to the step generator (setCurrentPosition(hardwareSteps)).
+     */
+    void acknowledgeCorrection()
+    {
+        last_.softwareSteps = hardwarePosition_;
+        last_.drift         = 0;
+        last_.status        = OK;
+    }
+
+    /** @brief Returns the last report produced by reconcile() */
+    Report lastReport() const { return last_; }
+
+    int32_t hardwarePosition() const { return hardwarePosition_; }
+
+    const Config& config() const { return cfg_; }
+
+    /**
+     * @brief Difference between two wrapping counter readings, mapped into
+     * (-modulus / 2, modulus / 2].
+     */
+    int32_t wrapDelta(int16_t current, int16_t previous) const
+    {
+        const int32_t m = cfg_.modulus;
+        int32_t delta   = (static_cast<int32_t>(current) - previous) % m;
+        if (delta > m / 2)
+        {
+            delta -= m;
+        }
+        else if (delta <= -m / 2)
+        {
+            delta += m;
+        }
+        return delta;
+    }
+
+private:
+    Config cfg_;
+    int32_t hardwarePosition_ = 0;
+    int16_t lastCounter_      = 0;
+    uint32_t lastMicros_      = 0;
+    Report last_;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <cmath>
 #include <optional>
 
 #include <AccelStepper.h>
@@ -6,6 +7,10 @@
 
 #include "TMCStepper.h"
 
+#ifdef FAST_STEP_OUTPUT
+#include "fast_step_output.hpp"
+#endif
+
 /**
  * Lightweight wrapper around TMC5160Stepper + AccelStepper that
  * separates *static* hardware‑level data (pins, rsense, etc.) from
@@ -84,19 +89,109 @@ public:
         }
     };
 
+    /**
+     * TMC5160 chopper profile. StealthChop is silent at standstill and low speed but loses torque
+     * as the speed rises, SpreadCycle keeps the torque at speed but hisses at standstill. The
+     * switch points are fractions of the axis max speed, so they follow MotionParams and M80.
+     */
+    struct ChopperParams
+    {
+        float stealthChopFraction  = 0.3f;  ///< StealthChop below this share of max speed,
+                                            ///< 0 SpreadCycle only, >= 1 StealthChop only
+        float highVelocityFraction = 0.0f;  ///< Fullstep chopper above this share, 0 disables
+        bool autotune              = true;  ///< StealthChop2 PWM autotune at begin()
+        uint8_t toff               = 5;     ///< SpreadCycle off time
+        uint8_t tbl                = 2;     ///< Comparator blank time, 2 = 36 clocks
+        uint8_t hstrt              = 4;     ///< SpreadCycle hysteresis start
+        int8_t hend                = 0;     ///< SpreadCycle hysteresis end
+
+        constexpr ChopperParams() {}  // default
+        constexpr ChopperParams(
+            float stealthChopFraction_,
+            float highVelocityFraction_,
+            bool autotune_ = true)
+            : stealthChopFraction(stealthChopFraction_),
+              highVelocityFraction(highVelocityFraction_),
+              autotune(autotune_)
+        {
+        }
+    };
+
+    /**
+     * Current management. The driver drops to the hold current by itself once the motor stood
+     * still for idleDelay_ms, CoolStep scales the run current with the StallGuard load while in
+     * SpreadCycle, and updateCurrent() raises the run current by accelBoost while accelerating.
+     */
+    struct CurrentParams
+    {
+        float holdFraction    = 0.5f;  ///< IHOLD as a share of the run current
+        uint16_t idleDelay_ms = 500;   ///< Standstill time before the hold current, up to 5570
+        float accelBoost      = 1.0f;  ///< Run current multiplier while accelerating, 1 disables
+        uint8_t coolStepMin   = 0;     ///< SEMIN, current rises below SG 32 * SEMIN, 0 disables
+        uint8_t coolStepMax   = 2;     ///< SEMAX, current drops above SG 32 * (SEMIN + SEMAX + 1)
+        int8_t stallThreshold = 0;     ///< SGT, -64 to 63, higher is less sensitive
+
+        constexpr CurrentParams() {}  // default
+        constexpr CurrentParams(
+            float holdFraction_,
+            uint16_t idleDelay_ms_,
+            float accelBoost_,
+            uint8_t coolStepMin_   = 0,
+            uint8_t coolStepMax_   = 2,
+            int8_t stallThreshold_ = 0)
+            : holdFraction(holdFraction_),
+              idleDelay_ms(idleDelay_ms_),
+              accelBoost(accelBoost_),
+              coolStepMin(coolStepMin_),
+              coolStepMax(coolStepMax_),
+              stallThreshold(stallThreshold_)
+        {
+        }
+    };
+
     struct ElectricalParams
     {
         float runCurrent_mA = 1000.0f;  ///< RMS current in mA
         uint16_t microsteps = 16;       ///< microsteps per full step (1, 2, 4, 8, 16, 32)
+        ChopperParams chopper;          ///< Chopper mode and its velocity thresholds
+        CurrentParams current;          ///< Hold current, CoolStep and acceleration boost
 
         constexpr ElectricalParams() : runCurrent_mA(1000.0f) {}  // default
-        constexpr ElectricalParams(float runCurrent_mA, uint16_t microsteps)
+        constexpr ElectricalParams(
+            float runCurrent_mA,
+            uint16_t microsteps,
+            ChopperParams chopper = ChopperParams(),
+            CurrentParams current = CurrentParams())
             : runCurrent_mA(runCurrent_mA),
-              microsteps(microsteps)
+              microsteps(microsteps),
+              chopper(chopper),
+              current(current)
         {
         }
     };
 
+    /** @brief Driver state decoded from one DRV_STATUS read, see driverHealth() */
+    struct DriverHealth
+    {
+        bool overTemperature;  ///< OT, the driver shut the bridges off
+        bool preWarning;       ///< OTPW, over temperature pre-warning
+        bool standstill;       ///< STST, no step for 2^20 clocks
+        bool boosted;          ///< The acceleration boost is applied
+        uint8_t csActual;      ///< Current scale 0-31 in use, CoolStep lowers it at light load
+        uint16_t stallGuard;   ///< SG_RESULT, lower is more load, only valid in SpreadCycle
+    };
+
+    /** @brief What the chopper is doing right now, see chopperStatus() */
+    struct ChopperStatus
+    {
+        bool stealthChop;     ///< StealthChop at the present speed, SpreadCycle otherwise
+        uint32_t tstep;       ///< Measured time between 1/256 microsteps, 1/fCLK
+        uint32_t tpwmthrs;    ///< StealthChop / SpreadCycle switch, in TSTEP units
+        uint32_t thigh;       ///< High velocity chopper switch, in TSTEP units
+        uint8_t pwmOfsAuto;   ///< Autotuned StealthChop offset
+        uint8_t pwmGradAuto;  ///< Autotuned StealthChop gradient
+    };
+
     struct PhysicalParams
     {
         float stepDistance = 1.0f;  ///< scale factor for position units (e.g., mm/step)
@@ -115,12 +210,66 @@ public:
     void apply(const ElectricalParams& p);
     void apply(const PhysicalParams& p);
 
+    void updateChopperThresholds();
+    ChopperStatus chopperStatus();
+
+    void updateCurrent();
+    DriverHealth driverHealth();
+
+    /** @brief Speed trend seen by the last updateCurrent() */
+    bool isAccelerating() const { return accelerating_; }
+    bool isDecelerating() const { return decelerating_; }
+
+    /** @brief True while the driver is in SpreadCycle, the only mode StallGuard reads in */
+    bool inSpreadCycle()
+    {
+        const float fraction = elec_.chopper.stealthChopFraction;
+        return fraction < 1.0f && std::fabs(speed()) > fraction * maxSpeed();
+    }
+
+    /**
+     * @brief TSTEP register value at a speed, the TMC5160 compares its thresholds against it.
+     *
+     * @param stepsPerSecond speed in the configured microsteps
+     * @param microsteps microsteps per full step
+     * @return time between 1/256 microsteps in driver clocks, saturated to the 20 bit register
+     */
+    static uint32_t tstepAt(float stepsPerSecond, uint16_t microsteps)
+    {
+        const float microstepRate = std::fabs(stepsPerSecond) * 256.0f / microsteps;
+        if (microstepRate * TSTEP_MAX <= TMC5160_FCLK)
+        {
+            return TSTEP_MAX;
+        }
+        return static_cast<uint32_t>(TMC5160_FCLK / microstepRate);
+    }
+
     float currentPositionUnits() { return currentPosition() * phys_.stepDistance; }
     void setPositionUnits(float pos) { setCurrentPosition(pos / phys_.stepDistance); }
     void moveToUnits(float pos) { moveTo(pos / phys_.stepDistance); }
     void setSpeedUnits(float speed) { setSpeed(speed / phys_.stepDistance); }
     float speedUnits() { return speed() * phys_.stepDistance; }
     float maxSpeedUnits() { return maxSpeed() * phys_.stepDistance; }
+    float accelerationUnits() { return acceleration() * phys_.stepDistance; }
+
+    /**
+     * @brief Tracks a position reference updated every Ts instead of planning AccelStepper's own
+     * trapezoid to it: the speed is the one that reaches the reference by the next update. Step
+     * it out with runSpeed(), the reference has to respect the speed and acceleration limits.
+     */
+    void followUnits(float pos, float Ts)
+    {
+        const float steps = pos / phys_.stepDistance;
+        const float error = steps - currentPosition();
+        moveTo(lroundf(steps));  // keeps isRunning() and distanceToGo() meaningful
+        if (std::fabs(error) < 0.5f)
+        {
+            setSpeed(0.0f);
+            return;
+        }
+        const float speed = error / Ts;
+        setSpeed(std::fmax(-maxSpeed(), std::fmin(maxSpeed(), speed)));
+    }
 
     // getters
     const char* getName() const { return cfg_.name; }
@@ -164,11 +313,48 @@ public:
         Serial.println();
     }
 
+#ifdef FAST_STEP_OUTPUT
+    /**
+     * @brief Routes this motor's steps through a shared register backend instead of
+     * AccelStepper's digitalWrite() path. Pass nullptr to go back to the default.
+     */
+    void useStepOutput(FastStepOutput* output) { stepOutput_ = output; }
+
+protected:
+    void step(long step) override;
+#endif
+
 private:
+    static constexpr float TMC5160_FCLK      = 12.0e6f;  // internal clock, Hz
+    static constexpr uint32_t TSTEP_MAX      = 0xFFFFF;
+    static constexpr uint32_t AT1_WAIT_MS    = 150;  // datasheet asks for > 130 ms at standstill
+    static constexpr float POWERDOWN_TICK_MS = 21.845f;  // TPOWERDOWN unit, 2^18 clocks
+    static constexpr uint8_t IHOLD_DELAY     = 6;        // 2^18 clocks per step down to IHOLD
+    // Speed gain between updateCurrent() calls, as a share of max speed, that counts as speeding up
+    static constexpr float ACCEL_DETECT_FRACTION = 0.01f;
+
+    static bool sameChopper(const ChopperParams& a, const ChopperParams& b);
+    static bool sameCurrent(const CurrentParams& a, const CurrentParams& b);
+
+    void applyChopper();
+    void applyCurrentControl();
+    void writeCurrent();
+    void autotuneStealthChop();
+
     StaticConfig cfg_;
     MotionParams motion_;
     ElectricalParams elec_;
     PhysicalParams phys_;
+    bool begun_ = false;  // driver registers are only written once begin() ran
+
+    // Last thresholds written, updateChopperThresholds() only touches SPI when they change
+    uint32_t tpwmthrs_ = 0;
+    uint32_t thigh_    = 0;
+
+    float lastSpeed_   = 0;  // |speed()| at the last updateCurrent()
+    bool boosted_      = false;
+    bool accelerating_ = false;
+    bool decelerating_ = false;
 
     /* driver instance (soft‑SPI vs HW‑SPI picked at run‑time) */
     uint8_t BrakePin;                // Pin used to brake the motor
@@ -176,4 +362,10 @@ private:
 
     bool BrakeOn = LOW;      // Define which direction for the pin to activate the break.
     char* name_  = nullptr;  // The name of the motor, used for debugging
+
+#ifdef FAST_STEP_OUTPUT
+    FastStepOutput* stepOutput_ = nullptr;
+    GpioMask stepMask_;  // Precomputed from cfg_.pins.step
+    GpioMask dirMask_;   // Precomputed from cfg_.pins.dir
+#endif
 };
@@ -0,0 +1,416 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief Compact telemetry of the control tick, see Cleaner::startTelemetry (M953).
+ *
+ * Every channel is quantized to counts of its own scale and sent once per window of `divider`
+ * ticks as any of the window's minimum, maximum, mean and last value. Each of those is a stream
+ * of its own, sent as the zigzag varint of its change since the stream's previous value. A
+ * smooth signal moves a few counts a tick, one byte instead of a float's four.
+ *
+ * The ticks are collected into packets that go out between the text lines on the same link:
+ *
+ *     0xA6       sentinel, never in a text line
+ *     varint     body length
+ *     body       1 byte flags, 1 byte ticks in the packet, varint first tick, then the values
+ *     1 byte     CRC-8 of the body, polynomial 0x07
+ *
+ * The values follow tick by tick, within a tick channel by channel, within a channel in the
+ * order MIN, MAX, MEAN, LAST, only for the channels whose window ends on that tick. The window of
+ * a channel ends on the ticks where (tick + 1) % divider == 0, so the host knows which values a
+ * packet holds from the channel table alone.
+ *
+ * A KEYFRAME packet starts every stream from 0, its first values are absolute. One is sent every
+ * `keyframeTicks` and after a packet was dropped, a host that lost a packet or joined late picks
+ * the stream up there. serverside/telemetry.py is the decoder. Nothing in here touches hardware
+ * so it can be tested on the host.
+ */
+namespace telemetry
+{
+static constexpr uint8_t SENTINEL = 0xA6;
+static constexpr uint8_t KEYFRAME = 0x01;  // packet flag
+
+/** @brief What a channel sends per window, any combination */
+enum Stat : uint8_t
+{
+    MIN  = 0x01,
+    MAX  = 0x02,
+    MEAN = 0x04,
+    LAST = 0x08,
+};
+
+struct Channel
+{
+    float scale      = 1e-3f;  ///< Units per count the values are quantized to
+    uint16_t divider = 1;      ///< Ticks per window, the channel's rate is the tick rate / divider
+    uint8_t stats    = LAST;   ///< Stat flags sent per window, 0 leaves the channel out
+
+    constexpr Channel() {}
+    constexpr Channel(float scale_, uint16_t divider_, uint8_t stats_)
+        : scale(scale_),
+          divider(divider_),
+          stats(stats_)
+    {
+    }
+};
+
+/** @brief LEB128, 7 bits a byte low first, returns the bytes written (5 at most) */
+inline size_t putVarint(uint8_t* out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+/** @brief Small magnitudes of either sign to small numbers, 0 -1 1 -2 2 -> 0 1 2 3 4 */
+inline uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+/** @brief Nearest count of `scale`, saturated to the int32 range */
+inline int32_t quantize(float value, float scale)
+{
+    const float counts = value / scale;
+    if (!(counts > -2147483520.0f))  // also NaN
+    {
+        return counts > 0 ? INT32_MAX : INT32_MIN;
+    }
+    if (counts > 2147483520.0f)
+    {
+        return INT32_MAX;
+    }
+    return static_cast<int32_t>(lroundf(counts));
+}
+
+inline uint8_t crc8(const uint8_t* data, size_t length)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x80 ? static_cast<uint8_t>((crc << 1) ^ 0x07)
+                             : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Encodes CHANNELS values a tick into packets of at most PACKET_SIZE bytes and queues up
+ * to QUEUED of them for the link.
+ *
+ * sample() runs in the control tick, front()/pop() wherever the link is written. A packet is
+ * closed once it holds `packetTicks` ticks or the next tick doesn't fit, a closed packet that
+ * finds the queue full is dropped and the next one is a keyframe.
+ */
+template <uint8_t CHANNELS, size_t PACKET_SIZE = 128, size_t QUEUED = 8>
+class Encoder
+{
+public:
+    static_assert(PACKET_SIZE < 16384, "the length is a varint of 2 bytes at most");
+
+    // Sentinel, 2 byte length, flags, tick count, first tick and CRC around the values
+    static constexpr size_t FRAMING = 1 + 2 + 1 + 1 + 5 + 1;
+
+    Encoder() {}
+
+    /**
+     * @brief Takes a new channel table, restarts at tick 0 with an empty queue.
+     *
+     * @param channels CHANNELS entries, a channel with a scale that isn't positive is left out
+     * @param packetTicks most ticks per packet, 1 to 255, bounds the latency
+     * @param keyframeTicks ticks between keyframes
+     * @return EXIT_SUCCESS, or EXIT_FAILURE and the table is kept if one tick of every stream at
+     * its longest could overflow a packet
+     */
+    int configure(const Channel* channels, uint8_t packetTicks, uint32_t keyframeTicks)
+    {
+        size_t worst = FRAMING;
+        for (uint8_t c = 0; c < CHANNELS; c++)
+        {
+            if (channels[c].scale > 0.0f)
+            {
+                worst += 5 * streams(channels[c].stats);
+            }
+        }
+        if (worst > PACKET_SIZE)
+        {
+            return EXIT_FAILURE;
+        }
+
+        for (uint8_t c = 0; c < CHANNELS; c++)
+        {
+            channels_[c] = channels[c];
+            if (channels_[c].divider == 0)
+            {
+                channels_[c].divider = 1;
+            }
+            if (!(channels_[c].scale > 0.0f))
+            {
+                channels_[c].stats = 0;
+            }
+        }
+        packetTicks_   = packetTicks > 0 ? packetTicks : 1;
+        keyframeTicks_ = keyframeTicks > 0 ? keyframeTicks : 1;
+        restart();
+        return EXIT_SUCCESS;
+    }
+
+    /** @brief Streams a channel sends with these Stat flags */
+    static uint8_t streams(uint8_t stats)
+    {
+        return (stats & MIN ? 1 : 0) + (stats & MAX ? 1 : 0) + (stats & MEAN ? 1 : 0) +
+               (stats & LAST ? 1 : 0);
+    }
+
+    /** @brief Back to tick 0, forgets the open packet, the queue and the counters */
+    void restart()
+    {
+        for (uint8_t c = 0; c < CHANNELS; c++)
+        {
+            resetWindow(c);
+        }
+        tick_    = 0;
+        open_    = false;
+        keyNext_ = true;
+        lastKey_ = 0;
+        head_    = 0;
+        count_   = 0;
+        packets_ = 0;
+        bytes_   = 0;
+        values_  = 0;
+        dropped_ = 0;
+    }
+
+    const Channel& channel(uint8_t c) const { return channels_[c]; }
+
+    /**
+     * @brief One control tick, `values` holds CHANNELS values in the channels' units
+     * @return true if a packet was closed
+     */
+    bool sample(const float* values)
+    {
+        // The values of the windows ending on this tick and the streams they belong to
+        int32_t due[CHANNELS * 4];
+        uint8_t stream[CHANNELS * 4];
+        uint8_t dueCount = 0;
+        for (uint8_t c = 0; c < CHANNELS; c++)
+        {
+            const Channel& ch = channels_[c];
+            if (ch.stats == 0)
+            {
+                continue;
+            }
+            Window& w     = windows_[c];
+            const float v = values[c];
+            w.min         = v < w.min ? v : w.min;
+            w.max         = v > w.max ? v : w.max;
+            w.sum += v;
+            if (++w.count < ch.divider)
+            {
+                continue;
+            }
+            // Only ever reached on (tick_ + 1) % divider == 0, restart() lines the windows up
+            const float stat[4] = {w.min, w.max, w.sum / w.count, v};
+            for (uint8_t s = 0; s < 4; s++)
+            {
+                if (ch.stats & (1 << s))
+                {
+                    due[dueCount]    = quantize(stat[s], ch.scale);
+                    stream[dueCount] = c * 4 + s;
+                    dueCount++;
+                }
+            }
+            resetWindow(c);
+        }
+
+        bool closed = false;
+        if (!open_)
+        {
+            open();
+        }
+        size_t length = encode(due, stream, dueCount);
+        if (used_ + length + 1 > PACKET_SIZE)
+        {
+            close();
+            closed = true;
+            open();
+            length = encode(due, stream, dueCount);  // a keyframe starts from 0
+        }
+        memcpy(packet_ + used_, scratch_, length);
+        used_ += length;
+        for (uint8_t i = 0; i < dueCount; i++)
+        {
+            previous_[stream[i]] = due[i];
+        }
+        values_ += dueCount;
+        tick_++;
+        if (++ticks_ == packetTicks_)
+        {
+            close();
+            closed = true;
+        }
+        return closed;
+    }
+
+    /** @brief Closes the open packet early, at the end of a run */
+    bool flush()
+    {
+        if (!open_ || ticks_ == 0)
+        {
+            return false;
+        }
+        close();
+        return true;
+    }
+
+    /** @brief Oldest queued packet, whole with sentinel and CRC */
+    bool front(const uint8_t*& data, size_t& length) const
+    {
+        if (count_ == 0)
+        {
+            return false;
+        }
+        data   = queue_[head_].bytes;
+        length = queue_[head_].length;
+        return true;
+    }
+
+    void pop()
+    {
+        if (count_ > 0)
+        {
+            head_ = (head_ + 1) % QUEUED;
+            count_--;
+        }
+    }
+
+    size_t queued() const { return count_; }
+    uint32_t tick() const { return tick_; }
+    uint32_t packets() const { return packets_; }  ///< Queued since restart()
+    uint32_t bytes() const { return bytes_; }      ///< Of the queued packets, framing included
+    uint32_t values() const { return values_; }    ///< Quantized values encoded
+    uint32_t dropped() const { return dropped_; }  ///< Packets the full queue turned away
+
+private:
+    static constexpr size_t HEAD = 3;  // room for the sentinel and a 2 byte length in front
+
+    struct Window
+    {
+        float min;
+        float max;
+        float sum;
+        uint16_t count;
+    };
+
+    struct Slot
+    {
+        uint8_t bytes[PACKET_SIZE];
+        size_t length;
+    };
+
+    void resetWindow(uint8_t c)
+    {
+        windows_[c].min   = INFINITY;
+        windows_[c].max   = -INFINITY;
+        windows_[c].sum   = 0.0f;
+        windows_[c].count = 0;
+    }
+
+    void open()
+    {
+        const bool key = keyNext_ || tick_ - lastKey_ >= keyframeTicks_;
+        if (key)
+        {
+            memset(previous_, 0, sizeof(previous_));
+            lastKey_ = tick_;
+            keyNext_ = false;
+        }
+        packet_[HEAD]     = key ? KEYFRAME : 0;
+        packet_[HEAD + 1] = 0;  // ticks, filled in by close()
+        used_             = HEAD + 2 + putVarint(packet_ + HEAD + 2, tick_);
+        ticks_            = 0;
+        open_             = true;
+    }
+
+    /** @brief Varints of this tick's values into scratch_, previous_ untouched */
+    size_t encode(const int32_t* due, const uint8_t* stream, uint8_t dueCount)
+    {
+        size_t n = 0;
+        for (uint8_t i = 0; i < dueCount; i++)
+        {
+            // Wraps like the host's int32 sum does
+            const uint32_t change =
+                static_cast<uint32_t>(due[i]) - static_cast<uint32_t>(previous_[stream[i]]);
+            n += putVarint(scratch_ + n, zigzag(static_cast<int32_t>(change)));
+        }
+        return n;
+    }
+
+    void close()
+    {
+        open_             = false;
+        packet_[HEAD + 1] = ticks_;
+        const size_t body = used_ - HEAD;
+        packet_[used_]    = crc8(packet_ + HEAD, body);
+
+        // Sentinel and length in front of the body, the length takes 1 or 2 bytes
+        const size_t start = HEAD - 1 - (body < 0x80 ? 1 : 2);
+        packet_[start]     = SENTINEL;
+        putVarint(packet_ + start + 1, static_cast<uint32_t>(body));
+        const size_t length = used_ + 1 - start;
+
+        if (count_ == QUEUED)
+        {
+            dropped_++;
+            keyNext_ = true;  // the host lost a link of the chain
+            return;
+        }
+        Slot& slot = queue_[(head_ + count_) % QUEUED];
+        memcpy(slot.bytes, packet_ + start, length);
+        slot.length = length;
+        count_++;
+        packets_++;
+        bytes_ += length;
+    }
+
+    Channel channels_[CHANNELS];
+    Window windows_[CHANNELS];
+    int32_t previous_[CHANNELS * 4] = {};  // last value of every stream, channel * 4 + stat bit
+    uint8_t packetTicks_    = 10;
+    uint32_t keyframeTicks_ = 1000;
+
+    uint32_t tick_    = 0;
+    uint32_t lastKey_ = 0;
+    bool keyNext_     = true;
+
+    uint8_t packet_[HEAD + PACKET_SIZE];
+    uint8_t scratch_[CHANNELS * 4 * 5];  // one tick of varints
+    size_t used_   = 0;
+    uint8_t ticks_ = 0;
+    bool open_     = false;
+
+    Slot queue_[QUEUED];
+    size_t head_  = 0;
+    size_t count_ = 0;
+
+    uint32_t packets_ = 0;
+    uint32_t bytes_   = 0;
+    uint32_t values_  = 0;
+    uint32_t dropped_ = 0;
+};
+}  // namespace telemetry
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "hot_path.hpp"
+#include "spectrum_monitor.hpp"
+
+/**
+ * @brief Runs the spectrum::SpectrumMonitor of the jaw rotation velocity in a background FreeRTOS
+ * task, so chatter, a loose clamp or a worn bearing show up without extra sensors.
+ *
+ * The control tick pushes one velocity sample per tick into a double buffered window. When a
+ * window fills, the task is woken to analyse it on the other core at low priority while the next
+ * window fills, the control loop never waits on it. Everything is statically allocated, including
+ * the task stack, and a window costs a fixed Monitor::OPERATIONS multiply-adds. A window that
+ * fills before the previous analysis finished is dropped and counted as an overrun.
+ */
+class VibrationMonitor
+{
+public:
+    static constexpr uint16_t WINDOW = 256;  // 0.256 s at 1 kHz, ~4 Hz resolution
+    static constexpr uint8_t BINS    = 32;
+    static constexpr uint8_t BANDS   = 4;
+
+    typedef spectrum::WindowBuffer<WINDOW> Buffer;
+    typedef spectrum::SpectrumMonitor<WINDOW, BINS, BANDS> Monitor;
+    typedef spectrum::Summary<BANDS> Summary;
+
+    // ~10k multiply-adds, well under a millisecond of the second core every 256 ms
+    static_assert(Monitor::OPERATIONS <= 16384, "spectrum work per window over budget");
+
+    struct Status
+    {
+        Summary summary;
+        uint32_t overruns   = 0;  ///< Windows dropped because the task fell behind
+        uint32_t busyMicros = 0;  ///< Time the last analysis took
+    };
+
+    VibrationMonitor() = default;
+
+    /**
+     * @brief Configures the bins and thresholds and starts the task.
+     *
+     * @param cfg bins and full scale of the spectrum, Ts must match the rate push() is called at
+     * @param thresholds RMS per band that raises an event, 0 disables the band
+     * @return EXIT_SUCCESS, or EXIT_FAILURE if the configuration is invalid or the task could not
+     * be created
+     */
+    int begin(const spectrum::Config& cfg, const float (&thresholds)[BANDS]);
+
+    /** @brief Adds one velocity sample, called from the control tick */
+    HOT_PATH void push(float velocity)
+    {
+        if (!active_)
+        {
+            return;
+        }
+        const int16_t* full = buffer_.push(Buffer::quantize(velocity, fullScale_));
+        if (full)
+        {
+            handOver(full);
+        }
+    }
+
+    /** @brief Copy of the latest summary and task statistics */
+    Status status();
+
+    /** @brief Bands that went over their threshold since the last call, one bit per band */
+    uint32_t takeEvents();
+
+    bool isActive() const { return active_; }
+
+private:
+    static constexpr uint32_t STACK_SIZE = 4096;  // bytes, StackType_t is a byte on ESP-IDF
+
+    static void taskEntry(void* self);
+    void task();
+    void handOver(const int16_t* window);
+
+    Buffer buffer_;
+    Monitor monitor_;
+    float fullScale_ = 20.0f;
+    bool active_     = false;
+
+    const int16_t* volatile pending_ = nullptr;  // window handed to the task, set by push()
+    volatile bool busy_              = false;    // task is analysing, cleared when it is done
+    volatile uint32_t overruns_      = 0;
+
+    Status status_;
+    uint32_t events_   = 0;
+    portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+    TaskHandle_t handle_ = nullptr;
+    StaticTask_t taskBuffer_;
+    StackType_t stack_[STACK_SIZE];
+};
@@ -14,7 +14,6 @@
 
 #include "RotaryEncoder.h"
 #include "Arduino.h"
-#include "PCF8575.h"
 
 #define LATCH0 0 // input state at position 0
 #define LATCH3 3 // input state at position 3
@@ -39,8 +38,8 @@ const int8_t KNOBDIR[] = {
 
 // ----- Initialization and Default Values -----
 
-RotaryEncoder::RotaryEncoder(int pin1, int pin2, ReadFunction reader, LatchMode mode)
-  : _readPin(reader)
+RotaryEncoder::RotaryEncoder(int pin1, int pin2, ReadFunction reader, void *context, LatchMode mode)
+  : _readPin(reader), _readContext(context)
 {
   // Remember Hardware Setup
   _pin1 = pin1;
@@ -54,8 +53,8 @@ RotaryEncoder::RotaryEncoder(int pin1, int pin2, ReadFunction reader, LatchMode
   // pinMode(pin2, INPUT_PULLUP);
 
   // when not started in motion, the current state of the encoder should be 3
-  int sig1 = _readPin(_pin1);
-  int sig2 = _readPin(_pin2);
+  int sig1 = _readPin(_readContext, _pin1);
+  int sig2 = _readPin(_readContext, _pin2);
   _oldState = sig1 | (sig2 << 1);
 
   // start with position 0;
@@ -114,8 +113,8 @@ void RotaryEncoder::setPosition(long newPosition)
 
 void RotaryEncoder::tick(void)
 {
-  int sig1 = _readPin(_pin1);
-  int sig2 = _readPin(_pin2);
+  int sig1 = _readPin(_readContext, _pin1);
+  int sig2 = _readPin(_readContext, _pin2);
   int8_t thisState = sig1 | (sig2 << 1);
 
   if (_oldState != thisState) {
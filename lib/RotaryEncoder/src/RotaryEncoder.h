@@ -19,8 +19,6 @@
 #define RotaryEncoder_h
 
 #include "Arduino.h"
-#include "PCF8575.h"
-#include <functional>
 
 class RotaryEncoder
 {
@@ -37,10 +35,12 @@ public:
     TWO03 = 3  // 2 steps, Latch at position 0 and 3 
   };
 
-  using ReadFunction = std::function<int(int)>;
+  // Reads one encoder pin, context is passed back untouched (e.g. the IO expander to read from).
+  // A plain function pointer instead of std::function keeps the heap and its code out of it.
+  typedef int (*ReadFunction)(void *context, int pin);
 
   // ----- Constructor -----
-  RotaryEncoder(int pin1, int pin2, ReadFunction reader, LatchMode mode = LatchMode::FOUR0);
+  RotaryEncoder(int pin1, int pin2, ReadFunction reader, void *context, LatchMode mode = LatchMode::FOUR0);
 
   // retrieve the current position
   long getPosition();
@@ -65,8 +65,6 @@ private:
   
   LatchMode _mode; // Latch mode from initialization
 
-  PCF8575 ioExtender;
-
   volatile int8_t _oldState;
 
   volatile long _position;        // Internal position (4 times _positionExt)
@@ -77,6 +75,7 @@ private:
   unsigned long _positionExtTimePrev; // The time the previous position change was detected.
 
   ReadFunction _readPin;
+  void *_readContext;
 };
 
 #endif
@@ -0,0 +1,251 @@
+"""Runs the scripted sessions in sim/golden through the native build and compares the traces.
+
+Each NAME.session is run with the tick clock, so the run is repeatable, and its trace is compared
+with NAME.trace next to it (see sim/include/sim.hpp for both formats):
+
+  - the lines sent and the text the device printed must match, "At Pos" aside,
+  - every axis must follow the golden steps to within --steps, allowing --time ms of lag or lead,
+  - every axis must end on the golden step count to within --steps.
+
+Timing deltas are reported whether or not the traces match: per command the time to the first
+"At Pos" and to the last step before the next command (settle), and the cycle time from the first
+command to the last step.
+
+Usage:
+    pio run -e native_sim
+    python scripts/golden_traces.py
+    python scripts/golden_traces.py pass --time 5 --steps 4
+    python scripts/golden_traces.py --bless     # rewrites the golden traces after a wanted change
+
+The traces depend on how AccelStepper steps, so --bless also writes the AccelStepper version the
+native_sim build pulled from lib_deps to sim/golden/LIBRARY. A run against another version fails
+before comparing, check its deltas with --force and re-bless. Goldens are only blessed from a
+`pio run -e native_sim` build, until then there is nothing to compare against and the run fails.
+"""
+import argparse
+import bisect
+import os
+import subprocess
+import sys
+import tempfile
+from dataclasses import dataclass, field
+from typing import List, Optional, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_SIM = os.path.join(ROOT, ".pio", "build", "native_sim", "program")
+DEFAULT_GOLDEN = os.path.join(ROOT, "sim", "golden")
+AXES = ("jaw_rotation", "jaw_pos", "clamp")
+ACK = "At Pos"
+LIBRARY_STAMP = "LIBRARY"
+
+
+@dataclass
+class Trace:
+    events: List[Tuple[int, str, str]] = field(default_factory=list)  # t_us, kind, text
+    times: List[int] = field(default_factory=list)
+    steps: List[Tuple[int, int, int]] = field(default_factory=list)
+
+    def span(self, start: int, end: int, axis: int) -> Tuple[int, int]:
+        """Lowest and highest step count of an axis between start and end."""
+        first = max(bisect.bisect_right(self.times, start) - 1, 0)
+        last = max(bisect.bisect_right(self.times, end), first + 1)
+        values = [s[axis] for s in self.steps[first:last]]
+        return min(values), max(values)
+
+    def sent(self) -> List[Tuple[int, str]]:
+        return [(t, text) for t, kind, text in self.events if kind == "tx"]
+
+    def printed(self) -> List[str]:
+        return [text for _, kind, text in self.events if kind == "rx" and text != ACK]
+
+
+def load(path: str) -> Trace:
+    trace = Trace()
+    with open(path) as f:
+        for line in f:
+            parts = line.rstrip("\n").split(" ", 3)
+            if parts[0] == "E":
+                trace.events.append((int(parts[1]), parts[2], parts[3] if len(parts) > 3 else ""))
+            elif parts[0] == "S":
+                values = line.split()
+                trace.times.append(int(values[1]))
+                trace.steps.append((int(values[2]), int(values[3]), int(values[4])))
+    if not trace.times:
+        raise ValueError(f"{path} has no samples")
+    return trace
+
+
+def run(sim: str, session: str, trace: str, tick: int, period: int) -> None:
+    """Runs a session on a fresh storage directory, so stored settings can't leak between runs."""
+    with tempfile.TemporaryDirectory() as storage:
+        result = subprocess.run(
+            [sim, "--tick", str(tick), "--speed", "0", "--storage", storage,
+             "--session", session, "--trace", trace, "--trace-us", str(period)],
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"{os.path.basename(session)}: the simulator failed\n{result.stderr}")
+
+
+@dataclass
+class Timing:
+    cycle: int
+    acks: List[Optional[int]]  # per command, µs from sending to the first "At Pos" answering it
+    settles: List[int]  # per command, µs from sending to the last step before the next command
+
+
+def timing(trace: Trace) -> Timing:
+    sent = trace.sent()
+    start = sent[0][0] if sent else trace.times[0]
+    moves = [t for i, t in enumerate(trace.times[1:], 1) if trace.steps[i] != trace.steps[i - 1]]
+    cycle = (moves[-1] - start) if moves else 0
+
+    reads = [t for t, kind, _ in trace.events if kind == "read"]
+
+    acks, settles = [], []
+    for i, (t, _) in enumerate(sent):
+        end = sent[i + 1][0] if i + 1 < len(sent) else trace.times[-1]
+        # The "At Pos" before the firmware read the frame still answer the previous command
+        read = next((r for r in reads if r > t), end)
+        ack = next((e for e, kind, text in trace.events if kind == "rx" and text == ACK and
+                    read <= e <= end and e > t), None)
+        acks.append(None if ack is None else ack - t)
+        last = [m for m in moves if t < m <= end]
+        settles.append(last[-1] - t if last else 0)
+    return Timing(cycle, acks, settles)
+
+
+def compare(golden: Trace, trace: Trace, steps: int, time_us: int) -> List[str]:
+    """Differences beyond the tolerances, empty if the traces match."""
+    problems = []
+    gold_sent, sent = golden.sent(), trace.sent()
+    if [text for _, text in gold_sent] != [text for _, text in sent]:
+        problems.append("the lines sent differ, the session or an ack changed")
+    else:
+        for (t0, text), (t1, _) in zip(gold_sent, sent):
+            if abs(t1 - t0) > time_us:
+                problems.append(f"'{text}' sent {(t1 - t0) / 1000:+.1f} ms off the golden")
+    if golden.printed() != trace.printed():
+        problems.append("the device printed different text")
+
+    # Each trace must pass within the tolerance band of the other, in time and in steps
+    for name, a, b in (("golden", golden, trace), ("run", trace, golden)):
+        for axis, label in enumerate(AXES):
+            worst = None
+            for t, s in zip(a.times, a.steps):
+                low, high = b.span(t - time_us, t + time_us, axis)
+                miss = max(low - s[axis], s[axis] - high, 0)
+                if miss > steps and (worst is None or miss > worst[1]):
+                    worst = (t, miss)
+            if worst is not None:
+                problems.append(f"{label} leaves the {name} band by {worst[1]} steps at "
+                                f"{worst[0] / 1e6:.3f} s")
+
+    for axis, label in enumerate(AXES):
+        end, gold_end = trace.steps[-1][axis], golden.steps[-1][axis]
+        if abs(end - gold_end) > steps:
+            problems.append(f"{label} ends at {end} steps, golden {gold_end}")
+    return problems
+
+
+def ms(us: Optional[int]) -> str:
+    return "-" if us is None else f"{us / 1000:.2f}"
+
+
+def delta(now: Optional[int], then: Optional[int]) -> str:
+    return "-" if now is None or then is None else f"{(now - then) / 1000:+.2f}"
+
+
+def report(golden: Trace, trace: Trace, out=sys.stdout) -> None:
+    then, now = timing(golden), timing(trace)
+    print(f"  {'command':<32} {'ack ms':>8} {'delta':>7} {'settle ms':>10} {'delta':>7}", file=out)
+    rows = zip(trace.sent(), now.acks, then.acks, now.settles, then.settles)
+    for (_, text), ack, gold_ack, settle, gold_settle in rows:
+        print(f"  {text[:32]:<32} {ms(ack):>8} {delta(ack, gold_ack):>7} {ms(settle):>10} "
+              f"{delta(settle, gold_settle):>7}", file=out)
+    print(f"  cycle {ms(now.cycle)} ms, {delta(now.cycle, then.cycle)} ms on the golden", file=out)
+
+
+def stepper_library(sim: str) -> Optional[str]:
+    """AccelStepper version of the PlatformIO build the program came from, None if unknown."""
+    build = os.path.dirname(os.path.abspath(sim))
+    properties = os.path.join(build, "..", "..", "libdeps", os.path.basename(build),
+                              "AccelStepper", "library.properties")
+    if not os.path.isfile(properties):
+        return None
+    with open(properties) as f:
+        for line in f:
+            if line.startswith("version="):
+                return "AccelStepper " + line.split("=", 1)[1].strip()
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("names", nargs="*", help="sessions to run, all of them by default")
+    parser.add_argument("--sim", default=DEFAULT_SIM, help="native_sim program")
+    parser.add_argument("--golden", default=DEFAULT_GOLDEN, help="sessions and golden traces")
+    parser.add_argument("--tick", type=int, default=5, help="virtual µs per loop()")
+    parser.add_argument("--period", type=int, default=5000, help="trace sample period, µs")
+    parser.add_argument("--steps", type=int, default=2, help="step tolerance per axis")
+    parser.add_argument("--time", type=float, default=2.0, help="time tolerance, ms")
+    parser.add_argument("--bless", action="store_true", help="write the runs as the golden traces")
+    parser.add_argument("--force", action="store_true",
+                        help="compare even if the goldens were recorded with another AccelStepper")
+    args = parser.parse_args()
+
+    library = stepper_library(args.sim)
+    stamp_path = os.path.join(args.golden, LIBRARY_STAMP)
+    if args.bless:
+        if library is None:
+            print(f"Can't tell which AccelStepper {args.sim} was built with, bless a "
+                  "`pio run -e native_sim` build")
+            sys.exit(1)
+        with open(stamp_path, "w") as f:
+            f.write(library + "\n")
+    else:
+        if not os.path.isfile(stamp_path):
+            print(f"No golden traces in {args.golden}, bless them from a `pio run -e native_sim` "
+                  "build")
+            sys.exit(1)
+        recorded = open(stamp_path).read().strip()
+        if library is None:
+            print(f"{args.sim} is not a PlatformIO build, goldens were recorded with {recorded}")
+        elif library != recorded and not args.force:
+            print(f"The goldens were recorded with {recorded}, this build uses {library}. "
+                  "Check the deltas with --force and --bless if they are wanted.")
+            sys.exit(1)
+
+    names = args.names or sorted(os.path.splitext(f)[0] for f in os.listdir(args.golden)
+                                 if f.endswith(".session"))
+    failed = []
+    with tempfile.TemporaryDirectory() as scratch:
+        for name in names:
+            session = os.path.join(args.golden, name + ".session")
+            golden_path = os.path.join(args.golden, name + ".trace")
+            trace_path = golden_path if args.bless else os.path.join(scratch, name + ".trace")
+            run(args.sim, session, trace_path, args.tick, args.period)
+            if args.bless:
+                print(f"{name}: blessed")
+                continue
+
+            if not os.path.isfile(golden_path):
+                print(f"{name}: FAIL\n  no golden trace, bless it")
+                failed.append(name)
+                continue
+            golden, trace = load(golden_path), load(trace_path)
+            problems = compare(golden, trace, args.steps, int(args.time * 1000))
+            print(f"{name}: {'FAIL' if problems else 'ok'}")
+            for problem in problems:
+                print(f"  {problem}")
+            report(golden, trace)
+            if problems:
+                failed.append(name)
+
+    if failed:
+        print(f"\n{len(failed)} of {len(names)} session(s) left their golden traces: "
+              f"{', '.join(failed)}")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,266 @@
+"""Parses the GNU ld map file of the firmware and reports what lives in IRAM vs flash.
+
+Usage:
+    python scripts/linker_map.py .pio/build/arduino_nano_esp32/firmware.map [--modules N]
+
+The same parser is used by scripts/pio_map_report.py after every firmware build.
+"""
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+from collections import defaultdict
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional
+
+# Output section -> memory region. Anything not listed falls back to the address ranges below.
+REGION_BY_SECTION = {
+    ".iram0.vectors": "IRAM",
+    ".iram0.text": "IRAM",
+    ".iram0.text_end": "IRAM",
+    ".iram0.data": "IRAM",
+    ".iram0.bss": "IRAM",
+    ".dram0.data": "DRAM",
+    ".dram0.bss": "DRAM",
+    ".noinit": "DRAM",
+    ".flash.text": "FLASH_TEXT",
+    ".flash.rodata": "FLASH_RODATA",
+    ".flash.appdesc": "FLASH_RODATA",
+    ".flash.rodata_noload": "FLASH_RODATA",
+    ".flash_rodata_dummy": None,
+    ".flash.text_dummy": None,
+}
+
+# ESP32-S3 address map, used when the section name is unknown
+REGION_BY_ADDRESS = [
+    (0x40370000, 0x403E0000, "IRAM"),
+    (0x3FC88000, 0x3FD00000, "DRAM"),
+    (0x42000000, 0x44000000, "FLASH_TEXT"),
+    (0x3C000000, 0x3E000000, "FLASH_RODATA"),
+    (0x50000000, 0x50002000, "RTC"),
+    (0x600FE000, 0x60100000, "RTC"),
+]
+
+REGIONS = ("IRAM", "DRAM", "FLASH_TEXT", "FLASH_RODATA", "RTC")
+
+# Input sections produced by the HOT_PATH macro (include/hot_path.hpp)
+HOT_SECTION_PREFIX = ".iram1.hot."
+
+# Functions that run on every pass of the step loop or in interrupts. If any of them shows up in
+# flash the report warns about it.
+HOT_SYMBOLS = (
+    "Cleaner::run()",
+    "Cleaner::runControl()",
+    "Cleaner::updateRealState()",
+    "Cleaner::updateJawEncoder()",
+    "Cleaner::updateJawVelocity()",
+    "Cleaner::sampleVibration()",
+    "VibrationMonitor::handOver(",
+    "spectrum::WindowBuffer<",
+    "Cleaner::PCFMessageRec()",
+    "StepperMotor::step(long)",
+    "DiscreteFilter<",
+    "AdaptiveNotch::filterData(",
+    "shaping::InputShaper<",
+    "compensation::LeadScrewCompensator::",
+    "StepOutputBatch<",
+    "IsrTrampoline<",
+    "AccelStepper::run()",
+    "AccelStepper::runSpeed()",
+    "AccelStepper::computeNewSpeed()",
+)
+
+_OUTPUT_SECTION = re.compile(r"^(\.[^\s]+)(?:\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+))?")
+_INPUT_FULL = re.compile(r"^ (\.[^\s]+|COMMON)\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(\S.*)$")
+_INPUT_NAME = re.compile(r"^ (\.[^\s]+|COMMON)\s*$")
+_INPUT_CONT = re.compile(r"^\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(\S.*)$")
+_SYMBOL = re.compile(r"^\s+(0x[0-9a-fA-F]+)\s+([^\s=]+)\s*$")
+
+
+@dataclass
+class InputSection:
+    name: str
+    output: str
+    address: int
+    size: int
+    obj: str
+    symbols: List[str] = field(default_factory=list)
+
+    @property
+    def region(self) -> Optional[str]:
+        return region_of(self.output, self.address)
+
+    @property
+    def module(self) -> str:
+        return module_of(self.obj)
+
+    @property
+    def hot(self) -> bool:
+        return self.name.startswith(HOT_SECTION_PREFIX)
+
+
+def region_of(output_section: str, address: int) -> Optional[str]:
+    if output_section in REGION_BY_SECTION:
+        return REGION_BY_SECTION[output_section]
+    for low, high, region in REGION_BY_ADDRESS:
+        if low <= address < high:
+            return region
+    return None
+
+
+def module_of(obj: str) -> str:
+    """Short, stable name for an object file: project sources by path, libraries by archive."""
+    obj = obj.replace("\\", "/")
+    archive = re.match(r"(?:.*/)?([^/()]+\.a)\((.+)\)$", obj)
+    if archive:
+        return archive.group(1)
+    if "/src/" in obj:
+        return "src/" + re.sub(r"\.o(bj)?$", "", obj.split("/src/", 1)[1])
+    # PlatformIO builds each library in .pio/build/<env>/lib<hash>/<Library>/
+    library = re.search(r"/lib[0-9a-f]*/([^/]+)/", obj)
+    if library:
+        return library.group(1)
+    return re.sub(r"\.o(bj)?$", "", os.path.basename(obj))
+
+
+def parse_map(path: str) -> List[InputSection]:
+    sections: List[InputSection] = []
+    current_output = ""
+    pending_name: Optional[str] = None
+    in_memory_map = False
+
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_memory_map:
+                in_memory_map = line.startswith("Linker script and memory map")
+                continue
+
+            if pending_name is not None:
+                cont = _INPUT_CONT.match(line)
+                if cont:
+                    sections.append(InputSection(
+                        pending_name, current_output, int(cont.group(1), 16),
+                        int(cont.group(2), 16), cont.group(3).strip()))
+                pending_name = None
+                if cont:
+                    continue
+
+            if line.startswith("."):
+                out = _OUTPUT_SECTION.match(line)
+                if out:
+                    current_output = out.group(1)
+                continue
+
+            full = _INPUT_FULL.match(line)
+            if full:
+                sections.append(InputSection(
+                    full.group(1), current_output, int(full.group(2), 16),
+                    int(full.group(3), 16), full.group(4).strip()))
+                continue
+
+            name = _INPUT_NAME.match(line)
+            if name:
+                pending_name = name.group(1)
+                continue
+
+            sym = _SYMBOL.match(line)
+            if sym and sections:
+                sections[-1].symbols.append(sym.group(2))
+
+    return [s for s in sections if s.size > 0]
+
+
+def demangle(names: List[str]) -> Dict[str, str]:
+    """Demangles with whichever c++filt is around, returns the names unchanged otherwise."""
+    tool = None
+    for candidate in ("xtensa-esp32s3-elf-c++filt", "xtensa-esp-elf-c++filt", "c++filt"):
+        tool = shutil.which(candidate)
+        if tool:
+            break
+    if not tool or not names:
+        return {n: n for n in names}
+    result = subprocess.run([tool], input="\n".join(names), capture_output=True, text=True)
+    demangled = result.stdout.splitlines()
+    if len(demangled) != len(names):
+        return {n: n for n in names}
+    return dict(zip(names, demangled))
+
+
+def section_label(section: InputSection, names: Dict[str, str]) -> str:
+    if section.symbols:
+        return names.get(section.symbols[0], section.symbols[0])
+    return section.name
+
+
+def region_totals(sections: List[InputSection]) -> Dict[str, int]:
+    totals = defaultdict(int)
+    for s in sections:
+        if s.region:
+            totals[s.region] += s.size
+    return totals
+
+
+def module_totals(sections: List[InputSection]) -> Dict[str, Dict[str, int]]:
+    totals: Dict[str, Dict[str, int]] = defaultdict(lambda: defaultdict(int))
+    for s in sections:
+        if s.region:
+            totals[s.module][s.region] += s.size
+    return totals
+
+
+def report(path: str, max_modules: int = 20, out=sys.stdout) -> int:
+    """Prints the IRAM/flash report, returns the number of hot symbols found in flash."""
+    sections = parse_map(path)
+    names = demangle(sorted({sym for s in sections for sym in s.symbols}))
+
+    totals = region_totals(sections)
+    print("Memory usage by region (bytes)", file=out)
+    for region in REGIONS:
+        print(f"  {region:<13} {totals.get(region, 0):>9}", file=out)
+
+    hot = [s for s in sections if s.hot]
+    print(f"\nCurated hot path ({len(hot)} functions, "
+          f"{sum(s.size for s in hot)} bytes)", file=out)
+    for s in sorted(hot, key=lambda s: -s.size):
+        print(f"  {s.region or '?':<13} {s.size:>7}  {section_label(s, names)}", file=out)
+
+    misplaced = []
+    for s in sections:
+        if s.region != "FLASH_TEXT":
+            continue
+        label = section_label(s, names)
+        if any(label.startswith(h) or h in label for h in HOT_SYMBOLS):
+            misplaced.append((s, label))
+    if misplaced:
+        print("\nWARNING: hot functions executing from flash", file=out)
+        for s, label in misplaced:
+            print(f"  {s.size:>7}  {label}  ({s.module})", file=out)
+
+    modules = module_totals(sections)
+    ranked = sorted(modules.items(), key=lambda kv: -(kv[1]["IRAM"] + kv[1]["FLASH_TEXT"]))
+    print(f"\nTop {max_modules} modules by code size (bytes)", file=out)
+    print(f"  {'module':<48} {'IRAM':>8} {'FLASH':>8} {'RODATA':>8} {'DRAM':>8}", file=out)
+    for module, sizes in ranked[:max_modules]:
+        print(f"  {module[:48]:<48} {sizes['IRAM']:>8} {sizes['FLASH_TEXT']:>8} "
+              f"{sizes['FLASH_RODATA']:>8} {sizes['DRAM']:>8}", file=out)
+
+    return len(misplaced)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--modules", type=int, default=20, help="number of modules to list")
+    parser.add_argument("--strict", action="store_true",
+                        help="exit non-zero when a hot function is left in flash")
+    args = parser.parse_args()
+
+    misplaced = report(args.map, args.modules)
+    sys.exit(1 if args.strict and misplaced else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,29 @@
+"""PlatformIO extra script, prints the IRAM/flash placement and size budget reports after the
+firmware links.
+
+Enabled from platformio.ini with `extra_scripts = post:scripts/pio_map_report.py`, the map file is
+written by the `-Wl,-Map` build flag.
+"""
+import os
+import sys
+
+Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+
+sys.path.insert(0, os.path.join(env.subst("$PROJECT_DIR"), "scripts"))  # noqa: F821
+
+import linker_map  # noqa: E402
+import size_budget  # noqa: E402
+
+
+def map_report(source, target, env):
+    map_path = os.path.join(env.subst("$BUILD_DIR"), "firmware.map")
+    if not os.path.isfile(map_path):
+        print(f"Linker map not found at {map_path}, is -Wl,-Map in build_flags?")
+        return
+    print("\n========== Hot path placement ==========")
+    linker_map.report(map_path)
+    print("\n========== Size budget ==========")
+    size_budget.check(map_path)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", map_report)  # noqa: F821
@@ -0,0 +1,140 @@
+"""Checks the flash/RAM footprint of every module against the budgets in size_budget.json.
+
+Usage:
+    python scripts/size_budget.py .pio/build/arduino_nano_esp32/firmware.map [--strict]
+    python scripts/size_budget.py .pio/build/arduino_nano_esp32/firmware.map --calibrate
+
+--calibrate rewrites the budgets of the listed modules from the map, with HEADROOM on top of the
+measured size, run it after a change that is meant to grow a module and commit the json with it.
+
+Also flags heavy library facilities (std::vector, std::string, std::function, std::complex,
+Arduino String) instantiated by the project's own sources, those have fixed-size replacements.
+"""
+import argparse
+import json
+import os
+import re
+import sys
+from typing import Dict, List, Tuple
+
+import linker_map
+
+DEFAULT_BUDGET = os.path.join(os.path.dirname(os.path.abspath(__file__)), "size_budget.json")
+
+# Margin left above the measured size by --calibrate, budgets are rounded up to these steps
+HEADROOM = 1.25
+FLASH_STEP = 1024
+RAM_STEP = 256
+
+
+def module_footprint(sizes: Dict[str, int]) -> Tuple[int, int]:
+    flash = sizes.get("IRAM", 0) + sizes.get("FLASH_TEXT", 0) + sizes.get("FLASH_RODATA", 0)
+    ram = sizes.get("IRAM", 0) + sizes.get("DRAM", 0)
+    return flash, ram
+
+
+def round_up(value: float, step: int) -> int:
+    return max(step, int(-(-value // step)) * step)
+
+
+def calibrate(map_path: str, budget_path: str = DEFAULT_BUDGET, out=sys.stdout):
+    """Sets the budget of every module listed in the json to its size in the map plus HEADROOM."""
+    with open(budget_path) as f:
+        budget = json.load(f)
+
+    modules = linker_map.module_totals(linker_map.parse_map(map_path))
+    print(f"  {'module':<40} {'flash':>8} {'budget':>8} {'ram':>8} {'budget':>8}", file=out)
+    for module, limits in budget["modules"].items():
+        if module not in modules:
+            print(f"  {module[:40]:<40} not in the map, budget kept", file=out)
+            continue
+        flash, ram = module_footprint(modules[module])
+        limits["flash"] = round_up(flash * HEADROOM, FLASH_STEP)
+        limits["ram"] = round_up(ram * HEADROOM, RAM_STEP)
+        print(f"  {module[:40]:<40} {flash:>8} {limits['flash']:>8} {ram:>8} {limits['ram']:>8}",
+              file=out)
+
+    with open(budget_path) as f:
+        text = f.read()
+    for module, limits in budget["modules"].items():
+        text = re.sub(r'("%s": )\{[^}]*\}' % re.escape(module),
+                      lambda m: m.group(1) + json.dumps(limits), text)
+    with open(budget_path, "w") as f:
+        f.write(text)
+
+
+def check(map_path: str, budget_path: str = DEFAULT_BUDGET, out=sys.stdout) -> List[str]:
+    """Prints the budget report and returns the list of violations."""
+    with open(budget_path) as f:
+        budget = json.load(f)
+
+    sections = linker_map.parse_map(map_path)
+    violations: List[str] = []
+
+    print("Region totals vs budget (bytes)", file=out)
+    totals = linker_map.region_totals(sections)
+    for region, limit in budget["regions"].items():
+        used = totals.get(region, 0)
+        status = "OVER" if used > limit else "ok"
+        print(f"  {region:<13} {used:>9} / {limit:>9}  {100.0 * used / limit:5.1f}%  {status}",
+              file=out)
+        if used > limit:
+            violations.append(f"{region} uses {used} bytes, budget {limit}")
+
+    print("\nModule footprint vs budget (bytes)", file=out)
+    print(f"  {'module':<40} {'flash':>8} {'budget':>8} {'ram':>8} {'budget':>8}", file=out)
+    default = budget["default_module"]
+    modules = linker_map.module_totals(sections)
+    ranked = sorted(modules.items(), key=lambda kv: -module_footprint(kv[1])[0])
+    for module, sizes in ranked:
+        flash, ram = module_footprint(sizes)
+        limits = budget["modules"].get(module, default)
+        over = flash > limits["flash"] or ram > limits["ram"]
+        if module in budget["modules"] or over:
+            print(f"  {module[:40]:<40} {flash:>8} {limits['flash']:>8} {ram:>8} "
+                  f"{limits['ram']:>8}  {'OVER' if over else 'ok'}", file=out)
+        if over:
+            violations.append(f"{module} uses {flash} flash / {ram} ram bytes, "
+                              f"budget {limits['flash']} / {limits['ram']}")
+
+    names = linker_map.demangle(sorted({sym for s in sections for sym in s.symbols}))
+    heavy = []
+    for s in sections:
+        if not s.module.startswith("src/") or not s.region:
+            continue
+        label = linker_map.section_label(s, names)
+        for pattern in budget.get("forbidden_in_project", []):
+            if pattern in label:
+                heavy.append((s.module, s.size, label))
+                break
+    if heavy:
+        print("\nHeavy facilities instantiated by project sources", file=out)
+        for module, size, label in heavy:
+            print(f"  {size:>7}  {module}: {label}", file=out)
+            violations.append(f"{module} instantiates {label}")
+
+    if violations:
+        print(f"\n{len(violations)} size budget violation(s)", file=out)
+    else:
+        print("\nAll modules within budget", file=out)
+    return violations
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--budget", default=DEFAULT_BUDGET, help="budget json file")
+    parser.add_argument("--strict", action="store_true", help="exit non-zero on any violation")
+    parser.add_argument("--calibrate", action="store_true",
+                        help="rewrite the module budgets from the map instead of checking")
+    args = parser.parse_args()
+
+    if args.calibrate:
+        calibrate(args.map, args.budget)
+        return
+    violations = check(args.map, args.budget)
+    sys.exit(1 if args.strict and violations else 0)
+
+
+if __name__ == "__main__":
+    main()
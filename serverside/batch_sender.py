@@ -0,0 +1,150 @@
+"""Streams G-code to the cleaner in BATCH frames, acked by sequence number.
+
+Each command gets a 16-bit sequence number and as many commands as fit go into one frame, so short
+moves aren't dominated by the frame header. The device runs them in order and answers
+
+    Ack <seq>\\r             every command up to seq completed
+    Err <seq> <reason>\\r    seq was refused, "gap" and "full" name the seq to resend from
+
+The stream starts with a RESTART frame, acked as 65535, that sets the device's sequence back to 0.
+Up to --window commands are then in flight. After a gap, a full queue or --timeout without an ack
+everything past the last ack is sent again, the device drops what it already has. Lines the
+device can't run are reported and skipped.
+
+Usage:
+    python batch_sender.py --port COM9 toolpath.gcode
+    python batch_sender.py --port COM9 toolpath.gcode --window 32 --frame 900
+
+The system must be in AUTO mode and idle when the stream starts.
+"""
+import argparse
+import pathlib
+import re
+import sys
+import time
+
+ACK = b"\r"
+REPLY = re.compile(r"(Ack|Err) (\d+)(?: (.*))?$")
+
+
+def commands(path: str) -> list:
+    """The G/M lines of a file, comments and blanks dropped."""
+    lines = []
+    for line in pathlib.Path(path).read_text().splitlines():
+        line = line.split(";", 1)[0].strip()
+        if line:
+            lines.append(line)
+    return lines
+
+
+class BatchSender:
+    def __init__(self, tx, window: int, frame: int, timeout: float):
+        self.tx = tx
+        self.window = window
+        self.frame = frame
+        self.timeout = timeout
+
+    def restart(self, tries: int = 5):
+        """Starts the device's sequence over at 0, nothing is queued after it."""
+        import transmitter
+
+        for _ in range(tries):
+            self.tx.send_msg(transmitter.BatchMessage([], Restart=True))
+            deadline = time.time() + self.timeout
+            buffer = bytearray()
+            while time.time() < deadline:
+                buffer.extend(self.tx.serial.read(self.tx.serial.in_waiting or 1))
+                if b"Ack 65535\r" in buffer:
+                    return
+        sys.exit("the device doesn't answer the batch restart")
+
+    def stream(self, lines: list) -> int:
+        """Runs every line, returns the number the device refused."""
+        import transmitter
+
+        self.restart()
+        acked = 0        # lines completed, the next seq to be acked is acked & 0xFFFF
+        sent = 0         # lines sent at least once since the last resend
+        paused = False   # the device queue was full, wait for an ack before sending
+        errors = 0
+        progress = time.time()
+        buffer = bytearray()
+
+        def index(seq: int) -> int:
+            # Acks and errors name a seq within one window of the last ack
+            return acked - 1 + ((seq - (acked - 1)) & 0xFFFF)
+
+        while acked < len(lines):
+            limit = min(len(lines), acked + self.window)
+            if sent < limit and not paused:
+                records, size = [], 1
+                while sent < limit:
+                    record = 3 + len(lines[sent].encode())
+                    if records and size + record > self.frame:
+                        break
+                    records.append((sent, lines[sent]))
+                    size += record
+                    sent += 1
+                self.tx.send_msg(transmitter.BatchMessage(records))
+
+            buffer.extend(self.tx.serial.read(self.tx.serial.in_waiting or 1))
+            while ACK in buffer:
+                text, _, buffer = buffer.partition(ACK)
+                for reply in text.decode(errors="replace").split("\n"):
+                    reply = reply.strip()
+                    match = REPLY.match(reply)
+                    if not match:
+                        if reply and reply != "At Pos":
+                            print(reply)
+                        continue
+                    kind, seq, reason = match.group(1), int(match.group(2)), match.group(3) or ""
+                    if kind == "Ack":
+                        acked = max(acked, index(seq) + 1)
+                        sent = max(sent, acked)
+                        paused = False
+                        progress = time.time()
+                    elif reason.startswith(("gap", "full")):
+                        sent = index(int(reason.split()[-1]))
+                        paused = reason.startswith("full")
+                    elif reason.startswith("truncated"):
+                        sent = index(seq)
+                    else:
+                        errors += 1
+                        print(f"{lines[index(seq)]!r}: {reason}")
+
+            if time.time() - progress > self.timeout:
+                # Nothing acked for a while, a frame may have been lost: send it all again
+                sent, paused, progress = acked, False, time.time()
+        return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file")
+    parser.add_argument("--port", default="COM9")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--window", type=int, default=32,
+                        help="commands in flight, at most the device's BATCH_COMMANDS (48)")
+    parser.add_argument("--frame", type=int, default=900,
+                        help="bytes per frame, at most the device's BUFFER_SIZE (1024)")
+    parser.add_argument("--timeout", type=float, default=2.0,
+                        help="seconds without an ack before everything unacked is resent")
+    args = parser.parse_args()
+
+    import transmitter
+
+    lines = commands(args.file)
+    tx = transmitter.Transmitter(args.port, args.baud, write_timeout=1, timeout=0.01)
+    tx.serial.reset_input_buffer()
+    start = time.time()
+    try:
+        errors = BatchSender(tx, args.window, args.frame, args.timeout).stream(lines)
+    finally:
+        tx.serial.close()
+    print(f"{len(lines)} commands in {time.time() - start:.1f} s, {errors} refused")
+    if errors:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
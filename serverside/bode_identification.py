@@ -0,0 +1,231 @@
+"""Runs a frequency response identification (M950) on the cleaner and computes the Bode plot.
+
+The firmware perturbs the jaw rotation (A) with a chirp or stepped sine velocity and streams what
+it commanded next to what the AS5048A measured, the other axes have no sensor to measure them.
+From that record this tool estimates the frequency response H = Pxy / Pxx together with the
+coherence, so the filter cutoffs and loop gains can be tuned against the measured plant instead of
+guesses.
+
+Usage:
+    python bode_identification.py --port COM9 --axis A --amplitude 0.5 --f0 1 --f1 200 -T 20
+    python bode_identification.py --from-log run.txt --plot
+
+The system must be in AUTO mode and idle. Frequencies are limited to 0.4 x the 1 kHz control rate.
+"""
+import argparse
+import csv
+import sys
+import time
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional
+
+import numpy as np
+
+MODES = {"chirp": 0, "stepped": 1}
+
+
+@dataclass
+class Record:
+    header: Dict[str, float] = field(default_factory=dict)
+    index: List[int] = field(default_factory=list)
+    frequency: List[float] = field(default_factory=list)
+    command: List[float] = field(default_factory=list)
+    response: List[float] = field(default_factory=list)
+    dropped: int = 0
+    complete: bool = False
+
+    def parse_line(self, line: str):
+        parts = line.split()
+        if not parts:
+            return
+        if parts[0] == "BODE_START":
+            self.header = {k: float(v) for k, v in (p.split("=", 1) for p in parts[1:])}
+        elif parts[0] == "BODE" and len(parts) == 5:
+            self.index.append(int(parts[1]))
+            self.frequency.append(float(parts[2]))
+            self.command.append(float(parts[3]))
+            self.response.append(float(parts[4]))
+        elif parts[0] == "BODE_END":
+            end = {k: int(v) for k, v in (p.split("=", 1) for p in parts[1:])}
+            self.dropped = end.get("dropped", 0)
+            self.complete = True
+
+    def arrays(self):
+        """Samples on a regular tick grid, ticks dropped by the firmware are interpolated."""
+        index = np.asarray(self.index)
+        ticks = np.arange(index[0], index[-1] + 1)
+        missing = len(ticks) - len(index)
+        if missing:
+            print(f"warning: {missing} samples missing from the stream, interpolated",
+                  file=sys.stderr)
+        columns = [np.interp(ticks, index, np.asarray(c))
+                   for c in (self.frequency, self.command, self.response)]
+        return columns
+
+
+def run_on_device(args) -> Record:
+    import transmitter
+
+    tx = transmitter.Transmitter(args.port, args.baud, write_timeout=1, timeout=0.5)
+    command = (f"M950 {args.axis}{args.amplitude} F{args.f0} H{args.f1} T{args.duration} "
+               f"S{MODES[args.mode]} N{args.steps}\0")
+    record = Record()
+    raw = open(args.raw, "w") if args.raw else None
+
+    tx.serial.reset_input_buffer()
+    tx.send_msg(transmitter.CommandMessage(command))
+    deadline = time.time() + args.duration + 10.0
+    buffer = bytearray()
+    try:
+        while not record.complete and time.time() < deadline:
+            buffer.extend(tx.serial.read(4096))
+            while b"\n" in buffer:
+                line, _, rest = buffer.partition(b"\n")
+                buffer = bytearray(rest)
+                # acks end with \r and no \n, they get glued to the next line
+                text = line.decode(errors="replace").split("\r")[-1].strip()
+                if raw:
+                    raw.write(text + "\n")
+                if text.startswith("Identification rejected"):
+                    sys.exit(text)
+                record.parse_line(text)
+    finally:
+        if not record.complete:
+            tx.send_msg(transmitter.CommandMessage("M951\0"))
+        if raw:
+            raw.close()
+        tx.serial.close()
+
+    if not record.complete:
+        print("warning: no BODE_END received, the record may be truncated", file=sys.stderr)
+    return record
+
+
+def load_log(path: str) -> Record:
+    record = Record()
+    with open(path) as f:
+        for line in f:
+            record.parse_line(line.split("\r")[-1].strip())
+    return record
+
+
+def welch_response(x, y, fs: float, nperseg: int):
+    """H1 estimate and magnitude squared coherence with Hann windowed, 50 % overlapped segments."""
+    nperseg = min(nperseg, len(x))
+    step = nperseg // 2
+    window = np.hanning(nperseg)
+    pxx = np.zeros(nperseg // 2 + 1)
+    pyy = np.zeros(nperseg // 2 + 1)
+    pxy = np.zeros(nperseg // 2 + 1, dtype=complex)
+    for start in range(0, len(x) - nperseg + 1, step):
+        X = np.fft.rfft(window * (x[start:start + nperseg] - np.mean(x[start:start + nperseg])))
+        Y = np.fft.rfft(window * (y[start:start + nperseg] - np.mean(y[start:start + nperseg])))
+        pxx += np.abs(X) ** 2
+        pyy += np.abs(Y) ** 2
+        pxy += np.conj(X) * Y
+    freqs = np.fft.rfftfreq(nperseg, 1.0 / fs)
+    with np.errstate(divide="ignore", invalid="ignore"):
+        H = pxy / pxx
+        coherence = np.abs(pxy) ** 2 / (pxx * pyy)
+    return freqs, H, coherence
+
+
+def stepped_response(freq, x, y, fs: float, settle: float, blocks: int = 4):
+    """One H per tone from the DFT bin at the tone, the first `settle` of every tone is skipped.
+
+    Coherence comes from splitting the settled part of the tone into blocks.
+    """
+    tones, H, coherence = [], [], []
+    edges = np.flatnonzero(np.diff(freq) != 0) + 1
+    for segment in np.split(np.arange(len(freq)), edges):
+        f = freq[segment[0]]
+        settled = segment[int(len(segment) * settle):]
+        # whole periods only, so the single bin does not leak
+        period = fs / f
+        usable = int(np.floor(len(settled) / period) * period)
+        if usable < period:
+            continue
+        settled = settled[:usable]
+        n = np.arange(len(settled))
+        basis = np.exp(-2j * np.pi * f * n / fs)
+        sxy = sxx = syy = 0
+        for block in np.array_split(np.arange(len(settled)), blocks):
+            X = np.sum(x[settled[block]] * basis[block])
+            Y = np.sum(y[settled[block]] * basis[block])
+            sxx += np.abs(X) ** 2
+            syy += np.abs(Y) ** 2
+            sxy += np.conj(X) * Y
+        tones.append(f)
+        H.append(sxy / sxx)
+        coherence.append(np.abs(sxy) ** 2 / (sxx * syy))
+    return np.asarray(tones), np.asarray(H), np.asarray(coherence)
+
+
+def analyse(record: Record, nperseg: int, settle: float):
+    freq, x, y = record.arrays()
+    fs = record.header.get("rate", 1000.0)
+    if int(record.header.get("mode", 0)) == MODES["stepped"]:
+        return stepped_response(freq, x, y, fs, settle)
+    freqs, H, coherence = welch_response(x, y, fs, nperseg)
+    f0, f1 = record.header.get("f0", freqs[1]), record.header.get("f1", freqs[-1])
+    keep = (freqs >= f0) & (freqs <= f1)
+    return freqs[keep], H[keep], coherence[keep]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", default="COM9")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--axis", choices=("A",), default="A",
+                        help="A jaw rotation, the only axis the AS5048A measures")
+    parser.add_argument("--amplitude", type=float, default=0.5,
+                        help="peak velocity perturbation in axis units/s")
+    parser.add_argument("--f0", type=float, default=1.0, help="start frequency in Hz")
+    parser.add_argument("--f1", type=float, default=200.0, help="end frequency in Hz")
+    parser.add_argument("-T", "--duration", type=float, default=20.0, help="seconds")
+    parser.add_argument("--mode", choices=tuple(MODES), default="chirp")
+    parser.add_argument("--steps", type=int, default=20, help="tones for --mode stepped")
+    parser.add_argument("--nperseg", type=int, default=1024, help="Welch segment length")
+    parser.add_argument("--settle", type=float, default=0.25,
+                        help="fraction of every stepped tone skipped for transients")
+    parser.add_argument("--from-log", help="analyse a saved raw log instead of running")
+    parser.add_argument("--raw", help="save the raw stream to this file")
+    parser.add_argument("--out", default="bode.csv", help="csv with the estimated response")
+    parser.add_argument("--plot", action="store_true", help="show the Bode plot")
+    args = parser.parse_args()
+
+    record = load_log(args.from_log) if args.from_log else run_on_device(args)
+    if not record.index:
+        sys.exit("no samples received")
+
+    freqs, H, coherence = analyse(record, args.nperseg, args.settle)
+    gain_db = 20 * np.log10(np.abs(H))
+    phase = np.degrees(np.unwrap(np.angle(H)))
+
+    with open(args.out, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["frequency_hz", "gain_db", "phase_deg", "coherence"])
+        writer.writerows(zip(freqs, gain_db, phase, coherence))
+    print(f"{len(record.index)} samples, {record.dropped} dropped by the firmware, "
+          f"{len(freqs)} points written to {args.out}")
+
+    if args.plot:
+        import matplotlib.pyplot as plt
+
+        fig, (ax_gain, ax_phase, ax_coh) = plt.subplots(3, 1, sharex=True)
+        ax_gain.semilogx(freqs, gain_db)
+        ax_gain.set_ylabel("gain [dB]")
+        ax_phase.semilogx(freqs, phase)
+        ax_phase.set_ylabel("phase [deg]")
+        ax_coh.semilogx(freqs, coherence)
+        ax_coh.set_ylabel("coherence")
+        ax_coh.set_ylim(0, 1.05)
+        ax_coh.set_xlabel("frequency [Hz]")
+        for ax in (ax_gain, ax_phase, ax_coh):
+            ax.grid(True, which="both")
+        fig.suptitle(f"axis {int(record.header.get('axis', -1))}")
+        plt.show()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,201 @@
+"""Measures the link round trip and maps device time to host time with PING messages.
+
+Each ping carries the host's send time t0. The device answers "Pong t0 t1 t2" with the time it
+read the frame, t1, and the time it answered, t2, in esp_timer microseconds since boot. micros()
+is the low 32 bits of that clock. The host notes the arrival, t3. As in NTP
+
+    delay  = (t3 - t0) - (t2 - t1)          time on the link, both ways
+    offset = ((t1 - t0) + (t2 - t3)) / 2    device clock minus host clock
+
+and a single offset is off by at most delay / 2. USB-CDC delays are lopsided and come in bursts,
+so only the fastest pings of each window are kept. A line fitted through their offsets gives the
+offset and the drift of the device crystal against the host clock.
+
+Host time is time.time_ns() in microseconds, the wall clock other programs on the host share.
+
+Usage:
+    python clock_sync.py --port COM9
+    python clock_sync.py --port COM9 --count 1000 --interval 0.01 --csv pings.csv
+
+As a module, with a transmitter.Transmitter already open:
+    sync = ClockSync(tx)
+    sync.measure(200)
+    host_us = sync.to_host(device_us)
+    host_us = sync.micros_to_host(micros32)
+    other = sync.take_unread()   # whatever else the device sent while pinging
+
+The system must be in AUTO mode, pings can be sent while it runs.
+"""
+import argparse
+import csv
+import statistics
+import sys
+import time
+from dataclasses import dataclass
+from typing import List, Optional
+
+
+def now_us() -> int:
+    return time.time_ns() // 1000
+
+
+@dataclass
+class Sample:
+    t0: int  # host, sent
+    t1: int  # device, received
+    t2: int  # device, answered
+    t3: int  # host, answer received
+
+    @property
+    def delay(self) -> int:
+        return (self.t3 - self.t0) - (self.t2 - self.t1)
+
+    @property
+    def offset(self) -> float:
+        return ((self.t1 - self.t0) + (self.t2 - self.t3)) / 2
+
+    @property
+    def host(self) -> float:
+        return (self.t0 + self.t3) / 2
+
+
+class ClockSync:
+    def __init__(self, tx, keep: float = 0.25, window: int = 20):
+        self.tx = tx
+        self.keep = keep
+        self.window = window
+        self.samples: List[Sample] = []
+        self.reference = 0.0  # host µs the fit is around
+        self.offset = 0.0     # device - host at reference, µs
+        self.drift = 0.0      # device µs gained per host µs
+        self.error = 0.0      # bound on the offset, µs
+        self.unread = bytearray()  # bytes read while pinging that were not a Pong, in order
+
+    def ping(self, timeout: float = 0.5) -> Optional[Sample]:
+        """Pings once. Everything else read meanwhile is kept for take_unread()."""
+        import transmitter
+
+        t0 = now_us()
+        self.tx.send_msg(transmitter.PingMessage(t0))
+        deadline = time.time() + timeout
+        buffer = bytearray()
+        while time.time() < deadline:
+            buffer.extend(self.tx.serial.read(self.tx.serial.in_waiting or 1))
+            while b"\r" in buffer:
+                text, _, buffer = buffer.partition(b"\r")
+                start = text.rfind(b"\n") + 1
+                parts = text[start:].decode(errors="replace").split()
+                if len(parts) != 4 or parts[0] != "Pong":
+                    self.unread += text + b"\r"
+                    continue
+                # Pongs of earlier pings that timed out are dropped as well, with their "\r\n"
+                self.unread += text[:start]
+                if buffer.startswith(b"\n"):
+                    del buffer[0]
+                if int(parts[1]) == t0:
+                    sample = Sample(t0, int(parts[2]), int(parts[3]), now_us())
+                    self.unread += buffer
+                    return sample
+        self.unread += buffer
+        return None
+
+    def take_unread(self) -> bytes:
+        """Returns and forgets what ping() read that was not its answer."""
+        data = bytes(self.unread)
+        self.unread.clear()
+        return data
+
+    def measure(self, count: int, interval: float = 0.02) -> int:
+        """Pings `count` times and fits the clocks, returns the number answered."""
+        answered = 0
+        for _ in range(count):
+            sample = self.ping()
+            if sample:
+                self.samples.append(sample)
+                answered += 1
+            time.sleep(interval)
+        self.fit()
+        return answered
+
+    def fit(self):
+        if not self.samples:
+            raise ValueError("no pings answered")
+        chosen = []
+        for i in range(0, len(self.samples), self.window):
+            chunk = sorted(self.samples[i:i + self.window], key=lambda s: s.delay)
+            chosen += chunk[:max(1, int(len(chunk) * self.keep))]
+
+        xs = [s.host for s in chosen]
+        ys = [s.offset for s in chosen]
+        self.reference = statistics.fmean(xs)
+        mean = statistics.fmean(ys)
+        spread = sum((x - self.reference) ** 2 for x in xs)
+        self.drift = (sum((x - self.reference) * (y - mean) for x, y in zip(xs, ys)) / spread
+                      if spread > 0 else 0.0)
+        self.offset = mean
+        residuals = [y - self.offset_at(x) for x, y in zip(xs, ys)]
+        rms = (sum(r * r for r in residuals) / len(residuals)) ** 0.5
+        self.error = min(s.delay for s in chosen) / 2 + rms
+
+    def offset_at(self, host_us: float) -> float:
+        return self.offset + self.drift * (host_us - self.reference)
+
+    def to_device(self, host_us: float) -> float:
+        return host_us + self.offset_at(host_us)
+
+    def to_host(self, device_us: float) -> float:
+        # device = host + offset + drift * (host - reference), solved for host
+        return (device_us - self.offset + self.drift * self.reference) / (1 + self.drift)
+
+    def micros_to_host(self, micros32: int, near_host_us: Optional[float] = None) -> float:
+        """Host time of a 32-bit micros() stamp, taken within 35 minutes of near_host_us (now)."""
+        estimate = int(self.to_device(now_us() if near_host_us is None else near_host_us))
+        difference = (micros32 - estimate) % (1 << 32)
+        if difference >= 1 << 31:
+            difference -= 1 << 32
+        return self.to_host(estimate + difference)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", default="COM9")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--count", type=int, default=200)
+    parser.add_argument("--interval", type=float, default=0.02, help="seconds between pings")
+    parser.add_argument("--csv", help="write every ping to this file")
+    args = parser.parse_args()
+
+    import transmitter
+
+    tx = transmitter.Transmitter(args.port, args.baud, write_timeout=1, timeout=0.01)
+    tx.serial.reset_input_buffer()
+    sync = ClockSync(tx)
+    try:
+        answered = sync.measure(args.count, args.interval)
+    finally:
+        tx.serial.close()
+    if not answered:
+        sys.exit("no pings answered, is the system in AUTO mode?")
+
+    delays = sorted(s.delay for s in sync.samples)
+    held = statistics.median(s.t2 - s.t1 for s in sync.samples)
+    print(f"{answered}/{args.count} pings answered")
+    p99 = delays[min(len(delays) - 1, int(len(delays) * 0.99))]
+    print(f"round trip  min {delays[0]} µs  median {statistics.median(delays):.0f} µs  "
+          f"p99 {p99} µs  (device held each ping {held:.0f} µs)")
+    print(f"offset      device - host = {sync.offset:.0f} µs "
+          f"at host {sync.reference / 1e6:.3f} s")
+    print(f"drift       {sync.drift * 1e6:+.2f} ppm")
+    print(f"error       ±{sync.error:.0f} µs")
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as file:
+            writer = csv.writer(file)
+            writer.writerow(["t0_host_us", "t1_device_us", "t2_device_us", "t3_host_us",
+                             "delay_us", "offset_us"])
+            for s in sync.samples:
+                writer.writerow([s.t0, s.t1, s.t2, s.t3, s.delay, s.offset])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,141 @@
+"""Compares the host links, USB CDC, RS-485 and TCP, on latency and throughput with PING messages.
+
+For every --port, in turn:
+
+  - latency: pings one at a time, the round trip less the device's own handling (see
+    clock_sync.py), reported as percentiles,
+  - throughput: keeps --window pings in flight for --seconds and counts the answers, the frames
+    per second the firmware takes off the link with the bytes both ways.
+
+Ports are anything pyserial opens, COM9, /dev/ttyUSB0 behind an RS-485 adapter, or
+socket://<board>:3333 for a TRANSPORT_TCP build. A native_sim build with -D TRANSPORT_TCP listens
+on socket://localhost:3333 and stands in for the board.
+
+Usage:
+    python link_benchmark.py --port COM9 --port socket://192.168.1.40:3333
+    python link_benchmark.py --port socket://localhost:3333 --count 500 --window 16
+
+The system must be in AUTO mode.
+"""
+import argparse
+import sys
+import time
+from dataclasses import dataclass
+from typing import List, Optional
+
+import transmitter
+from clock_sync import ClockSync, now_us
+
+PING_FRAME = 1 + 5 + 8  # sentinel, header, host time
+
+
+@dataclass
+class Result:
+    port: str
+    delays: List[int]  # µs
+    lost: int
+    frames: int = 0
+    seconds: float = 0.0
+    sent_bytes: int = 0
+    received_bytes: int = 0
+
+
+def percentile(values: List[int], fraction: float) -> float:
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def latency(tx, count: int, interval: float) -> Result:
+    sync = ClockSync(tx)
+    delays, lost = [], 0
+    for _ in range(count):
+        sample = sync.ping()
+        if sample is None:
+            lost += 1
+        else:
+            delays.append(sample.delay)
+        time.sleep(interval)
+    return Result(tx.serial.port, delays, lost)
+
+
+def throughput(tx, result: Result, seconds: float, window: int):
+    """Pipelined pings, a new one for every answer, until `seconds` have passed."""
+    in_flight, answered, sent, received = 0, 0, 0, 0
+    buffer = bytearray()
+    start = time.time()
+    last_answer = start
+    while True:
+        elapsed = time.time() - start
+        if elapsed < seconds:
+            while in_flight < window:
+                tx.send_msg(transmitter.PingMessage(now_us()))
+                in_flight += 1
+                sent += PING_FRAME
+        elif in_flight == 0 or time.time() - last_answer > 1.0:
+            break
+        data = tx.serial.read(tx.serial.in_waiting or 1)
+        received += len(data)
+        buffer.extend(data)
+        while b"\r" in buffer:
+            text, _, buffer = buffer.partition(b"\r")
+            if text.decode(errors="replace").split("\n")[-1].startswith("Pong "):
+                in_flight -= 1
+                answered += 1
+                last_answer = time.time()
+    result.frames = answered
+    result.seconds = last_answer - start
+    result.sent_bytes = sent
+    result.received_bytes = received
+
+
+def run(port: str, args) -> Optional[Result]:
+    try:
+        tx = transmitter.Transmitter(port, args.baud, write_timeout=1, timeout=0.01)
+    except Exception as error:  # pyserial raises several kinds for a port it can't open
+        print(f"{port}: {error}", file=sys.stderr)
+        return None
+    try:
+        tx.serial.reset_input_buffer()
+        result = latency(tx, args.count, args.interval)
+        throughput(tx, result, args.seconds, args.window)
+    finally:
+        tx.serial.close()
+    return result
+
+
+def report(results: List[Result], out=sys.stdout):
+    print(f"{'port':<32} {'p50 ms':>7} {'p90 ms':>7} {'p99 ms':>7} {'max ms':>7} {'lost':>5} "
+          f"{'frames/s':>9} {'kB/s up':>8} {'kB/s down':>10}", file=out)
+    for r in results:
+        if r.delays:
+            delays = [f"{percentile(r.delays, q) / 1000:7.2f}" for q in (0.5, 0.9, 0.99)]
+            delays.append(f"{max(r.delays) / 1000:7.2f}")
+        else:
+            delays = [f"{'-':>7}"] * 4
+        rate = r.seconds if r.seconds > 0 else float("inf")
+        print(f"{r.port[:32]:<32} {' '.join(delays)} {r.lost:>5} {r.frames / rate:>9.1f} "
+              f"{r.sent_bytes / rate / 1000:>8.1f} {r.received_bytes / rate / 1000:>10.1f}",
+              file=out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", action="append", required=True,
+                        help="a link to measure, repeat to compare several")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--count", type=int, default=200, help="latency pings per port")
+    parser.add_argument("--interval", type=float, default=0.01, help="seconds between them")
+    parser.add_argument("--seconds", type=float, default=5.0, help="throughput run per port")
+    parser.add_argument("--window", type=int, default=8, help="pings in flight")
+    args = parser.parse_args()
+
+    results = [r for r in (run(port, args) for port in args.port) if r is not None]
+    if not results:
+        sys.exit("no link could be opened")
+    report(results)
+    if any(not r.delays for r in results):
+        sys.exit("a link answered no pings, is the system in AUTO mode?")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,120 @@
+"""Uploads, lists, deletes and runs the G-code programs stored on the cleaner (M20-M31).
+
+A stored program runs locally at full speed, the host only starts, stops and polls it. Besides
+G0/G1, G4, G28, M80 and M17 a program may contain
+
+    M808 L<n>      start of a block repeated n times, L0 repeats until stopped
+    M808           end of the innermost block
+    M98 P<name>    runs another stored program, then carries on
+
+Names are up to 11 letters, digits, - or _. Everything after ; on a line is a comment.
+
+Usage:
+    python program_store.py --port COM9 upload pass.gcode --name pass
+    python program_store.py --port COM9 list
+    python program_store.py --port COM9 check pass
+    python program_store.py --port COM9 run pass --wait
+    python program_store.py --port COM9 stop
+    python program_store.py --port COM9 delete pass
+
+The system must be in AUTO mode. Uploads and deletes are refused while the machine moves.
+check and run go through every move the program will make from where the machine is, against the
+soft limits and the clamp and brake interlocks, and report the first one that fails. run refuses
+a program that fails.
+"""
+import argparse
+import pathlib
+import sys
+import time
+
+ACK = b"\r"
+
+
+def send(tx, command: str, timeout: float = 5.0) -> list:
+    """Sends one command and returns the lines printed before its ack."""
+    import transmitter
+
+    tx.send_msg(transmitter.CommandMessage(command + "\0"))
+    deadline = time.time() + timeout
+    buffer = bytearray()
+    while time.time() < deadline:
+        buffer.extend(tx.serial.read(tx.serial.in_waiting or 1))
+        if ACK in buffer:
+            # acks end with \r and no \n, the lines before them end with \n
+            text, _, _ = buffer.partition(ACK)
+            return [line.strip() for line in text.decode(errors="replace").split("\n")
+                    if line.strip() and line.strip() != "At Pos"]
+    sys.exit(f"no ack for {command!r}")
+
+
+def upload(tx, path: str, name: str):
+    lines = pathlib.Path(path).read_text().splitlines()
+    for reply in send(tx, f"M28 {name}"):
+        print(reply)
+        if reply.startswith("Upload rejected"):
+            sys.exit(1)
+    rejected = 0
+    for number, line in enumerate(lines, 1):
+        for reply in send(tx, line):
+            print(f"{path}:{number}: {reply}  ({line.strip()})")
+            rejected += reply.startswith("Program line rejected")
+    for reply in send(tx, "M29"):
+        print(reply)
+    if rejected:
+        sys.exit(f"{rejected} line(s) rejected, nothing stored")
+
+
+def wait(tx, poll: float):
+    while True:
+        replies = send(tx, "M27")
+        for reply in replies:
+            print(reply)
+        if not any(" running," in reply for reply in replies):
+            return
+        time.sleep(poll)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", default="COM9")
+    parser.add_argument("--baud", type=int, default=921600)
+    commands = parser.add_subparsers(dest="command", required=True)
+    up = commands.add_parser("upload", help="compile and store a G-code file")
+    up.add_argument("file")
+    up.add_argument("--name", help="stored name, the file stem by default")
+    commands.add_parser("list", help="list the stored programs")
+    check = commands.add_parser("check", help="check and plan a stored program without running it")
+    check.add_argument("name")
+    run = commands.add_parser("run", help="run a stored program")
+    run.add_argument("name")
+    run.add_argument("--wait", action="store_true", help="poll M27 until it ends")
+    run.add_argument("--poll", type=float, default=1.0, help="seconds between polls")
+    commands.add_parser("stop", help="stop the running program after the current move")
+    commands.add_parser("status", help="report the running program")
+    delete = commands.add_parser("delete", help="delete a stored program")
+    delete.add_argument("name")
+    args = parser.parse_args()
+
+    import transmitter
+
+    tx = transmitter.Transmitter(args.port, args.baud, write_timeout=1, timeout=0.1)
+    tx.serial.reset_input_buffer()
+    try:
+        if args.command == "upload":
+            upload(tx, args.file, args.name or pathlib.Path(args.file).stem)
+        elif args.command == "run":
+            for reply in send(tx, f"M24 {args.name}"):
+                print(reply)
+            if args.wait:
+                wait(tx, args.poll)
+        else:
+            command = {"list": "M20", "stop": "M25", "status": "M27"}.get(args.command)
+            command = command or ("M31 " if args.command == "check" else "M30 ") + args.name
+            for reply in send(tx, command):
+                print(reply)
+    finally:
+        tx.serial.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,455 @@
+"""Records the traffic between the cell software and the device, and replays it.
+
+record sits between the two as a proxy. The cell software opens the proxy's port instead of the
+device's, everything is passed through untouched and logged, both directions, with the host time
+of every read. On Linux and macOS --link makes a pseudo-terminal for the cell software, on
+Windows --host-port opens one end of a virtual null-modem pair (com0com) whose other end the cell
+software opens.
+
+replay sends the host side of a capture to a device, or to the simulator
+(`.pio/build/native_sim/program --link COM9`), and records the new session:
+
+  --speed 1     with the captured timing
+  --speed 4     four times faster
+  --speed 0     as fast as the device answers, each chunk waits for the replies ("At Pos",
+                "Ack n", "Err n", "Pong") the device had sent before it in the capture
+
+stats reports the latency of every command in a capture, from the last byte of its frame to its
+reply, per command word: a COMMAND to the next "At Pos", a BATCH to the "Ack"/"Err" of its last
+sequence number, a PING to its "Pong". In AUTO the firmware runs the last command again every
+loop, so an "At Pos" can arrive that still answers the previous one, those show as latencies under
+a millisecond. replay prints the same report for the original and the replay side by side.
+
+Capture file, little endian:
+
+    header  b"SCAP", u8 version (1), u8 0, u16 0, u64 host start time µs, u32 baud
+    record  u8 direction (0 host -> device, 1 device -> host),
+            varint µs since the previous record, varint length, the bytes
+
+Usage:
+    python session_recorder.py record --device COM9 --link COM20 --out shift.scap
+    python session_recorder.py record --device COM9 --host-port COM21 --out shift.scap
+    python session_recorder.py stats shift.scap
+    python session_recorder.py replay shift.scap --port COM9 --speed 0 --out replay.scap
+"""
+import argparse
+import os
+import re
+import signal
+import statistics
+import struct
+import sys
+import threading
+import time
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Tuple
+
+MAGIC = b"SCAP"
+VERSION = 1
+HEADER = struct.Struct("<4sBBHQI")
+TO_DEVICE = 0
+TO_HOST = 1
+
+FRAME_START = 0xA5
+COMMAND, STOP, BATCH, PING = 1, 2, 3, 4
+REPLY = re.compile(r"^(At Pos|Ack \d+|Err \d+.*|Pong .*)$")
+
+
+def now_us() -> int:
+    return time.time_ns() // 1000
+
+
+@dataclass
+class Record:
+    t: int  # host µs
+    direction: int
+    data: bytes
+
+
+# ─────────────────────────────── capture file ──────────────────────────────────
+def put_varint(out: bytearray, value: int):
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def get_varint(data: bytes, pos: int) -> Tuple[int, int]:
+    value, shift = 0, 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("capture ends inside a record")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, pos
+        shift += 7
+
+
+class CaptureWriter:
+    """Appends records as they come, from any thread. Flushed every record, a crash keeps them."""
+
+    def __init__(self, path: str, baud: int):
+        self.file = open(path, "wb")
+        self.lock = threading.Lock()
+        self.last = now_us()
+        self.file.write(HEADER.pack(MAGIC, VERSION, 0, 0, self.last, baud))
+
+    def write(self, direction: int, data: bytes, t: Optional[int] = None):
+        with self.lock:
+            t = now_us() if t is None else t
+            record = bytearray([direction])
+            put_varint(record, max(t - self.last, 0))
+            put_varint(record, len(data))
+            record += data
+            self.file.write(record)
+            self.file.flush()
+            self.last = max(t, self.last)
+
+    def close(self):
+        self.file.close()
+
+
+def load(path: str) -> Tuple[int, List[Record]]:
+    """The baud rate and the records of a capture."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise ValueError(f"{path} is not a capture")
+    magic, version, _, _, t, baud = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError(f"{path} is not a version {VERSION} capture")
+    records, pos = [], HEADER.size
+    while pos < len(data):
+        direction = data[pos]
+        dt, pos = get_varint(data, pos + 1)
+        length, pos = get_varint(data, pos)
+        t += dt
+        records.append(Record(t, direction, data[pos:pos + length]))
+        pos += length
+    return baud, records
+
+
+# ─────────────────────────────── frames, replies ──────────────────────────────
+@dataclass
+class Frame:
+    t: int  # its last byte was sent
+    kind: int
+    label: str  # command word, BATCH, PING or STOP
+    key: str  # what the reply has to carry, see answers()
+
+
+def frames(records: List[Record]) -> List[Frame]:
+    """The frames the host sent, however they were split across reads."""
+    found, buffer = [], bytearray()
+    for r in records:
+        if r.direction != TO_DEVICE:
+            continue
+        buffer += r.data
+        while True:
+            start = buffer.find(bytes([FRAME_START]))
+            if start < 0:
+                buffer.clear()
+                break
+            del buffer[:start]
+            if len(buffer) < 6:
+                break
+            kind, length = struct.unpack_from("<BI", buffer, 1)
+            if len(buffer) < 6 + length:
+                break
+            found.append(describe(r.t, kind, bytes(buffer[6:6 + length])))
+            del buffer[:6 + length]
+    return found
+
+
+def describe(t: int, kind: int, body: bytes) -> Frame:
+    if kind == COMMAND:
+        text = body.split(b"\0", 1)[0].decode(errors="replace").split()
+        return Frame(t, kind, text[0] if text else "?", "At Pos")
+    if kind == BATCH:
+        # Restart flag, then (u16 seq, line, NUL) per command, a bare restart is acked as 65535
+        seq, pos = 65535, 1
+        while pos + 2 <= len(body):
+            seq = struct.unpack_from("<H", body, pos)[0]
+            end = body.find(b"\0", pos + 2)
+            pos = len(body) if end < 0 else end + 1
+        return Frame(t, kind, "BATCH", str(seq))
+    if kind == PING:
+        t0 = struct.unpack_from("<Q", body)[0] if len(body) >= 8 else 0
+        return Frame(t, kind, "PING", str(t0))
+    return Frame(t, kind, "STOP" if kind == STOP else f"type {kind}", "")
+
+
+def lines(records: List[Record]) -> List[Tuple[int, str]]:
+    """The lines the device printed, each at the time its end arrived."""
+    found, buffer = [], bytearray()
+    for r in records:
+        if r.direction != TO_HOST:
+            continue
+        for byte in r.data:
+            if byte in b"\r\n":
+                if buffer:
+                    found.append((r.t, buffer.decode(errors="replace")))
+                    buffer.clear()
+            else:
+                buffer.append(byte)
+    return found
+
+
+def answers(frame: Frame, line: str) -> bool:
+    if frame.kind == COMMAND:
+        return line == frame.key
+    if frame.kind == BATCH:
+        match = re.match(r"(Ack|Err) (\d+)", line)
+        return match is not None and match.group(2) == frame.key
+    if frame.kind == PING:
+        return line.startswith("Pong " + frame.key)
+    return False
+
+
+def latencies(records: List[Record], timeout_us: int) -> Dict[str, List[Optional[int]]]:
+    """Per command word, the µs from each frame to its reply, None if none came in time."""
+    printed = lines(records)
+    result: Dict[str, List[Optional[int]]] = {}
+    first = 0
+    for frame in frames(records):
+        if frame.kind == STOP:
+            continue
+        while first < len(printed) and printed[first][0] < frame.t:
+            first += 1
+        reply = next((t for t, line in printed[first:]
+                      if t - frame.t <= timeout_us and answers(frame, line)), None)
+        result.setdefault(frame.label, []).append(None if reply is None else reply - frame.t)
+    return result
+
+
+# ─────────────────────────────────── report ────────────────────────────────────
+def percentile(values: List[int], p: float) -> int:
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def summary(values: List[Optional[int]]) -> str:
+    answered = sorted(v for v in values if v is not None)
+    missed = len(values) - len(answered)
+    if not answered:
+        return f"{len(values):>6} " + " ".join(f"{'-':>8}" for _ in range(5)) + f" {missed:>6}"
+    ms = [answered[0], statistics.median(answered), percentile(answered, 0.9),
+          percentile(answered, 0.99), answered[-1]]
+    return f"{len(values):>6} " + " ".join(f"{v / 1000:>8.2f}" for v in ms) + f" {missed:>6}"
+
+
+def report(captures: List[Tuple[str, List[Record]]], timeout_us: int, out=sys.stdout):
+    print(f"  {'':<10} {'':<10} {'count':>6} {'min ms':>8} {'p50':>8} {'p90':>8} {'p99':>8} "
+          f"{'max':>8} {'missed':>6}", file=out)
+    measured = [(name, latencies(records, timeout_us)) for name, records in captures]
+    labels = sorted({label for _, result in measured for label in result})
+    for label in labels:
+        for name, result in measured:
+            print(f"  {label:<10} {name:<10} {summary(result.get(label, []))}", file=out)
+    for name, records in captures:
+        sent = frames(records)
+        if len(sent) > 1:
+            span = (sent[-1].t - sent[0].t) / 1e6
+            sent_bytes = sum(len(r.data) for r in records if r.direction == TO_DEVICE)
+            print(f"  {name}: {len(sent)} frames in {span:.2f} s, {len(sent) / span:.1f} frames/s, "
+                  f"{sent_bytes / span / 1000:.1f} kB/s to the device", file=out)
+
+
+# ──────────────────────────────────── ports ────────────────────────────────────
+class SerialPort:
+    def __init__(self, port: str, baud: int):
+        import serial
+
+        self.serial = serial.serial_for_url(port, baud, timeout=0.01, write_timeout=0.1)
+
+    def read(self) -> bytes:
+        return self.serial.read(self.serial.in_waiting or 1)
+
+    def write(self, data: bytes):
+        import serial
+
+        try:
+            self.serial.write(data)
+        except serial.SerialTimeoutException:
+            pass  # nobody reading the other end, dropped as the device would
+
+    def close(self):
+        self.serial.close()
+
+
+class PseudoTerminal:
+    """The cell software's side of the proxy, at `link`, POSIX only."""
+
+    def __init__(self, link: str):
+        import tty
+
+        self.master, self.terminal = os.openpty()
+        tty.setraw(self.terminal)
+        os.set_blocking(self.master, False)
+        self.link = link
+        if os.path.lexists(link):
+            os.unlink(link)
+        os.symlink(os.ttyname(self.terminal), link)
+
+    def read(self) -> bytes:
+        import select
+
+        ready, _, _ = select.select([self.master], [], [], 0.01)
+        return os.read(self.master, 4096) if ready else b""
+
+    def write(self, data: bytes):
+        try:
+            os.write(self.master, data)
+        except BlockingIOError:
+            pass  # the cell software isn't reading, dropped once the terminal is full
+
+    def close(self):
+        os.unlink(self.link)
+        os.close(self.terminal)
+        os.close(self.master)
+
+
+def pump(source, sink, capture: CaptureWriter, direction: int, running: threading.Event):
+    while running.is_set():
+        data = source.read()
+        if data:
+            capture.write(direction, data)
+            sink.write(data)
+
+
+# ──────────────────────────────────── record ───────────────────────────────────
+def record(args):
+    device = SerialPort(args.device, args.baud)
+    host = PseudoTerminal(args.link) if args.link else SerialPort(args.host_port, args.baud)
+    capture = CaptureWriter(args.out, args.baud)
+    running = threading.Event()
+    running.set()
+    threads = [threading.Thread(target=pump, args=(host, device, capture, TO_DEVICE, running)),
+               threading.Thread(target=pump, args=(device, host, capture, TO_HOST, running))]
+    for thread in threads:
+        thread.start()
+    print(f"recording {args.device} <-> {args.link or args.host_port} to {args.out}, "
+          f"Ctrl+C to stop")
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+    try:
+        while True:
+            time.sleep(0.5)
+    except KeyboardInterrupt:
+        pass
+    running.clear()
+    for thread in threads:
+        thread.join()
+    capture.close()
+    host.close()
+    device.close()
+    _, records = load(args.out)
+    print(f"{len(records)} records, {len(frames(records))} frames")
+
+
+# ──────────────────────────────────── replay ───────────────────────────────────
+def replay(args):
+    baud, original = load(args.capture)
+    sent = [r for r in original if r.direction == TO_DEVICE]
+    if not sent:
+        sys.exit("the capture has nothing the host sent")
+
+    # Replies the device had sent before each chunk, --speed 0 waits for as many
+    replies_before, count, printed = [], 0, lines(original)
+    for r in sent:
+        while count < len(printed) and printed[count][0] <= r.t:
+            count += 1
+        replies_before.append(sum(1 for _, line in printed[:count] if REPLY.match(line)))
+
+    device = SerialPort(args.port, args.baud or baud)
+    device.serial.reset_input_buffer()
+    capture = CaptureWriter(args.out, args.baud or baud)
+    replies = [0]
+    running = threading.Event()
+    running.set()
+
+    def listen():
+        buffer = bytearray()
+        while running.is_set():
+            data = device.read()
+            if not data:
+                continue
+            capture.write(TO_HOST, data)
+            for byte in data:
+                if byte in b"\r\n":
+                    if buffer and REPLY.match(buffer.decode(errors="replace")):
+                        replies[0] += 1
+                    buffer.clear()
+                else:
+                    buffer.append(byte)
+
+    listener = threading.Thread(target=listen)
+    listener.start()
+    late = 0
+    start = time.perf_counter()
+    try:
+        for r, needed in zip(sent, replies_before):
+            if args.speed > 0:
+                due = start + (r.t - sent[0].t) / 1e6 / args.speed
+                time.sleep(max(due - time.perf_counter(), 0))
+            else:
+                deadline = time.perf_counter() + args.timeout
+                while replies[0] < needed and time.perf_counter() < deadline:
+                    time.sleep(0.0002)
+                late += replies[0] < needed
+            capture.write(TO_DEVICE, r.data)
+            device.write(r.data)
+        time.sleep(args.tail)
+    finally:
+        running.clear()
+        listener.join()
+        capture.close()
+        device.close()
+
+    speed = "as fast as answered" if args.speed <= 0 else f"at {args.speed:g}x"
+    print(f"replayed {len(sent)} chunks {speed} in {time.perf_counter() - start:.2f} s")
+    if late:
+        print(f"{late} chunks went out after waiting {args.timeout} s for replies that never came")
+    _, replayed = load(args.out)
+    report([("capture", original), ("replay", replayed)], int(args.timeout * 1e6))
+
+
+def stats(args):
+    _, records = load(args.capture)
+    report([(os.path.basename(args.capture)[:10], records)], int(args.timeout * 1e6))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    rec = commands.add_parser("record", help="proxy and log a live session")
+    rec.add_argument("--device", default="COM9", help="the device's port")
+    host = rec.add_mutually_exclusive_group(required=True)
+    host.add_argument("--link", help="pseudo-terminal for the cell software, made at this path")
+    host.add_argument("--host-port", help="port the cell software's traffic comes in on")
+    rec.add_argument("--baud", type=int, default=921600)
+    rec.add_argument("--out", required=True, help="capture file")
+    rec.set_defaults(run=record)
+
+    rep = commands.add_parser("replay", help="send a capture's host side to a device")
+    rep.add_argument("capture")
+    rep.add_argument("--port", default="COM9")
+    rep.add_argument("--baud", type=int, help="the capture's by default")
+    rep.add_argument("--speed", type=float, default=1.0, help="time scale, 0 as fast as answered")
+    rep.add_argument("--out", default="replay.scap", help="capture of the replay")
+    rep.add_argument("--timeout", type=float, default=10.0, help="longest wait for a reply, s")
+    rep.add_argument("--tail", type=float, default=1.0, help="s to keep listening at the end")
+    rep.set_defaults(run=replay)
+
+    sta = commands.add_parser("stats", help="latency report of a capture")
+    sta.add_argument("capture")
+    sta.add_argument("--timeout", type=float, default=10.0, help="longest wait for a reply, s")
+    sta.set_defaults(run=stats)
+
+    args = parser.parse_args()
+    args.run(args)
+
+
+if __name__ == "__main__":
+    main()
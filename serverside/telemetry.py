@@ -0,0 +1,303 @@
+"""Decodes the compact telemetry stream of the cleaner (M953) and reports what it costs the link.
+
+The firmware quantizes position, error and speed of every axis to a scale per channel and sends
+the change of each value since the last as a zigzag varint, in binary packets between the text
+lines (see include/telemetry.hpp). This tool turns the stream back into values, checks every
+packet's CRC and the tick continuity, and reports the compression against plain floats next to
+the encoder's CPU time the device measured.
+
+Usage:
+    python telemetry.py --port COM9 -T 10
+    python telemetry.py --port COM9 -T 10 --channel "6 D5 F7" --csv run.csv --raw run.bin
+    python telemetry.py --from-raw run.bin --csv run.csv
+
+--channel takes the parameters of M953 C<n>: D ticks per window, F stat flags (1 min, 2 max,
+4 mean, 8 last), Q scale in units per count. The system must be in AUTO mode.
+"""
+import argparse
+import csv
+import sys
+import time
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional, Tuple, Union
+
+SENTINEL = 0xA6
+KEYFRAME = 0x01
+MAX_BODY = 16383  # the length is a 2 byte varint at most
+STATS = ((0x01, "min"), (0x02, "max"), (0x04, "mean"), (0x08, "last"))
+
+
+@dataclass
+class Channel:
+    index: int
+    name: str
+    scale: float
+    divider: int
+    stats: int
+
+
+@dataclass
+class Packet:
+    tick: int  # first tick
+    ticks: int
+    keyframe: bool
+    size: int  # bytes on the link, framing included
+    values: List[Tuple[int, int, str, float]]  # tick, channel, stat, value
+
+
+@dataclass
+class Counters:
+    packets: int = 0
+    bytes: int = 0  # of the packets, framing included
+    text_bytes: int = 0
+    values: int = 0
+    crc_errors: int = 0
+    skipped: int = 0  # packets that could not be decoded, waiting for a keyframe
+    gaps: int = 0  # ticks missing between decoded packets
+    seconds: float = 0.0  # spent decoding packets
+
+
+def varint(data, at: int) -> Tuple[Optional[int], int]:
+    """Value and the position after it, None if the data ends first."""
+    value, shift = 0, 0
+    while at < len(data):
+        byte = data[at]
+        at += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, at
+        shift += 7
+    return None, at
+
+
+def crc8(data) -> int:
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+@dataclass
+class Decoder:
+    """Splits the link into text lines and packets and decodes the packets.
+
+    feed() takes the bytes as they arrive and returns what completed, in order: a str per text
+    line and a Packet per decoded packet. TLM_START and TLM_CH lines set the channel table.
+    """
+    rate: float = 1000.0
+    channels: List[Channel] = field(default_factory=list)
+    counters: Counters = field(default_factory=Counters)
+    _buffer: bytearray = field(default_factory=bytearray)
+    _text: bytearray = field(default_factory=bytearray)
+    _previous: Dict[Tuple[int, int], int] = field(default_factory=dict)
+    _next_tick: Optional[int] = None  # None until a keyframe
+    _end_tick: Optional[int] = None  # after the last decoded packet, for counting the gaps
+
+    def feed(self, data: bytes) -> List[Union[str, Packet]]:
+        self._buffer.extend(data)
+        out: List[Union[str, Packet]] = []
+        while self._buffer:
+            start = self._buffer.find(SENTINEL)
+            if start != 0:
+                text = self._buffer if start < 0 else self._buffer[:start]
+                self._take_text(bytes(text), out)
+                del self._buffer[:len(text)]
+                continue
+            length, at = varint(self._buffer, 1)
+            if length is None:
+                if len(self._buffer) < 3:
+                    break  # the length is still coming
+                length = MAX_BODY + 1
+            if length > MAX_BODY:
+                self.counters.crc_errors += 1
+                del self._buffer[:1]
+                continue
+            if len(self._buffer) < at + length + 1:
+                break
+            body = bytes(self._buffer[at:at + length])
+            if crc8(body) != self._buffer[at + length]:
+                # Not a packet after all, or a damaged one, look for the next sentinel
+                self.counters.crc_errors += 1
+                del self._buffer[:1]
+                continue
+            size = at + length + 1
+            del self._buffer[:size]
+            packet = self._decode(body, size)
+            if packet is not None:
+                out.append(packet)
+        return out
+
+    def _take_text(self, text: bytes, out: List[Union[str, Packet]]):
+        self.counters.text_bytes += len(text)
+        for byte in text:
+            if byte in b"\r\n":
+                if self._text:
+                    line = self._text.decode(errors="replace").strip()
+                    self._text.clear()
+                    self._header(line)
+                    out.append(line)
+            else:
+                self._text.append(byte)
+
+    def _header(self, line: str):
+        parts = line.split()
+        if not parts:
+            return
+        if parts[0] == "TLM_START":
+            values = dict(p.split("=", 1) for p in parts[1:] if "=" in p)
+            self.rate = float(values.get("rate", self.rate))
+            self.channels = []
+            self._next_tick = None
+            self._end_tick = None
+        elif parts[0] == "TLM_CH" and len(parts) >= 3:
+            values = dict(p.split("=", 1) for p in parts[3:] if "=" in p)
+            channel = Channel(int(parts[1]), parts[2], float(values["scale"]),
+                              int(values["div"]), int(values["stats"]))
+            self.channels = [c for c in self.channels if c.index != channel.index] + [channel]
+            self.channels.sort(key=lambda c: c.index)
+
+    def _decode(self, body: bytes, size: int) -> Optional[Packet]:
+        began = time.perf_counter()
+        keyframe = bool(body[0] & KEYFRAME)
+        ticks = body[1]
+        first, at = varint(body, 2)
+        if not self.channels or (not keyframe and first != self._next_tick):
+            # Joined late or lost the one before, the chain of changes is broken until a keyframe
+            self.counters.skipped += 1
+            self._next_tick = None
+            return None
+        if keyframe:
+            self._previous = {}
+        if self._end_tick is not None and first > self._end_tick:
+            self.counters.gaps += first - self._end_tick
+
+        values = []
+        for tick in range(first, first + ticks):
+            for channel in self.channels:
+                if channel.stats == 0 or (tick + 1) % channel.divider:
+                    continue
+                for flag, stat in STATS:
+                    if not channel.stats & flag:
+                        continue
+                    z, at = varint(body, at)
+                    key = (channel.index, flag)
+                    q = (self._previous.get(key, 0) + ((z >> 1) ^ -(z & 1))) & 0xFFFFFFFF
+                    self._previous[key] = q
+                    q = q - (1 << 32) if q & 0x80000000 else q
+                    values.append((tick, channel.index, stat, q * channel.scale))
+
+        self._next_tick = self._end_tick = first + ticks
+        self.counters.packets += 1
+        self.counters.bytes += size
+        self.counters.values += len(values)
+        self.counters.seconds += time.perf_counter() - began
+        return Packet(first, ticks, keyframe, size, values)
+
+
+def report(decoder: Decoder, seconds: float, device: Optional[str]):
+    c = decoder.counters
+    floats = c.values * 4
+    print(f"packets {c.packets}, {c.bytes} bytes, {c.values} values in {seconds:.1f} s")
+    if c.bytes:
+        print(f"link     {c.bytes / max(seconds, 1e-9) / 1024:.1f} kB/s of telemetry, "
+              f"{c.text_bytes / max(seconds, 1e-9) / 1024:.1f} kB/s of text")
+        print(f"ratio    {floats / c.bytes:.2f} x against floats, "
+              f"{8 * c.bytes / max(c.values, 1):.1f} bits a value")
+    if c.values:
+        print(f"decode   {1e6 * c.seconds / c.values:.2f} µs a value on this host")
+    print(f"errors   {c.crc_errors} bad packets, {c.skipped} skipped waiting for a keyframe, "
+          f"{c.gaps} ticks lost")
+    if device:
+        print(f"device   {device}")
+
+
+def run_on_device(args, decoder: Decoder, sink) -> Tuple[float, Optional[str]]:
+    import transmitter
+
+    tx = transmitter.Transmitter(args.port, args.baud, write_timeout=1, timeout=0.05)
+    raw = open(args.raw, "wb") if args.raw else None
+    device = None
+    tx.serial.reset_input_buffer()
+    for channel in args.channel:
+        tx.send_msg(transmitter.CommandMessage(f"M953 C{channel}\0"))
+    tx.send_msg(transmitter.CommandMessage("M953 S1\0"))
+    began = time.time()
+    stopping = None
+    try:
+        while True:
+            now = time.time()
+            if stopping is None and now - began >= args.duration:
+                tx.send_msg(transmitter.CommandMessage("M953 S0\0"))
+                stopping = now
+            if stopping is not None and (device is not None or now - stopping > 2.0):
+                break
+            data = tx.serial.read(65536)
+            if raw and data:
+                raw.write(data)
+            for item in decoder.feed(data):
+                if isinstance(item, str):
+                    if item.startswith("TLM "):
+                        device = item[4:]
+                    elif item.startswith(("Telemetry", "Err", "Unhandled")):
+                        print(item, file=sys.stderr)
+                else:
+                    sink(item)
+    finally:
+        if stopping is None:
+            tx.send_msg(transmitter.CommandMessage("M953 S0\0"))
+        if raw:
+            raw.close()
+        tx.serial.close()
+    return (stopping or time.time()) - began, device
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", default="COM9")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("-T", "--duration", type=float, default=10.0, help="seconds")
+    parser.add_argument("--channel", action="append", default=[],
+                        help='"<n> D<div> F<stats> Q<scale>", set before the start')
+    parser.add_argument("--from-raw", help="decode a saved raw stream instead of running")
+    parser.add_argument("--raw", help="save the raw stream to this file")
+    parser.add_argument("--csv", help="write the values, one row each: time, channel, stat, value")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    out = open(args.csv, "w", newline="") if args.csv else None
+    writer = csv.writer(out) if out else None
+    if writer:
+        writer.writerow(["tick", "time_s", "channel", "stat", "value"])
+
+    def sink(packet: Packet):
+        if writer:
+            names = {c.index: c.name for c in decoder.channels}
+            for tick, channel, stat, value in packet.values:
+                writer.writerow([tick, f"{tick / decoder.rate:.4f}", names[channel], stat,
+                                 f"{value:.6g}"])
+
+    try:
+        if args.from_raw:
+            device, first, end = None, None, 0
+            with open(args.from_raw, "rb") as f:
+                data = f.read()
+            for item in decoder.feed(data):
+                if isinstance(item, str):
+                    device = item[4:] if item.startswith("TLM ") else device
+                else:
+                    sink(item)
+                    first = item.tick if first is None else first
+                    end = item.tick + item.ticks
+            seconds = (end - (first or 0)) / decoder.rate
+        else:
+            seconds, device = run_on_device(args, decoder, sink)
+    finally:
+        if out:
+            out.close()
+    report(decoder, seconds, device)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,366 @@
+"""Live plots of the cleaner's telemetry stream (M953), recorded to disk as it arrives.
+
+A background thread reads the link at full rate and decodes the stream with telemetry.Decoder,
+every value goes into a numpy ring of the last --history seconds and, with --session, into
+column files on disk. The plots show position, error and speed of every axis over the last
+--window seconds, min/max decimated to the plot width so a spike of one tick is never lost
+between the pixels.
+
+Lines typed into the terminal are sent as commands while the plots run, so a tuning change
+(M593, M80, ...) can be watched taking effect. Device text is printed as it arrives.
+
+A session is a directory with one file per column, part N/ for the Nth stream start:
+
+    meta.json                   rate and channel table
+    <channel>.tick.i64          tick of every window, 0 at the stream start
+    <channel>.<stat>.f32        min, max, mean or last of every window
+
+np.fromfile() reads a column, load_session() all of them.
+
+Usage:
+    python telemetry_viewer.py --port COM9
+    python telemetry_viewer.py --port COM9 --session runs/tuning --channel "6 D5 F7"
+    python telemetry_viewer.py --from-session runs/tuning
+"""
+import argparse
+import json
+import os
+import sys
+import threading
+import time
+from typing import Dict, List, Optional, Tuple
+
+import numpy as np
+
+import telemetry
+
+AXES = ("jaw_rotation", "jaw_pos", "clamp")
+QUANTITIES = (("position", "rad | mm"), ("error", "rad | mm"), ("speed", "rad/s | mm/s"))
+
+
+class Ring:
+    """The last `capacity` windows of one channel, a tick column and a column per stat."""
+
+    def __init__(self, capacity: int, stats: List[str]):
+        self.capacity = capacity
+        self.tick = np.zeros(capacity, np.int64)
+        self.columns = {stat: np.zeros(capacity, np.float32) for stat in stats}
+        self.written = 0
+
+    def extend(self, ticks: np.ndarray, columns: Dict[str, np.ndarray]):
+        n = len(ticks)
+        if n > self.capacity:
+            ticks, columns = ticks[-self.capacity:], {k: v[-self.capacity:] for k, v in
+                                                     columns.items()}
+            self.written += n - self.capacity
+            n = self.capacity
+        at = self.written % self.capacity
+        first = min(n, self.capacity - at)
+        self.tick[at:at + first] = ticks[:first]
+        self.tick[:n - first] = ticks[first:]
+        for stat, column in self.columns.items():
+            column[at:at + first] = columns[stat][:first]
+            column[:n - first] = columns[stat][first:]
+        self.written += n
+
+    def since(self, tick: int) -> Tuple[np.ndarray, Dict[str, np.ndarray]]:
+        """Copies of the windows from `tick` on, oldest first."""
+        count = min(self.written, self.capacity)
+        start = (self.written - count) % self.capacity
+        order = (np.arange(count) + start) % self.capacity
+        ticks = self.tick[order]
+        keep = ticks >= tick
+        return ticks[keep], {stat: column[order][keep] for stat, column in self.columns.items()}
+
+
+class SessionWriter:
+    """Appends every decoded window to its column files, a new part at every stream start."""
+
+    def __init__(self, path: str):
+        self.path = path
+        self.part = -1
+        self.files: Dict[str, object] = {}
+        os.makedirs(path, exist_ok=True)
+
+    def start(self, decoder: telemetry.Decoder):
+        self.close()
+        self.part += 1
+        directory = os.path.join(self.path, str(self.part))
+        os.makedirs(directory, exist_ok=True)
+        meta = {"rate": decoder.rate, "started": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                "channels": [{"name": c.name, "scale": c.scale, "divider": c.divider,
+                              "stats": c.stats} for c in decoder.channels]}
+        with open(os.path.join(directory, "meta.json"), "w") as f:
+            json.dump(meta, f, indent=1)
+        for channel in decoder.channels:
+            self.files[f"{channel.name}.tick"] = open(
+                os.path.join(directory, f"{channel.name}.tick.i64"), "ab")
+            for flag, stat in telemetry.STATS:
+                if channel.stats & flag:
+                    self.files[f"{channel.name}.{stat}"] = open(
+                        os.path.join(directory, f"{channel.name}.{stat}.f32"), "ab")
+
+    def write(self, name: str, ticks: np.ndarray, columns: Dict[str, np.ndarray]):
+        ticks.astype(np.int64).tofile(self.files[f"{name}.tick"])
+        for stat, column in columns.items():
+            column.astype(np.float32).tofile(self.files[f"{name}.{stat}"])
+
+    def close(self):
+        for f in self.files.values():
+            f.close()
+        self.files = {}
+
+
+def load_session(path: str) -> List[Dict]:
+    """Every part of a session: its meta.json with a "columns" dict, channel -> column -> array."""
+    parts = []
+    for part in sorted((p for p in os.listdir(path) if p.isdigit()), key=int):
+        directory = os.path.join(path, part)
+        with open(os.path.join(directory, "meta.json")) as f:
+            meta = json.load(f)
+        meta["columns"] = {}
+        for channel in meta["channels"]:
+            name = channel["name"]
+            columns = {"tick": np.fromfile(os.path.join(directory, f"{name}.tick.i64"), np.int64)}
+            for flag, stat in telemetry.STATS:
+                if channel["stats"] & flag:
+                    columns[stat] = np.fromfile(os.path.join(directory, f"{name}.{stat}.f32"),
+                                                np.float32)
+            meta["columns"][name] = columns
+        parts.append(meta)
+    return parts
+
+
+class Recorder:
+    """Decodes the link on a background thread into the rings and the session."""
+
+    def __init__(self, tx, history: float, session: Optional[SessionWriter]):
+        self.tx = tx
+        self.history = history
+        self.session = session
+        self.decoder = telemetry.Decoder()
+        self.lock = threading.Lock()
+        self.rings: Dict[str, Ring] = {}
+        self.rate = 1000.0
+        self.last_tick = 0
+        self.device: Optional[str] = None  # the last TLM report
+        self.began = time.time()
+        self.running = threading.Event()
+        self.thread = threading.Thread(target=self._run, daemon=True)
+
+    def start(self):
+        self.running.set()
+        self.thread.start()
+
+    def stop(self):
+        self.running.clear()
+        self.thread.join(timeout=2.0)
+        if self.session:
+            self.session.close()
+
+    def _run(self):
+        while self.running.is_set():
+            data = self.tx.serial.read(65536)
+            if not data:
+                continue
+            for item in self.decoder.feed(data):
+                if isinstance(item, str):
+                    self._text(item)
+                else:
+                    self._packet(item)
+
+    def _text(self, line: str):
+        if line.startswith("TLM "):
+            self.device = line[4:]
+        elif not line.startswith(("TLM_CH", "At Pos")):
+            print(f"< {line}")
+
+    def _restart(self):
+        """A new TLM_START: new rings for the new channel table, a new part of the session."""
+        decoder = self.decoder
+        with self.lock:
+            self.rate = decoder.rate
+            self.rings = {}
+            for channel in decoder.channels:
+                windows = int(self.history * decoder.rate / channel.divider) + 1
+                stats = [stat for flag, stat in telemetry.STATS if channel.stats & flag]
+                self.rings[channel.name] = Ring(windows, stats)
+        if self.session:
+            self.session.start(decoder)
+
+    def _packet(self, packet: telemetry.Packet):
+        names = {c.index: c.name for c in self.decoder.channels}
+        if (packet.keyframe and packet.tick == 0) or set(names.values()) != set(self.rings):
+            self._restart()
+        # Group the values by channel, every stat of a window comes in the same order
+        grouped: Dict[str, Tuple[List[int], Dict[str, List[float]]]] = {}
+        for tick, channel, stat, value in packet.values:
+            ticks, columns = grouped.setdefault(names[channel], ([], {}))
+            column = columns.setdefault(stat, [])
+            if len(column) == len(ticks):
+                ticks.append(tick)
+            column.append(value)
+        with self.lock:
+            for name, (ticks, columns) in grouped.items():
+                arrays = {stat: np.asarray(values, np.float32) for stat, values in columns.items()}
+                self.rings[name].extend(np.asarray(ticks, np.int64), arrays)
+            self.last_tick = packet.tick + packet.ticks
+        if self.session:
+            for name, (ticks, columns) in grouped.items():
+                self.session.write(name, np.asarray(ticks),
+                                   {stat: np.asarray(values) for stat, values in columns.items()})
+
+    def window(self, name: str, seconds: float):
+        """Ticks and columns of a channel over the last `seconds`, None before it was seen."""
+        with self.lock:
+            ring = self.rings.get(name)
+            if ring is None:
+                return None
+            return ring.since(self.last_tick - int(seconds * self.rate))
+
+    def status(self) -> str:
+        c = self.decoder.counters
+        elapsed = max(time.time() - self.began, 1e-9)
+        ratio = c.values * 4 / c.bytes if c.bytes else 0.0
+        return (f"{c.bytes / elapsed / 1024:.1f} kB/s, {ratio:.2f}x against floats, "
+                f"{c.crc_errors} bad, {c.skipped} skipped, {c.gaps} ticks lost")
+
+
+def minmax(x: np.ndarray, low: np.ndarray, high: np.ndarray, buckets: int):
+    """Min/max decimation to `buckets` vertical strokes, every extreme of the data is drawn."""
+    if len(x) <= 2 * buckets:
+        if low is high:
+            return x, low
+        return np.repeat(x, 2), np.column_stack((low, high)).ravel()
+    edges = np.linspace(0, len(x), buckets + 1).astype(int)[:-1]
+    lo = np.minimum.reduceat(low, edges)
+    hi = np.maximum.reduceat(high, edges)
+    return np.repeat(x[edges], 2), np.column_stack((lo, hi)).ravel()
+
+
+def extremes(columns: Dict[str, np.ndarray]):
+    """Lowest and highest value of each window, from what the channel sends."""
+    low = columns.get("min", columns.get("last", columns.get("mean")))
+    high = columns.get("max", columns.get("last", columns.get("mean")))
+    return low, high
+
+
+class Plots:
+    """A row per quantity, a column per axis, each an envelope line and the mean if sent."""
+
+    def __init__(self, title: str):
+        import matplotlib.pyplot as plt
+        self.plt = plt
+        self.figure, axes = plt.subplots(len(QUANTITIES), len(AXES), sharex=True,
+                                         figsize=(14, 8), squeeze=False)
+        self.figure.suptitle(title)
+        self.status = self.figure.text(0.01, 0.01, "", fontsize=8)
+        self.lines = {}
+        for row, (quantity, unit) in enumerate(QUANTITIES):
+            for col, axis in enumerate(AXES):
+                ax = axes[row][col]
+                ax.grid(True, alpha=0.3)
+                if row == 0:
+                    ax.set_title(axis)
+                if col == 0:
+                    ax.set_ylabel(f"{quantity}\n{unit}")
+                if row == len(QUANTITIES) - 1:
+                    ax.set_xlabel("s")
+                envelope, = ax.plot([], [], lw=0.8)
+                mean, = ax.plot([], [], lw=1.0, color="k")
+                self.lines[f"{axis}.{quantity}"] = (ax, envelope, mean)
+
+    def draw(self, name: str, ticks: np.ndarray, columns: Dict[str, np.ndarray], rate: float):
+        if name not in self.lines:
+            return
+        ax, envelope, mean = self.lines[name]
+        buckets = max(int(ax.bbox.width), 100)
+        t = ticks / rate
+        low, high = extremes(columns)
+        envelope.set_data(*minmax(t, low, high, buckets))
+        if "mean" in columns and ("min" in columns or "max" in columns):
+            mean.set_data(*minmax(t, columns["mean"], columns["mean"], buckets))
+        else:
+            mean.set_data([], [])
+        ax.relim()
+        ax.autoscale_view()
+
+
+def live(args):
+    import matplotlib.animation as animation
+    import transmitter
+
+    tx = transmitter.Transmitter(args.port, args.baud, write_timeout=1, timeout=0.05)
+    tx.serial.reset_input_buffer()
+    session = SessionWriter(args.session) if args.session else None
+    recorder = Recorder(tx, max(args.history, args.window), session)
+    recorder.start()
+    for channel in args.channel:
+        tx.send_msg(transmitter.CommandMessage(f"M953 C{channel}\0"))
+    tx.send_msg(transmitter.CommandMessage("M953 S1\0"))
+
+    def commands():
+        for line in sys.stdin:
+            line = line.strip()
+            if line:
+                tx.send_msg(transmitter.CommandMessage(line + "\0"))
+
+    threading.Thread(target=commands, daemon=True).start()
+
+    plots = Plots(args.port)
+
+    def update(_):
+        for name in plots.lines:
+            window = recorder.window(name, args.window)
+            if window is not None and len(window[0]):
+                plots.draw(name, window[0], window[1], recorder.rate)
+        plots.status.set_text(recorder.status())
+        return []
+
+    try:
+        _ = animation.FuncAnimation(plots.figure, update, interval=1000 / args.fps,
+                                    cache_frame_data=False)
+        plots.plt.show()
+    finally:
+        tx.send_msg(transmitter.CommandMessage("M953 S0\0"))
+        time.sleep(0.5)
+        recorder.stop()
+        tx.serial.close()
+        print(recorder.status())
+        if recorder.device:
+            print(f"device {recorder.device}")
+
+
+def replay(args):
+    parts = load_session(args.from_session)
+    if not parts:
+        sys.exit(f"{args.from_session} has no recorded parts")
+    for index, part in enumerate(parts):
+        plots = Plots(f"{args.from_session} part {index}, {part['started']}")
+        for name, columns in part["columns"].items():
+            ticks = columns.pop("tick")
+            plots.draw(name, ticks, columns, part["rate"])
+    plots.plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", default="COM9")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--window", type=float, default=10.0, help="seconds shown")
+    parser.add_argument("--history", type=float, default=60.0, help="seconds kept in memory")
+    parser.add_argument("--fps", type=float, default=10.0, help="plot refreshes a second")
+    parser.add_argument("--channel", action="append", default=[],
+                        help='"<n> D<div> F<stats> Q<scale>", set before the start')
+    parser.add_argument("--session", help="record to this directory")
+    parser.add_argument("--from-session", help="plot a recorded session instead of running")
+    args = parser.parse_args()
+
+    if args.from_session:
+        replay(args)
+    else:
+        live(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -7,7 +7,8 @@ import time
 
 class Transmitter:
     def __init__(self, port: str, baud_rate: int, write_timeout: float, timeout: float, rtscts: bool = False):
-        self.serial = serial.Serial(port, baud_rate, write_timeout=write_timeout, timeout=timeout, rtscts=rtscts)
+        # A port name or a pyserial URL, socket://<board>:3333 for a TRANSPORT_TCP build
+        self.serial = serial.serial_for_url(port, baud_rate, write_timeout=write_timeout, timeout=timeout, rtscts=rtscts)
     
     def send_msg(self, msg: "Message"):
         sentinel = b"\xA5"
@@ -57,6 +58,42 @@ class CommandMessage(Message):
     def encode(self) -> bytes:
         data = struct.pack(f"<{self.length()}s", self.Command.encode('utf-8'))
         return data
+
+
+@dataclass
+class BatchMessage(Message):
+    """Many (seq, line) commands in one frame, see include/command_batch.hpp"""
+    Commands: list
+    Restart: bool = False
+
+    @staticmethod
+    def message_id() -> int:
+        return 0x03
+
+    def length(self) -> int:
+        return len(self.encode())
+
+    def encode(self) -> bytes:
+        data = bytes([1 if self.Restart else 0])
+        for seq, line in self.Commands:
+            data += struct.pack("<H", seq & 0xFFFF) + line.encode('utf-8') + b"\0"
+        return data
+
+
+@dataclass
+class PingMessage(Message):
+    """Host send time, echoed in the device's "Pong" with its own timestamps"""
+    HostTime: int
+
+    @staticmethod
+    def message_id() -> int:
+        return 0x04
+
+    def length(self) -> int:
+        return 8
+
+    def encode(self) -> bytes:
+        return struct.pack("<Q", self.HostTime)
     
 if __name__ == "__main__":
     # Example usage
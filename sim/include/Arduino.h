@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief The part of the Arduino-ESP32 core the firmware uses, for the host build in sim/.
+ *
+ * Time comes from the simulator's virtual clock, pins are plain variables the simulated plant
+ * watches and drives, and Serial is the pseudo-terminal the host tools connect to.
+ */
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#ifndef M_TWOPI
+#define M_TWOPI (M_PI * 2.0)
+#endif
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define F(string_literal) (string_literal)
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define radians(deg) ((deg) * DEG_TO_RAD)
+#define degrees(rad) ((rad) * RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::abs;
+using std::max;
+using std::min;
+
+/* Nano ESP32 pin names, numbered 0..24 here, the simulator has no GPIO matrix to remap through */
+enum : uint8_t
+{
+    D0 = 0, D1, D2, D3, D4, D5, D6, D7, D8, D9, D10, D11, D12, D13,
+    A0, A1, A2, A3, A4, A5, A6, A7,
+    LED_RED, LED_GREEN, LED_BLUE,
+};
+constexpr uint8_t NUM_DIGITAL_PINS = 64;
+
+inline uint8_t digitalPinToInterrupt(uint8_t pin) { return pin; }
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+void noInterrupts();
+void interrupts();
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* buffer, size_t size)
+    {
+        return write(reinterpret_cast<const uint8_t*>(buffer), size);
+    }
+    size_t write(const char* str) { return str == nullptr ? 0 : write(str, strlen(str)); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t printf(const char* format, ...);
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(unsigned char value, int base = DEC)
+    {
+        return print(static_cast<unsigned long long>(value), base);
+    }
+    size_t print(int value, int base = DEC) { return print(static_cast<long long>(value), base); }
+    size_t print(unsigned int value, int base = DEC)
+    {
+        return print(static_cast<unsigned long long>(value), base);
+    }
+    size_t print(long value, int base = DEC) { return print(static_cast<long long>(value), base); }
+    size_t print(unsigned long value, int base = DEC)
+    {
+        return print(static_cast<unsigned long long>(value), base);
+    }
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(T value)
+    {
+        const size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(T value, int format)
+    {
+        const size_t n = print(value, format);
+        return n + println();
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { timeout_ = timeout; }
+    size_t readBytes(char* buffer, size_t length);
+    size_t readBytes(uint8_t* buffer, size_t length)
+    {
+        return readBytes(reinterpret_cast<char*>(buffer), length);
+    }
+
+protected:
+    unsigned long timeout_ = 1000;  // ms
+};
+
+/** @brief Serial on the simulator's pseudo-terminal, see sim::openSerial() */
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud, uint32_t config = 0, int8_t rxPin = -1, int8_t txPin = -1);
+    void end() {}
+    size_t setRxBufferSize(size_t size);
+    size_t setTxBufferSize(size_t size) { return size; }
+    explicit operator bool() const { return true; }
+
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    using Print::write;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int availableForWrite() override;
+    void flush() override {}
+
+private:
+    void fill();
+
+    uint8_t* rx_    = nullptr;
+    size_t rxSize_  = 256;  // the core's default receive buffer
+    size_t rxHead_  = 0;
+    size_t rxCount_ = 0;
+};
+
+extern HardwareSerial Serial;
+
+void setup();
+void loop();
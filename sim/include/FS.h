@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+/** @brief A file or directory of the host directory standing in for the flash file system */
+class File
+{
+public:
+    struct Handle;
+
+    File() {}
+    explicit File(std::shared_ptr<Handle> handle) : handle_(handle) {}
+
+    explicit operator bool() const;
+    size_t write(const uint8_t* buffer, size_t size);
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t read(uint8_t* buffer, size_t size);
+    int read();
+    size_t size() const;
+    void close();
+    /** @brief Name without the directory, as the ESP32 LittleFS gives it */
+    const char* name() const;
+    bool isDirectory() const;
+    File openNextFile(const char* mode = FILE_READ);
+
+private:
+    std::shared_ptr<Handle> handle_;
+};
+
+namespace fs
+{
+/** @brief Host directory mounted at `root`, every path is resolved under it */
+class FS
+{
+public:
+    bool exists(const char* path);
+    bool mkdir(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    File open(const char* path, const char* mode = FILE_READ, bool create = false);
+
+protected:
+    bool mount(const char* directory);
+
+private:
+    char root_[256] = {};
+    bool resolve(const char* path, char* out, size_t size) const;
+};
+}  // namespace fs
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "FS.h"
+
+/** @brief LittleFS on <options.storage>/littlefs */
+class LittleFSFS : public fs::FS
+{
+public:
+    bool begin(
+        bool formatOnFail       = false,
+        const char* basePath    = "/littlefs",
+        uint8_t maxOpenFiles    = 10,
+        const char* partition   = "spiffs");
+    void end() {}
+};
+
+extern LittleFSFS LittleFS;
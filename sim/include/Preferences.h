@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** @brief NVS namespace as <options.storage>/nvs/<namespace>, one file per key */
+class Preferences
+{
+public:
+    bool begin(const char* name, bool readOnly = false, const char* partition = nullptr);
+    void end() { open_ = false; }
+
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t length);
+    size_t putBytes(const char* key, const void* value, size_t length);
+    bool remove(const char* key);
+
+private:
+    bool path(const char* key, char* out, size_t size) const;
+
+    char directory_[256] = {};
+    bool open_           = false;
+    bool readOnly_       = false;
+};
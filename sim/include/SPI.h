@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+class SPISettings
+{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+/**
+ * @brief The only device on the simulated bus is the AS5048A, it answers every 16-bit frame with
+ * the register the previous frame asked for, as the sensor does.
+ */
+class SPIClass
+{
+public:
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings settings) {}
+    void endTransaction() {}
+    uint16_t transfer16(uint16_t data);
+    uint8_t transfer(uint8_t data) { return 0; }
+
+private:
+    uint16_t response_ = 0;
+};
+
+extern SPIClass SPI;
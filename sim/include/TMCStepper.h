@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief TMC5160 that keeps what is written to it. The simulated motors follow the STEP pulses
+ * exactly, so the driver reports a healthy, lightly loaded motor and never stalls.
+ */
+class TMC5160Stepper
+{
+public:
+    static constexpr uint16_t SG_RESULT_NOMINAL = 300;  ///< StallGuard reading of a free motor
+    static constexpr uint32_t TSTEP_STANDSTILL  = 0xFFFFF;
+
+    TMC5160Stepper(uint16_t pinCS, float RS, uint16_t pinMOSI, uint16_t pinMISO, uint16_t pinSCK)
+        : rSense_(RS)
+    {
+    }
+    TMC5160Stepper(uint16_t pinCS, float RS) : rSense_(RS) {}
+
+    void begin() {}
+    uint8_t test_connection() { return 0; }
+
+    /* Current */
+    void rms_current(uint16_t mA) { rms_ = mA; }
+    void rms_current(uint16_t mA, float holdMultiplier)
+    {
+        rms_  = mA;
+        hold_ = holdMultiplier;
+    }
+    uint16_t rms_current() { return rms_; }
+    void hold_multiplier(float multiplier) { hold_ = multiplier; }
+    void ihold(uint8_t value) {}
+    void irun(uint8_t value) {}
+    void iholddelay(uint8_t value) {}
+    void TPOWERDOWN(uint8_t value) {}
+    void GLOBAL_SCALER(uint8_t value) {}
+
+    void microsteps(uint16_t steps) { microsteps_ = steps; }
+    uint16_t microsteps() { return microsteps_; }
+
+    /* Chopper */
+    void toff(uint8_t value) { toff_ = value; }
+    uint8_t toff() { return toff_; }
+    void tbl(uint8_t value) {}
+    void hstrt(uint8_t value) {}
+    void hend(int8_t value) {}
+    void chm(bool value) {}
+    void vhighfs(bool value) {}
+    void vhighchm(bool value) {}
+    void en_pwm_mode(bool value) {}
+    void pwm_autoscale(bool value) {}
+    void pwm_autograd(bool value) {}
+    void pwm_freq(uint8_t value) {}
+    void pwm_ofs(uint8_t value) {}
+    void pwm_grad(uint8_t value) {}
+    uint8_t pwm_ofs_auto() { return 30; }
+    uint8_t pwm_grad_auto() { return 14; }
+    uint8_t pwm_scale_sum() { return 0; }
+    int16_t pwm_scale_auto() { return 0; }
+    void TPWMTHRS(uint32_t value) {}
+    void THIGH(uint32_t value) {}
+    void TCOOLTHRS(uint32_t value) {}
+    uint32_t TSTEP() { return TSTEP_STANDSTILL; }
+
+    /* CoolStep and StallGuard */
+    void semin(uint8_t value) {}
+    void semax(uint8_t value) {}
+    void seup(uint8_t value) {}
+    void sedn(uint8_t value) {}
+    void seimin(bool value) {}
+    void sgt(int8_t value) {}
+    void sfilt(bool value) {}
+    void sg_stop(bool value) {}
+
+    /* Status */
+    uint32_t DRV_STATUS()
+    {
+        return SG_RESULT_NOMINAL | static_cast<uint32_t>(cs_actual()) << 16;
+    }
+    uint16_t sg_result() { return SG_RESULT_NOMINAL; }
+    uint8_t cs_actual() { return toff_ == 0 ? 0 : 31; }
+    bool fsactive() { return false; }
+    bool stallguard() { return false; }
+    bool ot() { return false; }
+    bool otpw() { return false; }
+    bool s2ga() { return false; }
+    bool s2gb() { return false; }
+    bool ola() { return false; }
+    bool olb() { return false; }
+    bool stst() { return false; }
+    uint8_t s2vs_level() { return 0; }
+    uint8_t GSTAT() { return 0; }
+    bool reset() { return false; }
+    bool drv_err() { return false; }
+    bool uv_cp() { return false; }
+    bool sd_mode() { return false; }
+    bool drv_enn() { return false; }
+
+private:
+    float rSense_        = 0.075f;
+    uint16_t rms_        = 0;
+    float hold_          = 0.5f;
+    uint16_t microsteps_ = 256;
+    uint8_t toff_        = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The part of the Arduino-ESP32 WiFi library TcpTransport uses, over host sockets.
+ *
+ * There is no radio, joining a network always succeeds at once and the server listens on the
+ * host's own port, so the host tools reach a native_sim build with -D TRANSPORT_TCP at
+ * socket://localhost:<port> as they would the board.
+ */
+
+#define WIFI_STA 1
+
+class WiFiClient
+{
+public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd) : fd_(fd) {}
+    WiFiClient(WiFiClient&& other) : fd_(other.fd_) { other.fd_ = -1; }
+    WiFiClient& operator=(WiFiClient&& other);
+    WiFiClient(const WiFiClient&)            = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+    ~WiFiClient() { stop(); }
+
+    explicit operator bool() const { return fd_ >= 0; }
+    uint8_t connected();
+    void stop();
+    int setNoDelay(bool noDelay);
+
+    int available();
+    int read();
+    int read(uint8_t* buffer, size_t size);
+    size_t write(const uint8_t* data, size_t size);
+
+private:
+    int fd_ = -1;
+};
+
+class WiFiServer
+{
+public:
+    explicit WiFiServer(uint16_t port) : port_(port) {}
+    ~WiFiServer();
+
+    void begin();
+    void setNoDelay(bool noDelay) { noDelay_ = noDelay; }
+    bool hasClient();
+    /** @brief The connection hasClient() saw, an empty client if there is none */
+    WiFiClient available();
+
+private:
+    uint16_t port_;
+    int fd_       = -1;
+    int pending_  = -1;
+    bool noDelay_ = false;
+};
+
+class WiFiClass
+{
+public:
+    bool mode(int) { return true; }
+    bool setSleep(bool) { return true; }
+    bool setAutoReconnect(bool) { return true; }
+    int begin(const char*, const char* = nullptr) { return 3; }  // WL_CONNECTED
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+/** @brief I2C bus with the PCF8575 of the button board at its default address on it */
+class TwoWire : public Stream
+{
+public:
+    static constexpr uint8_t PCF8575_ADDRESS = 0x20;
+
+    bool begin() { return true; }
+    void setClock(uint32_t frequency) {}
+
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+
+    using Print::write;
+    size_t write(uint8_t c) override;
+    int available() override { return rxCount_ - rxIndex_; }
+    int read() override { return rxIndex_ < rxCount_ ? rx_[rxIndex_++] : -1; }
+    int peek() override { return rxIndex_ < rxCount_ ? rx_[rxIndex_] : -1; }
+
+private:
+    uint8_t address_ = 0;
+    uint8_t tx_[2]   = {};
+    uint8_t txCount_ = 0;
+    uint8_t rx_[2]   = {};
+    uint8_t rxCount_ = 0;
+    uint8_t rxIndex_ = 0;
+};
+
+extern TwoWire Wire;
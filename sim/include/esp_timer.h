@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sim.hpp"
+
+/** @brief µs since boot, the simulator's virtual clock */
+inline int64_t esp_timer_get_time() { return static_cast<int64_t>(sim::now()); }
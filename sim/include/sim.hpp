@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The firmware's main loop on the host, for testing the host tools and the whole
+ * host -> device pipeline without hardware.
+ *
+ * The unmodified setup() and loop() of src/main.cpp run against the Arduino shims in
+ * sim/include. Serial is a pseudo-terminal the host tools open like the board's USB port. Step
+ * pulses move a simulated plant, which feeds the AS5048A angle and the PCF8575 switches back.
+ *
+ * Time is virtual. It either follows the real clock scaled by `speed`, or advances a fixed `tickUs`
+ * per loop() so runs are repeatable and, unpaced, as fast as the host allows. delay() moves the
+ * clock forward without waiting. With the real clock a slow host steps the motors late, the moves
+ * still end where they should but take longer. The tick clock has no such error.
+ *
+ * STEP_VERIFICATION, FAST_STEP_OUTPUT and VIBRATION_MONITOR drive ESP32 peripherals directly and
+ * are not built here.
+ */
+namespace sim
+{
+struct Options
+{
+    double speed        = 1.0;            ///< virtual seconds per real second, 0 unpaced (tickUs)
+    uint32_t tickUs     = 0;              ///< virtual µs per loop(), 0 follows the real clock
+    const char* link    = nullptr;        ///< symlink made to the pseudo-terminal, e.g. COM9
+    const char* storage = "sim_storage";  ///< host directory behind LittleFS and Preferences
+    bool manual         = false;          ///< start with the mode switch on MANUAL
+    float resonanceHz   = 0.0f;           ///< jaw torsional mode the encoder sees, 0 rigid
+    float damping       = 0.05f;          ///< damping ratio of that mode
+    const char* session = nullptr;        ///< scripted host session to run, see sim::session
+    const char* trace   = nullptr;        ///< file the session's trace is written to
+    uint32_t traceUs    = 1000;           ///< trace sample period, virtual µs
+    uint32_t limitMs    = 600000;         ///< virtual ms a session gets to reach its END
+};
+
+extern Options options;
+
+/* Clock */
+void startClock();
+uint64_t now();  ///< virtual µs since startClock()
+void advance(uint64_t us);
+/** @brief Once per loop(): steps the tick clock, or waits so the run keeps to `speed` */
+void pace();
+
+/* Serial */
+/** @brief Opens the pseudo-terminal Serial talks over, returns the path of its terminal side */
+const char* openSerial(const char* link);
+void closeSerial();
+/** @brief Queues bytes for Serial to receive, ahead of anything from the pseudo-terminal */
+void injectSerial(const uint8_t* data, size_t size);
+/** @brief Injected bytes Serial hasn't received yet */
+size_t injectedSerial();
+/** @brief Calls `tap` with everything the firmware writes to Serial, as it is written */
+void tapSerial(void (*tap)(const uint8_t* data, size_t size));
+
+/* Pins, as the plant sees them */
+uint8_t pinLevel(uint8_t pin);
+/** @brief Drives an input pin from outside the firmware, runs its interrupt on a matching edge */
+void driveInput(uint8_t pin, uint8_t level);
+void driveAnalog(uint8_t pin, int value);
+
+/**
+ * @brief Motors, encoder and switches around the firmware.
+ *
+ * The three axes count the STEP edges AccelStepper writes. The AS5048A reads the jaw rotation,
+ * through a torsional mode when options.resonanceHz is set. The PCF8575 inputs hold the mode
+ * switch and the buttons, released.
+ */
+namespace plant
+{
+void begin();
+void pinWritten(uint8_t pin, uint8_t level);
+/** @brief Advances the jaw dynamics to now() */
+void update();
+
+long steps(uint8_t axis);
+/** @brief Jaw angle at the encoder, radians */
+float encoderAngle();
+
+uint16_t pcfRead();
+void pcfWrite(uint16_t value);
+/** @brief Flips the AUTO/MANUAL switch, SIGUSR1 does it from outside */
+void toggleMode();
+}  // namespace plant
+
+/**
+ * @brief A scripted host session in virtual time, and the trace of what the motors did.
+ *
+ * The session file has one line to send per line, after a trigger:
+ *
+ *     # comment
+ *     @250   G0 Y10 A0.2     at 250 ms
+ *     +100   M80 Y20         100 ms after the previous line was sent
+ *     ack    G0 Y0           once the device answered the previous line with "At Pos"
+ *     idle   STOP            once the motion the previous line started has stopped
+ *     idle   END             ends the run
+ *
+ * Lines go in as COMMAND frames, STOP as a STOP frame. In AUTO the firmware runs the last command
+ * again every loop, so "At Pos" keeps coming for the previous line until the new frame is read, and
+ * only the ones after that count for `ack`. Frames are handed straight to Serial rather
+ * than through the pseudo-terminal, whose kernel buffering would make the timing vary run to run.
+ * With the tick clock two runs of the same firmware give the same trace, which is what
+ * scripts/golden_traces.py compares against the traces committed in sim/golden.
+ *
+ * The trace has a line per event and a sample every options.traceUs the plant moved:
+ *
+ *     E <t_us> tx <line>      sent
+ *     E <t_us> read           the firmware has taken the whole frame off Serial
+ *     E <t_us> rx <text>      a line the device printed
+ *     E <t_us> idle           Cleaner::isMotionIdle() turned true
+ *     S <t_us> <jaw rotation steps> <jaw position steps> <clamp steps>
+ *       <jaw_rotation> <jaw_pos> <clamp_pos> <is_Brake>
+ *
+ * The State columns are Cleaner::updateRealState() worked out from the plant's steps, jaw_pos
+ * still carries the lead screw correction.
+ */
+namespace session
+{
+/** @brief Loads the script and opens the trace, EXIT_FAILURE if either can't be */
+int begin(const char* script, const char* trace);
+/** @brief Once per loop(): sends what is due and samples the trace, false once the run is over */
+bool update();
+/** @brief Closes the trace, EXIT_FAILURE if the session didn't reach its END */
+int end();
+}  // namespace session
+}  // namespace sim
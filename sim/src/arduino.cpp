@@ -0,0 +1,403 @@
+#include <Arduino.h>
+
+#include <cerrno>
+#include <cstdarg>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "sim.hpp"
+
+namespace sim
+{
+Options options;
+
+/* -------------------------------------------------------------------------- */
+/*                                    CLOCK                                   */
+/* -------------------------------------------------------------------------- */
+static uint64_t realStart = 0;  // real µs at startClock()
+static uint64_t ticked    = 0;  // µs the tick clock has advanced
+static uint64_t skipped   = 0;  // µs jumped by delay()
+
+static uint64_t realNow()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000u + ts.tv_nsec / 1000;
+}
+
+void startClock()
+{
+    realStart = realNow();
+    ticked    = 0;
+    skipped   = 0;
+}
+
+uint64_t now()
+{
+    if (options.tickUs > 0)
+    {
+        return ticked + skipped;
+    }
+    return static_cast<uint64_t>((realNow() - realStart) * options.speed) + skipped;
+}
+
+void advance(uint64_t us) { skipped += us; }
+
+void pace()
+{
+    if (options.tickUs == 0)
+    {
+        return;
+    }
+    ticked += options.tickUs;
+    if (options.speed <= 0.0)
+    {
+        return;
+    }
+    // Only sleep once the run is a millisecond ahead, sleeping every loop costs more than a tick
+    const uint64_t due = realStart + static_cast<uint64_t>(ticked / options.speed);
+    const uint64_t at  = realNow();
+    if (due > at + 1000)
+    {
+        usleep(static_cast<useconds_t>(due - at));
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    PINS                                    */
+/* -------------------------------------------------------------------------- */
+struct Pin
+{
+    uint8_t mode;
+    uint8_t level;
+    int analog;
+    void (*isr)(void);
+    int edge;
+};
+static Pin pins[NUM_DIGITAL_PINS];
+static bool interruptsEnabled = true;
+
+uint8_t pinLevel(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? pins[pin].level : LOW; }
+
+void driveInput(uint8_t pin, uint8_t level)
+{
+    if (pin >= NUM_DIGITAL_PINS || pins[pin].level == level)
+    {
+        return;
+    }
+    pins[pin].level = level;
+    const int edge  = level == HIGH ? RISING : FALLING;
+    if (pins[pin].isr != nullptr && interruptsEnabled &&
+        (pins[pin].edge == CHANGE || pins[pin].edge == edge))
+    {
+        pins[pin].isr();
+    }
+}
+
+void driveAnalog(uint8_t pin, int value)
+{
+    if (pin < NUM_DIGITAL_PINS)
+    {
+        pins[pin].analog = value;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   SERIAL                                   */
+/* -------------------------------------------------------------------------- */
+static int master   = -1;
+static int terminal = -1;  // kept open so the master never sees a hang up between clients
+static char terminalPath[128];
+static const char* linkPath = nullptr;
+static std::vector<uint8_t> injected;  // received ahead of the pseudo-terminal
+static size_t injectedRead = 0;
+static void (*serialTap)(const uint8_t* data, size_t size) = nullptr;
+
+const char* openSerial(const char* link)
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        return nullptr;
+    }
+    snprintf(terminalPath, sizeof(terminalPath), "%s", ptsname(master));
+    terminal = open(terminalPath, O_RDWR | O_NOCTTY);
+
+    termios raw;
+    tcgetattr(terminal, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(terminal, TCSANOW, &raw);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if (link != nullptr)
+    {
+        unlink(link);
+        if (symlink(terminalPath, link) == 0)
+        {
+            linkPath = link;
+        }
+    }
+    return terminalPath;
+}
+
+void closeSerial()
+{
+    if (linkPath != nullptr)
+    {
+        unlink(linkPath);
+    }
+    close(terminal);
+    close(master);
+}
+
+void injectSerial(const uint8_t* data, size_t size)
+{
+    injected.insert(injected.end(), data, data + size);
+}
+
+size_t injectedSerial() { return injected.size() - injectedRead; }
+
+void tapSerial(void (*tap)(const uint8_t* data, size_t size)) { serialTap = tap; }
+}  // namespace sim
+
+/* -------------------------------------------------------------------------- */
+/*                                 ARDUINO API                                */
+/* -------------------------------------------------------------------------- */
+HardwareSerial Serial;
+
+unsigned long millis() { return static_cast<unsigned long>(sim::now() / 1000); }
+unsigned long micros() { return static_cast<uint32_t>(sim::now()); }
+void delay(unsigned long ms) { sim::advance(static_cast<uint64_t>(ms) * 1000); }
+void delayMicroseconds(unsigned int us) { sim::advance(us); }
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < NUM_DIGITAL_PINS)
+    {
+        sim::pins[pin].mode = mode;
+        if (mode == INPUT_PULLUP)
+        {
+            sim::pins[pin].level = HIGH;
+        }
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    if (pin >= NUM_DIGITAL_PINS)
+    {
+        return;
+    }
+    level = level ? HIGH : LOW;
+    if (sim::pins[pin].level != level)
+    {
+        sim::pins[pin].level = level;
+        sim::plant::pinWritten(pin, level);
+    }
+}
+
+// Unused pins (255) read LOW like an unconnected input on the ESP32
+int digitalRead(uint8_t pin) { return sim::pinLevel(pin); }
+
+int analogRead(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? sim::pins[pin].analog : 0; }
+
+void analogWrite(uint8_t pin, int value)
+{
+    if (pin < NUM_DIGITAL_PINS)
+    {
+        sim::pins[pin].analog = value;
+    }
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+    if (pin < NUM_DIGITAL_PINS)
+    {
+        sim::pins[pin].isr  = isr;
+        sim::pins[pin].edge = mode;
+    }
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin < NUM_DIGITAL_PINS)
+    {
+        sim::pins[pin].isr = nullptr;
+    }
+}
+
+void noInterrupts() { sim::interruptsEnabled = false; }
+void interrupts() { sim::interruptsEnabled = true; }
+
+/* -------------------------------------------------------------------------- */
+/*                                PRINT, STREAM                               */
+/* -------------------------------------------------------------------------- */
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (n < size && write(buffer[n]))
+    {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write(text, std::min(static_cast<size_t>(length), sizeof(text) - 1));
+}
+
+size_t Print::print(long long value, int base)
+{
+    if (value < 0 && base == DEC)
+    {
+        return print('-') + print(static_cast<unsigned long long>(-value), base);
+    }
+    return print(static_cast<unsigned long long>(value), base);
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+    char digits[65];
+    char* cursor = &digits[sizeof(digits) - 1];
+    *cursor      = '\0';
+    base         = base < 2 ? DEC : base;
+    do
+    {
+        const int digit = value % base;
+        *--cursor       = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value > 0);
+    return write(cursor);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+}
+
+size_t Stream::readBytes(char* buffer, size_t length)
+{
+    size_t n                = 0;
+    const unsigned long end = millis() + timeout_;
+    while (n < length)
+    {
+        const int c = read();
+        if (c >= 0)
+        {
+            buffer[n++] = static_cast<char>(c);
+        }
+        else if (millis() >= end)
+        {
+            break;
+        }
+        else
+        {
+            sim::pace();  // let the clock run while waiting, the tick clock would stand still
+        }
+    }
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                         SERIAL ON THE PSEUDO-TERMINAL                      */
+/* -------------------------------------------------------------------------- */
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin)
+{
+    setRxBufferSize(rxSize_);
+}
+
+size_t HardwareSerial::setRxBufferSize(size_t size)
+{
+    delete[] rx_;
+    rx_      = new uint8_t[size];
+    rxSize_  = size;
+    rxHead_  = 0;
+    rxCount_ = 0;
+    return size;
+}
+
+// Takes what the host sent, as much as the receive buffer has room for, injected bytes first. The
+// rest waits in the pseudo-terminal, where it holds up the host's writes like a full USB endpoint
+// does.
+void HardwareSerial::fill()
+{
+    if (rx_ == nullptr)
+    {
+        setRxBufferSize(rxSize_);
+    }
+    while (rxCount_ < rxSize_ && sim::injectedRead < sim::injected.size())
+    {
+        rx_[(rxHead_ + rxCount_) % rxSize_] = sim::injected[sim::injectedRead++];
+        rxCount_++;
+    }
+    if (sim::injectedRead == sim::injected.size())
+    {
+        sim::injected.clear();
+        sim::injectedRead = 0;
+    }
+    while (rxCount_ < rxSize_)
+    {
+        const size_t tail = (rxHead_ + rxCount_) % rxSize_;
+        const size_t room = std::min(rxSize_ - rxCount_, rxSize_ - tail);
+        const ssize_t n   = ::read(sim::master, &rx_[tail], room);
+        if (n <= 0)
+        {
+            return;
+        }
+        rxCount_ += n;
+    }
+}
+
+int HardwareSerial::available()
+{
+    fill();
+    return static_cast<int>(rxCount_);
+}
+
+int HardwareSerial::read()
+{
+    if (available() == 0)
+    {
+        return -1;
+    }
+    const uint8_t c = rx_[rxHead_];
+    rxHead_         = (rxHead_ + 1) % rxSize_;
+    rxCount_--;
+    return c;
+}
+
+int HardwareSerial::peek() { return available() == 0 ? -1 : rx_[rxHead_]; }
+
+// Nothing is waited for, with no host reading the output is dropped once the terminal is full
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    if (sim::serialTap != nullptr)
+    {
+        sim::serialTap(buffer, size);
+    }
+    const ssize_t n = ::write(sim::master, buffer, size);
+    return n < 0 ? 0 : static_cast<size_t>(n);
+}
+
+int HardwareSerial::availableForWrite()
+{
+    pollfd fd = {sim::master, POLLOUT, 0};
+    return poll(&fd, 1, 0) == 1 && (fd.revents & POLLOUT) ? 1024 : 0;
+}
@@ -0,0 +1,371 @@
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <SPI.h>
+#include <Wire.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sim.hpp"
+
+SPIClass SPI;
+TwoWire Wire;
+LittleFSFS LittleFS;
+
+/** @brief mkdir -p */
+static bool makeDirectories(const char* path)
+{
+    char partial[256];
+    snprintf(partial, sizeof(partial), "%s", path);
+    for (char* slash = strchr(partial + 1, '/'); slash != nullptr; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(partial, 0755);
+        *slash = '/';
+    }
+    return mkdir(partial, 0755) == 0 || errno == EEXIST;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 AS5048A, SPI                               */
+/* -------------------------------------------------------------------------- */
+static constexpr uint16_t AS5048A_READ      = 0x4000;
+static constexpr uint16_t AS5048A_ADDRESS   = 0x3FFF;
+static constexpr uint16_t AS5048A_DIAG_AGC  = 0x3FFD;
+static constexpr uint16_t AS5048A_MAGNITUDE = 0x3FFE;
+static constexpr uint16_t AS5048A_ANGLE     = 0x3FFF;
+static constexpr uint16_t AS5048A_DIAG_OCF  = 0x0400;  // offset compensation finished
+static constexpr float AS5048A_COUNTS       = 16384.0f;
+
+/** @brief Sets bit 15 so the frame has even parity */
+static uint16_t withParity(uint16_t value)
+{
+    value &= 0x7FFF;
+    uint16_t ones = 0;
+    for (uint16_t bits = value; bits != 0; bits &= bits - 1)
+    {
+        ones++;
+    }
+    return value | static_cast<uint16_t>((ones & 1) << 15);
+}
+
+uint16_t SPIClass::transfer16(uint16_t data)
+{
+    const uint16_t response = response_;
+    uint16_t value          = 0;
+    if (data & AS5048A_READ)
+    {
+        switch (data & AS5048A_ADDRESS)
+        {
+            case AS5048A_ANGLE:
+            {
+                sim::plant::update();
+                const float turns = sim::plant::encoderAngle() / static_cast<float>(TWO_PI);
+                const long counts = lroundf((turns - floorf(turns)) * AS5048A_COUNTS);
+                value             = static_cast<uint16_t>(counts) & 0x3FFF;
+            }
+            break;
+            case AS5048A_MAGNITUDE:
+                value = 0x1000;
+                break;
+            case AS5048A_DIAG_AGC:
+                value = AS5048A_DIAG_OCF | 0x80;  // AGC mid scale
+                break;
+            default:
+                break;
+        }
+    }
+    response_ = withParity(value);
+    return response;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 PCF8575, I2C                               */
+/* -------------------------------------------------------------------------- */
+void TwoWire::beginTransmission(uint8_t address)
+{
+    address_ = address;
+    txCount_ = 0;
+}
+
+size_t TwoWire::write(uint8_t c)
+{
+    if (txCount_ >= sizeof(tx_))
+    {
+        return 0;
+    }
+    tx_[txCount_++] = c;
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+    if (address_ != PCF8575_ADDRESS)
+    {
+        return 2;  // address NACK
+    }
+    if (txCount_ == 2)
+    {
+        sim::plant::pcfWrite(tx_[0] | tx_[1] << 8);
+    }
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity)
+{
+    rxIndex_ = 0;
+    rxCount_ = 0;
+    if (address != PCF8575_ADDRESS)
+    {
+        return 0;
+    }
+    const uint16_t value = sim::plant::pcfRead();
+    rx_[0]               = value & 0xFF;
+    rx_[1]               = value >> 8;
+    rxCount_             = std::min<uint8_t>(quantity, 2);
+    return rxCount_;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  LITTLEFS                                  */
+/* -------------------------------------------------------------------------- */
+struct File::Handle
+{
+    FILE* file     = nullptr;
+    DIR* directory = nullptr;
+    char path[256] = {};
+
+    ~Handle()
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+        }
+        if (directory != nullptr)
+        {
+            closedir(directory);
+        }
+    }
+};
+
+File::operator bool() const
+{
+    return handle_ && (handle_->file != nullptr || handle_->directory != nullptr);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size)
+{
+    return *this && handle_->file ? fwrite(buffer, 1, size, handle_->file) : 0;
+}
+
+size_t File::read(uint8_t* buffer, size_t size)
+{
+    return *this && handle_->file ? fread(buffer, 1, size, handle_->file) : 0;
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::size() const
+{
+    struct stat info;
+    return *this && stat(handle_->path, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+}
+
+void File::close()
+{
+    if (handle_ && handle_->file != nullptr)
+    {
+        fflush(handle_->file);
+    }
+    handle_.reset();
+}
+
+const char* File::name() const
+{
+    if (!handle_)
+    {
+        return "";
+    }
+    const char* slash = strrchr(handle_->path, '/');
+    return slash == nullptr ? handle_->path : slash + 1;
+}
+
+bool File::isDirectory() const { return handle_ && handle_->directory != nullptr; }
+
+File File::openNextFile(const char* mode)
+{
+    if (!isDirectory())
+    {
+        return File();
+    }
+    for (dirent* entry = readdir(handle_->directory); entry != nullptr;
+         entry         = readdir(handle_->directory))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        std::shared_ptr<Handle> next(new Handle());
+        const int length =
+            snprintf(next->path, sizeof(next->path), "%s/%s", handle_->path, entry->d_name);
+        if (length >= static_cast<int>(sizeof(next->path)))
+        {
+            continue;
+        }
+        if (entry->d_type == DT_DIR)
+        {
+            next->directory = opendir(next->path);
+        }
+        else
+        {
+            next->file = fopen(next->path, "rb");
+        }
+        return File(next);
+    }
+    return File();
+}
+
+namespace fs
+{
+bool FS::mount(const char* directory)
+{
+    const int length = snprintf(root_, sizeof(root_), "%s", directory);
+    return length < static_cast<int>(sizeof(root_)) && makeDirectories(root_);
+}
+
+/** @brief Host path of `path`, false if it doesn't fit */
+bool FS::resolve(const char* path, char* out, size_t size) const
+{
+    const int length = snprintf(out, size, "%s%s%s", root_, path[0] == '/' ? "" : "/", path);
+    return length < static_cast<int>(size);
+}
+
+bool FS::exists(const char* path)
+{
+    char full[256];
+    struct stat info;
+    return resolve(path, full, sizeof(full)) && stat(full, &info) == 0;
+}
+
+bool FS::mkdir(const char* path)
+{
+    char full[256];
+    return resolve(path, full, sizeof(full)) && ::mkdir(full, 0755) == 0;
+}
+
+bool FS::remove(const char* path)
+{
+    char full[256];
+    return resolve(path, full, sizeof(full)) && ::remove(full) == 0;
+}
+
+bool FS::rename(const char* from, const char* to)
+{
+    char fullFrom[256];
+    char fullTo[256];
+    return resolve(from, fullFrom, sizeof(fullFrom)) && resolve(to, fullTo, sizeof(fullTo)) &&
+           ::rename(fullFrom, fullTo) == 0;
+}
+
+File FS::open(const char* path, const char* mode, bool create)
+{
+    std::shared_ptr<File::Handle> handle(new File::Handle());
+    if (!resolve(path, handle->path, sizeof(handle->path)))
+    {
+        return File();
+    }
+    struct stat info;
+    if (stat(handle->path, &info) == 0 && S_ISDIR(info.st_mode))
+    {
+        handle->directory = opendir(handle->path);
+    }
+    else
+    {
+        const char* hostMode = strcmp(mode, FILE_WRITE) == 0    ? "wb"
+                               : strcmp(mode, FILE_APPEND) == 0 ? "ab"
+                                                                : "rb";
+        handle->file = fopen(handle->path, hostMode);
+    }
+    return File(handle);
+}
+}  // namespace fs
+
+bool LittleFSFS::begin(
+    bool formatOnFail,
+    const char* basePath,
+    uint8_t maxOpenFiles,
+    const char* partition)
+{
+    char directory[256];
+    const int length = snprintf(directory, sizeof(directory), "%s/littlefs", sim::options.storage);
+    return length < static_cast<int>(sizeof(directory)) && mount(directory);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 PREFERENCES                                */
+/* -------------------------------------------------------------------------- */
+bool Preferences::begin(const char* name, bool readOnly, const char* partition)
+{
+    const int length =
+        snprintf(directory_, sizeof(directory_), "%s/nvs/%s", sim::options.storage, name);
+    readOnly_ = readOnly;
+    open_     = length < static_cast<int>(sizeof(directory_)) && makeDirectories(directory_);
+    return open_;
+}
+
+bool Preferences::path(const char* key, char* out, size_t size) const
+{
+    if (!open_)
+    {
+        return false;
+    }
+    return snprintf(out, size, "%s/%s", directory_, key) < static_cast<int>(size);
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+    char file[320];
+    struct stat info;
+    return path(key, file, sizeof(file)) && stat(file, &info) == 0
+               ? static_cast<size_t>(info.st_size)
+               : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t length)
+{
+    char file[320];
+    FILE* stored = path(key, file, sizeof(file)) ? fopen(file, "rb") : nullptr;
+    if (stored == nullptr)
+    {
+        return 0;
+    }
+    const size_t read = fread(buffer, 1, length, stored);
+    fclose(stored);
+    return read;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length)
+{
+    char file[320];
+    FILE* stored = !readOnly_ && path(key, file, sizeof(file)) ? fopen(file, "wb") : nullptr;
+    if (stored == nullptr)
+    {
+        return 0;
+    }
+    const size_t written = fwrite(value, 1, length, stored);
+    fclose(stored);
+    return written;
+}
+
+bool Preferences::remove(const char* key)
+{
+    char file[320];
+    return !readOnly_ && path(key, file, sizeof(file)) && ::remove(file) == 0;
+}
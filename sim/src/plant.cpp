@@ -0,0 +1,115 @@
+#include <Arduino.h>
+
+#include "cleaner_system_constants.hpp"
+#include "sim.hpp"
+
+namespace sim
+{
+namespace plant
+{
+enum Axis : uint8_t
+{
+    JAW_ROTATION = 0,
+    JAW_POSITION,
+    CLAMP,
+    AXES
+};
+
+struct Motor
+{
+    uint8_t stepPin;
+    uint8_t dirPin;
+    long steps;
+};
+
+static Motor motors[AXES] = {
+    {JAW_ROTATION_STEP_PIN, JAW_ROTATION_DIR_PIN, 0},
+    {JAW_POSITION_STEP_PIN, JAW_POSITION_DIR_PIN, 0},
+    {CLAMP_STEP_PIN, CLAMP_DIR_PIN, 0},
+};
+
+// Jaw behind the torsional mode, radians and radians/s
+static float jawAngle         = 0.0f;
+static float jawVelocity      = 0.0f;
+static uint64_t lastUpdate    = 0;
+static constexpr float MAX_DT = 20e-6f;  // integration step, well under a period up to 1 kHz
+
+// Buttons and encoder contacts are pulled up, released. The roll brake switch is off
+static uint16_t pcfInputs  = 0xFFFF & ~(1u << ROLL_BRAKE_BUT_PIN);
+static uint16_t pcfOutputs = 0xFFFF;
+
+static float motorAngle() { return motors[JAW_ROTATION].steps * JawRotationPhysical.stepDistance; }
+
+void begin()
+{
+    // The switch reads LOW in AUTO
+    if (options.manual)
+    {
+        pcfInputs |= 1u << MODE_PIN;
+    }
+    else
+    {
+        pcfInputs &= ~(1u << MODE_PIN);
+    }
+    jawAngle    = motorAngle();
+    jawVelocity = 0.0f;
+    lastUpdate  = now();
+}
+
+// AccelStepper sets DIR before it raises STEP, HIGH is a step forward
+void pinWritten(uint8_t pin, uint8_t level)
+{
+    if (level != HIGH)
+    {
+        return;
+    }
+    for (Motor& motor : motors)
+    {
+        if (pin == motor.stepPin)
+        {
+            motor.steps += pinLevel(motor.dirPin) == HIGH ? 1 : -1;
+        }
+    }
+}
+
+void update()
+{
+    const uint64_t at = now();
+    float dt          = (at - lastUpdate) * 1e-6f;
+    lastUpdate        = at;
+    if (options.resonanceHz <= 0.0f)
+    {
+        jawAngle = motorAngle();
+        return;
+    }
+
+    // Jaw on a torsional spring to the motor: a'' = w^2 (motor - a) - 2 z w a'
+    const float w      = static_cast<float>(TWO_PI) * options.resonanceHz;
+    const float target = motorAngle();
+    while (dt > 0.0f)
+    {
+        const float h = std::min(dt, MAX_DT);
+        jawVelocity += (w * w * (target - jawAngle) - 2.0f * options.damping * w * jawVelocity) * h;
+        jawAngle += jawVelocity * h;
+        dt -= h;
+    }
+}
+
+long steps(uint8_t axis) { return axis < AXES ? motors[axis].steps : 0; }
+
+float encoderAngle() { return jawAngle; }
+
+// Quasi-bidirectional: a pin written LOW reads LOW, one written HIGH reads what drives it
+uint16_t pcfRead() { return pcfOutputs & pcfInputs; }
+
+void pcfWrite(uint16_t value) { pcfOutputs = value; }
+
+void toggleMode()
+{
+    pcfInputs ^= 1u << MODE_PIN;
+    // The PCF8575 pulls its open drain INT low on any input change
+    driveInput(IO_EXTENDER_INT, LOW);
+    driveInput(IO_EXTENDER_INT, HIGH);
+}
+}  // namespace plant
+}  // namespace sim
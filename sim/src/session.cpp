@@ -0,0 +1,329 @@
+#include <Arduino.h>
+
+#include <vector>
+
+#include "cleaner_system.hpp"
+#include "cleaner_system_constants.hpp"
+#include "sim.hpp"
+
+extern Cleaner cleaner_system;  // src/main.cpp
+
+namespace sim
+{
+namespace session
+{
+enum class Trigger : uint8_t
+{
+    AT,     ///< at `us`
+    AFTER,  ///< `us` after the previous line was sent
+    ACK,    ///< once the previous line was answered with "At Pos"
+    IDLE    ///< once the motion of the previous line stopped
+};
+
+struct Line
+{
+    Trigger trigger;
+    uint64_t us;
+    char text[128];
+    int number;  ///< in the script, for messages
+};
+
+static constexpr uint8_t FRAME_START = 0xA5;
+static constexpr uint8_t COMMAND     = 1;  // SerialReceiverTransmitter::MessageType
+static constexpr uint8_t STOP        = 2;
+
+static std::vector<Line> lines;
+static size_t next = 0;
+static bool ended  = false;
+static FILE* trace = nullptr;
+
+// Since the previous line was sent
+static uint64_t sentAt = 0;
+static uint32_t acks   = 0;
+static bool stopped    = false;
+static bool reading    = false;  // the firmware hasn't taken the whole frame yet
+
+static bool wasIdle        = true;
+static uint64_t nextSample = 0;
+static long lastSteps[3]   = {};
+static int lastBrake       = -1;
+
+static char received[256];  // the line the device is printing
+static size_t receivedLength = 0;
+
+/** @brief The firmware hasn't read all of the last frame yet */
+static bool unread() { return injectedSerial() > 0 || Serial.available() > 0; }
+
+static void event(const char* kind, const char* text)
+{
+    if (trace != nullptr)
+    {
+        fprintf(trace, "E %llu %s%s%s\n", static_cast<unsigned long long>(now()), kind,
+                text[0] != '\0' ? " " : "", text);
+    }
+}
+
+static void sample(uint64_t at, bool always)
+{
+    long steps[3];
+    bool changed = always;
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        steps[axis]     = plant::steps(axis);
+        changed         = changed || steps[axis] != lastSteps[axis];
+        lastSteps[axis] = steps[axis];
+    }
+    const int brake = pinLevel(ROLL_BRAKE_REAL_PIN);
+    changed         = changed || brake != lastBrake;
+    lastBrake       = brake;
+    if (!changed || trace == nullptr)
+    {
+        return;
+    }
+
+    const float jawRotation = steps[0] * JawRotationPhysical.stepDistance;
+    const float jawPos      = steps[1] * JawPositionPhysical.stepDistance;
+    const float clampPos    = steps[2] * clampPhysical.stepDistance - jawRotation;
+    fprintf(trace, "S %llu %ld %ld %ld %.5f %.5f %.5f %d\n", static_cast<unsigned long long>(at),
+            steps[0], steps[1], steps[2], jawRotation, jawPos, clampPos, brake);
+}
+
+// Everything the firmware prints, cut into lines at \r or \n
+static void tap(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        const char c = static_cast<char>(data[i]);
+        if (c != '\r' && c != '\n')
+        {
+            if (receivedLength < sizeof(received) - 1)
+            {
+                received[receivedLength++] = isprint(static_cast<unsigned char>(c)) ? c : '.';
+            }
+            continue;
+        }
+        if (receivedLength == 0)
+        {
+            continue;
+        }
+        received[receivedLength] = '\0';
+        receivedLength           = 0;
+        event("rx", received);
+        // Until the frame is read the firmware is still answering the line before
+        if (strcmp(received, "At Pos") == 0 && !unread())
+        {
+            acks++;
+        }
+    }
+}
+
+// Frames as serverside/transmitter.py builds them, a COMMAND is padded to 4 bytes per character
+static void send(const Line& line)
+{
+    const bool stop       = strcmp(line.text, "STOP") == 0;
+    const size_t text     = stop ? 0 : strlen(line.text);
+    const uint32_t length = stop ? 4 : static_cast<uint32_t>(text * 4);
+
+    std::vector<uint8_t> frame(6 + length, 0);
+    frame[0] = FRAME_START;
+    frame[1] = stop ? STOP : COMMAND;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        frame[2 + i] = static_cast<uint8_t>(length >> (8 * i));
+    }
+    memcpy(&frame[6], line.text, text);
+    injectSerial(frame.data(), frame.size());
+
+    event("tx", line.text);
+    sentAt  = now();
+    acks    = 0;
+    stopped = false;
+    reading = true;
+}
+
+static bool due(const Line& line, uint64_t at)
+{
+    switch (line.trigger)
+    {
+        case Trigger::AT:
+            return at >= line.us;
+        case Trigger::AFTER:
+            return at >= sentAt + line.us;
+        case Trigger::ACK:
+            return acks > 0;
+        case Trigger::IDLE:
+            return stopped;
+    }
+    return false;
+}
+
+static char* trim(char* text)
+{
+    while (isspace(static_cast<unsigned char>(*text)))
+    {
+        text++;
+    }
+    char* end = text + strlen(text);
+    while (end > text && isspace(static_cast<unsigned char>(end[-1])))
+    {
+        *--end = '\0';
+    }
+    return text;
+}
+
+/** @brief One line of the script, false if it can't be read */
+static bool parseLine(char* text, Line& line)
+{
+    char* rest = text;
+    while (*rest != '\0' && !isspace(static_cast<unsigned char>(*rest)))
+    {
+        rest++;
+    }
+    if (*rest != '\0')
+    {
+        *rest++ = '\0';
+    }
+    rest = trim(rest);
+
+    char* end = nullptr;
+    if (text[0] == '@' || text[0] == '+')
+    {
+        line.trigger = text[0] == '@' ? Trigger::AT : Trigger::AFTER;
+        line.us      = static_cast<uint64_t>(strtod(text + 1, &end) * 1000.0);
+        if (end == text + 1 || *end != '\0')
+        {
+            return false;
+        }
+    }
+    else if (strcmp(text, "ack") == 0)
+    {
+        line.trigger = Trigger::ACK;
+    }
+    else if (strcmp(text, "idle") == 0)
+    {
+        line.trigger = Trigger::IDLE;
+    }
+    else
+    {
+        return false;
+    }
+    const int length = snprintf(line.text, sizeof(line.text), "%s", rest);
+    return length > 0 && length < static_cast<int>(sizeof(line.text));
+}
+
+int begin(const char* script, const char* tracePath)
+{
+    FILE* file = fopen(script, "r");
+    if (file == nullptr)
+    {
+        perror(script);
+        return EXIT_FAILURE;
+    }
+    char buffer[256];
+    int number = 0;
+    while (fgets(buffer, sizeof(buffer), file) != nullptr)
+    {
+        number++;
+        char* comment = strchr(buffer, '#');
+        if (comment != nullptr)
+        {
+            *comment = '\0';
+        }
+        char* text = trim(buffer);
+        if (text[0] == '\0')
+        {
+            continue;
+        }
+        Line line = {};
+        if (!parseLine(text, line))
+        {
+            fprintf(stderr, "%s:%d: expected @MS, +MS, ack or idle and a line to send\n", script,
+                    number);
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+        line.number = number;
+        lines.push_back(line);
+    }
+    fclose(file);
+
+    if (tracePath != nullptr)
+    {
+        trace = fopen(tracePath, "w");
+        if (trace == nullptr)
+        {
+            perror(tracePath);
+            return EXIT_FAILURE;
+        }
+        fprintf(trace, "# E t_us tx|read|rx|idle [text]\n");
+        fprintf(trace, "# S t_us jaw_rotation_steps jaw_pos_steps clamp_steps "
+                       "jaw_rotation jaw_pos clamp_pos is_Brake\n");
+    }
+    tapSerial(tap);
+    sample(now(), true);
+    return EXIT_SUCCESS;
+}
+
+bool update()
+{
+    const uint64_t at = now();
+
+    if (reading && !unread())
+    {
+        event("read", "");
+        reading = false;
+    }
+
+    const bool idle = cleaner_system.isMotionIdle();
+    if (idle && !wasIdle)
+    {
+        event("idle", "");
+        stopped = true;
+    }
+    wasIdle = idle;
+
+    if (at >= nextSample)
+    {
+        sample(at, false);
+        nextSample = at - at % options.traceUs + options.traceUs;
+    }
+
+    while (next < lines.size() && due(lines[next], at))
+    {
+        if (strcmp(lines[next].text, "END") == 0)
+        {
+            ended = true;
+            return false;
+        }
+        send(lines[next++]);
+    }
+
+    if (at > static_cast<uint64_t>(options.limitMs) * 1000)
+    {
+        if (next < lines.size())
+        {
+            fprintf(stderr, "%s:%d: still waiting after %u ms\n", options.session,
+                    lines[next].number, options.limitMs);
+        }
+        else
+        {
+            fprintf(stderr, "%s: no END after %u ms\n", options.session, options.limitMs);
+        }
+        return false;
+    }
+    return true;
+}
+
+int end()
+{
+    tapSerial(nullptr);
+    if (trace != nullptr)
+    {
+        sample(now(), true);
+        fclose(trace);
+        trace = nullptr;
+    }
+    return ended ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+}  // namespace session
+}  // namespace sim
@@ -0,0 +1,175 @@
+#include <Arduino.h>
+
+#include <csignal>
+#include <getopt.h>
+
+#include "sim.hpp"
+
+/**
+ * @brief Entry point of the host build, runs setup() and loop() of src/main.cpp until SIGINT.
+ *
+ *     .pio/build/native_sim/program --link COM9 --tick 5 --speed 0
+ *
+ * prints the pseudo-terminal the firmware's Serial is on, COM9 links to it so the host tools
+ * open it by their default port from the same directory. SIGUSR1 flips the AUTO/MANUAL switch.
+ *
+ *     program --tick 5 --speed 0 --session sim/golden/pass.session --trace pass.trace
+ *
+ * runs a scripted session instead, see sim::session, and exits once it reaches its END.
+ */
+
+static volatile sig_atomic_t running    = 1;
+static volatile sig_atomic_t modeToggle = 0;
+
+static void onStop(int) { running = 0; }
+static void onToggle(int) { modeToggle = 1; }
+
+static void usage(const char* program)
+{
+    fprintf(
+        stderr,
+        "usage: %s [options]\n"
+        "  --link PATH        symlink PATH to the pseudo-terminal, e.g. COM9\n"
+        "  --speed X          virtual seconds per real second (1), 0 unpaced with --tick\n"
+        "  --tick US          advance the clock US per loop() instead of following real time\n"
+        "  --storage DIR      host directory for LittleFS and Preferences (sim_storage)\n"
+        "  --manual           start with the mode switch on MANUAL\n"
+        "  --resonance HZ     jaw torsional mode seen by the encoder (rigid)\n"
+        "  --damping Z        damping ratio of the mode (0.05)\n"
+        "  --session FILE     run a scripted host session, exit at its END\n"
+        "  --trace FILE       write the session's step and State trace to FILE\n"
+        "  --trace-us US      trace sample period (1000)\n"
+        "  --limit MS         fail a session that hasn't ended after MS virtual ms (600000)\n",
+        program);
+}
+
+static int parse(int argc, char** argv)
+{
+    static const option longOptions[] = {
+        {"link", required_argument, nullptr, 'l'},
+        {"speed", required_argument, nullptr, 's'},
+        {"tick", required_argument, nullptr, 't'},
+        {"storage", required_argument, nullptr, 'd'},
+        {"manual", no_argument, nullptr, 'm'},
+        {"resonance", required_argument, nullptr, 'r'},
+        {"damping", required_argument, nullptr, 'z'},
+        {"session", required_argument, nullptr, 'S'},
+        {"trace", required_argument, nullptr, 'T'},
+        {"trace-us", required_argument, nullptr, 'p'},
+        {"limit", required_argument, nullptr, 'L'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'l':
+                sim::options.link = optarg;
+                break;
+            case 's':
+                sim::options.speed = atof(optarg);
+                break;
+            case 't':
+                sim::options.tickUs = static_cast<uint32_t>(atol(optarg));
+                break;
+            case 'd':
+                sim::options.storage = optarg;
+                break;
+            case 'm':
+                sim::options.manual = true;
+                break;
+            case 'r':
+                sim::options.resonanceHz = static_cast<float>(atof(optarg));
+                break;
+            case 'z':
+                sim::options.damping = static_cast<float>(atof(optarg));
+                break;
+            case 'S':
+                sim::options.session = optarg;
+                break;
+            case 'T':
+                sim::options.trace = optarg;
+                break;
+            case 'p':
+                sim::options.traceUs = static_cast<uint32_t>(atol(optarg));
+                break;
+            case 'L':
+                sim::options.limitMs = static_cast<uint32_t>(atol(optarg));
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (sim::options.tickUs == 0 && sim::options.speed <= 0.0)
+    {
+        fprintf(stderr, "--speed 0 needs --tick, the real clock can't run unpaced\n");
+        return EXIT_FAILURE;
+    }
+    if (sim::options.trace != nullptr && sim::options.session == nullptr)
+    {
+        fprintf(stderr, "--trace needs --session\n");
+        return EXIT_FAILURE;
+    }
+    if (sim::options.traceUs == 0)
+    {
+        fprintf(stderr, "--trace-us must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    if (parse(argc, argv) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    const char* terminal = sim::openSerial(sim::options.link);
+    if (terminal == nullptr)
+    {
+        perror("pseudo-terminal");
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Serial on %s", terminal);
+    if (sim::options.link != nullptr)
+    {
+        fprintf(stderr, ", linked as %s", sim::options.link);
+    }
+    fprintf(stderr, "\n");
+
+    signal(SIGINT, onStop);
+    signal(SIGTERM, onStop);
+    signal(SIGUSR1, onToggle);
+
+    sim::startClock();
+    sim::plant::begin();
+    setup();
+    if (sim::options.session != nullptr &&
+        sim::session::begin(sim::options.session, sim::options.trace) != EXIT_SUCCESS)
+    {
+        sim::closeSerial();
+        return EXIT_FAILURE;
+    }
+    while (running)
+    {
+        if (modeToggle)
+        {
+            modeToggle = 0;
+            sim::plant::toggleMode();
+        }
+        sim::plant::update();
+        loop();
+        if (sim::options.session != nullptr && !sim::session::update())
+        {
+            break;
+        }
+        sim::pace();
+    }
+
+    sim::closeSerial();
+    return sim::options.session != nullptr ? sim::session::end() : EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#include <WiFi.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+
+WiFiClass WiFi;
+
+static void setNonBlocking(int fd) { fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK); }
+
+WiFiClient& WiFiClient::operator=(WiFiClient&& other)
+{
+    if (this != &other)
+    {
+        stop();
+        fd_       = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (fd_ < 0)
+    {
+        return 0;
+    }
+    // A closed peer reads as end of file, unread bytes still count as connected like on the board
+    uint8_t byte;
+    const ssize_t n = recv(fd_, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 1 : 0;
+}
+
+void WiFiClient::stop()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+int WiFiClient::setNoDelay(bool noDelay)
+{
+    const int flag = noDelay ? 1 : 0;
+    return fd_ >= 0 ? setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) : -1;
+}
+
+int WiFiClient::available()
+{
+    int count = 0;
+    return fd_ >= 0 && ioctl(fd_, FIONREAD, &count) == 0 ? count : 0;
+}
+
+int WiFiClient::read()
+{
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size)
+{
+    if (fd_ < 0)
+    {
+        return -1;
+    }
+    const ssize_t n = recv(fd_, buffer, size, MSG_DONTWAIT);
+    return n > 0 ? static_cast<int>(n) : -1;
+}
+
+size_t WiFiClient::write(const uint8_t* data, size_t size)
+{
+    if (fd_ < 0)
+    {
+        return 0;
+    }
+    const ssize_t n = send(fd_, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+WiFiServer::~WiFiServer()
+{
+    if (pending_ >= 0)
+    {
+        close(pending_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+void WiFiServer::begin()
+{
+    fd_            = socket(AF_INET, SOCK_STREAM, 0);
+    const int flag = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+    sockaddr_in address     = {};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(port_);
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(fd_, 1) != 0)
+    {
+        perror("WiFiServer");
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    setNonBlocking(fd_);
+    fprintf(stderr, "listening on tcp port %u\n", port_);
+}
+
+bool WiFiServer::hasClient()
+{
+    if (pending_ < 0 && fd_ >= 0)
+    {
+        pending_ = accept(fd_, nullptr, nullptr);
+        if (pending_ >= 0)
+        {
+            setNonBlocking(pending_);
+        }
+    }
+    return pending_ >= 0;
+}
+
+WiFiClient WiFiServer::available()
+{
+    hasClient();
+    WiFiClient client(pending_);
+    pending_ = -1;
+    if (noDelay_)
+    {
+        client.setNoDelay(true);
+    }
+    return client;
+}
@@ -234,7 +234,7 @@ uint8_t AS5048A::getGain()
 /**
  * Get diagnostic
  */
-String AS5048A::getDiagnostic()
+const char* AS5048A::getDiagnostic()
 {
     uint16_t data = AS5048A::getState();
     if (data & AS5048A_DIAG_COMP_HIGH)
@@ -260,7 +260,7 @@ String AS5048A::getDiagnostic()
 /*
  * Get and clear the error register by reading it
  */
-String AS5048A::getErrors()
+const char* AS5048A::getErrors()
 {
     uint16_t error = AS5048A::read(AS5048A_CLEAR_ERROR_FLAG);
     if (error & AS5048A_ERROR_PARITY_FLAG)
@@ -0,0 +1,124 @@
+#include "byte_transport.hpp"
+
+#include <esp_timer.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                   USB CDC                                  */
+/* -------------------------------------------------------------------------- */
+int UsbCdcTransport::begin(uint32_t baudrate, size_t rxBufferSize)
+{
+    Serial.setRxBufferSize(rxBufferSize);
+    Serial.begin(baudrate);
+    return EXIT_SUCCESS;
+}
+
+size_t UsbCdcTransport::read(uint8_t* buffer, size_t size)
+{
+    const int ready = Serial.available();
+    return Serial.readBytes(buffer, std::min(size, static_cast<size_t>(ready > 0 ? ready : 0)));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 UART, RS-485                               */
+/* -------------------------------------------------------------------------- */
+#ifdef TRANSPORT_UART
+int UartTransport::begin(uint32_t baudrate, size_t rxBufferSize)
+{
+    // The driver's buffers are allocated by begin(), their sizes have to be set before
+    uart_.setRxBufferSize(rxBufferSize);
+    uart_.begin(baudrate, SERIAL_8N1, rxPin_, txPin_);
+    if (!uart_)
+    {
+        return EXIT_FAILURE;
+    }
+    uart_.setRxTimeout(RX_TIMEOUT_SYMBOLS);
+    if (dePin_ >= 0)
+    {
+        // RTS is the driver enable in RS-485 half duplex mode
+        if (!uart_.setPins(rxPin_, txPin_, -1, dePin_) ||
+            !uart_.setMode(UART_MODE_RS485_HALF_DUPLEX))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+void UartTransport::receive(frames::Assembler& assembler, int64_t)
+{
+    if (assembler_ != nullptr)
+    {
+        return;
+    }
+    // From the first parse() on the event task is the only producer, what arrived before the
+    // callback was set is taken at the next idle line
+    assembler_ = &assembler;
+    uart_.onReceive([this]() { frames::drain(*this, *assembler_, esp_timer_get_time()); }, true);
+}
+
+size_t UartTransport::read(uint8_t* buffer, size_t size)
+{
+    const int ready = uart_.available();
+    return uart_.read(buffer, std::min(size, static_cast<size_t>(ready > 0 ? ready : 0)));
+}
+
+size_t UartTransport::write(const uint8_t* data, size_t size)
+{
+    const int room = uart_.availableForWrite();
+    return uart_.write(data, std::min(size, static_cast<size_t>(room > 0 ? room : 0)));
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                 TCP, WI-FI                                 */
+/* -------------------------------------------------------------------------- */
+#ifdef TRANSPORT_TCP
+int TcpTransport::begin(uint32_t baudrate, size_t rxBufferSize)
+{
+    // Joining the network takes seconds, the core keeps at it and reconnects in the background
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(false);  // modem sleep adds up to a beacon interval to every answer
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(ssid_, password_);
+    server_.begin();
+    server_.setNoDelay(true);
+    return EXIT_SUCCESS;
+}
+
+bool TcpTransport::poll()
+{
+    if (!server_.hasClient())
+    {
+        return false;
+    }
+    if (client_)
+    {
+        client_.stop();
+    }
+    client_ = server_.available();
+    client_.setNoDelay(true);
+    return true;
+}
+
+size_t TcpTransport::read(uint8_t* buffer, size_t size)
+{
+    const int ready = available();
+    if (ready <= 0)
+    {
+        return 0;
+    }
+    const int n = client_.read(buffer, std::min(size, static_cast<size_t>(ready)));
+    return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+int TcpTransport::availableForWrite() { return client_.connected() ? WRITE_CHUNK : 0; }
+
+size_t TcpTransport::write(const uint8_t* data, size_t size)
+{
+    if (!client_.connected())
+    {
+        return 0;
+    }
+    return client_.write(data, std::min(size, static_cast<size_t>(WRITE_CHUNK)));
+}
+#endif
@@ -1,12 +1,14 @@
 #include "cleaner_system.hpp"
 
+#include <algorithm>
 #include <cmath>
 
-#include "BindArg.h"
 #include "RotaryEncoder.h"
 #include "TMCStepper.h"
 #include "butterworth.hpp"
 #include "cleaner_system_constants.hpp"
+#include "hot_path.hpp"
+#include "isr_trampoline.hpp"
 #include "macros.hpp"
 #include "pin_defs.hpp"
 #include "stepper_motor.hpp"
@@ -33,15 +35,25 @@ Cleaner::Cleaner(SerialReceiverTransmitter& receiver)
       encoder_jaw_rotation_(
           ENCODER_JAW_ROTATION_PIN1,
           ENCODER_JAW_ROTATION_PIN2,
-          [&](int pin) { return IOExtender_.readNoUpdate(pin); }),
+          &Cleaner::readIOExtender,
+          &IOExtender_),
       encoder_jaw_pos_(
           ENCODER_JAW_POSITION_PIN1,
           ENCODER_JAW_POSITION_PIN2,
-          [&](int pin) { return IOExtender_.readNoUpdate(pin); }),
+          &Cleaner::readIOExtender,
+          &IOExtender_),
       encoder_clamp_(
           ENCODER_CLAMP_PIN1,
           ENCODER_CLAMP_PIN2,
-          [&](int pin) { return IOExtender_.readNoUpdate(pin); }),
+          &Cleaner::readIOExtender,
+          &IOExtender_),
+#ifdef ADAPTIVE_ACCELERATION
+      accelAdapters_{AdaptiveAcceleration(JawRotationAdaptive),
+                     AdaptiveAcceleration(JawPositionAdaptive)},
+#endif
+#ifdef ADAPTIVE_NOTCH
+      jawNotch_(JawNotchCfg),
+#endif
       receiver(receiver)
 {
     // Add motors to the array
@@ -49,6 +61,13 @@ Cleaner::Cleaner(SerialReceiverTransmitter& receiver)
     motors[1] = &jaw_pos_motor_;
     motors[2] = &clamp_motor_;
 
+#ifdef FAST_STEP_OUTPUT
+    for (auto* motor : motors)
+    {
+        motor->useStepOutput(&stepOutput_);
+    }
+#endif
+
     jaw_rotation_motor_.apply(JawRotationMotion);
     jaw_pos_motor_.apply(JawPositionMotion);
     clamp_motor_.apply(ClampMotion);
@@ -61,6 +80,23 @@ Cleaner::Cleaner(SerialReceiverTransmitter& receiver)
     jaw_pos_motor_.apply(JawPositionPhysical);
     clamp_motor_.apply(clampPhysical);
 
+#ifdef STEP_VERIFICATION
+    for (auto& reconciler : stepReconcilers_)
+    {
+        reconciler = StepReconciler(StepVerificationCfg);
+    }
+#endif
+
+    shaperParams_[0] = JawRotationShaper;
+    shaperParams_[1] = JawPositionShaper;
+    shaperParams_[2] = ClampShaper;
+    applyShapers();
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+    {
+        telemetryChannels_[i] = TelemetryChannels[i];
+    }
+
     reset();
 }
 
@@ -81,128 +117,1460 @@ Cleaner::~Cleaner() = default;
  * @return int Returns EXIT_SUCCESS on successful initialization, or EXIT_FAILURE if any component
  * fails to initialize.
  */
-int Cleaner::begin()
+int Cleaner::begin()
+{
+    // Initialize the communication bus
+    Wire.begin();  // Initialize I2C bus
+    Wire.setClock(400000);
+
+    // Initialize the motors
+    for (auto* motor : motors)
+    {
+        if (motor->begin() != EXIT_SUCCESS)
+        {
+            char errorMessage[64];
+            snprintf(
+                errorMessage,
+                sizeof(errorMessage),
+                "Failed to initialize %s motor.\n",
+                motor->getName());
+            if (Serial.availableForWrite() > strlen(errorMessage))
+            {
+                Serial.print(errorMessage);
+            }
+            return EXIT_FAILURE;
+        }
+    }
+
+#ifdef STEP_VERIFICATION
+    // Route every STEP/DIR pair into its own pulse counter unit
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        StepperMotor::Pins pins = motors[i]->getPins();
+        if (stepCounters_[i].begin(i, pins.step, pins.dir, StepVerificationCfg.modulus) !=
+            EXIT_SUCCESS)
+        {
+            receiver.SafePrint("Failed to start step counter, step verification disabled.\n");
+        }
+        stepReconcilers_[i].resync(motors[i]->currentPosition(), stepCounters_[i].read(), micros());
+    }
+#endif
+
+    if (programStore_.begin() != EXIT_SUCCESS)
+    {
+        receiver.SafePrint("No program file system, stored programs disabled.\n");
+    }
+    if (config_.load() != EXIT_SUCCESS)
+    {
+        receiver.SafePrint("No stored calibration, lead screw compensation off.\n");
+    }
+    applyCompensation();
+
+    // Initialize the encoder
+    encoder_.begin();
+    jawAngle_ = encoder_.getRotationUnwrappedInRadians();
+#ifdef VIBRATION_MONITOR
+    if (vibration_.begin(VibrationCfg, VibrationThresholds) != EXIT_SUCCESS)
+    {
+        receiver.SafePrint("Failed to start the vibration monitor.\n");
+    }
+#endif
+
+    // Register the interrupt for the PCF8575
+    if (IO_EXTENDER_INT != 255)
+    {
+        pinMode(IO_EXTENDER_INT, INPUT_PULLUP);
+        detachInterrupt(IO_EXTENDER_INT);
+        attachInterrupt(IO_EXTENDER_INT, bindIsr<Cleaner, &Cleaner::PCFMessageRec>(this), CHANGE);
+    }
+    // Initialize the IO extender
+    IOExtender_.begin();
+
+    // Initialize the pins
+    pinMode(LIMIT_SWITCH_PIN_JAW_ROTATION, INPUT_PULLUP);
+    pinMode(ESTOP_PIN, INPUT_PULLUP);
+    pinMode(ROLL_BRAKE_REAL_PIN, OUTPUT);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Executes the ~300kHz control loop for the Cleaner system.
+ *
+ * This function performs the following actions:
+ * - Checks if the system is in an emergency stop (E-Stop) state and exits early if so.
+ * - Executes control logic at a fixed rate using the DO_EVERY macro.
+ * - Iterates through all motors, running each one.
+ * - For the clamp motor, synchronizes its speed with the jaw rotation motor and adjusts
+ *   the speed to account for any additional required movement based on error.
+ *
+ * The function ensures coordinated movement between the jaw rotation and clamp motors,
+ * and enforces speed limits for safe operation.
+ */
+void HOT_PATH Cleaner::run()
+{
+    // Do not run if we're E-Stopped
+    if (state_.is_Estopped)
+    {
+        return;
+    }
+
+    DO_EVERY(1.0f / RUN_RATE_HZ, runControl());
+#ifdef STEP_VERIFICATION
+    DO_EVERY(STEP_VERIFY_PERIOD_S, verifySteps());
+#endif
+#ifdef ADAPTIVE_NOTCH
+    DO_EVERY(NOTCH_REPORT_PERIOD_S, reportResonance());
+#endif
+#ifdef VIBRATION_MONITOR
+    DO_EVERY(VIBRATION_EVENT_POLL_S, reportVibrationEvents());
+#endif
+    DO_EVERY(CURRENT_UPDATE_PERIOD_S, updateCurrents());
+    DO_EVERY(DRIVER_HEALTH_PERIOD_S, checkDriverHealth());
+    if (identRunning_)
+    {
+        DO_EVERY(IDENT_STREAM_PERIOD_S, streamIdentification());
+    }
+    if (telemetryStreaming_)
+    {
+        DO_EVERY(TELEMETRY_STREAM_PERIOD_S, streamTelemetry());
+    }
+#ifdef FAST_STEP_OUTPUT
+    // Collect the steps of every motor and pulse them together
+    stepOutput_.beginBatch();
+#endif
+    // run all motors
+    for (const auto& motor : motors)
+    {
+        /* If we're moving the jaw rotation, sync the clamp motor to it
+         * and add any additional speed needed to move the clamp when it
+         * too has error
+         */
+        clamp_motor_.setSpeed(limit_val(
+            jaw_rotation_motor_.speed() * 2 +
+                desired_clamp_speed / clamp_motor_.getPhysicalParams().stepDistance,
+            -clamp_motor_.maxSpeed(),
+            clamp_motor_.maxSpeed()));
+
+        // A shaped jaw axis already got its speed for this tick from followUnits()
+        if (shaped_ && motor != &clamp_motor_)
+        {
+            motor->runSpeed();
+        }
+        else
+        {
+            motor->run();
+        }
+    }
+#ifdef FAST_STEP_OUTPUT
+    stepOutput_.endBatch();
+#endif
+}
+/**
+ * @brief Runs the 1kHz control loop
+ *
+ */
+void HOT_PATH Cleaner::runControl()
+{
+    if (shaperPending_ && isMotionIdle())
+    {
+        applyShapers();
+    }
+    if (compensationPending_ && isMotionIdle())
+    {
+        applyCompensation();
+    }
+
+    updateRealState();
+    updateJawEncoder();
+#ifdef ADAPTIVE_NOTCH
+    updateJawVelocity();
+#endif
+#ifdef VIBRATION_MONITOR
+    sampleVibration();
+#endif
+
+    State error = des_state_ - state_;
+
+    /* Shaped references, every axis is delayed by the same amount so multi axis moves stay in
+     * sync. When shaping, the jaw axes shape the trapezoid they move rather than the step to the
+     * target, so the stop is shaped as well as the start.
+     */
+    float jawRotationPlan = des_state_.jaw_rotation;
+    float jawPosPlan      = des_state_.jaw_pos;
+    if (shaped_)
+    {
+        jawRotationPlan = trajectories_[0].next(
+            des_state_.jaw_rotation,
+            std::fabs(jaw_rotation_motor_.maxSpeedUnits()),
+            std::fabs(jaw_rotation_motor_.accelerationUnits()),
+            1.0f / RUN_RATE_HZ);
+        jawPosPlan = trajectories_[1].next(
+            des_state_.jaw_pos,
+            std::fabs(jaw_pos_motor_.maxSpeedUnits()),
+            std::fabs(jaw_pos_motor_.accelerationUnits()),
+            1.0f / RUN_RATE_HZ);
+    }
+    const float jawRotationRef = shapers_[0].shape(jawRotationPlan);
+    const float jawPosRef      = shapers_[1].shape(jawPosPlan);
+    const float clampRef       = shapers_[2].shape(des_state_.clamp_pos);
+
+    /* The identification perturbation is a velocity, the jaw rotation is position commanded so
+     * it gets its integral.
+     */
+    const float perturbation = identPerturbation_.next();
+    identOffset_ += perturbation / RUN_RATE_HZ;
+
+    const float jawRotationCommand = jawRotationRef + identOffset_;
+    if (shaped_)
+    {
+        jaw_rotation_motor_.followUnits(jawRotationCommand, 1.0f / RUN_RATE_HZ);
+        jaw_pos_motor_.followUnits(jawPosCompensator_.apply(jawPosRef), 1.0f / RUN_RATE_HZ);
+    }
+    else
+    {
+        jaw_rotation_motor_.moveToUnits(jawRotationCommand);
+        jaw_pos_motor_.moveToUnits(jawPosCompensator_.apply(jawPosRef));
+    }
+
+    desired_clamp_speed = limit_val(
+        clampLowpassFilter.filterData(ClampPID.filterData(clampRef - state_.clamp_pos)),
+        -clamp_motor_.maxSpeedUnits() * CLAMP_SPEED_FRACTION,
+        clamp_motor_.maxSpeedUnits() * CLAMP_SPEED_FRACTION);
+
+    if (abs(desired_clamp_speed) < 0.0f)
+    {
+        desired_clamp_speed = 0;
+    }
+
+    if (identRunning_)
+    {
+        recordIdentification(perturbation);
+    }
+    if (telemetryOn_)
+    {
+        recordTelemetry(error);
+    }
+
+    if (error.is_Brake)
+    {
+        // Invert what's currently on the brake
+        digitalWrite(ROLL_BRAKE_REAL_PIN, !digitalRead(ROLL_BRAKE_REAL_PIN));
+    }
+
+    State errorTol;
+    errorTol.jaw_rotation = 0.05f;
+    errorTol.jaw_pos      = 0.1f;
+    errorTol.clamp_pos    = 0.01f;
+    if (abs(error) < errorTol && command_in_progress_)
+    {
+        // The host only hears about the moves it sent, not the ones of a stored program
+        if (!programRunner_.isRunning())
+        {
+            receiver.SafePrint(SERIAL_ACK);
+        }
+        command_in_progress_ = false;
+    }
+}
+
+#ifdef STEP_VERIFICATION
+/**
+ * @brief Compares the steps counted by the PCNT units against what AccelStepper thinks it stepped.
+ *
+ * Any drift beyond the tolerance is reported over serial. With autoCorrect enabled the software
+ * position is replaced by the counted one, but only once the motor is at rest since
+ * setCurrentPosition() also zeroes AccelStepper's speed. The next control tick then steps out the
+ * difference.
+ */
+void Cleaner::verifySteps()
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        if (!stepCounters_[i].isActive())
+        {
+            continue;
+        }
+
+        StepReconciler::Report report = stepReconcilers_[i].reconcile(
+            stepCounters_[i].read(),
+            motors[i]->currentPosition(),
+            micros());
+
+        // Only state changes are printed, a flagged axis would otherwise repeat every period
+        if (report.changed)
+        {
+            char message[112];
+            snprintf(
+                message,
+                sizeof(message),
+                "%s step drift: %ld (hw %ld, sw %ld) at %.0f steps/s%s\n",
+                motors[i]->getName(),
+                static_cast<long>(report.drift),
+                static_cast<long>(report.hardwareSteps),
+                static_cast<long>(report.softwareSteps),
+                report.stepRate,
+                report.status == StepReconciler::OK ? ", back in tolerance" : "");
+            receiver.SafePrint(message);
+        }
+
+        if (report.status == StepReconciler::DRIFT_CORRECTED && !motors[i]->isRunning())
+        {
+            motors[i]->setCurrentPosition(report.hardwareSteps);
+            stepReconcilers_[i].acknowledgeCorrection();
+
+            char message[64];
+            snprintf(
+                message,
+                sizeof(message),
+                "%s position corrected to %ld\n",
+                motors[i]->getName(),
+                static_cast<long>(report.hardwareSteps));
+            receiver.SafePrint(message);
+        }
+    }
+}
+#endif
+
+#ifdef ADAPTIVE_NOTCH
+/**
+ * @brief Runs the AS5048A velocity through the adaptive notch, which tracks the jaw resonance, and
+ * then the low pass, which does not have to be set below the resonance. The jaw rotation is
+ * commanded open loop, the filtered velocity is only measured and reported.
+ */
+void HOT_PATH Cleaner::updateJawVelocity()
+{
+    jaw_rotation_velocity_ = jawEncoderLowpassFilter.filterData(jawNotch_.filterData(jawVelocity_));
+}
+
+/**
+ * @brief Reports the tracked jaw resonance over serial while the notch is locked onto one.
+ */
+void Cleaner::reportResonance()
+{
+    if (!jawNotch_.locked())
+    {
+        return;
+    }
+
+    char message[80];
+    snprintf(
+        message,
+        sizeof(message),
+        "Jaw resonance: %.1f Hz (notch at %.1f Hz, %.1f dB)\n",
+        jawNotch_.trackedFrequency(),
+        jawNotch_.notchFrequency(),
+        jawNotch_.attenuation());
+    receiver.SafePrint(message);
+}
+#endif
+
+#ifdef VIBRATION_MONITOR
+/**
+ * @brief Hands the raw jaw rotation velocity to the vibration monitor. Taken before any notch or
+ * low pass, those would hide exactly what the monitor is looking for.
+ */
+void HOT_PATH Cleaner::sampleVibration() { vibration_.push(jawVelocity_); }
+
+/**
+ * @brief Prints a line for every band that went over its threshold since the last poll.
+ */
+void Cleaner::reportVibrationEvents()
+{
+    const uint32_t events = vibration_.takeEvents();
+    if (events == 0)
+    {
+        return;
+    }
+
+    const VibrationMonitor::Summary summary = vibration_.status().summary;
+    for (uint8_t b = 0; b < VibrationMonitor::BANDS; b++)
+    {
+        if (!(events & (1UL << b)))
+        {
+            continue;
+        }
+        char message[96];
+        snprintf(
+            message,
+            sizeof(message),
+            "Vibration over threshold: band %u from %.0f Hz at %.3f rms, peak %.1f Hz\n",
+            b,
+            summary.bandStart[b],
+            summary.bandRms[b],
+            summary.peakFrequency);
+        receiver.SafePrint(message);
+    }
+}
+#endif
+
+/**
+ * @brief Prints the latest vibration spectrum summary (M952) as one line,
+ * `VIB windows=.. rms=.. peak=<Hz>/<amplitude> bands=<rms>,.. over=<mask> overruns=.. busy=<us>`
+ */
+void Cleaner::reportVibration()
+{
+#ifdef VIBRATION_MONITOR
+    const VibrationMonitor::Status status    = vibration_.status();
+    const VibrationMonitor::Summary& summary = status.summary;
+    char message[160];
+    snprintf(
+        message,
+        sizeof(message),
+        "VIB windows=%lu rms=%.4f peak=%.1f/%.4f bands=%.4f,%.4f,%.4f,%.4f over=0x%lx "
+        "overruns=%lu busy=%lu\n",
+        static_cast<unsigned long>(summary.windows),
+        summary.rms,
+        summary.peakFrequency,
+        summary.peakAmplitude,
+        summary.bandRms[0],
+        summary.bandRms[1],
+        summary.bandRms[2],
+        summary.bandRms[3],
+        static_cast<unsigned long>(summary.overMask),
+        static_cast<unsigned long>(status.overruns),
+        static_cast<unsigned long>(status.busyMicros));
+    receiver.SafePrint(message);
+#else
+    receiver.SafePrint("Vibration monitor not built, enable -D VIBRATION_MONITOR\n");
+#endif
+}
+
+/**
+ * @brief Lets every motor apply or drop its acceleration current boost.
+ */
+void Cleaner::updateCurrents()
+{
+    for (auto* motor : motors)
+    {
+        motor->updateCurrent();
+    }
+#ifdef ADAPTIVE_ACCELERATION
+    adaptAccelerations();
+#endif
+}
+
+#ifdef ADAPTIVE_ACCELERATION
+/**
+ * @brief Samples the load of the jaw axes while they move and lets the adapters pick the
+ * acceleration of the next move once they stop. The jaw rotation is measured by the AS5048A, its
+ * margin is how far it stays from falling ADAPT_TRACKING_TOLERANCE behind the step count, which
+ * marks the move unsafe. The jaw position is measured by StallGuard at the speed and current
+ * scale it was read at. A new clamp target is a new part, the adapters start over from the worst
+ * case.
+ *
+ * @note Overrides M17 on the jaw axes after their next move.
+ */
+void Cleaner::adaptAccelerations()
+{
+    if (des_state_.clamp_pos != adaptClampTarget_)
+    {
+        adaptClampTarget_ = des_state_.clamp_pos;
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            accelAdapters_[i].reset(accelAdapters_[i].config().minAcceleration);
+            motors[i]->setAcceleration(accelAdapters_[i].acceleration());
+        }
+    }
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        StepperMotor* motor = motors[i];
+        const bool moving   = motor->isRunning();
+
+        if (moving && !adaptMoving_[i] && i == 0)
+        {
+            adaptEncoderStart_ = jawAngle_;
+            adaptStepsStart_   = motor->currentPositionUnits();
+        }
+        if (moving && i == 0)
+        {
+            const float measured = jawAngle_ - adaptEncoderStart_;
+            const float stepped  = motor->currentPositionUnits() - adaptStepsStart_;
+            const float lag      = std::fabs(stepped - measured);
+            if (lag > ADAPT_TRACKING_TOLERANCE)
+            {
+                accelAdapters_[i].flagUnsafe();
+            }
+            else if (motor->isAccelerating())
+            {
+                accelAdapters_[i].sampleMargin(1.0f - lag / ADAPT_TRACKING_TOLERANCE);
+            }
+        }
+        else if (moving && motor->inSpreadCycle() && !motor->isDecelerating())
+        {
+            const StepperMotor::DriverHealth health = motor->driverHealth();
+            accelAdapters_[i].sample(
+                health.stallGuard,
+                motor->speed(),
+                health.csActual,
+                motor->isAccelerating());
+        }
+
+        if (!moving && adaptMoving_[i])
+        {
+            const float before = motor->acceleration();
+            const AdaptiveAcceleration::Decision decision = accelAdapters_[i].endMove();
+            if (decision == AdaptiveAcceleration::INCREASED ||
+                decision == AdaptiveAcceleration::DECREASED)
+            {
+                motor->setAcceleration(accelAdapters_[i].acceleration());
+
+                char message[112];
+                snprintf(
+                    message,
+                    sizeof(message),
+                    "%s acceleration %.0f -> %.0f steps/s^2, load margin %.2f\n",
+                    motor->getName(),
+                    before,
+                    accelAdapters_[i].acceleration(),
+                    accelAdapters_[i].margin());
+                receiver.SafePrint(message);
+            }
+        }
+        adaptMoving_[i] = moving;
+    }
+}
+#endif
+
+/**
+ * @brief Polls the driver thermal flags and reports when one is raised or cleared.
+ */
+void Cleaner::checkDriverHealth()
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        const StepperMotor::DriverHealth health = motors[i]->driverHealth();
+        if (health.preWarning == driverPreWarning_[i] &&
+            health.overTemperature == driverOverTemperature_[i])
+        {
+            continue;
+        }
+        driverPreWarning_[i]      = health.preWarning;
+        driverOverTemperature_[i] = health.overTemperature;
+
+        char message[96];
+        snprintf(
+            message,
+            sizeof(message),
+            "%s driver %s\n",
+            motors[i]->getName(),
+            health.overTemperature
+                ? "over temperature, bridges off"
+                : (health.preWarning ? "over temperature pre-warning" : "temperature ok"));
+        receiver.SafePrint(message);
+    }
+}
+
+/**
+ * @brief Prints the thermal flags, current scale and StallGuard reading of every driver (M911),
+ * what CoolStep and the StallGuard thresholds are tuned against.
+ */
+void Cleaner::reportDrivers()
+{
+    for (auto* motor : motors)
+    {
+        const StepperMotor::DriverHealth health = motor->driverHealth();
+        char message[128];
+        snprintf(
+            message,
+            sizeof(message),
+            "%s: ot %d otpw %d cs %u/31 sg %u%s%s\n",
+            motor->getName(),
+            health.overTemperature,
+            health.preWarning,
+            health.csActual,
+            health.stallGuard,
+            health.standstill ? " standstill" : "",
+            health.boosted ? " boosted" : "");
+        receiver.SafePrint(message);
+    }
+}
+
+/**
+ * @brief Sets the input shaper of motors[axis]. The change is applied once the machine is idle,
+ * reshaping a move half way would make the reference jump.
+ *
+ * @param axis index into motors[], 0 jaw rotation, 1 jaw position, 2 clamp
+ * @param params shaper type and the resonance it targets
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the axis or parameters are invalid or the shaper is too
+ * long for the reference history
+ */
+int Cleaner::setShaper(uint8_t axis, const shaping::Params& params)
+{
+    if (axis >= 3 || params.type > shaping::EI)
+    {
+        return EXIT_FAILURE;
+    }
+    shaping::Impulses impulses = shaping::design(params);
+    if (params.type != shaping::NONE &&
+        (impulses.count == 1 ||
+         impulses.time[impulses.count - 1] * RUN_RATE_HZ > SHAPER_HISTORY - 1))
+    {
+        return EXIT_FAILURE;
+    }
+
+    shaperParams_[axis] = params;
+    shaperPending_      = true;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Configures the shapers from shaperParams_. Every axis gets the delay of the longest
+ * shaper, the shorter ones make up the difference with a pure delay, so axes commanded together
+ * still arrive together and the clamp stays coupled to the jaw rotation.
+ */
+void Cleaner::applyShapers()
+{
+    float longest = 0.0f;
+    for (const auto& params : shaperParams_)
+    {
+        shaping::Impulses impulses = shaping::design(params);
+        longest = std::max(longest, impulses.time[impulses.count - 1]);
+    }
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        shaping::Impulses impulses = shaping::design(shaperParams_[i]);
+        if (shapers_[i].configure(
+                shaperParams_[i],
+                1.0f / RUN_RATE_HZ,
+                longest - impulses.time[impulses.count - 1]) != EXIT_SUCCESS)
+        {
+            receiver.SafePrint("Shaper does not fit the reference history, kept the last one\n");
+        }
+    }
+    shaped_ = false;
+    for (const auto& shaper : shapers_)
+    {
+        shaped_ = shaped_ || shaper.params().type != shaping::NONE;
+    }
+    shaperPending_ = false;
+    resetShapers();
+}
+
+/**
+ * @brief Starts every shaper and trajectory from the current desired state so nothing moves.
+ */
+void Cleaner::resetShapers()
+{
+    shapers_[0].reset(des_state_.jaw_rotation);
+    shapers_[1].reset(des_state_.jaw_pos);
+    shapers_[2].reset(des_state_.clamp_pos);
+    trajectories_[0].reset(des_state_.jaw_rotation);
+    trajectories_[1].reset(des_state_.jaw_pos);
+}
+
+/**
+ * @brief Prints the shaper of every axis with its latency: the length of the shaper, the mean
+ * delay it adds to the reference and the total delay after synchronisation.
+ */
+void Cleaner::reportShapers()
+{
+    const char axisLetters[] = {'A', 'Y', 'C'};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        const shaping::Params& params = shapers_[i].params();
+        char message[128];
+        snprintf(
+            message,
+            sizeof(message),
+            "Shaper %c %s %.2f Hz zeta %.3f: %.0f ms shaper, %.0f ms mean delay, %.0f ms synced\n",
+            axisLetters[i],
+            shaping::typeName(params.type),
+            params.frequency,
+            params.damping,
+            shapers_[i].shaperDuration() * 1e3f,
+            shapers_[i].meanDelay() * 1e3f,
+            shapers_[i].duration() * 1e3f);
+        receiver.SafePrint(message);
+    }
+    if (shaperPending_)
+    {
+        receiver.SafePrint("Shaper change pending until the machine is idle\n");
+    }
+}
+
+/**
+ * @brief Sets the pitch error table and backlash of the jaw position lead screw. Like the shapers
+ * they take effect once the machine is idle, the correction never jumps mid-move. M500 keeps them
+ * across power cycles.
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if a field is out of range
+ */
+int Cleaner::setCompensation(const compensation::Settings& settings)
+{
+    compensation::LeadScrewCompensator check;
+    if (check.configure(settings, 1.0f / RUN_RATE_HZ) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    config_.data().jawPosition = settings;
+    compensationPending_       = true;
+    return EXIT_SUCCESS;
+}
+
+void Cleaner::applyCompensation()
+{
+    if (jawPosCompensator_.configure(config_.data().jawPosition, 1.0f / RUN_RATE_HZ) !=
+        EXIT_SUCCESS)
+    {
+        receiver.SafePrint("Stored lead screw compensation is invalid, ignored.\n");
+    }
+    compensationPending_ = false;
+}
+
+void Cleaner::reportCompensation()
+{
+    const compensation::Settings& settings = config_.data().jawPosition;
+    char message[112];
+    snprintf(
+        message,
+        sizeof(message),
+        "Jaw position backlash %.3f mm at %.1f mm/s, %u pitch points from %.1f mm every %.1f mm\n",
+        settings.backlash,
+        settings.takeupRate,
+        settings.points,
+        settings.start,
+        settings.spacing);
+    receiver.SafePrint(message);
+    for (uint8_t i = 0; i < settings.points; i++)
+    {
+        snprintf(message, sizeof(message), "  I%u %.4f mm\n", i, settings.errors[i]);
+        receiver.SafePrint(message);
+    }
+    if (compensationPending_)
+    {
+        receiver.SafePrint("Compensation change pending until the machine is idle\n");
+    }
+}
+
+/**
+ * @brief Writes the calibration to flash.
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the machine is moving or the write failed
+ */
+int Cleaner::saveConfig()
+{
+    if (!isMotionIdle())
+    {
+        return EXIT_FAILURE;
+    }
+    return config_.save();
+}
+
+/** @brief Sets the max speed of every axis given, 0 keeps the axis */
+void Cleaner::setMaxSpeeds(float jawPos, float jawRotation, float clamp)
+{
+    // Kinda bad since it won't let you actually set the speed to 0
+    // TODO: fix this
+    if (jawRotation != 0)
+    {
+        jaw_rotation_motor_.setMaxSpeed(jawRotation);
+        jaw_rotation_motor_.updateChopperThresholds();
+    }
+    if (jawPos != 0)
+    {
+        jaw_pos_motor_.setMaxSpeed(jawPos);
+        jaw_pos_motor_.updateChopperThresholds();
+    }
+    if (clamp != 0)
+    {
+        clamp_motor_.setMaxSpeed(clamp);
+        clamp_motor_.updateChopperThresholds();
+    }
+}
+
+/** @brief Sets the acceleration of every axis given, 0 keeps the axis */
+void Cleaner::setAccelerations(float jawPos, float jawRotation, float clamp)
+{
+    if (jawRotation != 0)
+    {
+        jaw_rotation_motor_.setAcceleration(jawRotation);
+    }
+    if (jawPos != 0)
+    {
+        jaw_pos_motor_.setAcceleration(jawPos);
+    }
+    if (clamp != 0)
+    {
+        clamp_motor_.setAcceleration(clamp);
+    }
+}
+
+/**
+ * @brief Handles the stored program commands.
+ *
+ * - M28 <name> starts an upload, every following line is compiled and stored instead of run,
+ *   until M29. Each line is acked so the host can send the next one.
+ * - M31 <name> links the program and what it calls into RAM, checks every move it will make
+ *   against the soft limits and the clamp and brake interlocks and plans them, without moving.
+ * - M24 <name> does the same and, if the plan is valid, runs it locally. The next op is taken
+ *   as soon as the last move is in position, its speeds come out of the plan.
+ *   Both are refused while anything moves, the check reads flash and holds up loop() while it
+ *   plans, up to program::Plan::SIMULATED_MOVES moves.
+ * - M25 stops the program after the current move, M27 reports where it is.
+ * - M20 lists the stored programs, M30 <name> deletes one.
+ *
+ * While an upload or a program is running every message comes here, anything else from the host
+ * is refused until it is done.
+ */
+void Cleaner::processProgramCommands(const SerialReceiverTransmitter::CommandMessage& command)
+{
+    const bool fresh    = receiver.messagesReceived() != lastHandledMessage_;
+    lastHandledMessage_ = receiver.messagesReceived();
+
+    if (programStore_.isUploading())
+    {
+        if (!fresh)
+        {
+            return;
+        }
+        if (command.M29.received)
+        {
+            uint16_t count = 0;
+            char message[64];
+            if (programStore_.endUpload(count) == EXIT_SUCCESS)
+            {
+                snprintf(message, sizeof(message), "Program stored, %u ops\n", count);
+                receiver.SafePrint(message);
+            }
+            else
+            {
+                receiver.SafePrint("Program upload failed, nothing stored\n");
+            }
+        }
+        else if (programStore_.addLine(receiver.lastReceivedText()) != EXIT_SUCCESS)
+        {
+            receiver.SafePrint("Program line rejected, the upload will be discarded\n");
+        }
+        receiver.SafePrint(SERIAL_ACK);
+        return;
+    }
+
+    if (programRunner_.isRunning())
+    {
+        if (fresh)
+        {
+            if (command.M25.received)
+            {
+                stopProgram();
+                receiver.SafePrint("Program stopped\n");
+            }
+            else if (command.M27.received)
+            {
+                reportProgram();
+            }
+            else
+            {
+                receiver.SafePrint("Program running, only M25 and M27 are accepted\n");
+            }
+            receiver.SafePrint(SERIAL_ACK);
+        }
+        runProgram();
+        return;
+    }
+
+    // Flash is only written while the machine is idle
+    if (command.M28.received)
+    {
+        if (!isMotionIdle() || programStore_.beginUpload(command.M28.name) != EXIT_SUCCESS)
+        {
+            receiver.SafePrint("Upload rejected, check the name and that the machine is idle\n");
+        }
+    }
+    if (command.M30.received)
+    {
+        if (!isMotionIdle() || programStore_.remove(command.M30.name) != EXIT_SUCCESS)
+        {
+            receiver.SafePrint("Delete rejected, check the name and that the machine is idle\n");
+        }
+    }
+    if (command.M20.received)
+    {
+        programStore_.list(&SerialReceiverTransmitter::SafePrint);
+    }
+    if (command.M31.received)
+    {
+        if (!isMotionIdle() || identRunning_)
+        {
+            receiver.SafePrint("Check rejected, wait for the machine to stop\n");
+        }
+        else
+        {
+            checkProgram(command.M31.name);
+        }
+    }
+    if (command.M24.received)
+    {
+        startProgram(command.M24.name);
+    }
+    if (command.M25.received || command.M27.received)
+    {
+        reportProgram();
+    }
+    receiver.SafePrint(SERIAL_ACK);
+}
+
+/**
+ * @brief Links a stored program into RAM, checks every move it makes from the desired state on and
+ * plans them with the current M80/M17, see program::Plan. Prints the outcome.
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the program can't be linked or a move fails the checks
+ */
+int Cleaner::checkProgram(const char* name)
+{
+    if (programImage_.link(name, &ProgramStore::loader, &programStore_) != EXIT_SUCCESS)
+    {
+        receiver.SafePrint("Program rejected, check it and everything it calls is stored\n");
+        return EXIT_FAILURE;
+    }
+
+    const float start[program::AXES] = {
+        des_state_.jaw_pos, des_state_.jaw_rotation, des_state_.clamp_pos};
+    programKinematics_           = currentKinematics();
+    const program::Report report = programPlan_.build(programImage_.ops(),
+                                                      programImage_.size(),
+                                                      start,
+                                                      des_state_.is_Brake,
+                                                      programKinematics_,
+                                                      ProgramLimits);
+
+    static const char* const PROBLEMS[] = {
+        "valid",
+        "invalid, unbalanced M808, calls nested too deep or an empty endless loop",
+        "out of limits",
+        "travels with the clamp closed",
+        "travels with the brake on",
+        "moves an axis without M80/M17"};
+    static const char AXES[] = "YAC";
+
+    char message[128];
+    if (report.problem != program::NO_PROBLEM)
+    {
+        snprintf(
+            message,
+            sizeof(message),
+            "Program %s %s, op %u, move %lu, axis %c\n",
+            name,
+            PROBLEMS[report.problem],
+            report.pc,
+            static_cast<unsigned long>(report.moves + 1),
+            AXES[report.axis]);
+    }
+    else
+    {
+        snprintf(
+            message,
+            sizeof(message),
+            report.endless ? "Program %s valid, endless, %lu moves checked in %.1f s\n"
+                           : "Program %s valid, %lu moves in %.1f s\n",
+            name,
+            static_cast<unsigned long>(report.moves),
+            report.duration);
+    }
+    receiver.SafePrint(message);
+    return report.problem == program::NO_PROBLEM ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief Checks and plans a stored program, then starts it.
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the machine is busy or the program fails checkProgram()
+ */
+int Cleaner::startProgram(const char* name)
+{
+    if (!isMotionIdle() || identRunning_)
+    {
+        receiver.SafePrint("Program rejected, wait for the machine to stop\n");
+        return EXIT_FAILURE;
+    }
+    if (checkProgram(name) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    strncpy(programName_, name, sizeof(programName_) - 1);
+    programDwellEnd_ = millis();
+    programMoves_    = 0;
+    programRunner_.start(programImage_.ops(), programImage_.size());
+
+    char message[64];
+    snprintf(message, sizeof(message), "Program %s started, %u ops\n", name, programImage_.size());
+    receiver.SafePrint(message);
+    return EXIT_SUCCESS;
+}
+
+/** @brief Hands the next op of the running program to the axes once the last one is done */
+void Cleaner::runProgram()
+{
+    if (command_in_progress_ || static_cast<int32_t>(millis() - programDwellEnd_) < 0)
+    {
+        return;
+    }
+    const program::Op* op = programRunner_.next();
+    if (op == nullptr)
+    {
+        restoreProgramKinematics();
+        reportProgram();
+        return;
+    }
+
+    switch (op->code)
+    {
+        case program::MOVE:
+        {
+            const float from[program::AXES] = {
+                des_state_.jaw_pos, des_state_.jaw_rotation, des_state_.clamp_pos};
+            const float to[program::AXES] = {op->values[0], op->values[1], op->values[2]};
+
+            // Past the planned moves the same plan is made as they come, they were all checked
+            const program::Segment* planned = programPlan_.segment(programMoves_++);
+            const program::Segment segment =
+                planned != nullptr ? *planned : program::planMove(from, to, programKinematics_);
+            jaw_pos_motor_.setMaxSpeed(segment.speed[program::Y]);
+            jaw_pos_motor_.setAcceleration(segment.acceleration[program::Y]);
+            jaw_rotation_motor_.setMaxSpeed(segment.speed[program::A]);
+            jaw_rotation_motor_.setAcceleration(segment.acceleration[program::A]);
+
+            des_state_.jaw_pos      = to[program::Y];
+            des_state_.jaw_rotation = to[program::A];
+            des_state_.clamp_pos    = to[program::C];
+            des_state_.is_Brake     = op->flags & 1;
+            command_in_progress_    = true;
+            break;
+        }
+        case program::DWELL:
+            // Unlike G4 from the host this doesn't block, the control loop keeps running
+            programDwellEnd_ = millis() + static_cast<uint32_t>(op->values[0]);
+            break;
+        case program::HOME:
+        {
+            SerialReceiverTransmitter::CommandMessage homing;
+            homing.M80.y = op->flags & program::AXIS_Y ? 1.0f : 0.0f;
+            homing.M80.a = op->flags & program::AXIS_A ? 1.0f : 0.0f;
+            homing.M80.c = op->flags & program::AXIS_C ? 1.0f : 0.0f;
+            home(homing);
+            break;
+        }
+        case program::SET_SPEED:
+            // The motors still have the last move's scaled speeds, the change is on the program's
+            restoreProgramKinematics();
+            setMaxSpeeds(op->values[0], op->values[1], op->values[2]);
+            programKinematics_ = currentKinematics();
+            break;
+        case program::SET_ACCELERATION:
+            restoreProgramKinematics();
+            setAccelerations(op->values[0], op->values[1], op->values[2]);
+            programKinematics_ = currentKinematics();
+            break;
+        default:
+            break;
+    }
+}
+
+/** @brief Stops the running program, its M80/M17 stay in effect */
+void Cleaner::stopProgram()
+{
+    if (programRunner_.isRunning())
+    {
+        programRunner_.stop();
+        restoreProgramKinematics();
+    }
+}
+
+/** @brief M80/M17 of the axes in steps, the clamp's speed as far as its PID may take it */
+program::Kinematics Cleaner::currentKinematics()
+{
+    StepperMotor* const axes[program::AXES] = {
+        &jaw_pos_motor_, &jaw_rotation_motor_, &clamp_motor_};
+
+    program::Kinematics kinematics;
+    for (uint8_t axis = 0; axis < program::AXES; axis++)
+    {
+        kinematics.stepDistance[axis] = axes[axis]->getPhysicalParams().stepDistance;
+        kinematics.maxSpeed[axis]     = axes[axis]->maxSpeed();
+        kinematics.acceleration[axis] = axes[axis]->acceleration();
+    }
+    kinematics.maxSpeed[program::C] *= CLAMP_SPEED_FRACTION;
+    return kinematics;
+}
+
+/** @brief Puts the program's own M80/M17 back on the axes a planned move scaled down */
+void Cleaner::restoreProgramKinematics()
+{
+    jaw_pos_motor_.setMaxSpeed(programKinematics_.maxSpeed[program::Y]);
+    jaw_pos_motor_.setAcceleration(programKinematics_.acceleration[program::Y]);
+    jaw_rotation_motor_.setMaxSpeed(programKinematics_.maxSpeed[program::A]);
+    jaw_rotation_motor_.setAcceleration(programKinematics_.acceleration[program::A]);
+}
+
+void Cleaner::reportProgram()
+{
+    static const char* const ERRORS[] = {
+        "done",
+        "failed, loops and calls nested too deep",
+        "failed, unbalanced M808",
+        "failed, endless loop without moves"};
+
+    char message[112];
+    if (programRunner_.isRunning())
+    {
+        snprintf(
+            message,
+            sizeof(message),
+            "Program %s running, op %u of %u, %lu moves\n",
+            programName_,
+            programRunner_.pc(),
+            programImage_.size(),
+            static_cast<unsigned long>(programRunner_.executed()));
+    }
+    else if (programName_[0] != '\0')
+    {
+        snprintf(
+            message,
+            sizeof(message),
+            "Program %s %s, %lu moves\n",
+            programName_,
+            ERRORS[programRunner_.error()],
+            static_cast<unsigned long>(programRunner_.executed()));
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "No program run yet\n");
+    }
+    receiver.SafePrint(message);
+}
+
+/**
+ * @brief Starts a frequency response identification of the jaw rotation.
+ *
+ * A chirp or stepped-sine velocity perturbation is added to the jaw rotation command on every
+ * control tick and the commanded perturbation is recorded next to the velocity measured by the
+ * AS5048A. The other axes have no sensor of their own, their step counts would only give back
+ * the command.
+ * The record is streamed as text lines:
+ *
+ *     BODE_START axis=<n> mode=<0 chirp|1 stepped> f0=<Hz> f1=<Hz> amp=<units/s> T=<s>
+ *                rate=<Hz> steps=<n>
+ *     BODE <tick> <frequency Hz> <command units/s> <measured rad/s>
+ *     BODE_END samples=<n> dropped=<n>
+ *
+ * serverside/bode_identification.py turns it into gain, phase and coherence.
+ *
+ * @param axis index into motors[], only 0, the jaw rotation, is measured
+ * @param cfg perturbation settings, cfg.Ts must be the control period
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the axis is not the jaw rotation, the machine is
+ * moving, a run is already in progress or the settings are invalid
+ */
+int Cleaner::startIdentification(uint8_t axis, const identification::Config& cfg)
+{
+    if (axis != 0 || identRunning_ || !isMotionIdle())
+    {
+        return EXIT_FAILURE;
+    }
+    if (identPerturbation_.start(cfg) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    identOffset_ = 0;
+    // Builds without another user of the encoder only read it while identifying
+    jawAngle_ = encoder_.getRotationUnwrappedInRadians();
+    identSamples_.clear();
+    identRunning_ = true;
+
+    char header[128];
+    snprintf(
+        header,
+        sizeof(header),
+        "BODE_START axis=%u mode=%u f0=%.3f f1=%.3f amp=%.5f T=%.3f rate=%.1f steps=%u\n",
+        static_cast<unsigned>(axis),
+        static_cast<unsigned>(cfg.mode),
+        cfg.fStart,
+        cfg.fEnd,
+        cfg.amplitude,
+        cfg.duration,
+        1.0f / cfg.Ts,
+        static_cast<unsigned>(cfg.steps));
+    receiver.SafePrint(header);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Aborts a running identification. The samples already recorded are still streamed and
+ * terminated with BODE_END.
+ */
+void Cleaner::stopIdentification()
+{
+    identPerturbation_.stop();
+    identOffset_ = 0;
+}
+
+/**
+ * @brief Pushes this tick's commanded and measured velocity into the sample ring, called from the
+ * control tick while an identification is running.
+ *
+ * @param perturbation the velocity perturbation applied this tick
+ */
+void Cleaner::recordIdentification(float perturbation)
 {
-    // Initialize the communication bus
-    Wire.begin();  // Initialize I2C bus
-    Wire.setClock(400000);
+    if (!identPerturbation_.active())
+    {
+        // Run is over, put the axis back on its target and let the stream drain
+        identOffset_ = 0;
+        return;
+    }
 
-    // Initialize the motors
-    for (auto* motor : motors)
+    identification::Sample sample;
+    sample.index     = identPerturbation_.sampleIndex() - 1;
+    sample.frequency = identPerturbation_.frequency();
+    sample.command   = perturbation;
+    sample.response  = jawVelocity_;
+
+    identSamples_.push(sample);
+}
+
+/**
+ * @brief Writes the recorded identification samples to serial, as many as the transmit buffer
+ * takes without blocking. Ends the run with BODE_END once the perturbation has finished and the
+ * ring is empty.
+ */
+void Cleaner::streamIdentification()
+{
+    char line[64];
+    identification::Sample sample;
+    while (identSamples_.size() > 0)
     {
-        if (motor->begin() != EXIT_SUCCESS)
+        // Only take a sample out when the whole line fits, SafePrint would cut it short
+        if (SerialReceiverTransmitter::availableForWrite() < static_cast<int>(sizeof(line)))
         {
-            std::string errorMessage =
-                std::string("Failed to initialize ") + motor->getName() + " motor.\n";
-            if (Serial.availableForWrite() > strlen(errorMessage.c_str()))
-            {
-                Serial.print(errorMessage.c_str());
-            }
-            return EXIT_FAILURE;
+            return;
+        }
+        if (!identSamples_.pop(sample))
+        {
+            break;
         }
+        snprintf(
+            line,
+            sizeof(line),
+            "BODE %lu %.3f %.5f %.5f\n",
+            static_cast<unsigned long>(sample.index),
+            sample.frequency,
+            sample.command,
+            sample.response);
+        receiver.SafePrint(line);
     }
 
-    // Initialize the encoder
-    encoder_.begin();
-
-    // Register the interrupt for the PCF8575
-    if (IO_EXTENDER_INT != 255)
+    if (!identPerturbation_.active())
     {
-        pinMode(IO_EXTENDER_INT, INPUT_PULLUP);
-        detachInterrupt(IO_EXTENDER_INT);
-        attachInterrupt(
-            IO_EXTENDER_INT,
-            bindArgGateThisAllocate(&Cleaner::PCFMessageRec, this),
-            CHANGE);
+        snprintf(
+            line,
+            sizeof(line),
+            "BODE_END samples=%lu dropped=%lu\n",
+            static_cast<unsigned long>(identPerturbation_.sampleIndex()),
+            static_cast<unsigned long>(identSamples_.dropped()));
+        receiver.SafePrint(line);
+        identRunning_ = false;
     }
-    // Initialize the IO extender
-    IOExtender_.begin();
-
-    // Initialize the pins
-    pinMode(LIMIT_SWITCH_PIN_JAW_ROTATION, INPUT_PULLUP);
-    pinMode(ESTOP_PIN, INPUT_PULLUP);
-    pinMode(ROLL_BRAKE_REAL_PIN, OUTPUT);
-
-    return EXIT_SUCCESS;
 }
 
 /**
- * @brief Executes the ~300kHz control loop for the Cleaner system.
+ * @brief Starts the compact telemetry stream of TelemetryChannels, see telemetry.hpp. The stream
+ * opens with text lines describing it
  *
- * This function performs the following actions:
- * - Checks if the system is in an emergency stop (E-Stop) state and exits early if so.
- * - Executes control logic at a fixed rate using the DO_EVERY macro.
- * - Iterates through all motors, running each one.
- * - For the clamp motor, synchronizes its speed with the jaw rotation motor and adjusts
- *   the speed to account for any additional required movement based on error.
+ *     TLM_START rate=<Hz> channels=<n> key=<ticks>
+ *     TLM_CH <index> <name> scale=<units per count> div=<ticks> stats=<Stat flags>
  *
- * The function ensures coordinated movement between the jaw rotation and clamp motors,
- * and enforces speed limits for safe operation.
+ * followed by the binary packets, interleaved with whatever else is printed.
+ * serverside/telemetry.py decodes it.
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the channels send more than a packet can hold
  */
-void Cleaner::run()
+int Cleaner::startTelemetry()
 {
-    // Do not run if we're E-Stopped
-    if (state_.is_Estopped)
+    if (telemetry_.configure(
+            telemetryChannels_, TELEMETRY_PACKET_TICKS, TELEMETRY_KEYFRAME_TICKS) != EXIT_SUCCESS)
     {
-        return;
+        return EXIT_FAILURE;
     }
+    telemetryBusyUs_    = 0;
+    telemetryMaxUs_     = 0;
+    telemetryHeader_    = 1 + TELEMETRY_CHANNELS;
+    telemetryOn_        = true;
+    telemetryStreaming_ = true;
+    return EXIT_SUCCESS;
+}
 
-    DO_EVERY(1.0f / RUN_RATE_HZ, runControl());
-    // run all motors
-    for (const auto& motor : motors)
+/**
+ * @brief Stops sampling, what is queued is still streamed and followed by the TLM_END report.
+ */
+void Cleaner::stopTelemetry()
+{
+    if (telemetryOn_)
     {
-        /* If we're moving the jaw rotation, sync the clamp motor to it
-         * and add any additional speed needed to move the clamp when it
-         * too has error
-         */
-        clamp_motor_.setSpeed(limit_val(
-            jaw_rotation_motor_.speed() * 2 +
-                desired_clamp_speed / clamp_motor_.getPhysicalParams().stepDistance,
-            -clamp_motor_.maxSpeed(),
-            clamp_motor_.maxSpeed()));
+        telemetryOn_ = false;
+        telemetry_.flush();
+    }
+}
 
-        motor->run();
+/**
+ * @brief Changes one channel, a running stream restarts with it and a new header.
+ *
+ * @param channel index into TelemetryChannelNames
+ * @param settings a scale that isn't positive or no stats leave the channel out
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if there is no such channel or a running stream would not
+ * fit its packets with it, the channel is unchanged then
+ */
+int Cleaner::setTelemetryChannel(uint8_t channel, const telemetry::Channel& settings)
+{
+    if (channel >= TELEMETRY_CHANNELS)
+    {
+        return EXIT_FAILURE;
+    }
+    const telemetry::Channel previous = telemetryChannels_[channel];
+    telemetryChannels_[channel]       = settings;
+    if (telemetryOn_ && startTelemetry() != EXIT_SUCCESS)
+    {
+        telemetryChannels_[channel] = previous;
+        return EXIT_FAILURE;
     }
+    return EXIT_SUCCESS;
 }
+
 /**
- * @brief Runs the 1kHz control loop
+ * @brief Prints what the stream cost since it started as one line
+ *
+ *     TLM ticks=<n> packets=<n> bytes=<n> values=<n> dropped=<packets> ratio=<x>
+ *         snapshot_ratio=<x> encode_us=<mean per tick> max_us=<longest tick>
  *
+ * ratio compares the packets with the values sent as floats, snapshot_ratio with every channel
+ * sent as a float every tick.
  */
-void Cleaner::runControl()
+void Cleaner::reportTelemetry()
 {
-    updateRealState();
+    const uint32_t ticks = telemetry_.tick();
+    const float bytes    = telemetry_.bytes() > 0 ? telemetry_.bytes() : 1.0f;
+    char message[192];
+    snprintf(
+        message,
+        sizeof(message),
+        "TLM ticks=%lu packets=%lu bytes=%lu values=%lu dropped=%lu ratio=%.2f "
+        "snapshot_ratio=%.2f encode_us=%.2f max_us=%lu\n",
+        static_cast<unsigned long>(ticks),
+        static_cast<unsigned long>(telemetry_.packets()),
+        static_cast<unsigned long>(telemetry_.bytes()),
+        static_cast<unsigned long>(telemetry_.values()),
+        static_cast<unsigned long>(telemetry_.dropped()),
+        telemetry_.values() * sizeof(float) / bytes,
+        ticks * TELEMETRY_CHANNELS * sizeof(float) / bytes,
+        ticks > 0 ? static_cast<float>(telemetryBusyUs_) / ticks : 0.0f,
+        static_cast<unsigned long>(telemetryMaxUs_));
+    receiver.SafePrint(message);
+}
 
-    State error = des_state_ - state_;
-    jaw_rotation_motor_.moveToUnits(des_state_.jaw_rotation);
+/**
+ * @brief Hands this tick's position, error and speed of every axis to the encoder, called from
+ * the control tick while the telemetry is on.
+ *
+ * @param error desired minus measured state of this tick
+ */
+void Cleaner::recordTelemetry(const State& error)
+{
+    const float values[TELEMETRY_CHANNELS] = {
+        state_.jaw_rotation,
+        state_.jaw_pos,
+        state_.clamp_pos,
+        error.jaw_rotation,
+        error.jaw_pos,
+        error.clamp_pos,
+        jaw_rotation_motor_.speedUnits(),
+        jaw_pos_motor_.speedUnits(),
+        clamp_motor_.speedUnits()};
 
-    jaw_pos_motor_.moveToUnits(des_state_.jaw_pos);
+    const uint32_t start = micros();
+    telemetry_.sample(values);
+    const uint32_t busy = micros() - start;
+    telemetryBusyUs_ += busy;
+    telemetryMaxUs_ = busy > telemetryMaxUs_ ? busy : telemetryMaxUs_;
+}
 
-    const float percentOfMax = .25f;
-    desired_clamp_speed      = limit_val(
-        clampLowpassFilter.filterData(ClampPID.filterData(error.clamp_pos)),
-        -clamp_motor_.maxSpeedUnits() * percentOfMax,
-        clamp_motor_.maxSpeedUnits() * percentOfMax);
+/**
+ * @brief Writes the header lines and the queued packets, each only once it fits whole so text
+ * printed in between never lands inside one. Ends the stream with TLM_END and the report once it
+ * was stopped and the queue is empty.
+ */
+void Cleaner::streamTelemetry()
+{
+    char line[96];
+    while (telemetryHeader_ > 0)
+    {
+        if (SerialReceiverTransmitter::availableForWrite() < static_cast<int>(sizeof(line)))
+        {
+            return;
+        }
+        const uint8_t index = 1 + TELEMETRY_CHANNELS - telemetryHeader_;
+        if (index == 0)
+        {
+            snprintf(
+                line,
+                sizeof(line),
+                "TLM_START rate=%.1f channels=%u key=%lu\n",
+                RUN_RATE_HZ,
+                static_cast<unsigned>(TELEMETRY_CHANNELS),
+                static_cast<unsigned long>(TELEMETRY_KEYFRAME_TICKS));
+        }
+        else
+        {
+            const telemetry::Channel& channel = telemetry_.channel(index - 1);
+            snprintf(
+                line,
+                sizeof(line),
+                "TLM_CH %u %s scale=%g div=%u stats=%u\n",
+                static_cast<unsigned>(index - 1),
+                TelemetryChannelNames[index - 1],
+                channel.scale,
+                static_cast<unsigned>(channel.divider),
+                static_cast<unsigned>(channel.stats));
+        }
+        receiver.SafePrint(line);
+        telemetryHeader_--;
+    }
 
-    if (abs(desired_clamp_speed) < 0.0f)
+    const uint8_t* packet;
+    size_t length;
+    while (telemetry_.front(packet, length))
     {
-        desired_clamp_speed = 0;
+        if (SerialReceiverTransmitter::availableForWrite() < static_cast<int>(length))
+        {
+            return;
+        }
+        receiver.SafePrint(packet, length);
+        telemetry_.pop();
     }
 
-    if (error.is_Brake)
+    if (!telemetryOn_)
     {
-        // Invert what's currently on the brake
-        digitalWrite(ROLL_BRAKE_REAL_PIN, !digitalRead(ROLL_BRAKE_REAL_PIN));
+        receiver.SafePrint("TLM_END\n");
+        reportTelemetry();
+        telemetryStreaming_ = false;
     }
+}
 
-    State errorTol;
-    errorTol.jaw_rotation = 0.05f;
-    errorTol.jaw_pos      = 0.1f;
-    errorTol.clamp_pos    = 0.01f;
-    if (abs(error) < errorTol && command_in_progress_)
+/**
+ * @brief Reads the AS5048A once per control tick, everything that needs the jaw angle or its
+ * velocity in the tick takes jawAngle_ and jawVelocity_ instead of another SPI transfer.
+ */
+void HOT_PATH Cleaner::updateJawEncoder()
+{
+#if !defined(ADAPTIVE_NOTCH) && !defined(VIBRATION_MONITOR) && !defined(ADAPTIVE_ACCELERATION)
+    // Only the identification uses the encoder in this build
+    if (!identRunning_)
     {
-        receiver.SafePrint(SERIAL_ACK);
-        command_in_progress_ = false;
+        return;
     }
+#endif
+    const float angle = encoder_.getRotationUnwrappedInRadians();
+    jawVelocity_      = (angle - jawAngle_) * RUN_RATE_HZ;
+    jawAngle_         = angle;
 }
 
 /**std
@@ -218,7 +1586,7 @@ void Cleaner::runControl()
  * @return Cleaner::State The updated state of the Cleaner system, reflecting
  *         the latest hardware readings and safety status.
  */
-Cleaner::State Cleaner::updateRealState()
+Cleaner::State HOT_PATH Cleaner::updateRealState()
 {
     if (ESTOP_PIN != 255 && !digitalRead(ESTOP_PIN))
     {
@@ -229,7 +1597,9 @@ Cleaner::State Cleaner::updateRealState()
     }
 
     state_.jaw_rotation = jaw_rotation_motor_.currentPositionUnits();
-    state_.clamp_pos    = clamp_motor_.currentPositionUnits() -
+    // Where the carriage is, the motor position still carries the lead screw correction
+    state_.jaw_pos   = jaw_pos_motor_.currentPositionUnits() - jawPosCompensator_.correction();
+    state_.clamp_pos = clamp_motor_.currentPositionUnits() -
                        state_.jaw_rotation;  // clamp is relative to jaw rotation
 
     state_.is_Brake = digitalRead(ROLL_BRAKE_REAL_PIN);
@@ -311,7 +1681,10 @@ void Cleaner::initializeManualMode()
     updateRealState();  // Update the real state to get the current position
     updateDesStateManual();
     ClampPID.reset();
+    stopIdentification();
+    stopProgram();
     des_state_ = state_;
+    resetShapers();
 }
 
 /**
@@ -325,6 +1698,7 @@ void Cleaner::initializeAutoMode(SerialReceiverTransmitter& receiver)
 {
     reset();
     receiver.reset();
+    batchCommandOpen_ = false;
     ClampPID.reset();
     updateRealState();
 }
@@ -332,7 +1706,7 @@ void Cleaner::initializeAutoMode(SerialReceiverTransmitter& receiver)
 /**
  * @brief ISR for the PCF8575
  */
-void Cleaner::PCFMessageRec() { updatePCF8575_flag = true; }
+void IRAM_ATTR Cleaner::PCFMessageRec() { updatePCF8575_flag = true; }
 
 // This function is called in the main loop whenever the interrupt is triggered
 /**
@@ -432,9 +1806,46 @@ int Cleaner::reset()
     {
         motor->setCurrentPosition(0);
     }
+
+    stopIdentification();
+    resetShapers();
+    jawPosCompensator_.reset(des_state_.jaw_pos);
+    stopProgram();
+
+#ifdef STEP_VERIFICATION
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        stepReconcilers_[i].resync(0, stepCounters_[i].read(), micros());
+    }
+#endif
     return EXIT_SUCCESS;
 }
 
+/**
+ * @brief Checks that no axis is moving and no command is being executed.
+ *
+ * Writing flash (NVS, file system) disables the caches and pauses the other core, which would
+ * stall the step generation mid-move no matter where the code lives. Anything that writes flash
+ * must wait for this to be true.
+ *
+ * @return true when it is safe to write flash
+ */
+bool Cleaner::isMotionIdle()
+{
+    if (command_in_progress_)
+    {
+        return false;
+    }
+    for (auto* motor : motors)
+    {
+        if (motor->isRunning())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * @brief Stops all motors managed by the Cleaner instance.
  *
@@ -444,6 +1855,10 @@ int Cleaner::reset()
  */
 void Cleaner::stop()
 {
+    stopProgram();
+    // The stop drops the queued batch commands, the one running isn't acked either
+    batchCommandOpen_ = false;
+
     uint8_t numRunning = 0;
     while (numRunning > 0)
     {
@@ -466,14 +1881,22 @@ void Cleaner::stop()
  *
  * This function interprets the provided command message and performs actions such as
  * moving motors, setting speeds, accelerations, current limits, or executing homing and dwell
- * commands. Each command type (G0, G4, G28, G90, M80, M17, M906) is handled individually, updating
- * the desired state or hardware parameters as required.
+ * commands. Each command type (G0, G4, G28, G90, M80, M17, M906, M593, M911, M950, M951,
+ * M952, M953) is handled individually, updating the desired state or hardware parameters as
+ * required.
  *
  * @param command The command message received from the serial interface, containing
  *                various possible instructions for the cleaner system.
  */
 void Cleaner::processCommand(SerialReceiverTransmitter::CommandMessage command)
 {
+    // An upload or a running program takes over the link until it is done
+    if (programStore_.isUploading() || programRunner_.isRunning())
+    {
+        processProgramCommands(command);
+        return;
+    }
+
     if (command.G0.received)
     {
         // Move command, modify the state to the desired state
@@ -508,34 +1931,12 @@ void Cleaner::processCommand(SerialReceiverTransmitter::CommandMessage command)
         // Set max speed command only if the speed command is not 0
         // Kinda bad since it won't let you actually set the speed to 0
         // TODO: fix this
-        if (command.M80.a != 0)
-        {
-            jaw_rotation_motor_.setMaxSpeed(command.M80.a);
-        }
-        if (command.M80.y != 0)
-        {
-            jaw_pos_motor_.setMaxSpeed(command.M80.y);
-        }
-        if (command.M80.c != 0)
-        {
-            clamp_motor_.setMaxSpeed(command.M80.c);
-        }
+        setMaxSpeeds(command.M80.y, command.M80.a, command.M80.c);
         receiver.SafePrint(SERIAL_ACK);
     }
     if (command.M17.received)
     {
-        if (command.M17.a != 0)
-        {
-            jaw_rotation_motor_.setAcceleration(command.M17.a);
-        }
-        if (command.M17.y != 0)
-        {
-            jaw_pos_motor_.setAcceleration(command.M17.y);
-        }
-        if (command.M17.c != 0)
-        {
-            clamp_motor_.setAcceleration(command.M17.c);
-        }
+        setAccelerations(command.M17.y, command.M17.a, command.M17.c);
         receiver.SafePrint(SERIAL_ACK);
     }
     if (command.M906.received)
@@ -562,6 +1963,237 @@ void Cleaner::processCommand(SerialReceiverTransmitter::CommandMessage command)
         }
         receiver.SafePrint(SERIAL_ACK);
     }
+    // The last command is handed in again on every loop, only act on a newly received one
+    if (command.M425.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+
+        compensation::Settings settings = config_.data().jawPosition;
+        if (command.M425.backlash >= 0)
+        {
+            settings.backlash = command.M425.backlash;
+        }
+        if (command.M425.takeupRate >= 0)
+        {
+            settings.takeupRate = command.M425.takeupRate;
+        }
+        if (!std::isnan(command.M425.start))
+        {
+            settings.start = command.M425.start;
+        }
+        if (command.M425.spacing >= 0)
+        {
+            settings.spacing = command.M425.spacing;
+        }
+        if (command.M425.index >= 0 && command.M425.index < compensation::PITCH_POINTS)
+        {
+            settings.errors[command.M425.index] = command.M425.error;
+            settings.points = std::max<uint8_t>(settings.points, command.M425.index + 1);
+        }
+        if (command.M425.points >= 0)
+        {
+            settings.points = static_cast<uint8_t>(std::min(command.M425.points, 255));
+        }
+        if (setCompensation(settings) != EXIT_SUCCESS)
+        {
+            receiver.SafePrint("Compensation rejected, check the point count and signs\n");
+        }
+        if (compensationPending_ && isMotionIdle())
+        {
+            applyCompensation();
+        }
+        reportCompensation();
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if (command.M500.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+        receiver.SafePrint(
+            saveConfig() == EXIT_SUCCESS ? "Calibration saved\n"
+                                         : "Calibration not saved, wait for the machine to stop\n");
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if ((command.M20.received || command.M24.received || command.M25.received ||
+         command.M27.received || command.M28.received || command.M30.received ||
+         command.M31.received) &&
+        receiver.messagesReceived() != lastHandledMessage_)
+    {
+        processProgramCommands(command);
+    }
+    if (command.M593.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+
+        const bool axes[3] = {command.M593.a, command.M593.y, command.M593.c};
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            if (!axes[i])
+            {
+                continue;
+            }
+            // Start from the pending parameters, anything not given in the command is kept
+            shaping::Params params = shaperParams_[i];
+            if (command.M593.type >= 0)
+            {
+                params.type = static_cast<shaping::Type>(command.M593.type);
+            }
+            if (command.M593.damping >= 0)
+            {
+                params.damping = command.M593.damping;
+            }
+            if (command.M593.frequency > 0)
+            {
+                params.frequency = command.M593.frequency;
+            }
+#ifdef ADAPTIVE_NOTCH
+            else if (command.M593.frequency == 0 && jawNotch_.locked())
+            {
+                // Take the resonance the notch is tracking on the AS5048A
+                params.frequency = jawNotch_.trackedFrequency();
+            }
+#endif
+            if (setShaper(i, params) != EXIT_SUCCESS)
+            {
+                receiver.SafePrint("Shaper rejected, check the type and frequency\n");
+            }
+        }
+        if (shaperPending_ && isMotionIdle())
+        {
+            applyShapers();
+        }
+        reportShapers();
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if (command.M911.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+        reportDrivers();
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if (command.M950.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+
+        identification::Config cfg;
+        cfg.mode      = command.M950.mode == 1 ? identification::STEPPED_SINE
+                                               : identification::CHIRP;
+        cfg.amplitude = command.M950.amplitude;
+        cfg.fStart    = command.M950.fStart;
+        cfg.fEnd      = command.M950.fEnd;
+        cfg.duration  = command.M950.duration;
+        cfg.steps     = command.M950.steps;
+        cfg.Ts        = 1.0f / RUN_RATE_HZ;
+
+        uint8_t axis = 255;
+        switch (command.M950.axis)
+        {
+            case 'A':
+                axis = 0;
+                break;
+            case 'Y':
+                axis = 1;
+                break;
+            case 'C':
+                axis = 2;
+                break;
+        }
+        if (startIdentification(axis, cfg) != EXIT_SUCCESS)
+        {
+            receiver.SafePrint(
+                "Identification rejected, only A is measured, check that the machine is idle\n");
+        }
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if (command.M951.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+        stopIdentification();
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if (command.M952.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+        reportVibration();
+        receiver.SafePrint(SERIAL_ACK);
+    }
+    if (command.M953.received && receiver.messagesReceived() != lastHandledMessage_)
+    {
+        lastHandledMessage_ = receiver.messagesReceived();
+
+        if (command.M953.channel >= TELEMETRY_CHANNELS)
+        {
+            receiver.SafePrint("Telemetry channel rejected, there is no such channel\n");
+        }
+        else if (command.M953.channel >= 0)
+        {
+            const uint8_t channel       = static_cast<uint8_t>(command.M953.channel);
+            telemetry::Channel settings = telemetryChannels_[channel];
+            if (command.M953.divider > 0)
+            {
+                settings.divider = static_cast<uint16_t>(command.M953.divider);
+            }
+            if (command.M953.stats >= 0)
+            {
+                settings.stats = static_cast<uint8_t>(command.M953.stats);
+            }
+            if (command.M953.scale >= 0)
+            {
+                settings.scale = command.M953.scale;
+            }
+            if (setTelemetryChannel(channel, settings) != EXIT_SUCCESS)
+            {
+                receiver.SafePrint("Telemetry channel rejected, a tick could outgrow a packet\n");
+            }
+        }
+        if (command.M953.state == 1 && !telemetryOn_)
+        {
+            // A stream still draining after a stop is cut short, the new header starts over
+            if (startTelemetry() != EXIT_SUCCESS)
+            {
+                receiver.SafePrint("Telemetry rejected, a tick could outgrow a packet\n");
+            }
+        }
+        else if (command.M953.state == 0)
+        {
+            stopTelemetry();
+        }
+        else if (command.M953.state < 0 && command.M953.channel < 0)
+        {
+            reportTelemetry();
+        }
+        receiver.SafePrint(SERIAL_ACK);
+    }
+}
+
+/**
+ * @brief Runs the commands of BATCH messages one at a time, see command_batch.hpp.
+ *
+ * The next command is taken once the last one completed: a move once it is in position, a stored
+ * program once it ended, anything else straight away. Each is handed to processCommand() once and
+ * acked by its seq when it completes, an ack covers every command before it too.
+ */
+void Cleaner::runBatch()
+{
+    if (programRunner_.isRunning())
+    {
+        // Keeps the program going, like the message that started it does outside a batch
+        processCommand(receiver.lastReceivedCommandMessage());
+        return;
+    }
+    if (command_in_progress_)
+    {
+        return;
+    }
+    if (batchCommandOpen_)
+    {
+        receiver.completeBatchCommand();
+        batchCommandOpen_ = false;
+    }
+    if (receiver.nextBatchCommand())
+    {
+        batchCommandOpen_ = true;
+        processCommand(receiver.lastReceivedCommandMessage());
+    }
 }
 
 /**
@@ -579,6 +2211,7 @@ int Cleaner::shutdown()
     jaw_rotation_motor_.kill();
     jaw_pos_motor_.kill();
     clamp_motor_.kill();
+    identPerturbation_.stop();
 
     state_.is_Estopped = true;
 
@@ -30,7 +30,7 @@ Coefficients<3, float> PIDControllerCoefficients(float kp, float ki, float kd, f
     // Forced coefficients (denominator)
     float b0        = kp + ki * ts / 2.0f + 2.0f * kd / ts;
     float b1        = ki * ts - 4.0f * kd / ts;
-    float b2        = -kp - ki * ts / 2.0f + 2.0f * kd / ts;
+    float b2        = -kp + ki * ts / 2.0f + 2.0f * kd / ts;
     forced_coeffs_ = {b0, b1, b2};
 
     coefficients.forcedResponseCoefficients  = forced_coeffs_;
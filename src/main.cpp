@@ -7,7 +7,16 @@
 
 constexpr int BAUDERATE = 921600;
 
-SerialReceiverTransmitter receiver;
+#if defined(TRANSPORT_TCP)
+constexpr uint16_t TCP_PORT = 3333;
+TcpTransport transport(WIFI_SSID, WIFI_PASSWORD, TCP_PORT);
+#elif defined(TRANSPORT_UART)
+UartTransport transport(Serial1, RS485_RX_PIN, RS485_TX_PIN, RS485_DE_PIN);
+#else
+UsbCdcTransport transport;
+#endif
+
+SerialReceiverTransmitter receiver(transport);
 
 Cleaner cleaner_system(receiver);
 
@@ -95,6 +104,13 @@ void loop()
                     cleaner_system.run();
                 }
                 break;
+                case SerialReceiverTransmitter::MessageType::BATCH:
+                {
+                    // Every queued command is processed once, in order
+                    cleaner_system.runBatch();
+                    cleaner_system.run();
+                }
+                break;
                 case SerialReceiverTransmitter::MessageType::STOP:
                 {
                     // If the message is a stop type, this is not the emergency stop
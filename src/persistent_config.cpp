@@ -0,0 +1,42 @@
+#include "persistent_config.hpp"
+
+#include <Preferences.h>
+
+int PersistentConfig::load()
+{
+    Preferences prefs;
+    if (!prefs.begin(NAMESPACE, true))
+    {
+        return EXIT_FAILURE;
+    }
+
+    Blob blob;
+    const bool valid = prefs.getBytesLength(KEY) == sizeof(blob) &&
+                       prefs.getBytes(KEY, &blob, sizeof(blob)) == sizeof(blob) &&
+                       blob.version == VERSION;
+    prefs.end();
+
+    if (!valid)
+    {
+        return EXIT_FAILURE;
+    }
+    data_ = blob.data;
+    return EXIT_SUCCESS;
+}
+
+int PersistentConfig::save()
+{
+    Preferences prefs;
+    if (!prefs.begin(NAMESPACE, false))
+    {
+        return EXIT_FAILURE;
+    }
+
+    Blob blob;
+    blob.version = VERSION;
+    blob.data    = data_;
+    const bool written = prefs.putBytes(KEY, &blob, sizeof(blob)) == sizeof(blob);
+    prefs.end();
+
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,289 @@
+#include "program_store.hpp"
+
+#include <LittleFS.h>
+
+#include "serial_receiver_transmitter.hpp"
+
+int ProgramStore::begin()
+{
+    // Formats an empty partition on first use
+    mounted_ = LittleFS.begin(true);
+    if (!mounted_)
+    {
+        return EXIT_FAILURE;
+    }
+    if (!LittleFS.exists(DIRECTORY))
+    {
+        LittleFS.mkdir(DIRECTORY);
+    }
+    return EXIT_SUCCESS;
+}
+
+int ProgramStore::beginUpload(const char* name)
+{
+    if (!mounted_ || uploading_ || !validName(name))
+    {
+        return EXIT_FAILURE;
+    }
+    char temporary[PATH_LENGTH];
+    path(name, ".tmp", temporary);
+    upload_ = LittleFS.open(temporary, FILE_WRITE);
+    if (!upload_)
+    {
+        return EXIT_FAILURE;
+    }
+    strncpy(uploadName_, name, program::NAME_LENGTH - 1);
+    uploadOps_    = 0;
+    uploadDepth_  = 0;
+    uploadFailed_ = false;
+    uploading_    = true;
+    return EXIT_SUCCESS;
+}
+
+int ProgramStore::addLine(const char* line)
+{
+    if (!uploading_ || uploadFailed_)
+    {
+        return EXIT_FAILURE;
+    }
+    program::Op op;
+    switch (compile(line, op))
+    {
+        case BLANK:
+            return EXIT_SUCCESS;
+        case INVALID:
+            uploadFailed_ = true;
+            return EXIT_FAILURE;
+        case OP:
+            break;
+    }
+
+    if (op.code == program::LOOP_START)
+    {
+        uploadDepth_++;
+    }
+    else if (op.code == program::LOOP_END && --uploadDepth_ < 0)
+    {
+        uploadFailed_ = true;
+        return EXIT_FAILURE;
+    }
+    if (upload_.write(reinterpret_cast<const uint8_t*>(&op), sizeof(op)) != sizeof(op))
+    {
+        uploadFailed_ = true;
+        return EXIT_FAILURE;
+    }
+    uploadOps_++;
+    return EXIT_SUCCESS;
+}
+
+int ProgramStore::endUpload(uint16_t& count)
+{
+    if (!uploading_)
+    {
+        return EXIT_FAILURE;
+    }
+    upload_.close();
+    uploading_ = false;
+    count      = uploadOps_;
+
+    char temporary[PATH_LENGTH];
+    char stored[PATH_LENGTH];
+    path(uploadName_, ".tmp", temporary);
+    path(uploadName_, ".bin", stored);
+    if (uploadFailed_ || uploadDepth_ != 0)
+    {
+        LittleFS.remove(temporary);
+        return EXIT_FAILURE;
+    }
+    LittleFS.remove(stored);
+    return LittleFS.rename(temporary, stored) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int ProgramStore::remove(const char* name)
+{
+    char stored[PATH_LENGTH];
+    path(name, ".bin", stored);
+    return mounted_ && validName(name) && LittleFS.remove(stored) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void ProgramStore::list(Printer print)
+{
+    if (!mounted_)
+    {
+        return;
+    }
+    File directory = LittleFS.open(DIRECTORY);
+    for (File file = directory.openNextFile(); file; file = directory.openNextFile())
+    {
+        const char* name  = file.name();
+        const char* split = strrchr(name, '.');
+        if (file.isDirectory() || split == nullptr || strcmp(split, ".bin") != 0)
+        {
+            continue;
+        }
+        char line[48];
+        snprintf(
+            line,
+            sizeof(line),
+            "  %.*s %u ops\n",
+            static_cast<int>(split - name),
+            name,
+            static_cast<unsigned>(file.size() / sizeof(program::Op)));
+        print(line);
+    }
+}
+
+int ProgramStore::load(const char* name, program::Op* ops, uint16_t capacity, uint16_t& count)
+{
+    char stored[PATH_LENGTH];
+    path(name, ".bin", stored);
+    if (!mounted_ || !validName(name) || !LittleFS.exists(stored))
+    {
+        return EXIT_FAILURE;
+    }
+    File file          = LittleFS.open(stored, FILE_READ);
+    const size_t bytes = file.size();
+    if (bytes % sizeof(program::Op) != 0 || bytes / sizeof(program::Op) > capacity)
+    {
+        file.close();
+        return EXIT_FAILURE;
+    }
+    const size_t read = file.read(reinterpret_cast<uint8_t*>(ops), bytes);
+    file.close();
+    count = static_cast<uint16_t>(bytes / sizeof(program::Op));
+    return read == bytes ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int ProgramStore::loader(
+    void* self,
+    const char* name,
+    program::Op* ops,
+    uint16_t capacity,
+    uint16_t& count)
+{
+    return static_cast<ProgramStore*>(self)->load(name, ops, capacity, count);
+}
+
+/**
+ * The loop and call directives are handled here, everything else goes through the same parser as
+ * a command from the host so a stored line means exactly what it would mean sent live.
+ */
+ProgramStore::Compiled ProgramStore::compile(const char* line, program::Op& op)
+{
+    char text[LINE_LENGTH];
+    if (strlen(line) >= sizeof(text))
+    {
+        return INVALID;
+    }
+    strcpy(text, line);
+
+    // Comments and surrounding blanks
+    char* comment = strchr(text, ';');
+    if (comment)
+    {
+        *comment = '\0';
+    }
+    char* start = text;
+    while (*start == ' ' || *start == '\t')
+    {
+        start++;
+    }
+    char* end = start + strlen(start);
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+    {
+        *--end = '\0';
+    }
+    if (*start == '\0')
+    {
+        return BLANK;
+    }
+
+    op = program::Op();
+    if (strncmp(start, "M808", 4) == 0 && (start[4] == ' ' || start[4] == '\0'))
+    {
+        const char* count = strstr(start, " L");
+        if (count == nullptr)
+        {
+            op.code = program::LOOP_END;
+            return OP;
+        }
+        const long repeats = atol(count + 2);
+        if (repeats < 0 || repeats > UINT16_MAX)
+        {
+            return INVALID;
+        }
+        op.code = program::LOOP_START;
+        op.arg  = static_cast<uint16_t>(repeats);
+        return OP;
+    }
+    if (strncmp(start, "M98 ", 4) == 0)
+    {
+        const char* name = strstr(start, " P");
+        if (name == nullptr || !validName(name + 2))
+        {
+            return INVALID;
+        }
+        op.code = program::CALL;
+        strncpy(op.name, name + 2, program::NAME_LENGTH - 1);
+        return OP;
+    }
+
+    SerialReceiverTransmitter::CommandMessage command(start);
+    if (command.G0.received)
+    {
+        op.code      = program::MOVE;
+        op.flags     = command.G0.val != 0 ? 1 : 0;
+        op.values[0] = command.G0.y;
+        op.values[1] = command.G0.a;
+        op.values[2] = command.G0.c;
+    }
+    else if (command.G4.received)
+    {
+        op.code      = program::DWELL;
+        op.values[0] = command.G4.val;
+    }
+    else if (command.G28.received)
+    {
+        op.code  = program::HOME;
+        op.flags = (command.G28.y > 0 ? program::AXIS_Y : 0) |
+                   (command.G28.a > 0 ? program::AXIS_A : 0) |
+                   (command.G28.c > 0 ? program::AXIS_C : 0);
+    }
+    else if (command.M80.received || command.M17.received)
+    {
+        const SerialReceiverTransmitter::mCommand& set = command.M80.received ? command.M80
+                                                                              : command.M17;
+        op.code      = command.M80.received ? program::SET_SPEED : program::SET_ACCELERATION;
+        op.values[0] = set.y;
+        op.values[1] = set.a;
+        op.values[2] = set.c;
+    }
+    else
+    {
+        return INVALID;
+    }
+    return OP;
+}
+
+/** @brief Letters, digits, - and _, short enough for an op and a LittleFS path */
+bool ProgramStore::validName(const char* name)
+{
+    const size_t length = strlen(name);
+    if (length == 0 || length >= program::NAME_LENGTH)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '-' && name[i] != '_')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProgramStore::path(const char* name, const char* extension, char (&out)[PATH_LENGTH])
+{
+    snprintf(out, sizeof(out), "%s/%s%s", DIRECTORY, name, extension);
+}
@@ -1,43 +1,48 @@
 
 #include "serial_receiver_transmitter.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 // #ifdef ARDUINO
 #include <Arduino.h>
+#include <esp_timer.h>
 // #else
 // #endif
 
-void SerialReceiverTransmitter::begin(uint32_t baudrate) { Serial.begin(baudrate); }
+static UsbCdcTransport usbCdc;
+ByteTransport* SerialReceiverTransmitter::transport_ = &usbCdc;
 
-// Generic template (catch-all for types not explicitly handled)
-template <typename T>
-void SerialReceiverTransmitter::SafePrint(T message)
+int SerialReceiverTransmitter::begin(uint32_t baudrate)
 {
-    // Convert to String and get length
-    String str      = String(message);
-    int neededSpace = str.length();
-
-    if (Serial.availableForWrite() >= neededSpace)
-    {
-        Serial.print(str);
-    }
+    // A whole frame has to fit before READING_BODY takes it, BATCH frames run up to BUFFER_SIZE
+    return transport_->begin(baudrate, BUFFER_SIZE);
 }
 
-// Specialized for const char*
+// Specialized for const char*, what doesn't fit is cut off. One write, a TCP link sends it whole
 void SerialReceiverTransmitter::SafePrint(const char *message)
 {
     if (message == nullptr) return;
 
-    int remaining = Serial.availableForWrite();
-    for (int i = 0; message[i] != '\0' && remaining > 0; ++i, remaining = Serial.availableForWrite())
+    SafePrint(reinterpret_cast<const uint8_t*>(message), strlen(message));
+}
+
+void SerialReceiverTransmitter::SafePrint(const uint8_t* data, size_t length)
+{
+    const int room = transport_->availableForWrite();
+    if (room > 0)
     {
-        Serial.write(message[i]);
+        transport_->write(data, std::min(length, static_cast<size_t>(room)));
     }
 }
 
-// Specialized for Arduino String
-void SerialReceiverTransmitter::SafePrint(String message) { SafePrint(message.c_str()); }
+// Integers are formatted on the stack rather than through Arduino String
+void SerialReceiverTransmitter::SafePrint(long value)
+{
+    char text[12];
+    snprintf(text, sizeof(text), "%ld", value);
+    SafePrint(text);
+}
 
 SerialReceiverTransmitter::CommandMessage::CommandMessage()
     : G0(),
@@ -46,7 +51,23 @@ SerialReceiverTransmitter::CommandMessage::CommandMessage()
       G90(),
       M80(),
       M17(),
-      M906()  // Initialize all command messages to default values
+      M906(),
+      M425(),
+      M500(),
+      M20(),
+      M24(),
+      M25(),
+      M27(),
+      M28(),
+      M29(),
+      M30(),
+      M31(),
+      M593(),
+      M911(),
+      M950(),
+      M951(),
+      M952(),
+      M953()  // Initialize all command messages to default values
 {
 }
 
@@ -64,7 +85,23 @@ SerialReceiverTransmitter::CommandMessage::CommandMessage(
       G90(G90),
       M80(M80),
       M17(M17),
-      M906(M906)
+      M906(M906),
+      M425(),
+      M500(),
+      M20(),
+      M24(),
+      M25(),
+      M27(),
+      M28(),
+      M29(),
+      M30(),
+      M31(),
+      M593(),
+      M911(),
+      M950(),
+      M951(),
+      M952(),
+      M953()
 {
 }
 
@@ -79,19 +116,22 @@ SerialReceiverTransmitter::CommandMessage::CommandMessage(
  *
  * The parsing logic handles:
  * - G-code commands (e.g., G0, G4, G28, G90) and their parameters (e.g., Y, A, C).
- * - M-code commands (e.g., M80, M17, M906) and their parameters.
+ * - M-code commands (e.g., M80, M17, M906, M425, M500, M593, M911, M950, M951, M952, M953) and
+ *   their parameters, and the stored program commands M20, M24, M25, M27, M28, M29, M30 and M31.
  *
  * @param buffer A null-terminated character array containing the G-code or M-code command string.
  *
  * @note The constructor uses `strtok` to tokenize the input buffer and processes each token to
- * extract the command type and parameters. Unhandled commands or parameters are logged using
- * `Serial.print`.
+ * extract the command type and parameters. Unhandled parameters are reported to the host.
  */
-SerialReceiverTransmitter::CommandMessage::CommandMessage(char buffer[])
+SerialReceiverTransmitter::CommandMessage::CommandMessage(const char buffer[])
 {
-    // received string from serial, parse to allowed Gcode and Mcode
-    char POS_STRTOK_F_YOU[strlen(buffer) + 1];
+    // received string from serial, parse to allowed Gcode and Mcode. Only the copy is tokenized,
+    // the received text stays whole for lastReceivedText(). The second terminator is where the
+    // parameters start when there are none.
+    char POS_STRTOK_F_YOU[strlen(buffer) + 2];
     std::memcpy(POS_STRTOK_F_YOU, buffer, strlen(buffer) + 1);
+    POS_STRTOK_F_YOU[strlen(buffer) + 1] = '\0';
     char *token = strtok(POS_STRTOK_F_YOU, " ");
 
     switch (token[0])
@@ -108,15 +148,16 @@ SerialReceiverTransmitter::CommandMessage::CommandMessage(char buffer[])
                 case 0:
                 case 1:
                     G0.received = true;
-                    ProcessCommand(&buffer[strlen(token) + 1], &G0);
+                    ProcessCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &G0);
                     break;
                 case 4:
                     G4.received = true;
-                    G4.val      = atof(&buffer[strlen(token) + 2]);  // + 2 to skip the letter
+                    // + 2 to skip the letter
+                    G4.val = atof(&POS_STRTOK_F_YOU[strlen(token) + 2]);
                     break;
                 case 28:
                     G28.received = true;
-                    ProcessHomeCommand(&buffer[strlen(token) + 1], &G28);
+                    ProcessHomeCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &G28);
                     break;
                 case 90:
                     G90.received = true;
@@ -124,7 +165,7 @@ SerialReceiverTransmitter::CommandMessage::CommandMessage(char buffer[])
                     break;
                 default:
                     SafePrint("Unhandled Gcode type: G");
-                    SafePrint(std::to_string(token[0]).c_str());
+                    SafePrint(static_cast<long>(gCmd));
                     SafePrint("\n");
                     break;
             }
@@ -139,19 +180,79 @@ SerialReceiverTransmitter::CommandMessage::CommandMessage(char buffer[])
             {
                 case 80:
                     M80.received = true;
-                    ProcessCommand(&buffer[strlen(token) + 1], &M80);
+                    ProcessCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M80);
                     break;
                 case 17:
                     M17.received = true;
-                    ProcessCommand(&buffer[strlen(token) + 1], &M17);
+                    ProcessCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M17);
                     break;
                 case 906:
                     M906.received = true;
-                    ProcessCommand(&buffer[strlen(token) + 1], &M906);
+                    ProcessCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M906);
+                    break;
+                case 425:
+                    M425.received = true;
+                    ProcessCompensationCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M425);
+                    break;
+                case 500:
+                    M500.received = true;
+                    break;
+                case 20:
+                    M20.received = true;
+                    break;
+                case 24:
+                    M24.received = true;
+                    ProcessProgramCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M24);
+                    break;
+                case 25:
+                    M25.received = true;
+                    break;
+                case 27:
+                    M27.received = true;
+                    break;
+                case 28:
+                    M28.received = true;
+                    ProcessProgramCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M28);
+                    break;
+                case 29:
+                    M29.received = true;
+                    break;
+                case 30:
+                    M30.received = true;
+                    ProcessProgramCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M30);
+                    break;
+                case 31:
+                    M31.received = true;
+                    ProcessProgramCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M31);
+                    break;
+                case 98:
+                case 808:
+                    // Calls and loops only exist inside a stored program, see ProgramStore::compile
+                    break;
+                case 593:
+                    M593.received = true;
+                    ProcessShaperCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M593);
+                    break;
+                case 911:
+                    M911.received = true;
+                    break;
+                case 950:
+                    M950.received = true;
+                    ProcessIdentificationCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M950);
+                    break;
+                case 951:
+                    M951.received = true;
+                    break;
+                case 952:
+                    M952.received = true;
+                    break;
+                case 953:
+                    M953.received = true;
+                    ProcessTelemetryCommand(&POS_STRTOK_F_YOU[strlen(token) + 1], &M953);
                     break;
                 default:
                     SafePrint("Unhandled M-code: M");
-                    SafePrint(mCmd);
+                    SafePrint(static_cast<long>(mCmd));
                     break;
             }
         }
@@ -183,9 +284,7 @@ void SerialReceiverTransmitter::CommandMessage::ProcessCommand(char *param, comm
                 command->val = atoi(token + 1);
                 break;
             default:
-                Serial.print("Unhandled Gcode parameter: ");
-                Serial.print(std::to_string(token[0]).c_str());
-                Serial.print("\n");
+                reportUnhandled("Gcode", token[0]);
                 break;
         }
         token = strtok(NULL, " ");
@@ -223,6 +322,178 @@ void SerialReceiverTransmitter::CommandMessage::ProcessHomeCommand(char *param,
     }
 }
 
+/**
+ * Param is the rest of the M950 command in the form of C0.5 F1 H200 T10 S0 N20, the axis letter
+ * selects the axis and carries the perturbation amplitude. Missing parameters keep their defaults.
+ */
+void SerialReceiverTransmitter::CommandMessage::ProcessIdentificationCommand(
+    char *param,
+    identCommand *command)
+{
+    char *token = strtok(param, " ");
+    while (token != NULL)
+    {
+        switch (token[0])
+        {
+            case 'Y':
+            case 'A':
+            case 'C':
+                command->axis      = token[0];
+                command->amplitude = atof(token + 1);
+                break;
+            case 'F':
+                command->fStart = atof(token + 1);
+                break;
+            case 'H':
+                command->fEnd = atof(token + 1);
+                break;
+            case 'T':
+                command->duration = atof(token + 1);
+                break;
+            case 'S':
+                command->mode = atoi(token + 1);
+                break;
+            case 'N':
+                command->steps = atoi(token + 1);
+                break;
+            default:
+                reportUnhandled("M950", token[0]);
+                break;
+        }
+        token = strtok(NULL, " ");
+    }
+}
+
+/**
+ * Param is the rest of the M953 command in the form of S1 or C3 D10 F7 Q0.001, missing parameters
+ * keep the channel's current setting.
+ */
+void SerialReceiverTransmitter::CommandMessage::ProcessTelemetryCommand(
+    char *param,
+    telemetryCommand *command)
+{
+    char *token = strtok(param, " ");
+    while (token != NULL)
+    {
+        switch (token[0])
+        {
+            case 'S':
+                command->state = atoi(token + 1);
+                break;
+            case 'C':
+                command->channel = atoi(token + 1);
+                break;
+            case 'D':
+                command->divider = atoi(token + 1);
+                break;
+            case 'F':
+                command->stats = atoi(token + 1);
+                break;
+            case 'Q':
+                command->scale = atof(token + 1);
+                break;
+            default:
+                reportUnhandled("M953", token[0]);
+                break;
+        }
+        token = strtok(NULL, " ");
+    }
+}
+
+/**
+ * Param is the rest of the M593 command in the form of A Y F12.5 D0.05 S2, the bare axis letters
+ * select the axes the shaper is set on.
+ */
+void SerialReceiverTransmitter::CommandMessage::ProcessShaperCommand(
+    char *param,
+    shaperCommand *command)
+{
+    char *token = strtok(param, " ");
+    while (token != NULL)
+    {
+        switch (token[0])
+        {
+            case 'Y':
+                command->y = true;
+                break;
+            case 'A':
+                command->a = true;
+                break;
+            case 'C':
+                command->c = true;
+                break;
+            case 'S':
+                command->type = atoi(token + 1);
+                break;
+            case 'F':
+                command->frequency = atof(token + 1);
+                break;
+            case 'D':
+                command->damping = atof(token + 1);
+                break;
+            default:
+                reportUnhandled("M593", token[0]);
+                break;
+        }
+        token = strtok(NULL, " ");
+    }
+}
+
+/**
+ * Param is the rest of the M425 command in the form of Y0.05 F5 S0 P20 N11 I3 E-0.012, every
+ * parameter is optional and missing ones keep the current value.
+ */
+void SerialReceiverTransmitter::CommandMessage::ProcessCompensationCommand(
+    char *param,
+    compensationCommand *command)
+{
+    char *token = strtok(param, " ");
+    while (token != NULL)
+    {
+        switch (token[0])
+        {
+            case 'Y':
+                command->backlash = atof(token + 1);
+                break;
+            case 'F':
+                command->takeupRate = atof(token + 1);
+                break;
+            case 'S':
+                command->start = atof(token + 1);
+                break;
+            case 'P':
+                command->spacing = atof(token + 1);
+                break;
+            case 'N':
+                command->points = atoi(token + 1);
+                break;
+            case 'I':
+                command->index = atoi(token + 1);
+                break;
+            case 'E':
+                command->error = atof(token + 1);
+                break;
+            default:
+                reportUnhandled("M425", token[0]);
+                break;
+        }
+        token = strtok(NULL, " ");
+    }
+}
+
+/** Param is the rest of the M24/M28/M30/M31 command, the name of the program */
+void SerialReceiverTransmitter::CommandMessage::ProcessProgramCommand(
+    char *param,
+    programCommand *command)
+{
+    char *token = strtok(param, " ");
+    // A name too long is left empty rather than cut, so it can't hit another program
+    if (token != NULL && strlen(token) < sizeof(command->name))
+    {
+        strcpy(command->name, token);
+    }
+}
+
 SerialReceiverTransmitter::Stop::Stop() {}
 
 SerialReceiverTransmitter::Stop::Stop(char buffer[])
@@ -230,46 +501,51 @@ SerialReceiverTransmitter::Stop::Stop(char buffer[])
     // Empty constructor
 }
 
+/** @brief "Unhandled <command> parameter: <letter>" to the host */
+void SerialReceiverTransmitter::CommandMessage::reportUnhandled(const char* command, char parameter)
+{
+    char message[48];
+    snprintf(message, sizeof(message), "Unhandled %s parameter: %c\n", command, parameter);
+    SafePrint(message);
+}
+
 // Constructor for SerialReceiver
 SerialReceiverTransmitter::SerialReceiverTransmitter()
-    : state_(State::WAITING_FOR_HEADER),
-      currMsgId_(MessageType::NONE),
-      lastReceivedMsgId_(MessageType::NONE),
-      currMsgLen_(0),
+    : lastReceivedMsgId_(MessageType::NONE),
       lastReceivedCommandMessage_(),
-      lastReceivedStopMessage_()
+      lastReceivedStopMessage_(),
+      messagesReceived_(0),
+      pool_(rxStorage_, RX_POOL_SIZE),
+      assembler_(pool_, BUFFER_SIZE, MessageType::BATCH, RX_RESERVE)
 {
 }
 
+SerialReceiverTransmitter::SerialReceiverTransmitter(ByteTransport& transport)
+    : SerialReceiverTransmitter()
+{
+    transport_ = &transport;
+}
+
 /**
- * @brief Resets the SerialReceiverTransmitter state to its initial values.
+ * @brief Resets the SerialReceiverTransmitter state to its initial values. Frames already
+ * received stay, they are parsed next.
  */
 void SerialReceiverTransmitter::reset()
 {
-    state_             = State::WAITING_FOR_HEADER;
-    currMsgId_         = MessageType::NONE;
-    lastReceivedMsgId_ = MessageType::NONE;
-    currMsgLen_        = 0;
-    std::memset(currMsgData_, 0, BUFFER_SIZE);
+    lastReceivedMsgId_          = MessageType::NONE;
     lastReceivedCommandMessage_ = CommandMessage();
     lastReceivedStopMessage_    = Stop();
+    hold(false, 0, "");
+    dropBatch();
 }
 
 /**
- * @brief Parses incoming serial data and processes messages based on their
- * type.
+ * @brief Takes the next received message and processes it based on its type.
  *
- * This function reads data from the serial buffer and processes it according to
- * the current state. It handles three states: WAITING_FOR_HEADER,
- * READING_HEADER, and READING_BODY.
+ * The transport moves what has arrived into the receive pool first, see frame_pool.hpp. A backend
+ * with a receive task of its own has done so already. Frames come out of the pool whole, one per
+ * call, and are parsed where they lie:
  *
- * - WAITING_FOR_HEADER: Waits for the header byte (0xA5) to start reading a new
- * message.
- * - READING_HEADER: Reads the message type and length from the header.
- * - READING_BODY: Reads the message body and processes it based on the message
- * type.
- *
- * The message is expected to be in the following format:
  * 0xA5 - Header
  * 1 byte - Message type
  * 4 bytes - Message length
@@ -277,61 +553,108 @@ void SerialReceiverTransmitter::reset()
  *
  * It modifies the lastReceivedCommandMessage_ and lastReceivedStopMessage_
  * based on the message type. and updates the lastReceivedMsgId_ with the
- * message type. The function updates the state machine and processes messages
- * of type COMMAND.
+ * message type. The text of a COMMAND stays in its frame, held until the next message. The
+ * commands of a BATCH message are queued where they are, the queue holds the frame until the last
+ * of them is taken by nextBatchCommand(). A STOP drops whatever is queued. A PING is
+ * answered right here and leaves the last message as it was, so it can be sent at
+ * any time without disturbing a command or a batch in progress.
  */
 
 void SerialReceiverTransmitter::parse()
 {
-    switch (state_)
+    if (transport_->poll())
     {
-        case State::WAITING_FOR_HEADER:
-            if (Serial.available() > 0 && Serial.read() == 0xA5)
-            {
-                state_ = State::READING_HEADER;
-            }
+        assembler_.reset();  // the rest of that frame left with the old peer
+    }
+    transport_->receive(assembler_, esp_timer_get_time());
+
+    frames::Frame frame;
+    if (!pool_.take(frame))
+    {
+        reportDropped();
+        return;
+    }
+    const MessageType type = static_cast<MessageType>(frame.type);
+    switch (type)
+    {
+        case MessageType::COMMAND:
+            hold(true, frame.handle, frame.body);
+            lastReceivedCommandMessage_ = CommandMessage(frame.body);
             break;
-        case State::READING_HEADER:
-            if (Serial.available() >= HEADER_SIZE)
-            {
-                currMsgId_ = static_cast<MessageType>(
-                    Serial.read());  // Read the message type and set to current message id
-                // Define a union to convert 4 bytes to an int32_t
-                union
-                {
-                    uint8_t bytes[4];
-                    int32_t value;
-                } HeaderLength;
-                // Read the message length max size of 4 bytes
-                for (int i = 0; i < 4; i++)
-                {
-                    HeaderLength.bytes[i] = Serial.read();
-                }
-                currMsgLen_ = HeaderLength.value;
-                state_      = State::READING_BODY;
-            }
+        case MessageType::STOP:
+            lastReceivedStopMessage_ = Stop(frame.body);  // Kinda useless but here for completeness
+            dropBatch();
+            pool_.release(frame.handle);
             break;
-        case State::READING_BODY:
-            if (Serial.available() >= currMsgLen_)
-            {
-                Serial.readBytes(currMsgData_, currMsgLen_);
-                switch (currMsgId_)
-                {
-                    case MessageType::COMMAND:
-                        lastReceivedCommandMessage_ = CommandMessage(currMsgData_);
-                        break;
-                    case MessageType::STOP:
-                        lastReceivedStopMessage_ =
-                            Stop(currMsgData_);  // Kinda useless but here for completeness
-                        break;
-                    case MessageType::NONE:
-                        break;
-                }
-                lastReceivedMsgId_ = currMsgId_;
-                state_             = State::WAITING_FOR_HEADER;
-            }
+        case MessageType::BATCH:
+            receiveBatch(frame);
+            pool_.release(frame.handle);  // the queued commands hold it if they need it
+            break;
+        case MessageType::PING:
+            answerPing(frame);
+            pool_.release(frame.handle);
+            return;
+        case MessageType::NONE:
+            pool_.release(frame.handle);
             break;
+        default:
+            // Not a message of ours, nothing to do with it
+            pool_.release(frame.handle);
+            return;
     };
+    lastReceivedMsgId_ = type;
+    // A batch only counts once its commands are taken
+    if (type != MessageType::BATCH)
+    {
+        messagesReceived_++;
+    }
+}
+
+/** @brief Keeps `handle` as the last message's frame, `text` in it, and lets the one before go */
+void SerialReceiverTransmitter::hold(bool held, frames::Handle handle, const char* text)
+{
+    if (holding_)
+    {
+        pool_.release(current_);
+    }
+    holding_  = held;
+    current_  = handle;
+    lastText_ = text;
+}
+
+/** @brief Empties the batch queue, the frames its commands were in go back to the pool */
+void SerialReceiverTransmitter::dropBatch()
+{
+    uint32_t owner;
+    while (!batch_.empty())
+    {
+        if (batch_.frontOwner(owner))
+        {
+            pool_.release(owner);
+        }
+        batch_.pop();
+    }
+    batch_.restart();
+}
+
+/**
+ * @brief Tells the host about BATCH frames the pool had no room for, once every frame received
+ * before them is parsed. They are refused as a full queue would, the host resends from the seq
+ * named.
+ */
+void SerialReceiverTransmitter::reportDropped()
+{
+    const uint32_t dropped = assembler_.droppedBulk();
+    if (dropped == droppedSeen_)
+    {
+        return;
+    }
+    droppedSeen_ = dropped;
+    char message[48];
+    snprintf(
+        message, sizeof(message), "Err %u full, resend from %u\r", batch_.expected(),
+        batch_.expected());
+    SafePrint(message);
 }
 
 SerialReceiverTransmitter::CommandMessage SerialReceiverTransmitter::lastReceivedCommandMessage()
@@ -348,4 +671,128 @@ SerialReceiverTransmitter::Stop SerialReceiverTransmitter::lastReceivedStopMessa
 SerialReceiverTransmitter::MessageType SerialReceiverTransmitter::lastReceivedMessageId() const
 {
     return lastReceivedMsgId_;
+}
+
+/**
+ * @brief Queues the commands of a BATCH message, each one holds the frame until it is taken.
+ *
+ * Every command refused is reported as "Err <seq> <reason>\r". A gap or a full queue refuses the
+ * rest of the frame too, only the first is reported with the seq to resend from. A frame that
+ * only repeats commands already taken is answered with the last ack again, so a host that missed
+ * it learns where the device is. A restart is acked as seq 65535, the one before 0.
+ */
+void SerialReceiverTransmitter::receiveBatch(const frames::Frame& frame)
+{
+    static const char* const REASONS[] = {
+        "", "", "gap, resend from", "full, resend from", "too long", "not a G or M code"};
+
+    char message[64];
+    batch::Reader reader(frame.body, frame.length);
+    if (reader.restart())
+    {
+        dropBatch();
+        batchAcked_ = 0xFFFF;
+        SafePrint("Ack 65535\r");
+    }
+
+    bool repeated = false;
+    uint16_t seq;
+    const char* line;
+    size_t length;
+    while (reader.next(seq, line, length))
+    {
+        const batch::Result result = batch_.push(seq, line, length, frame.handle);
+        if (result == batch::ACCEPTED)
+        {
+            pool_.retain(frame.handle);
+            continue;
+        }
+        if (result == batch::DUPLICATE)
+        {
+            repeated = true;
+            continue;
+        }
+        if (result == batch::GAP || result == batch::FULL)
+        {
+            snprintf(
+                message,
+                sizeof(message),
+                "Err %u %s %u\r",
+                seq,
+                REASONS[result],
+                batch_.expected());
+            SafePrint(message);
+            return;
+        }
+        snprintf(message, sizeof(message), "Err %u %s\r", seq, REASONS[result]);
+        SafePrint(message);
+    }
+    if (reader.truncated())
+    {
+        snprintf(message, sizeof(message), "Err %u truncated frame\r", batch_.expected());
+        SafePrint(message);
+    }
+    if (repeated && batchAcked_ >= 0)
+    {
+        snprintf(message, sizeof(message), "Ack %ld\r", static_cast<long>(batchAcked_));
+        SafePrint(message);
+    }
+}
+
+/**
+ * @brief Answers a PING message, a link latency and clock offset probe.
+ *
+ * The body is the host's send time, 8 bytes little endian, in whatever unit the host keeps. The
+ * answer is "Pong <host time> <received> <sent>\r", both device times in esp_timer microseconds
+ * since boot. micros() is the low 32 bits of the same clock. Received is taken when the frame's
+ * sentinel came off the link, sent right before the answer is written, so the host can take the
+ * time the device held the ping out of the round trip, see serverside/clock_sync.py.
+ */
+void SerialReceiverTransmitter::answerPing(const frames::Frame& frame)
+{
+    uint64_t hostTime  = 0;
+    const size_t bytes = frame.length < sizeof(hostTime) ? frame.length : sizeof(hostTime);
+    std::memcpy(&hostTime, frame.body, bytes);
+
+    char message[80];
+    snprintf(
+        message,
+        sizeof(message),
+        "Pong %llu %lld %lld\r",
+        static_cast<unsigned long long>(hostTime),
+        static_cast<long long>(frame.startUs),
+        static_cast<long long>(esp_timer_get_time()));
+    SafePrint(message);
+}
+
+/**
+ * @brief Takes the next queued batch command, it becomes lastReceivedCommandMessage() and
+ * lastReceivedText() and counts as a new message.
+ *
+ * @return false if nothing is queued
+ */
+bool SerialReceiverTransmitter::nextBatchCommand()
+{
+    if (batch_.empty())
+    {
+        return false;
+    }
+    uint32_t owner;
+    const bool held  = batch_.frontOwner(owner);
+    const char* line = batch_.front(batchOpen_);
+    batch_.pop();
+    hold(held, owner, line);  // the queue's hold on the frame passes to the last message
+    // A line refused on arrival was reported then, it only keeps its place in the sequence
+    lastReceivedCommandMessage_ = held ? CommandMessage(line) : CommandMessage();
+    messagesReceived_++;
+    return true;
+}
+
+/** @brief Acks every batch command up to the one last taken as completed, "Ack <seq>\r" */
+void SerialReceiverTransmitter::completeBatchCommand()
+{
+    batchAcked_ = batchOpen_;
+    char message[16];
+    snprintf(message, sizeof(message), "Ack %u\r", batchOpen_);
+    SafePrint(message);
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "step_counter.hpp"
+
+#include <driver/gpio.h>
+#include <driver/pcnt.h>
+
+#include "pin_defs.hpp"
+
+// Pulses shorter than this many APB clock cycles (12.5 ns each) are ignored by the counter. Well
+// under the 1 us minimum pulse width the step generator uses.
+static constexpr uint16_t PCNT_GLITCH_FILTER_CYCLES = 10;
+
+int StepCounter::begin(uint8_t unit, uint8_t stepPin, uint8_t dirPin, int16_t modulus)
+{
+    const gpio_num_t stepGpio  = static_cast<gpio_num_t>(gpioNumber(stepPin));
+    const gpio_num_t dirGpio   = static_cast<gpio_num_t>(gpioNumber(dirPin));
+    const pcnt_unit_t pcntUnit = static_cast<pcnt_unit_t>(unit);
+
+    pcnt_config_t config  = {};
+    config.pulse_gpio_num = stepGpio;
+    config.ctrl_gpio_num  = dirGpio;
+    config.channel        = PCNT_CHANNEL_0;
+    config.unit           = pcntUnit;
+    config.pos_mode       = PCNT_COUNT_INC;     // count on the rising edge of STEP
+    config.neg_mode       = PCNT_COUNT_DIS;
+    config.lctrl_mode     = PCNT_MODE_REVERSE;  // DIR low -> counting backwards
+    config.hctrl_mode     = PCNT_MODE_KEEP;
+    config.counter_h_lim  = modulus;
+    config.counter_l_lim  = -modulus;
+
+    if (pcnt_unit_config(&config) != ESP_OK)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // pcnt_unit_config() turns both pins into inputs, give the step generator its outputs back
+    // while keeping the input path to the counter
+    gpio_set_direction(stepGpio, GPIO_MODE_INPUT_OUTPUT);
+    gpio_set_direction(dirGpio, GPIO_MODE_INPUT_OUTPUT);
+
+    pcnt_set_filter_value(pcntUnit, PCNT_GLITCH_FILTER_CYCLES);
+    pcnt_filter_enable(pcntUnit);
+
+    pcnt_counter_pause(pcntUnit);
+    pcnt_counter_clear(pcntUnit);
+    pcnt_counter_resume(pcntUnit);
+
+    unit_   = unit;
+    active_ = true;
+    return EXIT_SUCCESS;
+}
+
+int16_t StepCounter::read() const
+{
+    int16_t count = 0;
+    if (active_)
+    {
+        pcnt_get_counter_value(static_cast<pcnt_unit_t>(unit_), &count);
+    }
+    return count;
+}
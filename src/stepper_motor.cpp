@@ -1,7 +1,9 @@
 #include "stepper_motor.hpp"
 
 #include "TMCStepper.h"
+#include "hot_path.hpp"
 #include "pin_defs.hpp"
+#include "serial_receiver_transmitter.hpp"
 
 StepperMotor::StepperMotor(const StepperMotor::StaticConfig& cfg)
     : AccelStepper(AccelStepper::DRIVER, cfg.pins.step, cfg.pins.dir),
@@ -13,6 +15,10 @@ StepperMotor::StepperMotor(const StepperMotor::StaticConfig& cfg)
           (cfg.pins.miso != 255 ? cfg.pins.miso : HW_MISO),
           (cfg.pins.sck != 255 ? cfg.pins.sck : HW_SCK))
 {
+#ifdef FAST_STEP_OUTPUT
+    stepMask_ = GpioMask::fromGpio(gpioNumber(cfg.pins.step));
+    dirMask_  = GpioMask::fromGpio(gpioNumber(cfg.pins.dir));
+#endif
 }
 
 void StepperMotor::kill()
@@ -42,9 +48,14 @@ int StepperMotor::begin()
     }
 
     stepper_driver_.begin();
-    stepper_driver_.toff(5);                           // Enables driver in software
-    stepper_driver_.rms_current(elec_.runCurrent_mA);  // Set motor RMS current
-    stepper_driver_.microsteps(elec_.microsteps);      // Set microsteps
+    stepper_driver_.microsteps(elec_.microsteps);  // Set microsteps
+    begun_ = true;
+    applyCurrentControl();  // Set motor RMS and hold current
+    applyChopper();         // toff > 0 enables the driver in software
+    if (elec_.chopper.autotune && elec_.chopper.stealthChopFraction > 0.0f)
+    {
+        autotuneStealthChop();
+    }
     // End the SPI call because the stupid fricken libray doesn't do it for you
     digitalWrite(cfg_.pins.cs, HIGH);
 
@@ -57,16 +68,241 @@ void StepperMotor::apply(const MotionParams& p)
     digitalWrite(cfg_.pins.cs, LOW);  // Start SPI transaction
     setMaxSpeed(p.maxSpeed);
     setAcceleration(p.acceleration);
+    updateChopperThresholds();  // the thresholds are fractions of the max speed
     digitalWrite(cfg_.pins.cs, HIGH);  // End SPI transaction
 };
 
 void StepperMotor::apply(const ElectricalParams& p)
 {
+    const bool chopperChanged = !sameChopper(elec_.chopper, p.chopper);
+    const bool currentChanged = !sameCurrent(elec_.current, p.current);
+
     elec_ = p;
     digitalWrite(cfg_.pins.cs, LOW);  // Start SPI transaction
-    stepper_driver_.rms_current(elec_.runCurrent_mA);
+    if (currentChanged && begun_)
+    {
+        applyCurrentControl();
+    }
+    else
+    {
+        writeCurrent();  // keeps the acceleration boost if it is applied
+    }
     stepper_driver_.microsteps(p.microsteps);
+    if (chopperChanged && begun_)
+    {
+        applyChopper();
+    }
+    else
+    {
+        updateChopperThresholds();  // a microstep change moves them
+    }
     digitalWrite(cfg_.pins.cs, HIGH);  // End SPI transaction
 };
 
-void StepperMotor::apply(const PhysicalParams& p) { phys_ = p; };
\ No newline at end of file
+void StepperMotor::apply(const PhysicalParams& p) { phys_ = p; };
+
+bool StepperMotor::sameChopper(const ChopperParams& a, const ChopperParams& b)
+{
+    return a.stealthChopFraction == b.stealthChopFraction &&
+           a.highVelocityFraction == b.highVelocityFraction && a.toff == b.toff &&
+           a.tbl == b.tbl && a.hstrt == b.hstrt && a.hend == b.hend;
+}
+
+bool StepperMotor::sameCurrent(const CurrentParams& a, const CurrentParams& b)
+{
+    return a.holdFraction == b.holdFraction && a.idleDelay_ms == b.idleDelay_ms &&
+           a.accelBoost == b.accelBoost && a.coolStepMin == b.coolStepMin &&
+           a.coolStepMax == b.coolStepMax && a.stallThreshold == b.stallThreshold;
+}
+
+/**
+ * @brief Writes the standstill power down and the CoolStep configuration, then the currents.
+ * CoolStep only acts above TCOOLTHRS, which applyChopper() puts where SpreadCycle runs.
+ */
+void StepperMotor::applyCurrentControl()
+{
+    const CurrentParams& current = elec_.current;
+    const long powerDown         = lround(current.idleDelay_ms / POWERDOWN_TICK_MS);
+    stepper_driver_.TPOWERDOWN(powerDown > 255 ? 255 : powerDown);
+    stepper_driver_.iholddelay(IHOLD_DELAY);  // ramp down to IHOLD instead of a current step
+
+    stepper_driver_.semin(current.coolStepMin);
+    stepper_driver_.semax(current.coolStepMax);
+    stepper_driver_.seup(1);        // +2 current steps per low StallGuard reading
+    stepper_driver_.sedn(0);        // -1 current step per 32 high StallGuard readings
+    stepper_driver_.seimin(false);  // never below half the run current
+    stepper_driver_.sgt(current.stallThreshold);
+    stepper_driver_.sfilt(true);  // StallGuard filtered over 4 full steps, steadier CoolStep
+
+    writeCurrent();
+}
+
+/**
+ * @brief Writes IRUN and IHOLD, IRUN boosted while boosted_. IHOLD is derived from IRUN by the
+ * library so the hold multiplier is scaled down to keep it where it is.
+ */
+void StepperMotor::writeCurrent()
+{
+    const float boost = boosted_ ? elec_.current.accelBoost : 1.0f;
+    stepper_driver_.hold_multiplier(elec_.current.holdFraction / boost);
+    stepper_driver_.rms_current(elec_.runCurrent_mA * boost);
+    digitalWrite(cfg_.pins.cs, HIGH);
+}
+
+/**
+ * @brief Applies the acceleration boost while the motor speeds up and drops it once it cruises
+ * or slows down. Call periodically, the driver is only written when the boost toggles.
+ */
+void StepperMotor::updateCurrent()
+{
+    const float speedNow = std::fabs(speed());
+    const float detect   = ACCEL_DETECT_FRACTION * maxSpeed();
+    accelerating_        = speedNow > lastSpeed_ + detect;
+    decelerating_        = speedNow < lastSpeed_ - detect;
+    lastSpeed_           = speedNow;
+
+    const bool boost = begun_ && accelerating_ && elec_.current.accelBoost > 1.0f;
+    if (boost == boosted_)
+    {
+        return;
+    }
+    boosted_ = boost;
+    writeCurrent();
+}
+
+/**
+ * @brief Reads DRV_STATUS once and decodes the thermal and load flags.
+ */
+StepperMotor::DriverHealth StepperMotor::driverHealth()
+{
+    const uint32_t status = stepper_driver_.DRV_STATUS();
+    digitalWrite(cfg_.pins.cs, HIGH);
+
+    DriverHealth health;
+    health.stallGuard      = status & 0x3FF;         // SG_RESULT, bits 0-9
+    health.csActual        = (status >> 16) & 0x1F;  // CS_ACTUAL, bits 16-20
+    health.overTemperature = status & (1UL << 25);
+    health.preWarning      = status & (1UL << 26);
+    health.standstill      = status & (1UL << 31);
+    health.boosted         = boosted_;
+    return health;
+}
+
+/**
+ * @brief Writes the chopper profile: SpreadCycle as the base chopper, StealthChop2 on top of it
+ * below the threshold speed and optionally the fullstep high velocity chopper at the top end.
+ */
+void StepperMotor::applyChopper()
+{
+    const ChopperParams& chopper = elec_.chopper;
+    stepper_driver_.toff(chopper.toff);
+    stepper_driver_.tbl(chopper.tbl);
+    stepper_driver_.hstrt(chopper.hstrt);
+    stepper_driver_.hend(chopper.hend);
+    stepper_driver_.chm(false);  // SpreadCycle
+
+    stepper_driver_.en_pwm_mode(chopper.stealthChopFraction > 0.0f);
+    stepper_driver_.pwm_autoscale(true);
+    stepper_driver_.pwm_autograd(true);
+
+    const bool highVelocity = chopper.highVelocityFraction > 0.0f;
+    stepper_driver_.vhighchm(highVelocity);
+    stepper_driver_.vhighfs(highVelocity);
+
+    // Out of range of the 20 bit registers, forces the thresholds to be written
+    tpwmthrs_ = UINT32_MAX;
+    thigh_    = UINT32_MAX;
+    updateChopperThresholds();
+}
+
+/**
+ * @brief Recomputes TPWMTHRS, TCOOLTHRS and THIGH from the current max speed and writes them if
+ * they changed. Cheap enough to call whenever the max speed may have changed.
+ */
+void StepperMotor::updateChopperThresholds()
+{
+    if (!begun_)
+    {
+        return;
+    }
+
+    const ChopperParams& chopper = elec_.chopper;
+    const bool stealthOnly       = chopper.stealthChopFraction >= 1.0f;
+    const bool spreadOnly        = chopper.stealthChopFraction <= 0.0f;
+
+    // StealthChop runs while TSTEP >= TPWMTHRS, 0 keeps it on at every speed
+    const uint32_t tpwmthrs =
+        stealthOnly || spreadOnly
+            ? 0
+            : tstepAt(chopper.stealthChopFraction * maxSpeed(), elec_.microsteps);
+    // The high velocity chopper takes over while TSTEP <= THIGH, 0 never
+    const uint32_t thigh =
+        chopper.highVelocityFraction > 0.0f
+            ? tstepAt(chopper.highVelocityFraction * maxSpeed(), elec_.microsteps)
+            : 0;
+    if (tpwmthrs == tpwmthrs_ && thigh == thigh_)
+    {
+        return;
+    }
+    tpwmthrs_ = tpwmthrs;
+    thigh_    = thigh;
+
+    stepper_driver_.TPWMTHRS(tpwmthrs);
+    stepper_driver_.THIGH(thigh);
+    // StallGuard and CoolStep only work in SpreadCycle, enable them exactly where it runs
+    stepper_driver_.TCOOLTHRS(spreadOnly ? TSTEP_MAX : tpwmthrs);
+    digitalWrite(cfg_.pins.cs, HIGH);
+}
+
+StepperMotor::ChopperStatus StepperMotor::chopperStatus()
+{
+    ChopperStatus status;
+    status.tstep       = stepper_driver_.TSTEP();
+    status.tpwmthrs    = tpwmthrs_;
+    status.thigh       = thigh_;
+    status.stealthChop = elec_.chopper.stealthChopFraction > 0.0f && status.tstep >= tpwmthrs_;
+    status.pwmOfsAuto  = stepper_driver_.pwm_ofs_auto();
+    status.pwmGradAuto = stepper_driver_.pwm_grad_auto();
+    digitalWrite(cfg_.pins.cs, HIGH);
+    return status;
+}
+
+/**
+ * @brief StealthChop2 automatic tuning, step AT#1: at standstill with the run current applied the
+ * driver measures the PWM offset of the motor. Step AT#2, the gradient, is learnt by pwm_autograd
+ * over the first moves below the StealthChop threshold, so nothing has to move here.
+ */
+void StepperMotor::autotuneStealthChop()
+{
+    // AT#1 has to see the run current, at the hold current it would tune for the wrong one
+    stepper_driver_.hold_multiplier(1.0f);
+    stepper_driver_.rms_current(elec_.runCurrent_mA);
+    delay(AT1_WAIT_MS);
+    writeCurrent();
+
+    char message[64];
+    snprintf(
+        message,
+        sizeof(message),
+        "%s StealthChop offset tuned to %u\n",
+        getName(),
+        static_cast<unsigned>(stepper_driver_.pwm_ofs_auto()));
+    SerialReceiverTransmitter::SafePrint(message);
+}
+
+#ifdef FAST_STEP_OUTPUT
+/**
+ * @brief Replaces AccelStepper's DRIVER mode step, which goes through digitalWrite() and a
+ * minimum pulse width busy wait per motor. The step is queued on the shared output so every axis
+ * stepping in the same pass is pulsed with one register write.
+ */
+void HOT_PATH StepperMotor::step(long step)
+{
+    if (stepOutput_ == nullptr)
+    {
+        AccelStepper::step(step);
+        return;
+    }
+    stepOutput_->queue(stepMask_, dirMask_, _direction == DIRECTION_CW);
+}
+#endif
@@ -0,0 +1,99 @@
+#include "vibration_monitor.hpp"
+
+// Just above idle, the analysis only uses time nothing else on that core wants
+static constexpr UBaseType_t VIBRATION_TASK_PRIORITY = tskIDLE_PRIORITY + 1;
+
+int VibrationMonitor::begin(const spectrum::Config& cfg, const float (&thresholds)[BANDS])
+{
+    if (monitor_.configure(cfg) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    for (uint8_t b = 0; b < BANDS; b++)
+    {
+        monitor_.setThreshold(b, thresholds[b]);
+    }
+    fullScale_ = cfg.fullScale;
+    buffer_.reset();
+
+    if (handle_ == nullptr)
+    {
+        // On the core the Arduino loop is not running on, so the control tick never waits on it
+        handle_ = xTaskCreateStaticPinnedToCore(
+            taskEntry,
+            "vibration",
+            STACK_SIZE,
+            this,
+            VIBRATION_TASK_PRIORITY,
+            stack_,
+            &taskBuffer_,
+            xPortGetCoreID() ^ 1);
+        if (handle_ == nullptr)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    active_ = true;
+    return EXIT_SUCCESS;
+}
+
+void HOT_PATH VibrationMonitor::handOver(const int16_t* window)
+{
+    if (busy_)
+    {
+        // The task is still on the last window and push() has started refilling it
+        overruns_ = overruns_ + 1;
+        return;
+    }
+    busy_    = true;
+    pending_ = window;
+    xTaskNotifyGive(handle_);
+}
+
+VibrationMonitor::Status VibrationMonitor::status()
+{
+    portENTER_CRITICAL(&lock_);
+    Status status = status_;
+    portEXIT_CRITICAL(&lock_);
+    return status;
+}
+
+uint32_t VibrationMonitor::takeEvents()
+{
+    portENTER_CRITICAL(&lock_);
+    uint32_t events = events_;
+    events_         = 0;
+    portEXIT_CRITICAL(&lock_);
+    return events;
+}
+
+void VibrationMonitor::taskEntry(void* self)
+{
+    static_cast<VibrationMonitor*>(self)->task();
+}
+
+void VibrationMonitor::task()
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        const uint32_t overruns = overruns_;
+        const uint32_t start    = micros();
+        const uint32_t rising   = monitor_.analyse(pending_);
+        const uint32_t busy     = micros() - start;
+
+        portENTER_CRITICAL(&lock_);
+        // A window overwritten while it was analysed is not published
+        if (overruns_ == overruns)
+        {
+            status_.summary = monitor_.summary();
+            events_ |= rising;
+        }
+        status_.overruns   = overruns_;
+        status_.busyMicros = busy;
+        portEXIT_CRITICAL(&lock_);
+
+        busy_ = false;
+    }
+}
@@ -0,0 +1,190 @@
+#include <unity.h>
+
+#include "adaptive_acceleration.hpp"
+
+static const AdaptiveAcceleration::Config CFG(
+    /* minAcceleration */ 1000.0f,
+    /* maxAcceleration */ 4000.0f,
+    /* targetMargin    */ 0.4f,
+    /* deadBand        */ 0.1f,
+    /* increase        */ 1.5f,
+    /* decrease        */ 0.5f,
+    /* movesToIncrease */ 2,
+    /* minSamples      */ 3,
+    /* fullSpeed       */ 1000.0f);
+
+static const float SPEED   = 500.0f;
+static const uint8_t SCALE = 31;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief Cruising readings at `free`, as at the end of the move before */
+void cruise(AdaptiveAcceleration& adapter, float free)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        adapter.sample(free, SPEED, SCALE, false);
+    }
+}
+
+/** @brief One move: accelerating readings at `loaded` after cruising readings at `free` */
+AdaptiveAcceleration::Decision move(AdaptiveAcceleration& adapter, float loaded, float free)
+{
+    cruise(adapter, free);
+    for (int i = 0; i < 5; i++)
+    {
+        adapter.sample(loaded + i, SPEED, SCALE, true);
+    }
+    return adapter.endMove();
+}
+
+void test_light_part_speeds_up_slowly()
+{
+    AdaptiveAcceleration adapter(CFG);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1000.0f, adapter.acceleration());
+
+    // Margin 0.8, only every second move may raise it
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::HELD, move(adapter, 400.0f, 500.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.8f, adapter.margin());
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::INCREASED, move(adapter, 400.0f, 500.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1500.0f, adapter.acceleration());
+
+    for (int i = 0; i < 20; i++)
+    {
+        move(adapter, 400.0f, 500.0f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 4000.0f, adapter.acceleration());
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::HELD, move(adapter, 400.0f, 500.0f));
+}
+
+void test_heavy_part_backs_off_at_once()
+{
+    AdaptiveAcceleration adapter(CFG);
+    adapter.reset(4000.0f);
+
+    // Margin 0.1
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::DECREASED, move(adapter, 50.0f, 500.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 2000.0f, adapter.acceleration());
+    move(adapter, 50.0f, 500.0f);
+    move(adapter, 50.0f, 500.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1000.0f, adapter.acceleration());
+}
+
+void test_dead_band_holds_and_resets_the_streak()
+{
+    AdaptiveAcceleration adapter(CFG);
+
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::HELD, move(adapter, 400.0f, 500.0f));
+    // Margin 0.45 sits in the dead band, the good streak starts over
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::HELD, move(adapter, 225.0f, 500.0f));
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::HELD, move(adapter, 400.0f, 500.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1000.0f, adapter.acceleration());
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::INCREASED, move(adapter, 400.0f, 500.0f));
+}
+
+void test_unsafe_move_overrides_stallguard()
+{
+    AdaptiveAcceleration adapter(CFG);
+    adapter.reset(3000.0f);
+
+    cruise(adapter, 500.0f);
+    for (int i = 0; i < 5; i++)
+    {
+        adapter.sample(480.0f, SPEED, SCALE, true);
+    }
+    adapter.flagUnsafe();
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::DECREASED, adapter.endMove());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1500.0f, adapter.acceleration());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.0f, adapter.margin());
+}
+
+void test_short_moves_are_not_judged()
+{
+    AdaptiveAcceleration adapter(CFG);
+
+    // No baseline yet
+    for (int i = 0; i < 5; i++)
+    {
+        adapter.sample(10.0f, SPEED, SCALE, true);
+    }
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::NO_DATA, adapter.endMove());
+
+    // Baseline but too few accelerating readings
+    adapter.sample(500.0f, SPEED, SCALE, false);
+    adapter.sample(10.0f, SPEED, SCALE, true);
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::NO_DATA, adapter.endMove());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1000.0f, adapter.acceleration());
+}
+
+void test_readings_are_compared_at_matched_speed_and_current()
+{
+    AdaptiveAcceleration adapter(CFG);
+    adapter.reset(3000.0f);
+    cruise(adapter, 500.0f);
+
+    // SG_RESULT is lower at low speed with no load at all, that is no margin loss
+    for (int i = 0; i < 5; i++)
+    {
+        adapter.sample(50.0f, 100.0f, SCALE, true);
+    }
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::NO_DATA, adapter.endMove());
+
+    // CoolStep lowered the current while cruising, the baseline does not hold at full current
+    for (int i = 0; i < 10; i++)
+    {
+        adapter.sample(500.0f, SPEED, 16, false);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        adapter.sample(50.0f, SPEED, SCALE, true);
+    }
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::NO_DATA, adapter.endMove());
+
+    // Same band and current scale
+    for (int i = 0; i < 5; i++)
+    {
+        adapter.sample(50.0f, SPEED, 16, true);
+    }
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::DECREASED, adapter.endMove());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.1f, adapter.margin());
+}
+
+void test_direct_margin_needs_no_baseline()
+{
+    AdaptiveAcceleration adapter(CFG);
+
+    // e.g. the encoder lag against its tolerance
+    adapter.sampleMargin(0.9f);
+    adapter.sampleMargin(0.7f);
+    adapter.sampleMargin(0.8f);
+    TEST_ASSERT_EQUAL(AdaptiveAcceleration::HELD, adapter.endMove());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.7f, adapter.margin());
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_light_part_speeds_up_slowly);
+    RUN_TEST(test_heavy_part_backs_off_at_once);
+    RUN_TEST(test_dead_band_holds_and_resets_the_streak);
+    RUN_TEST(test_unsafe_move_overrides_stallguard);
+    RUN_TEST(test_short_moves_are_not_judged);
+    RUN_TEST(test_readings_are_compared_at_matched_speed_and_current);
+    RUN_TEST(test_direct_margin_needs_no_baseline);
+
+    UNITY_END();
+}
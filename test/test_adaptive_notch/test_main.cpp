@@ -0,0 +1,134 @@
+#include <unity.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "adaptive_notch.hpp"
+
+static const float TAU = 6.28318530718f;
+static const float TS     = 1e-3f;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief Small uniform noise in [-amplitude, amplitude], deterministic between runs */
+float noise(float amplitude)
+{
+    return amplitude * (2.0f * static_cast<float>(rand()) / RAND_MAX - 1.0f);
+}
+
+/** @brief Runs `samples` of a sine at `hz` plus noise through the notch, returns output power */
+float drive(AdaptiveNotch& notch, float hz, uint32_t samples, uint32_t& n)
+{
+    float power = 0.0f;
+    for (uint32_t i = 0; i < samples; i++, n++)
+    {
+        float x = std::sin(TAU * hz * TS * n) + noise(0.05f);
+        float y = notch.filterData(x);
+        power += y * y;
+    }
+    return power / samples;
+}
+
+void test_locks_onto_a_resonance()
+{
+    srand(1);
+    AdaptiveNotch notch;
+    uint32_t n = 0;
+    drive(notch, 37.0f, 4000, n);
+
+    TEST_ASSERT_TRUE(notch.locked());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 37.0f, notch.trackedFrequency());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 37.0f, notch.notchFrequency());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, notch.depth());
+
+    // The sine carries 0.5 power, what is left should be mostly the noise
+    float residual = drive(notch, 37.0f, 1000, n);
+    TEST_ASSERT_TRUE(residual < 0.02f);
+    TEST_ASSERT_TRUE(notch.attenuation() > 10.0f);
+}
+
+void test_follows_a_shifting_resonance()
+{
+    srand(2);
+    AdaptiveNotch notch;
+    uint32_t n = 0;
+    drive(notch, 30.0f, 4000, n);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 30.0f, notch.trackedFrequency());
+
+    // A heavier part lowers the resonance
+    drive(notch, 22.0f, 4000, n);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 22.0f, notch.trackedFrequency());
+    TEST_ASSERT_TRUE(notch.locked());
+}
+
+void test_applied_notch_moves_smoothly()
+{
+    srand(3);
+    AdaptiveNotch notch;
+    uint32_t n     = 0;
+    float previous = notch.notchFrequency();
+    for (uint32_t i = 0; i < 4000; i++, n++)
+    {
+        notch.filterData(std::sin(TAU * 60.0f * TS * n));
+        // Never more than smoothing of the band per sample
+        TEST_ASSERT_TRUE(std::fabs(notch.notchFrequency() - previous) < 2.0f);
+        previous = notch.notchFrequency();
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 60.0f, notch.notchFrequency());
+}
+
+void test_noise_alone_passes_untouched()
+{
+    srand(4);
+    AdaptiveNotch notch;
+    for (uint32_t i = 0; i < 4000; i++)
+    {
+        float x = noise(1.0f);
+        float y = notch.filterData(x);
+        if (i > 3000)
+        {
+            TEST_ASSERT_FALSE(notch.locked());
+            TEST_ASSERT_FLOAT_WITHIN(0.05f, x, y);
+        }
+    }
+}
+
+void test_slow_motion_does_not_lock()
+{
+    AdaptiveNotch notch;
+    // Trapezoidal velocity profile, nothing resonant in it
+    for (uint32_t i = 0; i < 6000; i++)
+    {
+        float t = i * TS;
+        float v = t < 1.0f ? t : (t < 4.0f ? 1.0f : (t < 5.0f ? 5.0f - t : 0.0f));
+        float y = notch.filterData(v);
+        TEST_ASSERT_FLOAT_WITHIN(0.05f, v, y);
+    }
+    TEST_ASSERT_FALSE(notch.locked());
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_locks_onto_a_resonance);
+    RUN_TEST(test_follows_a_shifting_resonance);
+    RUN_TEST(test_applied_notch_moves_smoothly);
+    RUN_TEST(test_noise_alone_passes_untouched);
+    RUN_TEST(test_slow_motion_does_not_lock);
+
+    UNITY_END();
+}
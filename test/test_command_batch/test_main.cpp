@@ -0,0 +1,165 @@
+#include <unity.h>
+
+#include "command_batch.hpp"
+
+typedef batch::Queue<4, 16> Queue;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief Appends one record to a frame body of `size` bytes */
+void record(char* body, size_t& size, uint16_t seq, const char* line)
+{
+    body[size++] = static_cast<char>(seq & 0xFF);
+    body[size++] = static_cast<char>(seq >> 8);
+    strcpy(&body[size], line);
+    size += strlen(line) + 1;
+}
+
+batch::Result push(Queue& queue, uint16_t seq, const char* line)
+{
+    return queue.push(seq, line, strlen(line));
+}
+
+void test_frames_are_split_into_records()
+{
+    char body[64] = {batch::RESTART};
+    size_t size   = 1;
+    record(body, size, 0x1234, "G0 Y10");
+    record(body, size, 0x1235, "M80 Y2000");
+
+    batch::Reader reader(body, size);
+    TEST_ASSERT_TRUE(reader.restart());
+    uint16_t seq;
+    const char* line;
+    size_t length;
+    TEST_ASSERT_TRUE(reader.next(seq, line, length));
+    TEST_ASSERT_EQUAL_UINT16(0x1234, seq);
+    TEST_ASSERT_EQUAL_STRING("G0 Y10", line);
+    TEST_ASSERT_EQUAL_UINT32(6, length);
+    TEST_ASSERT_TRUE(reader.next(seq, line, length));
+    TEST_ASSERT_EQUAL_UINT16(0x1235, seq);
+    TEST_ASSERT_FALSE(reader.next(seq, line, length));
+    TEST_ASSERT_FALSE(reader.truncated());
+
+    // Cut in the middle of the last record
+    batch::Reader cut(body, size - 3);
+    TEST_ASSERT_TRUE(cut.next(seq, line, length));
+    TEST_ASSERT_FALSE(cut.next(seq, line, length));
+    TEST_ASSERT_TRUE(cut.truncated());
+}
+
+void test_commands_come_out_in_order_across_the_wrap()
+{
+    Queue queue;
+    uint16_t seq = 0;
+    // Numbers wrap past 0xFFFF
+    queue.restart(0xFFFE);
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0xFFFE, "G0 Y1"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0xFFFF, "G0 Y2"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0x0000, "G0 Y3"));
+    TEST_ASSERT_EQUAL_UINT8(3, queue.size());
+
+    TEST_ASSERT_EQUAL_STRING("G0 Y1", queue.front(seq));
+    TEST_ASSERT_EQUAL_UINT16(0xFFFE, seq);
+    queue.pop();
+    queue.pop();
+    // The ring wraps too
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0x0001, "G0 Y4"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0x0002, "G0 Y5"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0x0003, "G0 Y6"));
+    TEST_ASSERT_EQUAL(batch::FULL, push(queue, 0x0004, "G0 Y7"));
+    TEST_ASSERT_EQUAL_UINT16(0x0004, queue.expected());
+
+    const char* expected[] = {"G0 Y3", "G0 Y4", "G0 Y5", "G0 Y6"};
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_STRING(expected[i], queue.front(seq));
+        TEST_ASSERT_EQUAL_UINT16(i, seq);
+        queue.pop();
+    }
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_resends_are_dropped_and_gaps_refused()
+{
+    Queue queue;
+    push(queue, 0, "G0 Y1");
+    push(queue, 1, "G0 Y2");
+
+    // The host resends from the last ack after a glitch, the device takes up where it was
+    TEST_ASSERT_EQUAL(batch::DUPLICATE, push(queue, 0, "G0 Y1"));
+    TEST_ASSERT_EQUAL(batch::DUPLICATE, push(queue, 1, "G0 Y2"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 2, "G0 Y3"));
+
+    // A lost record leaves a gap, nothing past it is taken until it is resent
+    TEST_ASSERT_EQUAL(batch::GAP, push(queue, 4, "G0 Y5"));
+    TEST_ASSERT_EQUAL_UINT8(3, queue.size());
+    TEST_ASSERT_EQUAL_UINT16(3, queue.expected());
+
+    // A restart starts over at 0
+    queue.restart();
+    TEST_ASSERT_TRUE(queue.empty());
+    TEST_ASSERT_EQUAL(batch::GAP, push(queue, 3, "G0 Y0"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 0, "G0 Y0"));
+}
+
+void test_bad_lines_keep_their_number()
+{
+    Queue queue;
+    TEST_ASSERT_EQUAL(batch::MALFORMED, push(queue, 0, "hello"));
+    TEST_ASSERT_EQUAL(batch::TOO_LONG, push(queue, 1, "G0 Y1 A2 C3 B0 Y4 A5"));
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, push(queue, 2, "G4 P10"));
+
+    // Queued empty so the cumulative ack can pass them
+    uint16_t seq;
+    TEST_ASSERT_EQUAL_STRING("", queue.front(seq));
+    TEST_ASSERT_EQUAL_UINT16(0, seq);
+    queue.pop();
+    TEST_ASSERT_EQUAL_STRING("", queue.front(seq));
+    queue.pop();
+    TEST_ASSERT_EQUAL_STRING("G4 P10", queue.front(seq));
+}
+
+void test_lines_stay_in_their_frame()
+{
+    Queue queue;
+    char frame[] = "G0 Y1";
+    TEST_ASSERT_EQUAL(batch::ACCEPTED, queue.push(0, frame, strlen(frame), 7));
+    TEST_ASSERT_EQUAL(batch::MALFORMED, queue.push(1, "hello", 5, 8));
+
+    // Not copied, the owner keeps the line for the queue
+    uint16_t seq;
+    uint32_t owner;
+    TEST_ASSERT_EQUAL_PTR(frame, queue.front(seq));
+    TEST_ASSERT_TRUE(queue.frontOwner(owner));
+    TEST_ASSERT_EQUAL_UINT32(7, owner);
+    queue.pop();
+    // A refused line holds nothing
+    TEST_ASSERT_FALSE(queue.frontOwner(owner));
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_frames_are_split_into_records);
+    RUN_TEST(test_commands_come_out_in_order_across_the_wrap);
+    RUN_TEST(test_resends_are_dropped_and_gaps_refused);
+    RUN_TEST(test_bad_lines_keep_their_number);
+    RUN_TEST(test_lines_stay_in_their_frame);
+
+    UNITY_END();
+}
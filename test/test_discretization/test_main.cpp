@@ -0,0 +1,248 @@
+#include <unity.h>
+
+#include <cmath>
+
+#include "discretization.hpp"
+
+using namespace filter;
+
+static const float PI_F = 3.14159265359f;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief Asserts `actual` within `relative` of `expected`, or of 1 when expected is small */
+void assertClose(float expected, float actual, float relative)
+{
+    TEST_ASSERT_FLOAT_WITHIN(relative * std::fmax(1.0f, std::fabs(expected)), expected, actual);
+}
+
+template <uint8_t SIZE>
+void assertCoefficients(const Coefficients<SIZE>& expected, const Coefficients<SIZE>& actual)
+{
+    for (uint8_t i = 0; i < SIZE; i++)
+    {
+        assertClose(expected.naturalResponseCoefficients[i],
+                    actual.naturalResponseCoefficients[i],
+                    1e-4f);
+        assertClose(expected.forcedResponseCoefficients[i],
+                    actual.forcedResponseCoefficients[i],
+                    1e-4f);
+    }
+}
+
+void test_tustin_matches_the_hand_derived_pid()
+{
+    const float kp = 2.0f, ki = 50.0f, kd = 0.01f, ts = 1e-3f;
+    // The algebra of controller::PIDControllerCoefficients, which had the sign of ki in b2 wrong
+    Coefficients<3> expected;
+    expected.naturalResponseCoefficients = {1.0f, 0.0f, -1.0f};
+    expected.forcedResponseCoefficients  = {kp + ki * ts / 2.0f + 2.0f * kd / ts,
+                                            ki * ts - 4.0f * kd / ts,
+                                            -kp + ki * ts / 2.0f + 2.0f * kd / ts};
+
+    assertCoefficients(expected, toCoefficients(discretize(tf<2>({kd, kp, ki}, {0, 1, 0}), ts)));
+}
+
+void test_tustin_matches_the_hand_derived_lag_lead()
+{
+    const float k = 3.0f, z = 10.0f, p = 100.0f, ts = 1e-3f;
+    // The algebra of controller::PhaseLagLeadCoefficients
+    Coefficients<2> expected;
+    expected.naturalResponseCoefficients = {1.0f, (p * ts - 2.0f) / (p * ts + 2.0f)};
+    expected.forcedResponseCoefficients  = {k * (z * ts + 2.0f) / (p * ts + 2.0f),
+                                            k * (z * ts - 2.0f) / (p * ts + 2.0f)};
+
+    assertCoefficients(expected, toCoefficients(discretize(tf<1>({k, k * z}, {1, p}), ts)));
+    assertCoefficients(expected, toCoefficients(discretize(zpk<1>({-z}, {-p}, k), ts)));
+}
+
+void test_prewarped_tustin_matches_butterworth()
+{
+    const float wc = 2.0f * PI_F * 150.0f, ts = 1e-3f;
+    const Complex pole(-wc * std::sqrt(0.5f), wc * std::sqrt(0.5f));
+    const ZeroPoleGain<2> analog = zpk<2>({}, {pole, Complex(pole.re, -pole.im)}, wc * wc);
+
+    const ZeroPoleGain<2> digital = discretize(analog, ts, TUSTIN, wc);
+    assertCoefficients(butterworth<2, LOWPASS>(wc, ts), toCoefficients(digital));
+
+    // Prewarping makes the response exact at wc, not only close
+    const Complex a = frequencyResponse(analog, wc);
+    const Complex d = frequencyResponse(digital, wc);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, a.re, d.re);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, a.im, d.im);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, std::sqrt(0.5f), complexAbs(d));
+
+    // Without it the bilinear warping moves the -3 dB point
+    const Complex plain = frequencyResponse(discretize(analog, ts), wc);
+    TEST_ASSERT_TRUE(std::fabs(complexAbs(plain) - std::sqrt(0.5f)) > 0.01f);
+}
+
+void test_zoh_of_known_plants()
+{
+    const float ts = 0.01f;
+
+    // a / (s + a) holds exactly to (1 - e^-aT) z^-1 / (1 - e^-aT z^-1)
+    const float a = 20.0f, e = std::exp(-a * ts);
+    Coefficients<2> lag;
+    lag.naturalResponseCoefficients = {1.0f, -e};
+    lag.forcedResponseCoefficients  = {0.0f, 1.0f - e};
+    assertCoefficients(lag, toCoefficients(discretize(zpk<1>({}, {-a}, a), ts, ZOH)));
+
+    // 1 / s^2 to T^2 / 2 (z^-1 + z^-2) / (1 - z^-1)^2
+    Coefficients<3> integrator;
+    integrator.naturalResponseCoefficients = {1.0f, -2.0f, 1.0f};
+    integrator.forcedResponseCoefficients  = {0.0f, ts * ts / 2.0f, ts * ts / 2.0f};
+    const Coefficients<3> d = toCoefficients(discretize(tf<2>({0, 0, 1}, {1, 0, 0}), ts, ZOH));
+    assertCoefficients(integrator, d);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9f, integrator.forcedResponseCoefficients[1],
+                             d.forcedResponseCoefficients[1]);
+}
+
+void test_zoh_step_response_is_exact_at_the_samples()
+{
+    const float wn = 2.0f * PI_F * 5.0f, zeta = 0.2f, ts = 2e-3f;
+    const ZeroPoleGain<2> plant = tf<2>({0, 0, wn * wn}, {1, 2 * zeta * wn, wn * wn});
+    DiscreteFilter<3> filter(toCoefficients(discretize(plant, ts, ZOH)));
+
+    const float wd = wn * std::sqrt(1 - zeta * zeta);
+    for (int n = 0; n < 500; n++)
+    {
+        const float t     = n * ts;
+        const float exact = 1.0f - std::exp(-zeta * wn * t) *
+                                       (std::cos(wd * t) +
+                                        zeta / std::sqrt(1 - zeta * zeta) * std::sin(wd * t));
+        TEST_ASSERT_FLOAT_WITHIN(2e-3f, exact, filter.filterData(1.0f));
+    }
+}
+
+void test_matched_maps_poles_and_keeps_the_gain()
+{
+    const float a = 20.0f, ts = 1e-3f, e = std::exp(-a * ts);
+    const ZeroPoleGain<1> lag = discretize(zpk<1>({}, {-a}, a), ts, MATCHED);
+    TEST_ASSERT_EQUAL_UINT8(1, lag.poleCount);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, e, lag.poles[0].re);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, -1.0f, lag.zeros[0].re);  // the zero at infinity
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 1.0f, frequencyResponse(lag, 0).re);
+
+    // A pole at the origin has no DC gain to match, the magnitude is matched at w instead
+    const float w                    = 100.0f;
+    const ZeroPoleGain<1> integrator = discretize(zpk<1>({}, {0.0f}, 1.0f), ts, MATCHED, w);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 1.0f, integrator.poles[0].re);
+    assertClose(std::tan(w * ts / 2) / w, integrator.gain, 1e-4f);
+    assertClose(1.0f / w, complexAbs(frequencyResponse(integrator, w)), 1e-4f);
+}
+
+void test_sections_match_the_direct_form()
+{
+    const float ts = 1e-3f;
+    const ZeroPoleGain<4> analog = zpk<4>(
+        {Complex(0, 300), Complex(0, -300), -50.0f},
+        {Complex(-20, 100), Complex(-20, -100), Complex(-60, 400), Complex(-60, -400)},
+        4000.0f);
+    const ZeroPoleGain<4> digital = discretize(analog, ts);
+
+    const Coefficients<5> direct                  = toCoefficients(digital);
+    const std::array<Coefficients<3>, 2> sections = toSos(digital);
+    for (float w = 10.0f; w < PI_F / ts; w *= 1.7f)
+    {
+        const Complex d = frequencyResponse(direct, w, ts);
+        const Complex s = frequencyResponse(sections, w, ts);
+        assertClose(complexAbs(d), complexAbs(s), 1e-3f);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, std::atan2(d.im, d.re), std::atan2(s.im, s.re));
+    }
+
+    // Conjugate pairs stay together, every section is real and second order
+    for (const Coefficients<3>& section : sections)
+    {
+        TEST_ASSERT_TRUE(section.naturalResponseCoefficients[2] > 0.0f);
+        TEST_ASSERT_TRUE(isStable(section));
+    }
+    // The pair nearest the unit circle is the last section
+    TEST_ASSERT_TRUE(sections[1].naturalResponseCoefficients[2] >
+                     sections[0].naturalResponseCoefficients[2]);
+
+    // The impulse response through the sections in series
+    DiscreteFilter<5> one(direct);
+    DiscreteFilter<3> first(sections[0]);
+    DiscreteFilter<3> second(sections[1]);
+    for (int n = 0; n < 300; n++)
+    {
+        const float x = n == 0 ? 1.0f : 0.0f;
+        const float y = one.filterData(x);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f * 4000.0f * ts, y, second.filterData(first.filterData(x)));
+    }
+}
+
+void test_stability_checks()
+{
+    Coefficients<3> coefficients;
+    coefficients.forcedResponseCoefficients = {1.0f, 0.0f, 0.0f};
+
+    // Poles at 2 and 0.5
+    coefficients.naturalResponseCoefficients = {1.0f, -2.5f, 1.0f};
+    TEST_ASSERT_FALSE(isStable(coefficients));
+
+    // A double pole at 0.9, stable, but not with a margin to 0.85
+    coefficients.naturalResponseCoefficients = {1.0f, -1.8f, 0.81f};
+    TEST_ASSERT_TRUE(isStable(coefficients));
+    TEST_ASSERT_TRUE(isStable(coefficients, 0.95f));
+    TEST_ASSERT_FALSE(isStable(coefficients, 0.85f));
+
+    // Poles at the origin do not count against it
+    coefficients.naturalResponseCoefficients = {1.0f, -0.5f, 0.0f};
+    TEST_ASSERT_TRUE(isStable(coefficients));
+
+    // An unstable plant stays unstable under every method, in either form
+    const ZeroPoleGain<2> unstable = zpk<2>({}, {1.0f, -5.0f}, 1.0f);
+    TEST_ASSERT_FALSE(isStable(unstable));
+    TEST_ASSERT_TRUE(isStable(zpk<2>({}, {-1.0f, -5.0f}, 1.0f)));
+    for (Method method : {TUSTIN, ZOH, MATCHED})
+    {
+        const ZeroPoleGain<2> d = discretize(unstable, 1e-2f, method);
+        TEST_ASSERT_FALSE(isStable(d));
+        TEST_ASSERT_FALSE(isStable(toCoefficients(d)));
+        TEST_ASSERT_FALSE(isStable(toSos(d)));
+    }
+}
+
+void test_invalid_designs()
+{
+    // ZOH and matched-Z need a proper H
+    TEST_ASSERT_FALSE(discretize(tf<2>({1, 1, 1}, {0, 1, 0}), 1e-3f, ZOH).valid());
+    TEST_ASSERT_FALSE(discretize(tf<2>({1, 1, 1}, {0, 1, 0}), 1e-3f, MATCHED).valid());
+    // Prewarping at or past Nyquist
+    TEST_ASSERT_FALSE(discretize(zpk<1>({}, {-1.0f}, 1.0f), 1e-3f, TUSTIN, 4000.0f).valid());
+    TEST_ASSERT_FALSE(discretize(zpk<1>({}, {-1.0f}, 1.0f), 0.0f).valid());
+    TEST_ASSERT_FALSE(zpk<1>({}, {-1.0f, -2.0f}, 1.0f).valid());
+    TEST_ASSERT_FALSE(isStable(discretize(zpk<1>({}, {-1.0f}, 1.0f), 0.0f)));
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_tustin_matches_the_hand_derived_pid);
+    RUN_TEST(test_tustin_matches_the_hand_derived_lag_lead);
+    RUN_TEST(test_prewarped_tustin_matches_butterworth);
+    RUN_TEST(test_zoh_of_known_plants);
+    RUN_TEST(test_zoh_step_response_is_exact_at_the_samples);
+    RUN_TEST(test_matched_maps_poles_and_keeps_the_gain);
+    RUN_TEST(test_sections_match_the_direct_form);
+    RUN_TEST(test_stability_checks);
+    RUN_TEST(test_invalid_designs);
+
+    UNITY_END();
+}
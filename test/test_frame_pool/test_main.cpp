@@ -0,0 +1,273 @@
+#include <unity.h>
+
+#include <vector>
+
+#include "frame_pool.hpp"
+
+static constexpr uint8_t COMMAND = 1;  // SerialReceiverTransmitter::MessageType
+static constexpr uint8_t BATCH   = 3;
+static constexpr uint8_t PING    = 4;
+
+/**
+ * Fake transport, the stream arrives in the chunks it is given. available() only counts what
+ * has arrived, like the UART driver's ring buffer between two idle line events.
+ */
+struct FakeTransport
+{
+    std::vector<uint8_t> stream;
+    size_t arrived = 0;
+    size_t read_   = 0;
+    int reads      = 0;
+
+    void arrive(size_t size) { arrived = std::min(stream.size(), arrived + size); }
+
+    int available() { return static_cast<int>(arrived - read_); }
+
+    size_t read(uint8_t* buffer, size_t size)
+    {
+        reads++;
+        const size_t n = std::min(size, arrived - read_);
+        memcpy(buffer, &stream[read_], n);
+        read_ += n;
+        return n;
+    }
+};
+
+void header(std::vector<uint8_t>& stream, uint8_t type, uint32_t length)
+{
+    stream.push_back(frames::SENTINEL);
+    stream.push_back(type);
+    for (int i = 0; i < 4; i++)
+    {
+        stream.push_back(static_cast<uint8_t>(length >> (8 * i)));
+    }
+}
+
+void frame(std::vector<uint8_t>& stream, uint8_t type, const char* body, uint32_t length)
+{
+    header(stream, type, length);
+    stream.insert(stream.end(), body, body + length);
+}
+
+void frame(std::vector<uint8_t>& stream, uint8_t type, const char* text)
+{
+    frame(stream, type, text, strlen(text) + 1);
+}
+
+alignas(8) static uint8_t storage[512];
+
+void setUp(void)
+{
+    memset(storage, 0xEE, sizeof(storage));  // stale bytes, nothing may rely on zeroes
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+void test_frames_come_out_whole_whatever_the_chunks()
+{
+    for (size_t chunk = 1; chunk <= 23; chunk++)
+    {
+        frames::Pool pool(storage, sizeof(storage));
+        frames::Assembler assembler(pool, 128, BATCH, 0);
+        FakeTransport link;
+        const uint8_t noise[] = {0x00, 0x13, 0x37};
+        link.stream.insert(link.stream.end(), noise, noise + sizeof(noise));
+        frame(link.stream, COMMAND, "G0 Y10 A0.5");
+        frame(link.stream, PING, "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+        frame(link.stream, COMMAND, "M500");
+
+        std::vector<frames::Frame> taken;
+        for (int64_t now = 0; link.arrived < link.stream.size(); now++)
+        {
+            link.arrive(chunk);
+            frames::drain(link, assembler, now * 1000);
+            frames::Frame next;
+            while (pool.take(next))
+            {
+                taken.push_back(next);
+            }
+        }
+
+        TEST_ASSERT_EQUAL_UINT32(3, taken.size());
+        TEST_ASSERT_EQUAL_UINT8(COMMAND, taken[0].type);
+        TEST_ASSERT_EQUAL_STRING("G0 Y10 A0.5", taken[0].body);
+        TEST_ASSERT_EQUAL_UINT8(PING, taken[1].type);
+        TEST_ASSERT_EQUAL_UINT32(8, taken[1].length);
+        TEST_ASSERT_EQUAL_MEMORY("\x01\x02\x03\x04\x05\x06\x07\x08", taken[1].body, 8);
+        TEST_ASSERT_EQUAL_STRING("M500", taken[2].body);
+        // Stamped with the chunk the sentinel came in
+        TEST_ASSERT_EQUAL_INT32(static_cast<int32_t>((sizeof(noise) / chunk) * 1000),
+                                static_cast<int32_t>(taken[0].startUs));
+        for (size_t i = 0; i < taken.size(); i++)
+        {
+            // Parsed where it landed, in the pool
+            TEST_ASSERT_TRUE(reinterpret_cast<uint8_t*>(taken[i].body) >= storage);
+            TEST_ASSERT_TRUE(reinterpret_cast<uint8_t*>(taken[i].body) < storage + sizeof(storage));
+            pool.release(taken[i].handle);
+        }
+        TEST_ASSERT_EQUAL_UINT32(sizeof(storage), pool.free());
+    }
+}
+
+void test_bodies_are_read_in_one_piece()
+{
+    frames::Pool pool(storage, sizeof(storage));
+    frames::Assembler assembler(pool, 256, BATCH, 0);
+    FakeTransport link;
+    char body[200];
+    memset(body, 'x', sizeof(body));
+    frame(link.stream, BATCH, body, sizeof(body));
+
+    link.arrive(link.stream.size());
+    frames::drain(link, assembler, 0);
+    // The sentinel and the header, then the whole body straight into its block
+    TEST_ASSERT_EQUAL_INT(2, link.reads);
+    frames::Frame taken;
+    TEST_ASSERT_TRUE(pool.take(taken));
+    TEST_ASSERT_EQUAL_UINT32(sizeof(body), taken.length);
+    TEST_ASSERT_EQUAL_INT(0, taken.body[sizeof(body)]);
+}
+
+void test_the_stream_resyncs_after_a_bad_header()
+{
+    frames::Pool pool(storage, sizeof(storage));
+    frames::Assembler assembler(pool, 64, BATCH, 0);
+    FakeTransport link;
+    // Too long to be one of ours, the search starts over after its sentinel
+    header(link.stream, COMMAND, 1000);
+    frame(link.stream, COMMAND, "G4 P1");
+
+    link.arrive(link.stream.size());
+    frames::drain(link, assembler, 0);
+    frames::Frame taken;
+    TEST_ASSERT_TRUE(pool.take(taken));
+    TEST_ASSERT_EQUAL_STRING("G4 P1", taken.body);
+    TEST_ASSERT_FALSE(pool.take(taken));
+    TEST_ASSERT_EQUAL_UINT32(0, assembler.dropped());
+
+    // A reset drops the frame in progress
+    FakeTransport cut;
+    frame(cut.stream, COMMAND, "G0 Y1");
+    cut.arrive(8);
+    frames::drain(cut, assembler, 0);
+    assembler.reset();
+    FakeTransport next;
+    frame(next.stream, COMMAND, "G0 Y2");
+    next.arrive(next.stream.size());
+    frames::drain(next, assembler, 0);
+    TEST_ASSERT_TRUE(pool.take(taken));
+    TEST_ASSERT_EQUAL_STRING("G0 Y2", taken.body);
+}
+
+void test_blocks_are_reused_around_the_ring()
+{
+    frames::Pool pool(storage, sizeof(storage));
+    frames::Assembler assembler(pool, 256, BATCH, 0);
+    char text[96];
+    for (int i = 0; i < 200; i++)
+    {
+        // Lengths that leave every kind of remainder at the end of the ring
+        const int length = 1 + (i * 37) % 90;
+        memset(text, 'a' + i % 26, length);
+        text[length] = '\0';
+        FakeTransport link;
+        frame(link.stream, COMMAND, text);
+        link.arrive(link.stream.size());
+        frames::drain(link, assembler, i);
+
+        frames::Frame taken;
+        TEST_ASSERT_TRUE(pool.take(taken));
+        TEST_ASSERT_EQUAL_STRING(text, taken.body);
+        TEST_ASSERT_EQUAL_INT32(i, static_cast<int32_t>(taken.startUs));
+        pool.release(taken.handle);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, assembler.dropped());
+    TEST_ASSERT_EQUAL_UINT32(sizeof(storage), pool.free());
+}
+
+void test_a_held_frame_keeps_its_place()
+{
+    frames::Pool pool(storage, sizeof(storage));
+    frames::Assembler assembler(pool, 256, BATCH, 96);
+    char lines[64];
+    memset(lines, 'G', sizeof(lines) - 1);
+    lines[sizeof(lines) - 1] = '\0';
+
+    // The first batch stays held, by a queued command say, while the ones after are handled
+    FakeTransport link;
+    for (int i = 0; i < 10; i++)
+    {
+        frame(link.stream, BATCH, lines);
+    }
+    link.arrive(link.stream.size());
+    frames::drain(link, assembler, 0);
+    frames::Frame held;
+    TEST_ASSERT_TRUE(pool.take(held));
+    pool.retain(held.handle);
+    pool.release(held.handle);
+
+    // 96 byte blocks, a fifth would eat into the reserve
+    frames::Frame taken;
+    int batches = 1;
+    while (pool.take(taken))
+    {
+        TEST_ASSERT_EQUAL_STRING(lines, taken.body);
+        batches++;
+        pool.release(taken.handle);
+    }
+    TEST_ASSERT_EQUAL_INT(4, batches);
+    TEST_ASSERT_EQUAL_UINT32(6, assembler.droppedBulk());
+
+    // Released out of order the space after the held one isn't reused until it goes, only what
+    // is left in front of it
+    FakeTransport more;
+    for (int i = 0; i < 4; i++)
+    {
+        frame(more.stream, BATCH, lines);
+    }
+    frame(more.stream, PING, "\0\0\0\0\0\0\0\0", 8);
+    more.arrive(more.stream.size());
+    frames::drain(more, assembler, 0);
+    batches = 0;
+    bool pinged = false;
+    while (pool.take(taken))
+    {
+        batches += taken.type == BATCH;
+        pinged = pinged || taken.type == PING;
+        pool.release(taken.handle);
+    }
+    TEST_ASSERT_EQUAL_INT(0, batches);
+    TEST_ASSERT_EQUAL_UINT32(10, assembler.droppedBulk());
+    TEST_ASSERT_TRUE(pinged);  // the reserve is there for it
+    TEST_ASSERT_EQUAL_STRING(lines, held.body);
+
+    pool.release(held.handle);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(storage), pool.free());
+    FakeTransport again;
+    frame(again.stream, BATCH, lines);
+    again.arrive(again.stream.size());
+    frames::drain(again, assembler, 0);
+    TEST_ASSERT_TRUE(pool.take(taken));
+    TEST_ASSERT_EQUAL_STRING(lines, taken.body);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_frames_come_out_whole_whatever_the_chunks);
+    RUN_TEST(test_bodies_are_read_in_one_piece);
+    RUN_TEST(test_the_stream_resyncs_after_a_bad_header);
+    RUN_TEST(test_blocks_are_reused_around_the_ring);
+    RUN_TEST(test_a_held_frame_keeps_its_place);
+
+    UNITY_END();
+}
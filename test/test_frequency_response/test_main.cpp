@@ -0,0 +1,194 @@
+#include <unity.h>
+
+#include <cmath>
+
+#include "frequency_response.hpp"
+
+using namespace identification;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+Config chirpConfig()
+{
+    Config cfg;
+    cfg.mode      = CHIRP;
+    cfg.amplitude = 0.5f;
+    cfg.fStart    = 1.0f;
+    cfg.fEnd      = 200.0f;
+    cfg.duration  = 5.0f;
+    cfg.Ts        = 1e-3f;
+    return cfg;
+}
+
+void test_invalid_configs_are_rejected()
+{
+    Perturbation perturbation;
+
+    Config aboveNyquist = chirpConfig();
+    aboveNyquist.fEnd   = 450.0f;
+    TEST_ASSERT_EQUAL(EXIT_FAILURE, perturbation.start(aboveNyquist));
+
+    Config noAmplitude    = chirpConfig();
+    noAmplitude.amplitude = 0.0f;
+    TEST_ASSERT_EQUAL(EXIT_FAILURE, perturbation.start(noAmplitude));
+
+    Config tooShort   = chirpConfig();
+    tooShort.duration = 0.5f;  // not a single period of 1 Hz
+    TEST_ASSERT_EQUAL(EXIT_FAILURE, perturbation.start(tooShort));
+
+    Config noSteps = chirpConfig();
+    noSteps.mode   = STEPPED_SINE;
+    noSteps.steps  = 0;
+    TEST_ASSERT_EQUAL(EXIT_FAILURE, perturbation.start(noSteps));
+
+    TEST_ASSERT_FALSE(perturbation.active());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, perturbation.next());
+}
+
+void test_chirp_sweeps_from_start_to_end()
+{
+    Perturbation perturbation;
+    TEST_ASSERT_EQUAL(EXIT_SUCCESS, perturbation.start(chirpConfig()));
+    TEST_ASSERT_EQUAL_UINT32(5000, perturbation.totalSamples());
+
+    float peak          = 0.0f;
+    float lastFrequency = 0.0f;
+    uint32_t samples    = 0;
+    while (true)
+    {
+        float value = perturbation.next();
+        if (!perturbation.active())
+        {
+            break;
+        }
+        if (samples == 0)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, perturbation.frequency());
+        }
+        TEST_ASSERT_TRUE(perturbation.frequency() >= lastFrequency);
+        lastFrequency = perturbation.frequency();
+        peak          = std::fmax(peak, std::fabs(value));
+        samples++;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(5000, samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 200.0f, lastFrequency);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.5f, peak);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, perturbation.next());
+}
+
+void test_stepped_sine_holds_log_spaced_tones()
+{
+    Config cfg   = chirpConfig();
+    cfg.mode     = STEPPED_SINE;
+    cfg.fStart   = 1.0f;
+    cfg.fEnd     = 100.0f;
+    cfg.duration = 3.0f;
+    cfg.steps    = 3;
+
+    Perturbation perturbation;
+    TEST_ASSERT_EQUAL(EXIT_SUCCESS, perturbation.start(cfg));
+
+    // 1 s per tone, 1 Hz, 10 Hz, 100 Hz
+    const float expected[] = {1.0f, 10.0f, 100.0f};
+    for (uint32_t i = 0; i < 3000; i++)
+    {
+        perturbation.next();
+        TEST_ASSERT_FLOAT_WITHIN(expected[i / 1000] * 1e-4f, expected[i / 1000],
+                                 perturbation.frequency());
+    }
+    perturbation.next();
+    TEST_ASSERT_FALSE(perturbation.active());
+}
+
+void test_phase_is_continuous_across_steps()
+{
+    Config cfg   = chirpConfig();
+    cfg.mode     = STEPPED_SINE;
+    cfg.fStart   = 5.0f;
+    cfg.fEnd     = 50.0f;
+    cfg.duration = 2.0f;
+    cfg.steps    = 2;
+
+    Perturbation perturbation;
+    perturbation.start(cfg);
+
+    // No sample to sample jump may exceed what the highest tone produces
+    const float maxStep = cfg.amplitude * 2.0f * 3.14159265f * cfg.fEnd * cfg.Ts * 1.01f;
+    float last          = perturbation.next();
+    while (true)
+    {
+        float value = perturbation.next();
+        if (!perturbation.active())
+        {
+            break;
+        }
+        TEST_ASSERT_TRUE(std::fabs(value - last) <= maxStep);
+        last = value;
+    }
+}
+
+void test_stop_aborts_the_run()
+{
+    Perturbation perturbation;
+    perturbation.start(chirpConfig());
+    perturbation.next();
+    perturbation.next();
+    perturbation.stop();
+
+    TEST_ASSERT_FALSE(perturbation.active());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, perturbation.next());
+}
+
+void test_sample_ring_is_fifo_and_counts_drops()
+{
+    SampleRing<4> ring;
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        Sample sample = {i, 1.0f, 0.0f, 0.0f};
+        ring.push(sample);
+    }
+    TEST_ASSERT_EQUAL_UINT16(4, ring.size());
+    TEST_ASSERT_EQUAL_UINT32(2, ring.dropped());
+
+    Sample out;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(ring.pop(out));
+        TEST_ASSERT_EQUAL_UINT32(i, out.index);
+    }
+    TEST_ASSERT_FALSE(ring.pop(out));
+
+    // wraps around the end of the buffer
+    Sample sample = {7, 1.0f, 0.0f, 0.0f};
+    ring.push(sample);
+    TEST_ASSERT_TRUE(ring.pop(out));
+    TEST_ASSERT_EQUAL_UINT32(7, out.index);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_invalid_configs_are_rejected);
+    RUN_TEST(test_chirp_sweeps_from_start_to_end);
+    RUN_TEST(test_stepped_sine_holds_log_spaced_tones);
+    RUN_TEST(test_phase_is_continuous_across_steps);
+    RUN_TEST(test_stop_aborts_the_run);
+    RUN_TEST(test_sample_ring_is_fifo_and_counts_drops);
+
+    UNITY_END();
+}
@@ -0,0 +1,218 @@
+#include <unity.h>
+
+#include <cmath>
+
+#include "input_shaper.hpp"
+
+using namespace shaping;
+
+static const float TS = 1e-3f;
+// Planned move of one unit, 50 ms ramps, about half a period of the 10 Hz part
+static const float MOVE_SPEED        = 5.0f;
+static const float MOVE_ACCELERATION = 100.0f;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/**
+ * @brief Feeds a unit step through the shaper into a damped oscillator (the part on the jaw) and
+ * returns the peak deviation from 1 once the shaped reference has settled. With `planned` the
+ * step is planned as a Trajectory first, the way the jaw axes move it.
+ */
+float residualVibration(const Params& params, float plantHz, float plantZeta, bool planned = false)
+{
+    InputShaper<512> shaper;
+    shaper.configure(params, TS);
+    Trajectory trajectory;
+    uint32_t arrived = 0;
+
+    const float w = 2.0f * 3.14159265f * plantHz;
+    float x       = 0.0f;
+    float v       = 0.0f;
+    float peak    = 0.0f;
+    for (uint32_t n = 0; n < 3000; n++)
+    {
+        float target = 1.0f;
+        if (planned)
+        {
+            target  = trajectory.next(1.0f, MOVE_SPEED, MOVE_ACCELERATION, TS);
+            arrived = target < 1.0f ? n + 1 : arrived;
+        }
+        const float r = shaper.shape(target);
+        // semi implicit Euler, 10 sub steps per tick
+        for (int k = 0; k < 10; k++)
+        {
+            const float a = w * w * (r - x) - 2.0f * plantZeta * w * v;
+            v += a * TS / 10;
+            x += v * TS / 10;
+        }
+        if (n > arrived && (n - arrived) * TS > shaper.duration() + 0.01f)
+        {
+            peak = std::fmax(peak, std::fabs(x - 1.0f));
+        }
+    }
+    return peak;
+}
+
+void test_impulses_sum_to_one()
+{
+    const Type types[] = {ZV, ZVD, EI};
+    for (Type type : types)
+    {
+        Impulses impulses = design(Params(type, 12.0f, 0.1f));
+        float sum         = 0.0f;
+        for (uint8_t i = 0; i < impulses.count; i++)
+        {
+            sum += impulses.amplitude[i];
+        }
+        TEST_ASSERT_FLOAT_WITHIN(1e-5f, 1.0f, sum);
+    }
+
+    Impulses zv = design(Params(ZV, 10.0f, 0.0f));
+    TEST_ASSERT_EQUAL_UINT8(2, zv.count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.5f, zv.amplitude[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.05f, zv.time[1]);
+}
+
+void test_none_is_a_pure_delay()
+{
+    InputShaper<64> shaper;
+    TEST_ASSERT_EQUAL(EXIT_SUCCESS, shaper.configure(Params(), TS, 0.01f));
+    for (int n = 0; n < 10; n++)
+    {
+        TEST_ASSERT_EQUAL_FLOAT(0.0f, shaper.shape(1.0f));
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, shaper.shape(1.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.01f, shaper.duration());
+}
+
+void test_shapers_cancel_the_resonance()
+{
+    const float unshaped = residualVibration(Params(), 10.0f, 0.05f);
+    TEST_ASSERT_TRUE(unshaped > 0.3f);
+
+    TEST_ASSERT_TRUE(residualVibration(Params(ZV, 10.0f, 0.05f), 10.0f, 0.05f) < 0.05f * unshaped);
+    TEST_ASSERT_TRUE(residualVibration(Params(ZVD, 10.0f, 0.05f), 10.0f, 0.05f) < 0.05f * unshaped);
+    // EI leaves `tolerance` on purpose
+    TEST_ASSERT_TRUE(residualVibration(Params(EI, 10.0f, 0.05f), 10.0f, 0.05f) < 0.08f * unshaped);
+}
+
+void test_zvd_and_ei_tolerate_frequency_error()
+{
+    const float unshaped = residualVibration(Params(), 11.5f, 0.05f);
+
+    // Design 15 % off the real resonance
+    float zv  = residualVibration(Params(ZV, 10.0f, 0.05f), 11.5f, 0.05f);
+    float zvd = residualVibration(Params(ZVD, 10.0f, 0.05f), 11.5f, 0.05f);
+    float ei  = residualVibration(Params(EI, 10.0f, 0.05f), 11.5f, 0.05f);
+    TEST_ASSERT_TRUE(zvd < zv);
+    TEST_ASSERT_TRUE(ei < zv);
+    TEST_ASSERT_TRUE(zvd < 0.1f * unshaped);
+    TEST_ASSERT_TRUE(ei < 0.1f * unshaped);
+}
+
+void test_extra_delay_synchronises_axes()
+{
+    InputShaper<256> fast;
+    InputShaper<256> slow;
+    slow.configure(Params(ZVD, 10.0f, 0.05f), TS);
+    fast.configure(Params(ZV, 20.0f, 0.05f), TS, slow.duration() - 0.5f / (20.0f * 0.99875f));
+
+    TEST_ASSERT_FLOAT_WITHIN(1.5e-3f, slow.duration(), fast.duration());
+
+    // Both reach the new reference on the same tick
+    int settledFast = -1;
+    int settledSlow = -1;
+    for (int n = 0; n < 256; n++)
+    {
+        if (fast.shape(1.0f) > 0.9999f && settledFast < 0)
+        {
+            settledFast = n;
+        }
+        if (slow.shape(1.0f) > 0.9999f && settledSlow < 0)
+        {
+            settledSlow = n;
+        }
+    }
+    TEST_ASSERT_TRUE(std::abs(settledFast - settledSlow) <= 1);
+}
+
+void test_shaped_trajectory_stops_without_ringing()
+{
+    // The ramps of the trapezoid alone leave the part ringing after the stop
+    const float unshaped = residualVibration(Params(), 10.0f, 0.05f, true);
+    TEST_ASSERT_TRUE(unshaped > 0.01f);
+
+    TEST_ASSERT_TRUE(residualVibration(Params(ZV, 10.0f, 0.05f), 10.0f, 0.05f, true) <
+                     0.05f * unshaped);
+    TEST_ASSERT_TRUE(residualVibration(Params(ZVD, 10.0f, 0.05f), 10.0f, 0.05f, true) <
+                     0.05f * unshaped);
+}
+
+void test_trajectory_keeps_its_limits()
+{
+    Trajectory trajectory;
+    float last     = 0.0f;
+    uint32_t ticks = 0;
+    while (trajectory.position() != 10.0f && ticks < 10000)
+    {
+        // Sent back to 10 after passing it on the way to 20
+        const float target = ticks < 2500 ? 20.0f : 10.0f;
+        trajectory.next(target, MOVE_SPEED, MOVE_ACCELERATION, TS);
+        if (trajectory.position() != 10.0f)
+        {
+            TEST_ASSERT_TRUE(std::fabs(trajectory.velocity()) <= MOVE_SPEED);
+            TEST_ASSERT_TRUE(std::fabs(trajectory.velocity() - last) <=
+                             MOVE_ACCELERATION * TS * 1.001f);
+        }
+        last = trajectory.velocity();
+        ticks++;
+    }
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, trajectory.position());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, trajectory.velocity());
+
+    // A plain move takes the time-optimal 10 / 5 + 5 / 100 s
+    trajectory.reset(0.0f);
+    for (ticks = 0; trajectory.position() != 10.0f && ticks < 10000; ticks++)
+    {
+        trajectory.next(10.0f, MOVE_SPEED, MOVE_ACCELERATION, TS);
+    }
+    TEST_ASSERT_TRUE(std::abs(static_cast<int>(ticks) - 2050) <= 5);
+}
+
+void test_too_long_is_rejected()
+{
+    InputShaper<64> shaper;
+    shaper.configure(Params(ZV, 20.0f, 0.0f), TS);
+    TEST_ASSERT_EQUAL(EXIT_FAILURE, shaper.configure(Params(ZVD, 5.0f, 0.05f), TS));
+    // previous shaper is kept
+    TEST_ASSERT_EQUAL(ZV, shaper.params().type);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_impulses_sum_to_one);
+    RUN_TEST(test_none_is_a_pure_delay);
+    RUN_TEST(test_shapers_cancel_the_resonance);
+    RUN_TEST(test_zvd_and_ei_tolerate_frequency_error);
+    RUN_TEST(test_extra_delay_synchronises_axes);
+    RUN_TEST(test_shaped_trajectory_stops_without_ringing);
+    RUN_TEST(test_trajectory_keeps_its_limits);
+    RUN_TEST(test_too_long_is_rejected);
+
+    UNITY_END();
+}
@@ -0,0 +1,103 @@
+#include <unity.h>
+
+#include "isr_trampoline.hpp"
+
+class Counter
+{
+public:
+    void onEdge() { edges++; }
+    void onOverflow() { overflows++; }
+
+    int edges     = 0;
+    int overflows = 0;
+};
+
+// The trampolines keep the bound pointer in a static, so the instances must outlive each test
+static Counter first;
+static Counter second;
+
+void setUp(void)
+{
+    first  = Counter();
+    second = Counter();
+    IsrTrampoline<Counter, &Counter::onEdge, 0>::unbind();
+    IsrTrampoline<Counter, &Counter::onEdge, 1>::unbind();
+    IsrTrampoline<Counter, &Counter::onOverflow, 0>::unbind();
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+void test_dispatch_to_bound_instance()
+{
+    void (*isr)() = bindIsr<Counter, &Counter::onEdge>(&first);
+
+    isr();
+    isr();
+    TEST_ASSERT_EQUAL(2, first.edges);
+    TEST_ASSERT_EQUAL(0, first.overflows);
+}
+
+void test_slots_dispatch_independently()
+{
+    void (*isrA)() = bindIsr<Counter, &Counter::onEdge, 0>(&first);
+    void (*isrB)() = bindIsr<Counter, &Counter::onEdge, 1>(&second);
+
+    TEST_ASSERT_TRUE(isrA != isrB);
+    isrA();
+    isrB();
+    isrB();
+    TEST_ASSERT_EQUAL(1, first.edges);
+    TEST_ASSERT_EQUAL(2, second.edges);
+}
+
+void test_members_dispatch_independently()
+{
+    void (*edge)()     = bindIsr<Counter, &Counter::onEdge>(&first);
+    void (*overflow)() = bindIsr<Counter, &Counter::onOverflow>(&first);
+
+    TEST_ASSERT_TRUE(edge != overflow);
+    overflow();
+    TEST_ASSERT_EQUAL(0, first.edges);
+    TEST_ASSERT_EQUAL(1, first.overflows);
+}
+
+void test_rebind_moves_dispatch()
+{
+    void (*isr)() = bindIsr<Counter, &Counter::onEdge>(&first);
+    isr();
+
+    // Same slot bound again, e.g. begin() called twice, reuses the stub instead of a new slot
+    void (*rebound)() = bindIsr<Counter, &Counter::onEdge>(&second);
+    TEST_ASSERT_TRUE(isr == rebound);
+    isr();
+    TEST_ASSERT_EQUAL(1, first.edges);
+    TEST_ASSERT_EQUAL(1, second.edges);
+}
+
+void test_unbound_stub_is_noop()
+{
+    typedef IsrTrampoline<Counter, &Counter::onEdge> EdgeTrampoline;
+    EdgeTrampoline::isr();
+    TEST_ASSERT_NULL(EdgeTrampoline::instance());
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_dispatch_to_bound_instance);
+    RUN_TEST(test_slots_dispatch_independently);
+    RUN_TEST(test_members_dispatch_independently);
+    RUN_TEST(test_rebind_moves_dispatch);
+    RUN_TEST(test_unbound_stub_is_noop);
+
+    UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <unity.h>
+
+#include "lead_screw_compensation.hpp"
+
+static const float TS = 1e-3f;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief Table every 10 mm from 0: 0, +0.02, -0.01 */
+compensation::Settings pitchTable()
+{
+    compensation::Settings settings;
+    settings.start     = 0.0f;
+    settings.spacing   = 10.0f;
+    settings.points    = 3;
+    settings.errors[0] = 0.0f;
+    settings.errors[1] = 0.02f;
+    settings.errors[2] = -0.01f;
+    return settings;
+}
+
+void test_pitch_error_is_interpolated_and_held_at_the_ends()
+{
+    compensation::LeadScrewCompensator comp;
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, comp.configure(pitchTable(), TS));
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.01f, comp.pitchError(5.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.005f, comp.pitchError(15.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, comp.pitchError(-3.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, -0.01f, comp.pitchError(40.0f));
+
+    // The motor goes against the error
+    comp.reset(0.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 10.0f - 0.02f, comp.apply(10.0f));
+}
+
+void test_backlash_is_ramped_in_on_reversal()
+{
+    compensation::Settings settings;
+    settings.backlash   = 0.1f;
+    settings.takeupRate = 10.0f;  // 0.01 mm per tick
+    compensation::LeadScrewCompensator comp;
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, comp.configure(settings, TS));
+    comp.reset(5.0f);
+
+    // Still going towards -, nothing to take up
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 4.9f, comp.apply(4.9f));
+
+    // Turning towards + takes up 0.01 mm per tick until the whole 0.1 is in
+    float reference = 4.9f;
+    float lastOut   = 4.9f;
+    for (int i = 0; i < 20; i++)
+    {
+        reference += 0.001f;
+        const float out = comp.apply(reference);
+        TEST_ASSERT_TRUE(out - lastOut <= 0.001f + 0.01f + 1e-5f);
+        lastOut = out;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.1f, comp.takenUp());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, reference + 0.1f, lastOut);
+
+    // And back out going towards - again
+    for (int i = 0; i < 20; i++)
+    {
+        reference -= 0.001f;
+        comp.apply(reference);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.0f, comp.takenUp());
+}
+
+void test_jitter_inside_the_hysteresis_is_ignored()
+{
+    compensation::Settings settings;
+    settings.backlash   = 0.1f;
+    settings.takeupRate = 0.0f;
+    compensation::LeadScrewCompensator comp;
+    comp.configure(settings, TS);
+    comp.reset(0.0f);
+
+    for (int i = 0; i < 50; i++)
+    {
+        comp.apply(i % 2 ? 0.001f : -0.001f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, comp.takenUp());
+
+    // A real reversal, with a zero takeup rate the whole lash is taken up in one tick
+    comp.apply(0.01f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.1f, comp.takenUp());
+}
+
+void test_invalid_settings_are_rejected()
+{
+    compensation::LeadScrewCompensator comp;
+    comp.configure(pitchTable(), TS);
+
+    compensation::Settings settings = pitchTable();
+    settings.points                 = compensation::PITCH_POINTS + 1;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, comp.configure(settings, TS));
+
+    settings          = pitchTable();
+    settings.backlash = -0.1f;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, comp.configure(settings, TS));
+
+    settings           = pitchTable();
+    settings.errors[1] = NAN;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, comp.configure(settings, TS));
+
+    // The previous table is kept
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.02f, comp.pitchError(10.0f));
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_pitch_error_is_interpolated_and_held_at_the_ends);
+    RUN_TEST(test_backlash_is_ramped_in_on_reversal);
+    RUN_TEST(test_jitter_inside_the_hysteresis_is_ignored);
+    RUN_TEST(test_invalid_settings_are_rejected);
+
+    UNITY_END();
+}
@@ -0,0 +1,201 @@
+#include <unity.h>
+
+#include "program.hpp"
+
+using program::Op;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+Op move(float y)
+{
+    Op op        = Op();
+    op.code      = program::MOVE;
+    op.values[0] = y;
+    return op;
+}
+
+Op control(program::OpCode code, uint16_t arg = 0, const char* name = "")
+{
+    Op op   = Op();
+    op.code = code;
+    op.arg  = arg;
+    strncpy(op.name, name, program::NAME_LENGTH - 1);
+    return op;
+}
+
+struct Library
+{
+    const char* names[3];
+    const Op* programs[3];
+    uint16_t sizes[3];
+};
+
+int load(void* context, const char* name, Op* ops, uint16_t capacity, uint16_t& count)
+{
+    const Library* library = static_cast<const Library*>(context);
+    for (int i = 0; i < 3; i++)
+    {
+        if (library->names[i] && strcmp(library->names[i], name) == 0)
+        {
+            if (library->sizes[i] > capacity)
+            {
+                return EXIT_FAILURE;
+            }
+            memcpy(ops, library->programs[i], library->sizes[i] * sizeof(Op));
+            count = library->sizes[i];
+            return EXIT_SUCCESS;
+        }
+    }
+    return EXIT_FAILURE;
+}
+
+/** @brief Runs to the end, writes the y of every move to `ys`, returns the number of moves */
+template <uint8_t DEPTH>
+int collect(program::Runner<DEPTH>& runner, float* ys, int max)
+{
+    int n = 0;
+    while (const Op* op = runner.next())
+    {
+        if (n < max)
+        {
+            ys[n] = op->values[0];
+        }
+        n++;
+    }
+    return n;
+}
+
+void test_straight_program_runs_in_order()
+{
+    const Op main[] = {move(1), move(2), move(3)};
+    Library library = {{"main", nullptr, nullptr}, {main, nullptr, nullptr}, {3, 0, 0}};
+
+    program::Image<32> image;
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, image.link("main", load, &library));
+    TEST_ASSERT_EQUAL_UINT16(4, image.size());
+
+    program::Runner<> runner;
+    runner.start(image.ops(), image.size());
+    float ys[8];
+    TEST_ASSERT_EQUAL_INT(3, collect(runner, ys, 8));
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, ys[2]);
+    TEST_ASSERT_EQUAL(program::Runner<>::NONE, runner.error());
+    TEST_ASSERT_FALSE(runner.isRunning());
+}
+
+void test_nested_loops_repeat()
+{
+    // 2 x (1, 3 x 2)
+    const Op main[] = {control(program::LOOP_START, 2),
+                       move(1),
+                       control(program::LOOP_START, 3),
+                       move(2),
+                       control(program::LOOP_END),
+                       control(program::LOOP_END)};
+    Library library = {{"main", nullptr, nullptr}, {main, nullptr, nullptr}, {6, 0, 0}};
+
+    program::Image<32> image;
+    image.link("main", load, &library);
+    program::Runner<> runner;
+    runner.start(image.ops(), image.size());
+
+    float ys[16];
+    TEST_ASSERT_EQUAL_INT(8, collect(runner, ys, 16));
+    const float expected[] = {1, 2, 2, 2, 1, 2, 2, 2};
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected, ys, 8);
+    TEST_ASSERT_EQUAL_UINT32(8, runner.executed());
+}
+
+void test_calls_are_linked_once_and_return()
+{
+    const Op pass[] = {move(10), move(20)};
+    const Op main[] = {control(program::CALL, 0, "pass"),
+                       move(1),
+                       control(program::CALL, 0, "pass")};
+    Library library = {{"main", "pass", nullptr}, {main, pass, nullptr}, {3, 2, 0}};
+
+    program::Image<32> image;
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, image.link("main", load, &library));
+    // main + END, pass + RETURN, linked a single time
+    TEST_ASSERT_EQUAL_UINT16(7, image.size());
+
+    program::Runner<> runner;
+    runner.start(image.ops(), image.size());
+    float ys[8];
+    TEST_ASSERT_EQUAL_INT(5, collect(runner, ys, 8));
+    const float expected[] = {10, 20, 1, 10, 20};
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected, ys, 5);
+    TEST_ASSERT_EQUAL(program::Runner<>::NONE, runner.error());
+}
+
+void test_link_fails_on_missing_or_oversized_programs()
+{
+    const Op main[] = {control(program::CALL, 0, "nope")};
+    Library library = {{"main", nullptr, nullptr}, {main, nullptr, nullptr}, {1, 0, 0}};
+
+    program::Image<32> image;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, image.link("main", load, &library));
+    TEST_ASSERT_EQUAL_UINT16(0, image.size());
+
+    const Op big[] = {move(1), move(2), move(3), move(4)};
+    Library large  = {{"main", nullptr, nullptr}, {big, nullptr, nullptr}, {4, 0, 0}};
+    program::Image<4> small;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, small.link("main", load, &large));
+}
+
+void test_broken_programs_stop_with_an_error()
+{
+    // An endless loop with nothing in it
+    const Op empty[] = {control(program::LOOP_START, 0), control(program::LOOP_END)};
+    Library library  = {{"main", nullptr, nullptr}, {empty, nullptr, nullptr}, {2, 0, 0}};
+    program::Image<32> image;
+    image.link("main", load, &library);
+    program::Runner<> runner;
+    runner.start(image.ops(), image.size());
+    TEST_ASSERT_NULL(runner.next());
+    TEST_ASSERT_EQUAL(program::Runner<>::RUNAWAY, runner.error());
+
+    // A program calling itself runs out of stack
+    const Op self[] = {move(1), control(program::CALL, 0, "self")};
+    Library recursive = {{"main", "self", nullptr}, {self, self, nullptr}, {2, 2, 0}};
+    image.link("main", load, &recursive);
+    program::Runner<4> shallow;
+    shallow.start(image.ops(), image.size());
+    float ys[8];
+    collect(shallow, ys, 8);
+    TEST_ASSERT_EQUAL(program::Runner<4>::TOO_DEEP, shallow.error());
+
+    // An end of loop without its start
+    const Op unbalanced[] = {move(1), control(program::LOOP_END)};
+    Library broken = {{"main", nullptr, nullptr}, {unbalanced, nullptr, nullptr}, {2, 0, 0}};
+    image.link("main", load, &broken);
+    runner.start(image.ops(), image.size());
+    collect(runner, ys, 8);
+    TEST_ASSERT_EQUAL(program::Runner<>::UNBALANCED, runner.error());
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_straight_program_runs_in_order);
+    RUN_TEST(test_nested_loops_repeat);
+    RUN_TEST(test_calls_are_linked_once_and_return);
+    RUN_TEST(test_link_fails_on_missing_or_oversized_programs);
+    RUN_TEST(test_broken_programs_stop_with_an_error);
+
+    UNITY_END();
+}
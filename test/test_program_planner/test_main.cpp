@@ -0,0 +1,223 @@
+#include <unity.h>
+
+#include "program_planner.hpp"
+
+using program::Op;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief 1 unit per step, 100 steps/s and 100 steps/s² on Y and A, clamp at 10 steps/s */
+program::Kinematics kinematics()
+{
+    program::Kinematics k;
+    for (uint8_t axis = 0; axis < program::AXES; axis++)
+    {
+        k.maxSpeed[axis]     = 100.0f;
+        k.acceleration[axis] = 100.0f;
+    }
+    k.maxSpeed[program::C] = 10.0f;
+    return k;
+}
+
+program::Limits limits()
+{
+    program::Limits limits;
+    for (uint8_t axis = 0; axis < program::AXES; axis++)
+    {
+        limits.min[axis] = -1000.0f;
+        limits.max[axis] = 1000.0f;
+    }
+    limits.clampOpenAt = 5.0f;
+    return limits;
+}
+
+Op move(float y, float a, float c, bool brake = false)
+{
+    Op op        = Op();
+    op.code      = program::MOVE;
+    op.flags     = brake;
+    op.values[0] = y;
+    op.values[1] = a;
+    op.values[2] = c;
+    return op;
+}
+
+Op control(program::OpCode code, uint16_t arg = 0)
+{
+    Op op   = Op();
+    op.code = code;
+    op.arg  = arg;
+    return op;
+}
+
+void test_axes_are_synchronized()
+{
+    const float from[program::AXES] = {0.0f, 0.0f, 5.0f};
+
+    // Y: 200 steps, trapezoid of 2 + 1 s. A: 25 steps, triangle of 2 * 0.5 s
+    const float to[program::AXES]  = {200.0f, 25.0f, 5.0f};
+    const program::Segment segment = program::planMove(from, to, kinematics());
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 3.0f, segment.duration);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f, segment.speed[program::Y]);
+    // A is slowed down by s = 3 on its speed and s² on its acceleration
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f / 3.0f, segment.speed[program::A]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f / 9.0f, segment.acceleration[program::A]);
+
+    // A slow clamp makes the whole move longer, without touching Y and A
+    const float clamp[program::AXES] = {200.0f, 25.0f, 45.0f};
+    const program::Segment slow      = program::planMove(from, clamp, kinematics());
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 4.0f, slow.duration);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f, slow.speed[program::Y]);
+}
+
+void test_limits_and_interlocks_are_checked()
+{
+    const float start[program::AXES] = {0.0f, 0.0f, 10.0f};
+    program::Plan<8> plan;
+
+    const Op far[]         = {move(10, 0, 10), move(2000, 0, 10), control(program::END)};
+    program::Report report = plan.build(far, 3, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::OUT_OF_LIMITS, report.problem);
+    TEST_ASSERT_EQUAL_UINT8(program::Y, report.axis);
+    TEST_ASSERT_EQUAL_UINT16(1, report.pc);
+
+    // Closing the clamp and rotating is fine, travelling with it closed isn't
+    const Op clamped[] = {move(0, 3, 0, true), move(10, 3, 0), control(program::END)};
+    report             = plan.build(clamped, 3, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::CLAMPED_TRAVEL, report.problem);
+    TEST_ASSERT_EQUAL_UINT16(1, report.pc);
+
+    const Op braked[] = {move(10, 0, 10, true), control(program::END)};
+    report            = plan.build(braked, 2, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::BRAKED_TRAVEL, report.problem);
+
+    // An M80 of 0 keeps the axis, a negative one leaves it unable to move
+    Op stopped        = control(program::SET_SPEED);
+    stopped.values[1] = -1.0f;
+    const Op bad[]    = {stopped, move(0, 1, 10), control(program::END)};
+    report            = plan.build(bad, 3, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::BAD_KINEMATICS, report.problem);
+    TEST_ASSERT_EQUAL_UINT8(program::A, report.axis);
+}
+
+void test_golden_pass_is_valid()
+{
+    // sim/golden/pass.session as a program, checked against ProgramLimits of the firmware
+    program::Limits machine = {{0.0f, -100.0f, -1.0f}, {300.0f, 100.0f, 10.0f}, 2.0f};
+    const float start[program::AXES] = {0.0f, 0.0f, 0.0f};
+    const Op pass[]                  = {move(0, 0, -0.1f),
+                                        move(0, 0.2f, -0.1f),
+                                        move(0, -0.2f, -0.1f),
+                                        move(0, 0, 2.5f),
+                                        move(10, 0, 2.5f),
+                                        move(10, 0, -0.1f),
+                                        move(10, 0.2f, -0.1f),
+                                        move(10, 0, 2.5f),
+                                        move(0, 0, 2.5f),
+                                        control(program::END)};
+    program::Plan<16> plan;
+    program::Report report = plan.build(pass, 10, start, false, kinematics(), machine);
+    TEST_ASSERT_EQUAL(program::NO_PROBLEM, report.problem);
+    TEST_ASSERT_EQUAL_UINT32(9, report.moves);
+    TEST_ASSERT_FALSE(report.endless);
+
+    // Sweeping Y with the part held is what the interlock is there for
+    const Op sweep[] = {move(0, 0, 0.5f), move(10, 0.2f, 0.5f), control(program::END)};
+    report           = plan.build(sweep, 3, start, false, kinematics(), machine);
+    TEST_ASSERT_EQUAL(program::CLAMPED_TRAVEL, report.problem);
+    TEST_ASSERT_EQUAL_UINT16(1, report.pc);
+}
+
+void test_loops_are_unrolled_into_the_plan()
+{
+    const float start[program::AXES] = {0.0f, 0.0f, 10.0f};
+    // 3 x (G4 500 ms, out 100 and back), 2 s each way
+    Op dwell        = control(program::DWELL);
+    dwell.values[0] = 500.0f;
+    const Op main[] = {control(program::LOOP_START, 3),
+                       dwell,
+                       move(100, 0, 10),
+                       move(0, 0, 10),
+                       control(program::LOOP_END),
+                       control(program::END)};
+
+    program::Plan<4> plan;
+    const program::Report report = plan.build(main, 6, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::NO_PROBLEM, report.problem);
+    TEST_ASSERT_EQUAL_UINT32(6, report.moves);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 3 * (0.5f + 2.0f + 2.0f), report.duration);
+    TEST_ASSERT_FALSE(report.endless);
+
+    // Only the first 4 moves are kept, the rest are planned as they come
+    TEST_ASSERT_EQUAL_UINT16(4, plan.size());
+    TEST_ASSERT_NOT_NULL(plan.segment(3));
+    TEST_ASSERT_NULL(plan.segment(4));
+}
+
+void test_set_ops_change_the_following_moves()
+{
+    const float start[program::AXES] = {0.0f, 0.0f, 10.0f};
+    Op fast         = control(program::SET_SPEED);
+    fast.values[0]  = 200.0f;
+    Op quick        = control(program::SET_ACCELERATION);
+    quick.values[0] = 400.0f;
+    const Op main[] = {move(100, 0, 10), fast, quick, move(0, 0, 10), control(program::END)};
+
+    program::Plan<8> plan;
+    const program::Report report = plan.build(main, 5, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::NO_PROBLEM, report.problem);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 100.0f, plan.segment(0)->speed[program::Y]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.0f, plan.segment(0)->duration);
+    // Triangle of 2 * sqrt(100 / 400) = 1 s, it never gets to 200 steps/s
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 200.0f, plan.segment(1)->speed[program::Y]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 400.0f, plan.segment(1)->acceleration[program::Y]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, plan.segment(1)->duration);
+}
+
+void test_endless_and_broken_programs()
+{
+    const float start[program::AXES] = {0.0f, 0.0f, 10.0f};
+
+    const Op endless[] = {control(program::LOOP_START, 0),
+                          move(1, 0, 10),
+                          move(0, 0, 10),
+                          control(program::LOOP_END),
+                          control(program::END)};
+
+    program::Plan<8> plan;
+    program::Report report = plan.build(endless, 5, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::NO_PROBLEM, report.problem);
+    TEST_ASSERT_TRUE(report.endless);
+    TEST_ASSERT_EQUAL_UINT32(program::Plan<8>::SIMULATED_MOVES, report.moves);
+
+    const Op unbalanced[] = {move(1, 0, 10), control(program::LOOP_END), control(program::END)};
+    report                = plan.build(unbalanced, 3, start, false, kinematics(), limits());
+    TEST_ASSERT_EQUAL(program::PROGRAM_INVALID, report.problem);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_axes_are_synchronized);
+    RUN_TEST(test_limits_and_interlocks_are_checked);
+    RUN_TEST(test_golden_pass_is_valid);
+    RUN_TEST(test_loops_are_unrolled_into_the_plan);
+    RUN_TEST(test_set_ops_change_the_following_moves);
+    RUN_TEST(test_endless_and_broken_programs);
+
+    UNITY_END();
+}
@@ -0,0 +1,156 @@
+#include <unity.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "spectrum_monitor.hpp"
+
+static const float TAU = 6.28318530718f;
+static const float TS     = 1e-3f;
+
+typedef spectrum::WindowBuffer<256> Buffer;
+typedef spectrum::SpectrumMonitor<256, 32, 4> Monitor;
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+/** @brief Small uniform noise in [-amplitude, amplitude], deterministic between runs */
+float noise(float amplitude)
+{
+    return amplitude * (2.0f * static_cast<float>(rand()) / RAND_MAX - 1.0f);
+}
+
+/** @brief Feeds `windows` windows of a sine plus offset and noise, returns the events raised */
+uint32_t drive(Monitor& monitor, Buffer& buffer, float hz, float amplitude, uint32_t windows,
+               uint32_t& n, float offset = 0.0f, float noiseAmplitude = 0.0f)
+{
+    uint32_t events = 0;
+    uint32_t done   = 0;
+    while (done < windows)
+    {
+        float v = offset + amplitude * std::sin(TAU * hz * TS * n++) + noise(noiseAmplitude);
+        const int16_t* full = buffer.push(Buffer::quantize(v, monitor.config().fullScale));
+        if (full)
+        {
+            events |= monitor.analyse(full);
+            done++;
+        }
+    }
+    return events;
+}
+
+void test_quantize_saturates()
+{
+    TEST_ASSERT_EQUAL_INT(0, Buffer::quantize(0.0f, 20.0f));
+    TEST_ASSERT_EQUAL_INT(16384, Buffer::quantize(10.0f, 20.0f));
+    TEST_ASSERT_EQUAL_INT(32767, Buffer::quantize(50.0f, 20.0f));
+    TEST_ASSERT_EQUAL_INT(-32767, Buffer::quantize(-50.0f, 20.0f));
+}
+
+void test_finds_the_peak_of_a_sine()
+{
+    Monitor monitor;
+    Buffer buffer;
+    uint32_t n = 0;
+
+    // 83 Hz sits between two bins, the interpolation should still land on it
+    drive(monitor, buffer, 83.0f, 2.0f, 2, n);
+    const auto& summary = monitor.summary();
+
+    TEST_ASSERT_EQUAL_UINT32(2, summary.windows);
+    TEST_ASSERT_FLOAT_WITHIN(2.0f, 83.0f, summary.peakFrequency);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 2.0f, summary.peakAmplitude);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 2.0f / std::sqrt(2.0f), summary.rms);
+}
+
+void test_energy_lands_in_the_right_band()
+{
+    Monitor monitor;
+    Buffer buffer;
+    uint32_t n = 0;
+
+    // 170 Hz is in the last of the four bands, 150 to 200 Hz
+    drive(monitor, buffer, 170.0f, 1.0f, 1, n);
+    const auto& summary = monitor.summary();
+
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 1.0f / std::sqrt(2.0f), summary.bandRms[3]);
+    for (uint8_t b = 0; b < 3; b++)
+    {
+        TEST_ASSERT_TRUE(summary.bandRms[b] < 0.05f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 5.0f, summary.bandStart[0]);
+    TEST_ASSERT_TRUE(summary.bandStart[3] < 170.0f);
+}
+
+void test_offset_and_noise_are_ignored()
+{
+    srand(1);
+    Monitor monitor;
+    Buffer buffer;
+    uint32_t n = 0;
+
+    // Constant velocity of a move plus encoder noise, no vibration
+    drive(monitor, buffer, 40.0f, 0.0f, 3, n, 8.0f, 0.05f);
+    const auto& summary = monitor.summary();
+
+    TEST_ASSERT_TRUE(summary.rms < 0.05f);
+    TEST_ASSERT_TRUE(summary.peakAmplitude < 0.02f);
+}
+
+void test_threshold_events_with_hysteresis()
+{
+    Monitor monitor;
+    Buffer buffer;
+    uint32_t n = 0;
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, monitor.setThreshold(1, 0.5f));
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, monitor.setThreshold(4, 0.5f));
+
+    // 70 Hz is in band 1, the event fires once on the way up
+    TEST_ASSERT_EQUAL_UINT32(0, drive(monitor, buffer, 70.0f, 0.3f, 2, n));
+    TEST_ASSERT_EQUAL_UINT32(1UL << 1, drive(monitor, buffer, 70.0f, 1.5f, 2, n));
+    TEST_ASSERT_EQUAL_UINT32(0, drive(monitor, buffer, 70.0f, 1.5f, 2, n));
+    TEST_ASSERT_EQUAL_UINT32(1UL << 1, monitor.summary().overMask);
+
+    // Just under the threshold is still inside the hysteresis
+    drive(monitor, buffer, 70.0f, 0.65f, 2, n);
+    TEST_ASSERT_EQUAL_UINT32(1UL << 1, monitor.summary().overMask);
+
+    drive(monitor, buffer, 70.0f, 0.1f, 2, n);
+    TEST_ASSERT_EQUAL_UINT32(0, monitor.summary().overMask);
+    TEST_ASSERT_EQUAL_UINT32(1UL << 1, drive(monitor, buffer, 70.0f, 1.5f, 2, n));
+}
+
+void test_rejects_bins_above_nyquist()
+{
+    Monitor monitor;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, monitor.configure(spectrum::Config(5.0f, 600.0f, TS, 20.0f)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 200.0f, monitor.config().fMax);
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, monitor.configure(spectrum::Config(5.0f, 400.0f, TS, 20.0f)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 400.0f, monitor.binFrequency(31));
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_quantize_saturates);
+    RUN_TEST(test_finds_the_peak_of_a_sine);
+    RUN_TEST(test_energy_lands_in_the_right_band);
+    RUN_TEST(test_offset_and_noise_are_ignored);
+    RUN_TEST(test_threshold_events_with_hysteresis);
+    RUN_TEST(test_rejects_bins_above_nyquist);
+
+    UNITY_END();
+}
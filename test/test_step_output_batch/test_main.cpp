@@ -0,0 +1,224 @@
+#include <unity.h>
+
+#include "step_output_batch.hpp"
+
+/**
+ * Fake GPIO register file, tracks the output levels and records every register write so the
+ * order and grouping of the writes can be checked.
+ */
+struct FakeGpioRegisters
+{
+    enum Op : uint8_t
+    {
+        SET = 0,
+        CLEAR,
+        HOLD,
+        DIR_SETUP
+    };
+
+    struct Write
+    {
+        Op op;
+        GpioMask mask;
+    };
+
+    static constexpr int MAX_WRITES = 32;
+
+    Write writes[MAX_WRITES];
+    int numWrites       = 0;
+    uint32_t level0     = 0;
+    uint32_t level1     = 0;
+    int risingEdges[49] = {0};
+
+    void set(const GpioMask& mask)
+    {
+        for (int gpio = 0; gpio < 49; gpio++)
+        {
+            if (GpioMask::fromGpio(gpio).overlaps(mask) && !isHigh(gpio))
+            {
+                risingEdges[gpio]++;
+            }
+        }
+        level0 |= mask.bank0;
+        level1 |= mask.bank1;
+        record(SET, mask);
+    }
+
+    void clear(const GpioMask& mask)
+    {
+        level0 &= ~mask.bank0;
+        level1 &= ~mask.bank1;
+        record(CLEAR, mask);
+    }
+
+    void holdPulse() { record(HOLD, GpioMask()); }
+
+    void holdDirSetup() { record(DIR_SETUP, GpioMask()); }
+
+    bool isHigh(uint8_t gpio) const
+    {
+        return gpio < 32 ? (level0 >> gpio) & 1 : (level1 >> (gpio - 32)) & 1;
+    }
+
+    void record(Op op, const GpioMask& mask)
+    {
+        if (numWrites < MAX_WRITES)
+        {
+            writes[numWrites].op   = op;
+            writes[numWrites].mask = mask;
+            numWrites++;
+        }
+    }
+};
+
+// Same split as the real hardware: a mix of bank 0 and bank 1 pins
+static const GpioMask ROT_STEP   = GpioMask::fromGpio(8);
+static const GpioMask ROT_DIR    = GpioMask::fromGpio(7);
+static const GpioMask POS_STEP   = GpioMask::fromGpio(17);
+static const GpioMask POS_DIR    = GpioMask::fromGpio(10);
+static const GpioMask CLAMP_STEP = GpioMask::fromGpio(5);
+static const GpioMask CLAMP_DIR  = GpioMask::fromGpio(38);
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+void test_mask_from_gpio()
+{
+    TEST_ASSERT_EQUAL_HEX32(1UL << 5, GpioMask::fromGpio(5).bank0);
+    TEST_ASSERT_EQUAL_HEX32(0, GpioMask::fromGpio(5).bank1);
+    TEST_ASSERT_EQUAL_HEX32(1UL << 6, GpioMask::fromGpio(38).bank1);
+    TEST_ASSERT_TRUE(GpioMask::fromGpio(255).empty());
+}
+
+void test_single_step_outside_batch()
+{
+    StepOutputBatch<FakeGpioRegisters> output;
+    output.queue(ROT_STEP, ROT_DIR, true);
+
+    FakeGpioRegisters& regs = output.registers();
+    TEST_ASSERT_EQUAL(5, regs.numWrites);  // dir, setup, step high, hold, step low
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::SET, regs.writes[0].op);
+    TEST_ASSERT_EQUAL_HEX32(ROT_DIR.bank0, regs.writes[0].mask.bank0);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::DIR_SETUP, regs.writes[1].op);
+    TEST_ASSERT_EQUAL(1, regs.risingEdges[8]);
+    TEST_ASSERT_FALSE(regs.isHigh(8));  // step returned low
+    TEST_ASSERT_TRUE(regs.isHigh(7));   // direction held
+}
+
+void test_batch_pulses_all_axes_with_one_write()
+{
+    StepOutputBatch<FakeGpioRegisters> output;
+    output.beginBatch();
+    output.queue(ROT_STEP, ROT_DIR, true);
+    output.queue(POS_STEP, POS_DIR, false);
+    output.queue(CLAMP_STEP, CLAMP_DIR, true);
+    TEST_ASSERT_EQUAL(0, output.registers().numWrites);  // nothing until the batch ends
+    output.endBatch();
+
+    FakeGpioRegisters& regs = output.registers();
+    // dir high, dir low, setup, step high, hold, step low
+    TEST_ASSERT_EQUAL(6, regs.numWrites);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::SET, regs.writes[0].op);
+    TEST_ASSERT_EQUAL_HEX32(ROT_DIR.bank0, regs.writes[0].mask.bank0);
+    TEST_ASSERT_EQUAL_HEX32(CLAMP_DIR.bank1, regs.writes[0].mask.bank1);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::CLEAR, regs.writes[1].op);
+    TEST_ASSERT_EQUAL_HEX32(POS_DIR.bank0, regs.writes[1].mask.bank0);
+
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::DIR_SETUP, regs.writes[2].op);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::SET, regs.writes[3].op);
+    TEST_ASSERT_EQUAL_HEX32(
+        ROT_STEP.bank0 | POS_STEP.bank0 | CLAMP_STEP.bank0,
+        regs.writes[3].mask.bank0);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::HOLD, regs.writes[4].op);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::CLEAR, regs.writes[5].op);
+
+    TEST_ASSERT_EQUAL(1, regs.risingEdges[8]);
+    TEST_ASSERT_EQUAL(1, regs.risingEdges[17]);
+    TEST_ASSERT_EQUAL(1, regs.risingEdges[5]);
+    TEST_ASSERT_FALSE(regs.isHigh(10));
+    TEST_ASSERT_TRUE(regs.isHigh(38));
+}
+
+void test_repeated_axis_in_batch_is_not_lost()
+{
+    StepOutputBatch<FakeGpioRegisters> output;
+    output.beginBatch();
+    output.queue(ROT_STEP, ROT_DIR, true);
+    output.queue(ROT_STEP, ROT_DIR, true);
+    output.endBatch();
+
+    TEST_ASSERT_EQUAL(2, output.registers().risingEdges[8]);
+}
+
+void test_unchanged_dir_is_not_rewritten()
+{
+    StepOutputBatch<FakeGpioRegisters> output;
+    output.queue(ROT_STEP, ROT_DIR, true);
+    FakeGpioRegisters& regs = output.registers();
+    regs.numWrites          = 0;
+
+    output.queue(ROT_STEP, ROT_DIR, true);
+    TEST_ASSERT_EQUAL(3, regs.numWrites);  // step high, hold, step low
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::SET, regs.writes[0].op);
+    TEST_ASSERT_EQUAL_HEX32(ROT_STEP.bank0, regs.writes[0].mask.bank0);
+    TEST_ASSERT_EQUAL(2, regs.risingEdges[8]);
+}
+
+void test_reversal_waits_for_dir_setup()
+{
+    StepOutputBatch<FakeGpioRegisters> output;
+    output.queue(ROT_STEP, ROT_DIR, true);
+    FakeGpioRegisters& regs = output.registers();
+    regs.numWrites          = 0;
+
+    output.queue(ROT_STEP, ROT_DIR, false);
+    TEST_ASSERT_EQUAL(5, regs.numWrites);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::CLEAR, regs.writes[0].op);
+    TEST_ASSERT_EQUAL_HEX32(ROT_DIR.bank0, regs.writes[0].mask.bank0);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::DIR_SETUP, regs.writes[1].op);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::SET, regs.writes[2].op);
+    TEST_ASSERT_FALSE(regs.isHigh(7));
+
+    // and back again
+    regs.numWrites = 0;
+    output.queue(ROT_STEP, ROT_DIR, true);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::SET, regs.writes[0].op);
+    TEST_ASSERT_EQUAL_HEX32(ROT_DIR.bank0, regs.writes[0].mask.bank0);
+    TEST_ASSERT_EQUAL(FakeGpioRegisters::DIR_SETUP, regs.writes[1].op);
+    TEST_ASSERT_TRUE(regs.isHigh(7));
+}
+
+void test_empty_batch_writes_nothing()
+{
+    StepOutputBatch<FakeGpioRegisters> output;
+    output.beginBatch();
+    output.endBatch();
+    TEST_ASSERT_EQUAL(0, output.registers().numWrites);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_mask_from_gpio);
+    RUN_TEST(test_single_step_outside_batch);
+    RUN_TEST(test_batch_pulses_all_axes_with_one_write);
+    RUN_TEST(test_repeated_axis_in_batch_is_not_lost);
+    RUN_TEST(test_unchanged_dir_is_not_rewritten);
+    RUN_TEST(test_reversal_waits_for_dir_setup);
+    RUN_TEST(test_empty_batch_writes_nothing);
+
+    UNITY_END();
+}
@@ -0,0 +1,125 @@
+#include <unity.h>
+
+#include "step_reconciler.hpp"
+
+void setUp(void)
+{
+    ;  // This is run before EACH test
+}
+
+void tearDown(void)
+{
+    ;  // This is run after EACH test
+}
+
+void test_matching_counts_report_ok()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, false));
+    reconciler.resync(0, 0, 0);
+
+    StepReconciler::Report report = reconciler.reconcile(1000, 1000, 100000);
+    TEST_ASSERT_EQUAL(StepReconciler::OK, report.status);
+    TEST_ASSERT_EQUAL_INT32(1000, report.hardwareSteps);
+    TEST_ASSERT_EQUAL_INT32(0, report.drift);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 10000.0f, report.stepRate);
+}
+
+void test_counter_wrap_forward()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, false));
+    reconciler.resync(0, 0, 0);
+
+    // Count up to just under the limit, then past it (the counter resets to 0 at +modulus)
+    reconciler.reconcile(14000, 14000, 1000);
+    reconciler.reconcile(28000, 28000, 2000);
+    StepReconciler::Report report = reconciler.reconcile(2000, 32000, 3000);
+    TEST_ASSERT_EQUAL_INT32(32000, report.hardwareSteps);
+    TEST_ASSERT_EQUAL(StepReconciler::OK, report.status);
+}
+
+void test_counter_wrap_backward()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, false));
+    reconciler.resync(0, 0, 0);
+
+    reconciler.reconcile(-14500, -14500, 1000);
+    reconciler.reconcile(-29000, -29000, 2000);
+    StepReconciler::Report report = reconciler.reconcile(-1500, -31500, 3000);
+    TEST_ASSERT_EQUAL_INT32(-31500, report.hardwareSteps);
+    TEST_ASSERT_TRUE(report.stepRate < 0.0f);
+}
+
+void test_dropped_steps_are_flagged()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, false));
+    reconciler.resync(0, 0, 0);
+
+    StepReconciler::Report report = reconciler.reconcile(990, 1000, 1000);
+    TEST_ASSERT_EQUAL(StepReconciler::DRIFT_FLAGGED, report.status);
+    TEST_ASSERT_EQUAL_INT32(10, report.drift);
+}
+
+void test_auto_correct_and_acknowledge()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, true));
+    reconciler.resync(0, 0, 0);
+
+    StepReconciler::Report report = reconciler.reconcile(990, 1000, 1000);
+    TEST_ASSERT_EQUAL(StepReconciler::DRIFT_CORRECTED, report.status);
+
+    // caller applies setCurrentPosition(hardwareSteps) then acknowledges
+    reconciler.acknowledgeCorrection();
+    TEST_ASSERT_EQUAL(StepReconciler::OK, reconciler.lastReport().status);
+
+    report = reconciler.reconcile(1090, 1090, 2000);
+    TEST_ASSERT_EQUAL(StepReconciler::OK, report.status);
+    TEST_ASSERT_EQUAL_INT32(0, report.drift);
+}
+
+void test_only_status_changes_are_marked()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, false));
+    reconciler.resync(0, 0, 0);
+
+    TEST_ASSERT_FALSE(reconciler.reconcile(1000, 1000, 1000).changed);
+    TEST_ASSERT_TRUE(reconciler.reconcile(1990, 2000, 2000).changed);
+    // still flagged, the drift changing does not count
+    TEST_ASSERT_FALSE(reconciler.reconcile(2980, 3000, 3000).changed);
+
+    StepReconciler::Report report = reconciler.reconcile(4000, 4000, 4000);
+    TEST_ASSERT_EQUAL(StepReconciler::OK, report.status);
+    TEST_ASSERT_TRUE(report.changed);
+}
+
+void test_resync_after_position_reset()
+{
+    StepReconciler reconciler(StepReconciler::Config(30000, 4, false));
+    reconciler.resync(0, 0, 0);
+    reconciler.reconcile(500, 500, 1000);
+
+    // software position zeroed while the counter keeps its value
+    reconciler.resync(0, 500, 1000);
+    StepReconciler::Report report = reconciler.reconcile(600, 100, 2000);
+    TEST_ASSERT_EQUAL(StepReconciler::OK, report.status);
+    TEST_ASSERT_EQUAL_INT32(100, report.hardwareSteps);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_matching_counts_report_ok);
+    RUN_TEST(test_counter_wrap_forward);
+    RUN_TEST(test_counter_wrap_backward);
+    RUN_TEST(test_dropped_steps_are_flagged);
+    RUN_TEST(test_auto_correct_and_acknowledge);
+    RUN_TEST(test_only_status_changes_are_marked);
+    RUN_TEST(test_resync_after_position_reset);
+
+    UNITY_END();
+}
@@ -0,0 +1,307 @@
+#include <unity.h>
+
+#include <vector>
+
+#include "telemetry.hpp"
+
+static constexpr uint8_t CHANNELS = 3;
+typedef telemetry::Encoder<CHANNELS, 64, 4> Encoder;
+
+struct Value
+{
+    uint32_t tick;
+    uint8_t channel;
+    uint8_t stat;  // Stat flag
+    float value;
+};
+
+/** The decoder of serverside/telemetry.py, so the tests see what the host sees */
+struct Decoder
+{
+    telemetry::Channel channels[CHANNELS];
+    int32_t previous[CHANNELS * 4] = {};
+    std::vector<Value> values;
+    bool keyframe = false;
+
+    static uint32_t varint(const uint8_t*& at)
+    {
+        uint32_t value = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            const uint8_t byte = *at++;
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+    }
+
+    /** Decodes one packet, false if its framing or CRC is wrong */
+    bool decode(const uint8_t* data, size_t length)
+    {
+        const uint8_t* at = data;
+        if (*at++ != telemetry::SENTINEL)
+        {
+            return false;
+        }
+        const uint32_t body = varint(at);
+        if (static_cast<size_t>(at - data) + body + 1 != length ||
+            telemetry::crc8(at, body) != at[body])
+        {
+            return false;
+        }
+        const uint8_t* end   = at + body;
+        keyframe             = *at++ & telemetry::KEYFRAME;
+        const uint8_t ticks  = *at++;
+        const uint32_t first = varint(at);
+        if (keyframe)
+        {
+            memset(previous, 0, sizeof(previous));
+        }
+        for (uint32_t tick = first; tick < first + ticks; tick++)
+        {
+            for (uint8_t c = 0; c < CHANNELS; c++)
+            {
+                if (channels[c].stats == 0 || (tick + 1) % channels[c].divider != 0)
+                {
+                    continue;
+                }
+                for (uint8_t s = 0; s < 4; s++)
+                {
+                    if (!(channels[c].stats & (1 << s)))
+                    {
+                        continue;
+                    }
+                    const uint32_t z = varint(at);
+                    const uint32_t change = (z >> 1) ^ (0u - (z & 1));  // zigzag back
+                    int32_t& q            = previous[c * 4 + s];
+                    q = static_cast<int32_t>(static_cast<uint32_t>(q) + change);
+                    const Value value = {
+                        tick, c, static_cast<uint8_t>(1 << s), q * channels[c].scale};
+                    values.push_back(value);
+                }
+            }
+        }
+        return at == end;
+    }
+
+    /** Decodes everything the encoder queued */
+    void drain(Encoder& encoder)
+    {
+        const uint8_t* data;
+        size_t length;
+        while (encoder.front(data, length))
+        {
+            TEST_ASSERT_TRUE(length <= 64);
+            TEST_ASSERT_TRUE(decode(data, length));
+            encoder.pop();
+        }
+    }
+};
+
+static void configure(Encoder& encoder, Decoder& decoder, const telemetry::Channel* channels,
+                      uint8_t packetTicks = 10, uint32_t keyframeTicks = 100)
+{
+    TEST_ASSERT_EQUAL_INT(EXIT_SUCCESS, encoder.configure(channels, packetTicks, keyframeTicks));
+    for (uint8_t c = 0; c < CHANNELS; c++)
+    {
+        decoder.channels[c] = encoder.channel(c);
+    }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_varints_and_zigzag()
+{
+    uint8_t out[5];
+    TEST_ASSERT_EQUAL_UINT32(1, telemetry::putVarint(out, 0x7F));
+    TEST_ASSERT_EQUAL_UINT32(2, telemetry::putVarint(out, 0x80));
+    TEST_ASSERT_EQUAL_HEX8(0x80, out[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, out[1]);
+    TEST_ASSERT_EQUAL_UINT32(5, telemetry::putVarint(out, 0xFFFFFFFF));
+
+    TEST_ASSERT_EQUAL_UINT32(0, telemetry::zigzag(0));
+    TEST_ASSERT_EQUAL_UINT32(1, telemetry::zigzag(-1));
+    TEST_ASSERT_EQUAL_UINT32(2, telemetry::zigzag(1));
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFF, telemetry::zigzag(INT32_MIN));
+
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, telemetry::quantize(1e12f, 1e-3f));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, telemetry::quantize(-1e12f, 1e-3f));
+    TEST_ASSERT_EQUAL_INT32(-3, telemetry::quantize(-0.0031f, 1e-3f));
+}
+
+void test_values_come_back_within_half_a_count()
+{
+    const telemetry::Channel channels[CHANNELS] = {
+        {1e-4f, 1, telemetry::LAST}, {1e-3f, 1, telemetry::LAST}, {1e-2f, 1, telemetry::LAST}};
+    Encoder encoder;
+    Decoder decoder;
+    configure(encoder, decoder, channels);
+
+    std::vector<float> sent;
+    for (int tick = 0; tick < 1000; tick++)
+    {
+        const float values[CHANNELS] = {3.0f * sinf(tick * 0.01f), 50.0f - tick * 0.02f,
+                                        tick % 200 < 100 ? 1.0f : -1.0f};
+        sent.insert(sent.end(), values, values + CHANNELS);
+        encoder.sample(values);
+        decoder.drain(encoder);
+    }
+    encoder.flush();
+    decoder.drain(encoder);
+
+    TEST_ASSERT_EQUAL_UINT32(1000 * CHANNELS, decoder.values.size());
+    for (size_t i = 0; i < decoder.values.size(); i++)
+    {
+        const Value& v = decoder.values[i];
+        TEST_ASSERT_EQUAL_UINT32(i / CHANNELS, v.tick);
+        TEST_ASSERT_FLOAT_WITHIN(channels[v.channel].scale * 0.51f, sent[i], v.value);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, encoder.dropped());
+}
+
+void test_windows_send_their_min_max_and_mean()
+{
+    const telemetry::Channel channels[CHANNELS] = {
+        {1e-3f, 5, telemetry::MIN | telemetry::MAX | telemetry::MEAN},
+        {1e-3f, 2, telemetry::LAST},
+        {1e-3f, 1, 0}};
+    Encoder encoder;
+    Decoder decoder;
+    configure(encoder, decoder, channels);
+
+    const float window[5] = {1.0f, -2.0f, 4.0f, 0.5f, 1.5f};  // min -2, max 4, mean 1
+    for (int tick = 0; tick < 10; tick++)
+    {
+        const float values[CHANNELS] = {window[tick % 5], static_cast<float>(tick), 7.0f};
+        encoder.sample(values);
+    }
+    encoder.flush();
+    decoder.drain(encoder);
+
+    // Ticks 1 and 3 LAST of channel 1, 4 MIN MAX MEAN of channel 0, 5 and 7 LAST, 9 all four
+    TEST_ASSERT_EQUAL_UINT32(11, decoder.values.size());
+    const Value& min = decoder.values[2];
+    TEST_ASSERT_EQUAL_UINT32(4, min.tick);
+    TEST_ASSERT_EQUAL_UINT8(telemetry::MIN, min.stat);
+    TEST_ASSERT_EQUAL_FLOAT(-2.0f, min.value);
+    TEST_ASSERT_EQUAL_FLOAT(4.0f, decoder.values[3].value);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, decoder.values[4].value);
+    TEST_ASSERT_EQUAL_UINT8(1, decoder.values[5].channel);
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, decoder.values[5].value);
+    TEST_ASSERT_EQUAL_UINT32(9, decoder.values[10].tick);
+    TEST_ASSERT_EQUAL_FLOAT(9.0f, decoder.values[10].value);
+}
+
+void test_a_dropped_packet_makes_the_next_a_keyframe()
+{
+    const telemetry::Channel channels[CHANNELS] = {
+        {1e-3f, 1, telemetry::LAST}, {1e-3f, 1, telemetry::LAST}, {1e-3f, 1, telemetry::LAST}};
+    Encoder encoder;
+    Decoder decoder;
+    configure(encoder, decoder, channels, 5, 100000);
+
+    // Nobody drains, the queue of 4 fills and the 5th packet is dropped
+    for (int tick = 0; tick < 25; tick++)
+    {
+        const float values[CHANNELS] = {tick * 0.1f, 1.0f, -1.0f};
+        encoder.sample(values);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, encoder.dropped());
+    TEST_ASSERT_EQUAL_UINT32(4, encoder.queued());
+
+    // The 4 queued packets decode in order, the next starts a chain of its own at tick 25
+    decoder.drain(encoder);
+    TEST_ASSERT_EQUAL_UINT32(20 * CHANNELS, decoder.values.size());
+    for (int tick = 25; tick < 30; tick++)
+    {
+        const float values[CHANNELS] = {tick * 0.1f, 1.0f, -1.0f};
+        encoder.sample(values);
+    }
+    Decoder late;
+    memcpy(late.channels, decoder.channels, sizeof(late.channels));
+    late.drain(encoder);
+    TEST_ASSERT_TRUE(late.keyframe);
+    TEST_ASSERT_EQUAL_UINT32(25, late.values[0].tick);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 2.5f, late.values[0].value);
+}
+
+void test_packets_stay_within_their_size()
+{
+    telemetry::Channel channels[CHANNELS] = {
+        {1e-3f, 1, telemetry::LAST | telemetry::MIN},
+        {1e-3f, 1, telemetry::LAST},
+        {1e-3f, 1, telemetry::LAST}};
+    Encoder encoder;
+    Decoder decoder;
+    configure(encoder, decoder, channels, 255);
+
+    // Noise the width of the int32 range, every value takes 5 bytes
+    uint32_t seed = 1;
+    for (int tick = 0; tick < 200; tick++)
+    {
+        float values[CHANNELS];
+        for (uint8_t c = 0; c < CHANNELS; c++)
+        {
+            seed      = seed * 1664525u + 1013904223u;
+            values[c] = (static_cast<int32_t>(seed) >> 1) * 1e-3f;
+        }
+        encoder.sample(values);
+        decoder.drain(encoder);
+    }
+    encoder.flush();
+    decoder.drain(encoder);
+    TEST_ASSERT_EQUAL_UINT32(200 * 4, decoder.values.size());
+
+    // 11 streams could take 55 bytes a tick, 2 more than a 64 byte packet has room for
+    channels[0].stats = telemetry::MIN | telemetry::MAX | telemetry::MEAN | telemetry::LAST;
+    channels[1].stats = telemetry::MIN | telemetry::MAX | telemetry::MEAN | telemetry::LAST;
+    channels[2].stats = telemetry::MIN | telemetry::MAX | telemetry::MEAN;
+    TEST_ASSERT_EQUAL_INT(EXIT_FAILURE, encoder.configure(channels, 10, 100));
+}
+
+void test_smooth_signals_take_a_byte_a_value()
+{
+    const telemetry::Channel channels[CHANNELS] = {
+        {1e-4f, 1, telemetry::LAST}, {1e-3f, 1, telemetry::LAST}, {1e-2f, 10, telemetry::MEAN}};
+    telemetry::Encoder<CHANNELS, 128, 4> encoder;
+    encoder.configure(channels, 20, 1000);
+
+    const uint8_t* data;
+    size_t length;
+    for (int tick = 0; tick < 5000; tick++)
+    {
+        // ~1 rad/s and ~10 mm/s, a few counts a tick
+        const float values[CHANNELS] = {sinf(tick * 1e-3f), 10.0f * cosf(tick * 1e-3f), 5.0f};
+        encoder.sample(values);
+        while (encoder.front(data, length))
+        {
+            encoder.pop();
+        }
+    }
+    // Floats would take 4 bytes a value, the packets about 1.2 with their framing
+    const float ratio = encoder.values() * 4.0f / encoder.bytes();
+    TEST_ASSERT_TRUE(ratio > 3.0f);
+}
+
+#ifdef ARDUINO
+void loop() {}
+void setup()
+#else
+int main(int argc, char **argv)
+#endif
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_varints_and_zigzag);
+    RUN_TEST(test_values_come_back_within_half_a_count);
+    RUN_TEST(test_windows_send_their_min_max_and_mean);
+    RUN_TEST(test_a_dropped_packet_makes_the_next_a_keyframe);
+    RUN_TEST(test_packets_stay_within_their_size);
+    RUN_TEST(test_smooth_signals_take_a_byte_a_value);
+
+    UNITY_END();
+}